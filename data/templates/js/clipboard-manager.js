@@ -2,59 +2,112 @@
  *  This utility handles the Copy/Paste behavior for the Knowledge Library.
  *
  *  By injecting this code into the articles, the user can select a block of text
+ *  and copy it with the #copy-button that the app adds to the page.
  */
 const FADE_DURATION = 200;
 
-$(document).ready(function () {
-    var $copy_button = $('#copy-button');
+var fade_frame = null;
+
+// Fades the copy button in or out over FADE_DURATION, like jQuery's
+// fadeIn() and fadeOut() did, starting from wherever the last fade
+// left off
+function fade (element, fade_in) {
+    var from = element.style.display === 'none' || getComputedStyle(element).display === 'none' ?
+        0 : Number(element.style.opacity || 1);
+    var to = fade_in ? 1 : 0;
+    var start = null;
+
+    if (from === to)
+        return;
+
+    if (fade_frame !== null)
+        window.cancelAnimationFrame(fade_frame);
+
+    element.style.opacity = from;
+    element.style.display = 'block';
+
+    function step (now) {
+        if (start === null)
+            start = now;
+        var progress = Math.min((now - start) / FADE_DURATION, 1);
+        element.style.opacity = from + (to - from) * progress;
+        if (progress < 1) {
+            fade_frame = window.requestAnimationFrame(step);
+        } else {
+            fade_frame = null;
+            if (!fade_in)
+                element.style.display = 'none';
+        }
+    }
+    fade_frame = window.requestAnimationFrame(step);
+}
+
+function outer_size (element, dimension) {
+    var style = getComputedStyle(element);
+    var rect = element.getBoundingClientRect();
+    if (dimension === 'height')
+        return rect.height + parseFloat(style.marginTop) + parseFloat(style.marginBottom);
+    return rect.width + parseFloat(style.marginLeft) + parseFloat(style.marginRight);
+}
+
+function init_clipboard_manager () {
+    var copy_button = document.getElementById('copy-button');
+    if (copy_button === null)
+        return;
 
     var mouse_is_down = false;
     // Webview should start focused
     var window_focus = true;
-    $(window).focus(function() {
+    window.addEventListener('focus', function () {
         window_focus = true;
-    }).blur(function() {
+    });
+    window.addEventListener('blur', function () {
         window_focus = false;
     });
     // Updates the copy button to appear at the beginning of the selection. If the
     // mouse is currently down we hide the copy button until the selection
     // drag is completed.
-    var update_copy_button = function() {
+    var update_copy_button = function () {
         var selection = window.getSelection();
         if (selection.isCollapsed || mouse_is_down || !window_focus) {
-            $copy_button.fadeOut(FADE_DURATION);
+            fade(copy_button, false);
         } else {
             var range = selection.getRangeAt(0).cloneRange();
             range.collapse(true);
             var rect = range.getClientRects()[0];
 
-            var top_position = Math.max(rect.top - $copy_button.outerHeight(true), 0) + $(window).scrollTop();
-            var left_position =  Math.max(rect.left - $copy_button.outerWidth(true), 0) + $(window).scrollLeft();
-            $copy_button.css({
-                top: top_position,
-                left: left_position,
-            });
-            $copy_button.fadeIn(FADE_DURATION);
+            var top_position = Math.max(rect.top - outer_size(copy_button, 'height'), 0) + window.pageYOffset;
+            var left_position = Math.max(rect.left - outer_size(copy_button, 'width'), 0) + window.pageXOffset;
+            copy_button.style.top = top_position + 'px';
+            copy_button.style.left = left_position + 'px';
+            fade(copy_button, true);
         }
     };
 
     // Update copy button location on any selectionchange or mouseup.
-    $(document).mousedown(function() {
+    document.addEventListener('mousedown', function () {
         mouse_is_down = true;
-    }).mouseup(function() {
+    });
+    document.addEventListener('mouseup', function () {
         mouse_is_down = false;
         update_copy_button();
-    }).on('selectionchange', function() {
-        update_copy_button();
     });
+    document.addEventListener('selectionchange', update_copy_button);
 
-    $copy_button.mousedown(function (event) {
-        // Returning false prevents mousedown signal from propagating up the DOM tree.
-        // This keeps us from losing our selection when clicking on the copy
-        // button.
-        return false;
-    }).click(function () {
+    copy_button.addEventListener('mousedown', function (event) {
+        // Keep the mousedown from propagating up the DOM tree, and from
+        // doing what it would by default. This keeps us from losing our
+        // selection when clicking on the copy button.
+        event.preventDefault();
+        event.stopPropagation();
+    });
+    copy_button.addEventListener('click', function () {
         document.execCommand('Copy');
-        $copy_button.fadeOut(FADE_DURATION);
+        fade(copy_button, false);
     });
-});
+}
+
+if (document.readyState === 'loading')
+    document.addEventListener('DOMContentLoaded', init_clipboard_manager);
+else
+    init_clipboard_manager();
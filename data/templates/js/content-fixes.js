@@ -1,3 +1,7 @@
+// Deprecated: legacy articles no longer include this script, since the
+// renderer leaves out citation needed markers as it writes the body.
+// It is kept for apps that still load it by its resource path.
+
 var citationRequiredElements = document.querySelectorAll("sup > i > a");
 for (var i = 0; i < citationRequiredElements.length; i++)
 {
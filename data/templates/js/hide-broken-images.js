@@ -1,3 +1,7 @@
+// Deprecated: legacy articles no longer include this script, since the
+// renderer gives images an onerror handler as it writes the body. It is
+// kept for apps that still load it by its resource path.
+
 function hide_caption (img) {
     thumb = img.parentNode.parentNode.parentNode;
     img.style.display = 'none';
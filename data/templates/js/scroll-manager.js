@@ -5,62 +5,141 @@
  *      2. Provide URI notifications when an anchored tag has been
  *         scrolled past
  *
+ *  It is wrapped in a function of its own, so it can be injected into
+ *  a page by itself as well as run from the legacy article bundle.
+ *
  *  To use the scrollTo function simply call scrollTo("#someHash", 1000)
  *  and the function will kick off an animated scroll to that location
  *  with the specified duration.
  *
  *  Notification for scrolling past an element happens in the form of
- *  window.location.hash changes. If a new element where id=elementId
- *  comes into view (where view is defined by isInView(element)), the 
- *  current hash will change to "#scrolled-past-{elementId}".
- *  Only elements matching SCROLL_NOTIFIER_MATCHER will be watched
+ *  window.location.hash changes. Once the user has scrolled, the first
+ *  heading in view, or failing that the last one above it, is the
+ *  current one, and when it changes to the element where id=elementId
+ *  the hash will change to "#scrolled-past-{elementId}".
+ *  The headings are the elements whose ids the renderer put in
+ *  window.scrollManagerHeadings, or on a page that the renderer did
+ *  not render with the scroll manager, the elements that match
+ *  SCROLL_NOTIFIER_MATCHER. They are watched with one
+ *  IntersectionObserver, so nothing is measured on scroll events.
  */
 
+(function () {
+
 // The hash prefixes used to interface with the scroll manager
 const SCROLLED_PAST_PREFIX = '#scrolled-past-';
 
-// Defines the jQuery matcher expression for grabbing elements
-// we want to watch for when user scrolls
+// Defines the selector for the headings to watch when the renderer did
+// not list them
 const SCROLL_NOTIFIER_MATCHER = '.mw-headline';
 
-function sanitize_hash (hash) {
-    var clean_hash = hash.replace(/([.:])/g, '\\$1');
-    return clean_hash;
+// Eases in and out like jQuery's animate() did
+function swing (progress) {
+    return 0.5 - Math.cos(progress * Math.PI) / 2;
 }
 
+var animation_frame = null;
+
 // If the anchor at the specified hash exists, scroll to it.
 // Returns whether the caller should propagate events
 window.scrollTo = function (hash, duration) {
-    var target = $(sanitize_hash(hash));
-    if (target.length > 0) {
-        var body = $('html,body');
-        var maxScroll = $(document).height() - $(window).height();
-        body.stop();
-        body.animate({
-          scrollTop: Math.min(target.offset().top, maxScroll)
-        }, duration);
-        return false;
+    var id = hash.charAt(0) === '#' ? hash.substring(1) : hash;
+    var target = document.getElementById(id);
+    if (target === null)
+        return true;
+
+    var scroller = document.scrollingElement;
+    var maxScroll = scroller.scrollHeight - window.innerHeight;
+    var from = scroller.scrollTop;
+    var to = Math.min(target.getBoundingClientRect().top + from, maxScroll);
+    var start = null;
+
+    function step (now) {
+        if (start === null)
+            start = now;
+        var progress = duration > 0 ? Math.min((now - start) / duration, 1) : 1;
+        scroller.scrollTop = from + (to - from) * swing(progress);
+        animation_frame = progress < 1 ? window.requestAnimationFrame(step) : null;
     }
-    return true;
+
+    // Stop any scroll that is already under way
+    if (animation_frame !== null)
+        window.cancelAnimationFrame(animation_frame);
+    animation_frame = window.requestAnimationFrame(step);
+    return false;
+};
+
+function find_headings () {
+    if (window.scrollManagerHeadings === undefined) {
+        return Array.prototype.filter.call(
+            document.querySelectorAll(SCROLL_NOTIFIER_MATCHER),
+            function (heading) {
+                return heading.id !== '';
+            });
+    }
+
+    var headings = [];
+    window.scrollManagerHeadings.forEach(function (id) {
+        var heading = document.getElementById(id);
+        if (heading !== null)
+            headings.push(heading);
+    });
+    return headings;
 }
 
-// Whenever a scroll event happens, filter the scrollNotifer
-// elements for ones that are inView. If any elements are, 
-// grab the first one and update the hash to say we've scrolled
-// past it
-$(window).bind('scroll', function () {
-    var scrollPosition = $(window).scrollTop();
-    var distance = 0;
-    var scrolledPastNode = null;
-    $(SCROLL_NOTIFIER_MATCHER).each(function (index, node) {
-        var nodePosition = $(node).offset().top;
-        var nodeDistance = Math.abs(scrollPosition - nodePosition);
-        if (scrolledPastNode === null || nodeDistance < distance) {
-            scrolledPastNode = node;
-            distance = nodeDistance;
-        }
+// Keep track of which headings are in view and which are above it as
+// the observer reports them crossing the edges of the viewport, and
+// update the hash to say we've scrolled past the current one
+function watch_headings () {
+    var headings = find_headings();
+    if (headings.length === 0)
+        return;
+
+    var visible = new Array(headings.length).fill(false);
+    var above = new Array(headings.length).fill(false);
+    var indices = new Map();
+    headings.forEach(function (heading, index) {
+        indices.set(heading, index);
     });
-    if (scrolledPastNode !== null) {
-        window.location.hash = SCROLLED_PAST_PREFIX + scrolledPastNode.id;
+
+    var scrolled = false;
+    var current = null;
+
+    function update_hash () {
+        var index = visible.indexOf(true);
+        if (index === -1)
+            index = above.lastIndexOf(true);
+        if (index === -1 || headings[index] === current)
+            return;
+        current = headings[index];
+        window.location.hash = SCROLLED_PAST_PREFIX + current.id;
     }
-});
+
+    var observer = new IntersectionObserver(function (entries) {
+        entries.forEach(function (entry) {
+            var index = indices.get(entry.target);
+            visible[index] = entry.isIntersecting;
+            above[index] = !entry.isIntersecting &&
+                entry.boundingClientRect.top < entry.rootBounds.top;
+        });
+        // Loading the page and scrolling to an anchor is not the user
+        // scrolling past anything
+        if (scrolled)
+            update_hash();
+    });
+    headings.forEach(function (heading) {
+        observer.observe(heading);
+    });
+
+    window.addEventListener('scroll', function () {
+        scrolled = true;
+        update_hash();
+    }, { once: true, passive: true });
+}
+
+if (document.readyState === 'loading')
+    document.addEventListener('DOMContentLoaded', watch_headings);
+else
+    watch_headings();
+
+})();
@@ -1,14 +1,25 @@
-
 /* Every element with a share-actions class exists will be populated with the
  * contents of #default-share-actions
  */
-function share_actions_init () {
-    let share_actions = $(".share-actions");
+window.share_actions_init = function () {
+    var share_actions = document.querySelectorAll('.share-actions');
+    var default_share_actions = document.getElementById('default-share-actions');
+
+    if (default_share_actions === null)
+        return;
 
     if (share_actions.length) {
-        share_actions.append($("#default-share-actions > *"));
+        // Like jQuery's append(), every container but the last gets its
+        // own copy
+        var actions = Array.prototype.slice.call(default_share_actions.children);
+        Array.prototype.forEach.call(share_actions, function (container, index) {
+            actions.forEach(function (action) {
+                container.appendChild(index === share_actions.length - 1 ?
+                    action : action.cloneNode(true));
+            });
+        });
     }
     else {
-        $("#default-share-actions").css ("visibility", "visible");
+        default_share_actions.style.visibility = 'visible';
     }
-}
+};
@@ -0,0 +1,52 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Serves the temporary allocations of one render from a few large
+ * blocks, which are all given back at once by eknr_arena_reset(). Not
+ * thread-safe; each arena belongs to one render at a time. */
+typedef struct _EknrArena EknrArena;
+
+G_GNUC_INTERNAL
+EknrArena * eknr_arena_new (void);
+
+G_GNUC_INTERNAL
+void eknr_arena_free (EknrArena *arena);
+
+G_GNUC_INTERNAL
+void eknr_arena_reset (EknrArena *arena);
+
+G_GNUC_INTERNAL
+gpointer eknr_arena_alloc (EknrArena *arena,
+                           gsize      size);
+
+G_GNUC_INTERNAL
+void eknr_arena_begin_string (EknrArena *arena);
+
+G_GNUC_INTERNAL
+void eknr_arena_append (EknrArena  *arena,
+                        const char *data,
+                        gsize       length);
+
+G_GNUC_INTERNAL
+void eknr_arena_append_printf (EknrArena  *arena,
+                               const char *format,
+                               ...) G_GNUC_PRINTF (2, 3);
+
+G_GNUC_INTERNAL
+gboolean eknr_arena_write (gpointer     arena,
+                           const char  *buffer,
+                           gsize        length,
+                           GError     **error);
+
+G_GNUC_INTERNAL
+char * eknr_arena_end_string (EknrArena *arena,
+                              gsize     *out_length);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrArena, eknr_arena_free)
+
+G_END_DECLS
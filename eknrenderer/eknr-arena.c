@@ -0,0 +1,305 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "eknr-arena-private.h"
+
+/* A bump allocator for the temporary allocations of a render, such as
+ * the disclaimer and the heading list. Allocations are taken from the
+ * newest block, and a new block twice the size is started when it runs
+ * out. Nothing is freed until the arena is reset.
+ *
+ * Resetting replaces the blocks with a single one as large as
+ * everything allocated since the last reset, so the next render of the
+ * same article, or of any smaller one, makes no allocations at all. So
+ * that one very large render does not hold on to its memory for the
+ * life of the renderer, the block kept is no larger than
+ * MAX_RETAINED_SIZE.
+ *
+ * Strings can be built up in place, one at a time: between
+ * eknr_arena_begin_string() and eknr_arena_end_string(), appended text
+ * goes to the end of the newest block, and is moved to a new block if
+ * it outgrows it. Nothing else may be allocated from the arena while a
+ * string is open.
+ */
+
+/* Enough for anything the renderer puts in an arena */
+#define ALIGNMENT (2 * sizeof (gpointer))
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~((gsize) ALIGNMENT - 1))
+
+#define MIN_BLOCK_SIZE (4 * 1024)
+#define MAX_RETAINED_SIZE (1024 * 1024)
+
+typedef struct _ArenaBlock ArenaBlock;
+
+struct _ArenaBlock {
+  ArenaBlock *next; /* the block before this one */
+  gsize size;
+  gsize used;
+};
+
+#define BLOCK_DATA(block) ((char *) (block) + ALIGN (sizeof (ArenaBlock)))
+
+struct _EknrArena {
+  ArenaBlock *block; /* the newest block */
+  gsize total_used; /* since the last reset, across all blocks */
+  char *string; /* the open string, if any, at the end of block */
+  gsize string_length;
+};
+
+static ArenaBlock *
+block_new (gsize size)
+{
+  ArenaBlock *block = g_malloc (ALIGN (sizeof (ArenaBlock)) + size);
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+static void
+free_blocks (ArenaBlock *block)
+{
+  while (block != NULL)
+    {
+      ArenaBlock *next = block->next;
+
+      g_free (block);
+      block = next;
+    }
+}
+
+/* Make sure there are @size bytes free at the end of the newest block,
+ * starting a new block if not, and return where they start */
+static char *
+arena_reserve (EknrArena *arena,
+               gsize      size)
+{
+  ArenaBlock *block = arena->block;
+
+  if (block->size - block->used < size)
+    {
+      ArenaBlock *new_block = block_new (MAX (block->size * 2, ALIGN (size)));
+
+      new_block->next = block;
+      arena->block = block = new_block;
+    }
+
+  return BLOCK_DATA (block) + block->used;
+}
+
+static void
+arena_commit (EknrArena *arena,
+              gsize      size)
+{
+  gsize aligned_size = ALIGN (size);
+
+  arena->block->used += aligned_size;
+  arena->total_used += aligned_size;
+}
+
+EknrArena *
+eknr_arena_new (void)
+{
+  EknrArena *arena = g_new0 (EknrArena, 1);
+
+  arena->block = block_new (MIN_BLOCK_SIZE);
+
+  return arena;
+}
+
+void
+eknr_arena_free (EknrArena *arena)
+{
+  free_blocks (arena->block);
+  g_free (arena);
+}
+
+/**
+ * eknr_arena_reset:
+ * @arena: An #EknrArena
+ *
+ * Free everything allocated from @arena at once. If @arena had to grow,
+ * it is left with one block large enough for everything that was
+ * allocated, up to a limit.
+ */
+void
+eknr_arena_reset (EknrArena *arena)
+{
+  g_return_if_fail (arena->string == NULL);
+
+  if (arena->block->next != NULL)
+    {
+      free_blocks (arena->block);
+      arena->block = block_new (CLAMP (arena->total_used, MIN_BLOCK_SIZE, MAX_RETAINED_SIZE));
+    }
+
+  arena->block->used = 0;
+  arena->total_used = 0;
+}
+
+/**
+ * eknr_arena_alloc:
+ * @arena: An #EknrArena
+ * @size: The number of bytes to allocate
+ *
+ * Returns: (transfer none): @size uninitialized bytes, which last until
+ *   @arena is reset
+ */
+gpointer
+eknr_arena_alloc (EknrArena *arena,
+                  gsize      size)
+{
+  char *p;
+
+  g_return_val_if_fail (arena->string == NULL, NULL);
+
+  p = arena_reserve (arena, ALIGN (size));
+  arena_commit (arena, size);
+
+  return p;
+}
+
+/**
+ * eknr_arena_begin_string:
+ * @arena: An #EknrArena
+ *
+ * Start building a string in @arena. Until eknr_arena_end_string() is
+ * called, nothing else may be allocated from @arena.
+ */
+void
+eknr_arena_begin_string (EknrArena *arena)
+{
+  g_return_if_fail (arena->string == NULL);
+
+  arena->string = arena_reserve (arena, 1);
+  arena->string_length = 0;
+}
+
+/* Make room for @length more bytes in the open string, and its nul */
+static char *
+arena_grow_string (EknrArena *arena,
+                   gsize      length)
+{
+  gsize needed = arena->string_length + length + 1;
+  char *string = arena_reserve (arena, needed);
+
+  if (string != arena->string)
+    {
+      memcpy (string, arena->string, arena->string_length);
+      arena->string = string;
+    }
+
+  return string + arena->string_length;
+}
+
+/**
+ * eknr_arena_append:
+ * @arena: An #EknrArena
+ * @data: The bytes to append
+ * @length: The number of bytes in @data
+ *
+ * Append @data to the string being built in @arena.
+ */
+void
+eknr_arena_append (EknrArena  *arena,
+                   const char *data,
+                   gsize       length)
+{
+  g_return_if_fail (arena->string != NULL);
+
+  if (length == 0)
+    return;
+
+  memcpy (arena_grow_string (arena, length), data, length);
+  arena->string_length += length;
+}
+
+/**
+ * eknr_arena_append_printf:
+ * @arena: An #EknrArena
+ * @format: A printf() format
+ * @...: The values for @format
+ *
+ * Append formatted text to the string being built in @arena.
+ */
+void
+eknr_arena_append_printf (EknrArena  *arena,
+                          const char *format,
+                          ...)
+{
+  va_list args, measure_args;
+  int length;
+
+  g_return_if_fail (arena->string != NULL);
+
+  va_start (args, format);
+  va_copy (measure_args, args);
+  length = vsnprintf (NULL, 0, format, measure_args);
+  va_end (measure_args);
+
+  if (length > 0)
+    {
+      vsnprintf (arena_grow_string (arena, length), length + 1, format, args);
+      arena->string_length += length;
+    }
+
+  va_end (args);
+}
+
+/**
+ * eknr_arena_write:
+ * @arena: (type EknrArena): An #EknrArena
+ * @buffer: The bytes to append
+ * @length: The number of bytes in @buffer
+ * @error: A #GError
+ *
+ * An #EknrTemplateWriteFunc that appends to the string being built in
+ * @arena, for writers such as eknr_html_escape_write().
+ *
+ * Returns: %TRUE, since appending cannot fail
+ */
+gboolean
+eknr_arena_write (gpointer                arena,
+                  const char             *buffer,
+                  gsize                   length,
+                  G_GNUC_UNUSED GError  **error)
+{
+  eknr_arena_append (arena, buffer, length);
+  return TRUE;
+}
+
+/**
+ * eknr_arena_end_string:
+ * @arena: An #EknrArena
+ * @out_length: (out) (optional): Return location for the length of the
+ *   string
+ *
+ * Finish the string being built in @arena.
+ *
+ * Returns: (transfer none): The nul-terminated string, which lasts until
+ *   @arena is reset
+ */
+char *
+eknr_arena_end_string (EknrArena *arena,
+                       gsize     *out_length)
+{
+  char *string = arena->string;
+
+  g_return_val_if_fail (string != NULL, NULL);
+
+  string[arena->string_length] = '\0';
+  arena_commit (arena, arena->string_length + 1);
+
+  if (out_length != NULL)
+    *out_length = arena->string_length;
+
+  arena->string = NULL;
+  arena->string_length = 0;
+
+  return string;
+}
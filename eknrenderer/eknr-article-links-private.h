@@ -0,0 +1,27 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-article-links.h"
+
+G_BEGIN_DECLS
+
+struct _EknrArticleLinks {
+  volatile gint ref_count;
+
+  char **link_table;
+  gsize n_links;
+
+  /* Chunk data, %NULL if it was never set */
+  char **parent_featured_set_ids;
+  char **parent_featured_set_titles;
+};
+
+G_GNUC_INTERNAL
+const char * eknr_article_links_lookup (const EknrArticleLinks *links,
+                                        const char             *index,
+                                        gsize                   index_length);
+
+G_END_DECLS
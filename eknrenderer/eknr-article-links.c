@@ -0,0 +1,146 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "eknr-article-links-private.h"
+
+/**
+ * SECTION:article-links
+ * @title: Article links
+ * @short_description: What the links and chunks in an article point to
+ *
+ * An #EknrArticleLinks holds what crosslink_init() and chunk_init() in
+ * crosslink.js and chunk.js used to be given once the page had loaded:
+ * the article's link table, and the data for the chunks its body asks
+ * for. Passing one to eknr_renderer_render_legacy_article() resolves
+ * the links and fills in the chunks while the body is rendered, so
+ * neither script has to run.
+ *
+ * Once an #EknrArticleLinks has been passed to the renderer it may be
+ * used from other threads, and must not be changed.
+ */
+
+G_DEFINE_BOXED_TYPE (EknrArticleLinks,
+                     eknr_article_links,
+                     eknr_article_links_ref,
+                     eknr_article_links_unref)
+
+/**
+ * eknr_article_links_new:
+ * @link_table: (array zero-terminated=1) (nullable): The EKN IDs that
+ *   the article's links point to, indexed by their
+ *   `data-ekn-link-table-idx` attribute. An empty string means that
+ *   the content the link points to is not available.
+ *
+ * Create a new #EknrArticleLinks with the given link table and no chunk
+ * data.
+ *
+ * Returns: (transfer full): A new #EknrArticleLinks.
+ */
+EknrArticleLinks *
+eknr_article_links_new (const char * const *link_table)
+{
+  EknrArticleLinks *links = g_new0 (EknrArticleLinks, 1);
+
+  links->ref_count = 1;
+  links->link_table = g_strdupv ((char **) link_table);
+  links->n_links = link_table != NULL ? g_strv_length (links->link_table) : 0;
+
+  return links;
+}
+
+/**
+ * eknr_article_links_ref:
+ * @links: An #EknrArticleLinks
+ *
+ * Returns: (transfer full): @links
+ */
+EknrArticleLinks *
+eknr_article_links_ref (EknrArticleLinks *links)
+{
+  g_return_val_if_fail (links != NULL, NULL);
+
+  g_atomic_int_inc (&links->ref_count);
+  return links;
+}
+
+/**
+ * eknr_article_links_unref:
+ * @links: An #EknrArticleLinks
+ *
+ * Drop a reference on @links, freeing it if it was the last one.
+ */
+void
+eknr_article_links_unref (EknrArticleLinks *links)
+{
+  g_return_if_fail (links != NULL);
+
+  if (!g_atomic_int_dec_and_test (&links->ref_count))
+    return;
+
+  g_strfreev (links->link_table);
+  g_strfreev (links->parent_featured_set_ids);
+  g_strfreev (links->parent_featured_set_titles);
+  g_free (links);
+}
+
+/**
+ * eknr_article_links_set_parent_featured_sets:
+ * @links: An #EknrArticleLinks
+ * @ekn_ids: (array zero-terminated=1): The EKN IDs of the sets the
+ *   article is featured in
+ * @titles: (array zero-terminated=1): The titles of those sets, in the
+ *   same order
+ *
+ * Set the data for `ParentFeaturedSets` chunks, which list links to
+ * the sets the article is featured in. An article whose body has such
+ * a chunk can only be rendered once this has been set, even if there
+ * are no sets.
+ */
+void
+eknr_article_links_set_parent_featured_sets (EknrArticleLinks   *links,
+                                             const char * const *ekn_ids,
+                                             const char * const *titles)
+{
+  g_return_if_fail (links != NULL);
+  g_return_if_fail (ekn_ids != NULL);
+  g_return_if_fail (titles != NULL);
+  g_return_if_fail (g_strv_length ((char **) ekn_ids) == g_strv_length ((char **) titles));
+
+  g_strfreev (links->parent_featured_set_ids);
+  g_strfreev (links->parent_featured_set_titles);
+  links->parent_featured_set_ids = g_strdupv ((char **) ekn_ids);
+  links->parent_featured_set_titles = g_strdupv ((char **) titles);
+}
+
+/* Look up a link the way crosslink.js did, given the value of its
+ * data-ekn-link-table-idx attribute, which is parsed like parseInt()
+ * would. Returns %NULL if the link points to nothing. */
+const char *
+eknr_article_links_lookup (const EknrArticleLinks *links,
+                           const char             *index,
+                           gsize                   index_length)
+{
+  const char *p = index;
+  const char *end = index + index_length;
+  gsize value = 0;
+  gboolean any_digits = FALSE;
+  const char *ekn_id;
+
+  while (p < end && g_ascii_isspace (*p))
+    ++p;
+  if (p < end && *p == '+')
+    ++p;
+
+  for (; p < end && g_ascii_isdigit (*p); ++p)
+    {
+      any_digits = TRUE;
+      value = value * 10 + (*p - '0');
+      if (value >= links->n_links)
+        return NULL;
+    }
+
+  if (!any_digits || value >= links->n_links)
+    return NULL;
+
+  ekn_id = links->link_table[value];
+  return *ekn_id != '\0' ? ekn_id : NULL;
+}
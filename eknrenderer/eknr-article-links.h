@@ -0,0 +1,27 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define EKNR_TYPE_ARTICLE_LINKS (eknr_article_links_get_type ())
+
+typedef struct _EknrArticleLinks EknrArticleLinks;
+
+GType eknr_article_links_get_type (void);
+
+EknrArticleLinks * eknr_article_links_new (const char * const *link_table);
+
+EknrArticleLinks * eknr_article_links_ref (EknrArticleLinks *links);
+
+void eknr_article_links_unref (EknrArticleLinks *links);
+
+void eknr_article_links_set_parent_featured_sets (EknrArticleLinks   *links,
+                                                  const char * const *ekn_ids,
+                                                  const char * const *titles);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrArticleLinks, eknr_article_links_unref)
+
+G_END_DECLS
@@ -0,0 +1,39 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Where stylesheets and scripts that legacy articles link to live in
+ * the renderer's resources */
+#define EKNR_ASSET_RESOURCE_PATH "/com/endlessm/knowledge/data/templates"
+#define EKNR_ASSET_URI_PREFIX "resource://" EKNR_ASSET_RESOURCE_PATH
+
+/**
+ * EknrAssetKind:
+ * @EKNR_ASSET_CSS: A stylesheet, from the css directory
+ * @EKNR_ASSET_JAVASCRIPT: A script, from the js directory
+ *
+ * The kinds of assets a legacy article can include.
+ */
+typedef enum {
+  EKNR_ASSET_CSS,
+  EKNR_ASSET_JAVASCRIPT
+} EknrAssetKind;
+
+typedef struct _EknrAssetCache EknrAssetCache;
+
+G_GNUC_INTERNAL
+EknrAssetCache * eknr_asset_cache_new (void);
+
+G_GNUC_INTERNAL
+void eknr_asset_cache_free (EknrAssetCache *cache);
+
+G_GNUC_INTERNAL
+GBytes * eknr_asset_cache_lookup (EknrAssetCache *cache,
+                                  EknrAssetKind   kind,
+                                  const char     *name);
+
+G_END_DECLS
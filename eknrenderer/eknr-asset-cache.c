@@ -0,0 +1,116 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "eknr-asset-cache-private.h"
+
+/* Keeps the contents of the stylesheets and scripts that legacy
+ * articles can have inlined into them.
+ *
+ * The assets are compressed in the renderer's resources, and
+ * g_resources_lookup_data() decompresses them again every time it is
+ * called, so each asset is looked up once and its contents kept for as
+ * long as the renderer lives. Assets that cannot be inlined are
+ * remembered too, so they are only looked for once.
+ */
+struct _EknrAssetCache {
+  GMutex lock;
+  GHashTable *assets[2]; /* (locked-by lock) indexed by EknrAssetKind, key-type=utf8, value-type=GBytes or NULL */
+};
+
+static const char *asset_directories[] = { "css", "js" };
+
+/* What would end the element the asset is inlined into early */
+static const char *closing_tags[] = { "</style", "</script" };
+
+static void
+asset_free (GBytes *contents)
+{
+  if (contents != NULL)
+    g_bytes_unref (contents);
+}
+
+EknrAssetCache *
+eknr_asset_cache_new (void)
+{
+  EknrAssetCache *cache = g_new0 (EknrAssetCache, 1);
+  gsize i;
+
+  g_mutex_init (&cache->lock);
+  for (i = 0; i < G_N_ELEMENTS (cache->assets); ++i)
+    cache->assets[i] = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              (GDestroyNotify) asset_free);
+
+  return cache;
+}
+
+void
+eknr_asset_cache_free (EknrAssetCache *cache)
+{
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (cache->assets); ++i)
+    g_hash_table_unref (cache->assets[i]);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/* Returns %NULL if the asset is not a resource or cannot be inlined */
+static GBytes *
+load_asset (EknrAssetKind  kind,
+            const char    *name)
+{
+  g_autofree char *path = g_build_path ("/",
+                                        EKNR_ASSET_RESOURCE_PATH,
+                                        asset_directories[kind],
+                                        name,
+                                        NULL);
+  g_autoptr(GBytes) contents = g_resources_lookup_data (path,
+                                                        G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                                        NULL);
+  const char *data;
+  gsize size;
+
+  if (contents == NULL)
+    return NULL;
+
+  data = g_bytes_get_data (contents, &size);
+  if (size > 0 && g_strstr_len (data, size, closing_tags[kind]) != NULL)
+    return NULL;
+
+  return g_steal_pointer (&contents);
+}
+
+/**
+ * eknr_asset_cache_lookup:
+ * @cache: An #EknrAssetCache
+ * @kind: Whether @name is a stylesheet or a script
+ * @name: The name of the asset, as used in links to it
+ *
+ * Get the contents of an asset for inlining, loading it from the
+ * renderer's resources the first time it is asked for.
+ *
+ * Returns: (transfer full) (nullable): The contents, or %NULL if there
+ *   is no such asset or it cannot be inlined, in which case it should be
+ *   linked to as usual.
+ */
+GBytes *
+eknr_asset_cache_lookup (EknrAssetCache *cache,
+                         EknrAssetKind   kind,
+                         const char     *name)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  GBytes *contents = NULL;
+
+  if (!g_hash_table_lookup_extended (cache->assets[kind], name, NULL, (gpointer *) &contents))
+    {
+      contents = load_asset (kind, name);
+      g_hash_table_insert (cache->assets[kind], g_strdup (name), contents);
+    }
+
+  return contents != NULL ? g_bytes_ref (contents) : NULL;
+}
@@ -23,12 +23,18 @@ GQuark eknr_error (void);
  * EknrError:
  * @EKNR_ERROR_SUBSTITUTION_FAILED: Template substitution failed
  * @EKNR_ERROR_UNKNOWN_LEGACY_SOURCE: Don't know how to deal with the specified source type
+ * @EKNR_ERROR_UNKNOWN_CHUNK_TYPE: An article body asks for a type of chunk
+ *   that cannot be made
+ * @EKNR_ERROR_MISSING_CHUNK_DATA: An article body asks for a chunk whose
+ *   data was not given
  *
  * Error codes for the %EKNR_ERROR error domain
  */
 typedef enum {
   EKNR_ERROR_SUBSTITUTION_FAILED,
-  EKNR_ERROR_UNKNOWN_LEGACY_SOURCE
+  EKNR_ERROR_UNKNOWN_LEGACY_SOURCE,
+  EKNR_ERROR_UNKNOWN_CHUNK_TYPE,
+  EKNR_ERROR_MISSING_CHUNK_DATA
 } EknrError;
 
 G_END_DECLS
@@ -0,0 +1,13 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL
+guint64 eknr_hash_bytes (const void *data,
+                         gsize       length);
+
+G_END_DECLS
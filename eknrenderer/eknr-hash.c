@@ -0,0 +1,61 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-hash-private.h"
+
+/**
+ * eknr_hash_bytes:
+ * @data: The bytes to hash
+ * @length: The length of @data
+ *
+ * A fast non-cryptographic 64-bit hash that reads eight bytes at a
+ * time, so that hashing a multi-megabyte body costs a small fraction of
+ * rendering it. This is MurmurHash64A; the result depends on the host's
+ * byte order, so anything that stores it must not be shared between
+ * machines of different byte orders.
+ *
+ * Returns: The hash of @data
+ */
+guint64
+eknr_hash_bytes (const void *data,
+                 gsize       length)
+{
+  const guint64 m = G_GUINT64_CONSTANT (0xc6a4a7935bd1e995);
+  const int r = 47;
+  guint64 h = G_GUINT64_CONSTANT (0x8445d61a4e774912) ^ (length * m);
+  const guchar *p = data;
+  const guchar *end = p + (length & ~(gsize) 7);
+
+  for (; p < end; p += 8)
+    {
+      guint64 k;
+
+      memcpy (&k, p, sizeof (k));
+
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+
+      h ^= k;
+      h *= m;
+    }
+
+  switch (length & 7)
+    {
+    case 7: h ^= (guint64) p[6] << 48; /* fall through */
+    case 6: h ^= (guint64) p[5] << 40; /* fall through */
+    case 5: h ^= (guint64) p[4] << 32; /* fall through */
+    case 4: h ^= (guint64) p[3] << 24; /* fall through */
+    case 3: h ^= (guint64) p[2] << 16; /* fall through */
+    case 2: h ^= (guint64) p[1] << 8; /* fall through */
+    case 1: h ^= (guint64) p[0];
+      h *= m;
+    }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
@@ -0,0 +1,401 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-html-private.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+/* AVX2 is not part of the baseline on any x86 target we build for, so
+ * it is compiled in with a target attribute and only used if the CPU
+ * turns out to support it. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+/* Escaping matches g_markup_escape_text(): the five characters that are
+ * special in HTML become entities, and C0 and C1 control characters
+ * other than tab, newline, carriage return and U+0085 become numeric
+ * character references. Every byte that might start one of those is
+ * "escapable": the five special characters, bytes below 0x20, 0x7f, and
+ * 0xc2, which is the first byte of every C1 control character in UTF-8.
+ *
+ * Most text has no escapable bytes at all, so the fast part is finding
+ * the next escapable byte. Everything up to it is written out in one
+ * go straight from the input, and the escapable byte is then looked at
+ * more closely, one at a time.
+ *
+ * The input is assumed to be valid UTF-8. On invalid input the output
+ * may differ from g_markup_escape_text(), which does not handle invalid
+ * UTF-8 consistently either.
+ */
+
+typedef const char * (*FindEscapableFunc) (const char *p,
+                                           const char *end);
+
+static inline gboolean
+is_escapable (guchar c)
+{
+  return (c < 0x20 || c == 0x7f || c == 0xc2 ||
+          c == '&' || c == '<' || c == '>' || c == '\'' || c == '"');
+}
+
+static const char *
+find_escapable_scalar (const char *p,
+                       const char *end)
+{
+  for (; p < end; ++p)
+    {
+      if (is_escapable ((guchar) *p))
+        return p;
+    }
+
+  return end;
+}
+
+#ifdef HAVE_SSE2
+static const char *
+find_escapable_sse2 (const char *p,
+                     const char *end)
+{
+  const __m128i amp = _mm_set1_epi8 ('&');
+  const __m128i lt = _mm_set1_epi8 ('<');
+  const __m128i gt = _mm_set1_epi8 ('>');
+  const __m128i apos = _mm_set1_epi8 ('\'');
+  const __m128i quot = _mm_set1_epi8 ('"');
+  const __m128i del = _mm_set1_epi8 (0x7f);
+  const __m128i c1_lead = _mm_set1_epi8 ((char) 0xc2);
+  const __m128i max_control = _mm_set1_epi8 (0x1f);
+
+  for (; end - p >= 16; p += 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) p);
+      __m128i matches;
+      int mask;
+
+      /* Bytes are unsigned here, so c <= 0x1f iff max (c, 0x1f) == 0x1f */
+      matches = _mm_cmpeq_epi8 (_mm_max_epu8 (chunk, max_control), max_control);
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, amp));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, lt));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, gt));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, apos));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, quot));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, del));
+      matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (chunk, c1_lead));
+
+      mask = _mm_movemask_epi8 (matches);
+      if (mask != 0)
+        return p + g_bit_nth_lsf (mask, -1);
+    }
+
+  return find_escapable_scalar (p, end);
+}
+#endif
+
+#ifdef HAVE_AVX2
+__attribute__ ((target ("avx2")))
+static const char *
+find_escapable_avx2 (const char *p,
+                     const char *end)
+{
+  const __m256i amp = _mm256_set1_epi8 ('&');
+  const __m256i lt = _mm256_set1_epi8 ('<');
+  const __m256i gt = _mm256_set1_epi8 ('>');
+  const __m256i apos = _mm256_set1_epi8 ('\'');
+  const __m256i quot = _mm256_set1_epi8 ('"');
+  const __m256i del = _mm256_set1_epi8 (0x7f);
+  const __m256i c1_lead = _mm256_set1_epi8 ((char) 0xc2);
+  const __m256i max_control = _mm256_set1_epi8 (0x1f);
+
+  for (; end - p >= 32; p += 32)
+    {
+      __m256i chunk = _mm256_loadu_si256 ((const __m256i *) p);
+      __m256i matches;
+      guint32 mask;
+
+      matches = _mm256_cmpeq_epi8 (_mm256_max_epu8 (chunk, max_control), max_control);
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, amp));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, lt));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, gt));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, apos));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, quot));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, del));
+      matches = _mm256_or_si256 (matches, _mm256_cmpeq_epi8 (chunk, c1_lead));
+
+      mask = (guint32) _mm256_movemask_epi8 (matches);
+      if (mask != 0)
+        return p + __builtin_ctz (mask);
+    }
+
+  return find_escapable_scalar (p, end);
+}
+#endif
+
+static FindEscapableFunc
+find_escapable_for_implementation (EknrHtmlEscapeImplementation implementation)
+{
+  switch (implementation)
+    {
+    case EKNR_HTML_ESCAPE_SCALAR:
+      return find_escapable_scalar;
+#ifdef HAVE_SSE2
+    case EKNR_HTML_ESCAPE_SSE2:
+      return find_escapable_sse2;
+#endif
+#ifdef HAVE_AVX2
+    case EKNR_HTML_ESCAPE_AVX2:
+      if (__builtin_cpu_supports ("avx2"))
+        return find_escapable_avx2;
+      return NULL;
+#endif
+    default:
+      return NULL;
+    }
+}
+
+static FindEscapableFunc
+find_escapable_best (void)
+{
+  static const EknrHtmlEscapeImplementation preferred[] = {
+    EKNR_HTML_ESCAPE_AVX2,
+    EKNR_HTML_ESCAPE_SSE2,
+    EKNR_HTML_ESCAPE_SCALAR
+  };
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (preferred); ++i)
+    {
+      FindEscapableFunc find = find_escapable_for_implementation (preferred[i]);
+
+      if (find != NULL)
+        return find;
+    }
+
+  g_assert_not_reached ();
+}
+
+static FindEscapableFunc find_escapable_override = NULL;
+
+static FindEscapableFunc
+get_find_escapable (void)
+{
+  static gsize best = 0;
+
+  if (G_UNLIKELY (find_escapable_override != NULL))
+    return find_escapable_override;
+
+  if (g_once_init_enter (&best))
+    g_once_init_leave (&best, (gsize) find_escapable_best ());
+
+  return (FindEscapableFunc) best;
+}
+
+/**
+ * eknr_html_escape_set_implementation:
+ * @implementation: An #EknrHtmlEscapeImplementation
+ *
+ * Force the escaper to use @implementation rather than the best one
+ * for this CPU. This is only meant for testing, and is not thread-safe.
+ *
+ * Returns: %TRUE if @implementation can be used on this machine.
+ */
+gboolean
+eknr_html_escape_set_implementation (EknrHtmlEscapeImplementation implementation)
+{
+  FindEscapableFunc find = find_escapable_for_implementation (implementation);
+
+  if (find == NULL)
+    return FALSE;
+
+  find_escapable_override = find;
+  return TRUE;
+}
+
+/* Writes the numeric character reference for @c into @buffer, which
+ * must have room for 8 bytes, and returns its length */
+static gsize
+format_character_reference (guint  c,
+                            char  *buffer)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  gsize length = 0;
+
+  buffer[length++] = '&';
+  buffer[length++] = '#';
+  buffer[length++] = 'x';
+  if (c >= 0x10)
+    buffer[length++] = hex_digits[c >> 4];
+  buffer[length++] = hex_digits[c & 0xf];
+  buffer[length++] = ';';
+
+  return length;
+}
+
+/* Works out how to escape the escapable byte at @p. Sets @out_escape
+ * to what to write in its place, or %NULL if the byte turns out not to
+ * need escaping, and returns how many bytes of input were consumed. */
+static gsize
+escape_at (const char  *p,
+           const char  *end,
+           char        *buffer,
+           const char **out_escape,
+           gsize       *out_escape_length)
+{
+  guchar c = (guchar) *p;
+
+#define ESCAPE(entity) \
+  *out_escape = (entity); *out_escape_length = sizeof (entity) - 1; return 1
+
+  switch (c)
+    {
+    case '&': ESCAPE ("&amp;");
+    case '<': ESCAPE ("&lt;");
+    case '>': ESCAPE ("&gt;");
+    case '\'': ESCAPE ("&#39;");
+    case '"': ESCAPE ("&quot;");
+    default:
+      break;
+    }
+
+#undef ESCAPE
+
+  if ((c >= 0x01 && c <= 0x08) || c == 0x0b || c == 0x0c ||
+      (c >= 0x0e && c <= 0x1f) || c == 0x7f)
+    {
+      *out_escape = buffer;
+      *out_escape_length = format_character_reference (c, buffer);
+      return 1;
+    }
+
+  if (c == 0xc2 && end - p >= 2)
+    {
+      guchar next = (guchar) p[1];
+
+      if ((next >= 0x80 && next <= 0x84) || (next >= 0x86 && next <= 0x9f))
+        {
+          *out_escape = buffer;
+          *out_escape_length = format_character_reference (next, buffer);
+          return 2;
+        }
+    }
+
+  *out_escape = NULL;
+  *out_escape_length = 0;
+  return 1;
+}
+
+/**
+ * eknr_html_escape_write:
+ * @text: The text to escape
+ * @length: The length of @text in bytes
+ * @write: An #EknrTemplateWriteFunc
+ * @user_data: The closure to pass to @write
+ * @error: A #GError
+ *
+ * Escape @text for HTML exactly as g_markup_escape_text() would, writing
+ * the result out with @write as it goes. Runs of text that need no
+ * escaping are written straight from @text.
+ *
+ * Returns: %TRUE on success, %FALSE with @error set if @write fails.
+ */
+gboolean
+eknr_html_escape_write (const char             *text,
+                        gsize                   length,
+                        EknrTemplateWriteFunc   write,
+                        gpointer                user_data,
+                        GError                **error)
+{
+  FindEscapableFunc find_escapable = get_find_escapable ();
+  const char *end = text + length;
+  const char *run = text;
+  const char *p = text;
+
+  while ((p = find_escapable (p, end)) < end)
+    {
+      char buffer[8];
+      const char *escape;
+      gsize escape_length;
+      gsize consumed = escape_at (p, end, buffer, &escape, &escape_length);
+
+      if (escape != NULL)
+        {
+          if (p > run && !write (user_data, run, p - run, error))
+            return FALSE;
+          if (!write (user_data, escape, escape_length, error))
+            return FALSE;
+          run = p + consumed;
+        }
+
+      p += consumed;
+    }
+
+  if (end > run)
+    return write (user_data, run, end - run, error);
+
+  return TRUE;
+}
+
+static gboolean
+append_to_string (gpointer                user_data,
+                  const char             *buffer,
+                  gsize                   length,
+                  G_GNUC_UNUSED GError  **error)
+{
+  g_string_append_len (user_data, buffer, length);
+  return TRUE;
+}
+
+/**
+ * eknr_html_escape_append:
+ * @output: A #GString
+ * @text: The text to escape
+ * @length: The length of @text in bytes
+ *
+ * Escape @text for HTML exactly as g_markup_escape_text() would,
+ * appending the result directly to @output.
+ *
+ * Returns: The number of bytes appended.
+ */
+gsize
+eknr_html_escape_append (GString    *output,
+                         const char *text,
+                         gsize       length)
+{
+  gsize old_length = output->len;
+
+  eknr_html_escape_write (text, length, append_to_string, output, NULL);
+
+  return output->len - old_length;
+}
+
+/**
+ * eknr_html_escape:
+ * @text: The text to escape
+ * @length: The length of @text in bytes, or -1 if it is nul-terminated
+ * @out_length: (out) (optional): Return location for the length of the
+ *   escaped text
+ *
+ * Like g_markup_escape_text(), but faster, and also giving the length
+ * of the result.
+ *
+ * Returns: (transfer full): The escaped text.
+ */
+char *
+eknr_html_escape (const char *text,
+                  gssize      length,
+                  gsize      *out_length)
+{
+  gsize text_length = length < 0 ? strlen (text) : (gsize) length;
+  GString *output = g_string_sized_new (text_length + 16);
+
+  eknr_html_escape_append (output, text, text_length);
+
+  if (out_length != NULL)
+    *out_length = output->len;
+
+  return g_string_free (output, FALSE);
+}
@@ -0,0 +1,128 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-arena-private.h"
+#include "eknr-article-links.h"
+#include "eknr-template-private.h"
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL
+const char * eknr_html_strip_body_tags (const char *html,
+                                        gssize      length,
+                                        gsize      *out_length);
+
+/**
+ * EknrHtmlBodyFeatures:
+ * @EKNR_HTML_BODY_FEATURES_NONE: None of the below
+ * @EKNR_HTML_BODY_HAS_MATH: The body contains TeX or MathML for MathJax
+ *   to typeset
+ * @EKNR_HTML_BODY_HAS_IMAGES: The body contains `<img>` tags
+ * @EKNR_HTML_BODY_HAS_CITATIONS: The body contains `<sup>` elements
+ *   that start with a bracket, which "citation needed" markers do
+ * @EKNR_HTML_BODY_HAS_LINKS: The body contains links into the link
+ *   table, with a `data-ekn-link-table-idx` attribute
+ * @EKNR_HTML_BODY_HAS_CHUNKS: The body contains chunks to fill in, with
+ *   a `data-ekn-chunk-type` attribute
+ * @EKNR_HTML_BODY_HAS_HEADINGS: The body contains `mw-headline` headings
+ *   for eknr_html_collect_headings() to find
+ *
+ * What is in an article body that needs MathJax, rewriting by
+ * eknr_html_rewrite_body(), or a look for headings.
+ */
+typedef enum {
+  EKNR_HTML_BODY_FEATURES_NONE = 0,
+  EKNR_HTML_BODY_HAS_MATH = 1 << 0,
+  EKNR_HTML_BODY_HAS_IMAGES = 1 << 1,
+  EKNR_HTML_BODY_HAS_CITATIONS = 1 << 2,
+  EKNR_HTML_BODY_HAS_LINKS = 1 << 3,
+  EKNR_HTML_BODY_HAS_CHUNKS = 1 << 4,
+  EKNR_HTML_BODY_HAS_HEADINGS = 1 << 5
+} EknrHtmlBodyFeatures;
+
+#define EKNR_HTML_BODY_ALL_FEATURES (EKNR_HTML_BODY_HAS_MATH | \
+                                     EKNR_HTML_BODY_HAS_IMAGES | \
+                                     EKNR_HTML_BODY_HAS_CITATIONS | \
+                                     EKNR_HTML_BODY_HAS_LINKS | \
+                                     EKNR_HTML_BODY_HAS_CHUNKS | \
+                                     EKNR_HTML_BODY_HAS_HEADINGS)
+
+/* The features that eknr_html_rewrite_body() always deals with */
+#define EKNR_HTML_BODY_REWRITTEN_FEATURES (EKNR_HTML_BODY_HAS_IMAGES | \
+                                           EKNR_HTML_BODY_HAS_CITATIONS)
+
+/* The features that eknr_html_rewrite_body() deals with when it is
+ * given an #EknrArticleLinks */
+#define EKNR_HTML_BODY_LINKED_FEATURES (EKNR_HTML_BODY_HAS_LINKS | \
+                                        EKNR_HTML_BODY_HAS_CHUNKS)
+
+G_GNUC_INTERNAL
+EknrHtmlBodyFeatures eknr_html_scan_body (const char *body,
+                                          gsize       length);
+
+G_GNUC_INTERNAL
+const char ** eknr_html_collect_headings (EknrArena  *arena,
+                                          const char *body,
+                                          gsize       length);
+
+G_GNUC_INTERNAL
+const char * eknr_html_format_script_strings (EknrArena          *arena,
+                                              const char * const *strings,
+                                              gsize              *out_length);
+
+G_GNUC_INTERNAL
+gboolean eknr_html_starts_with_bracket (const char *p,
+                                        const char *end);
+
+G_GNUC_INTERNAL
+gsize eknr_html_rewrite_max_growth (const char           *body,
+                                    gsize                 length,
+                                    EknrHtmlBodyFeatures  features);
+
+G_GNUC_INTERNAL
+gboolean eknr_html_rewrite_body (const char              *body,
+                                 gsize                    length,
+                                 EknrHtmlBodyFeatures     features,
+                                 const EknrArticleLinks  *links,
+                                 EknrTemplateWriteFunc    write,
+                                 gpointer                 user_data,
+                                 GError                 **error);
+
+/**
+ * EknrHtmlEscapeImplementation:
+ * @EKNR_HTML_ESCAPE_SCALAR: Look at one byte at a time
+ * @EKNR_HTML_ESCAPE_SSE2: Look at 16 bytes at a time with SSE2
+ * @EKNR_HTML_ESCAPE_AVX2: Look at 32 bytes at a time with AVX2
+ *
+ * The ways the HTML escaper can scan for characters to escape.
+ */
+typedef enum {
+  EKNR_HTML_ESCAPE_SCALAR,
+  EKNR_HTML_ESCAPE_SSE2,
+  EKNR_HTML_ESCAPE_AVX2
+} EknrHtmlEscapeImplementation;
+
+G_GNUC_INTERNAL
+gboolean eknr_html_escape_set_implementation (EknrHtmlEscapeImplementation implementation);
+
+G_GNUC_INTERNAL
+gboolean eknr_html_escape_write (const char             *text,
+                                 gsize                   length,
+                                 EknrTemplateWriteFunc   write,
+                                 gpointer                user_data,
+                                 GError                **error);
+
+G_GNUC_INTERNAL
+gsize eknr_html_escape_append (GString    *output,
+                               const char *text,
+                               gsize       length);
+
+G_GNUC_INTERNAL
+char * eknr_html_escape (const char *text,
+                         gssize      length,
+                         gsize      *out_length);
+
+G_END_DECLS
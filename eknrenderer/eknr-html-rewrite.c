@@ -0,0 +1,961 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-arena-private.h"
+#include "eknr-article-links-private.h"
+#include "eknr-errors.h"
+#include "eknr-html-private.h"
+
+/* Rewrites a legacy article body while it is written out, doing at
+ * render time what content-fixes.js and hide-broken-images.js used to
+ * do in the web view after the page had loaded, and what crosslink.js
+ * and chunk.js did if they were given the article's links.
+ *
+ * This is not a full HTML parser. It tokenizes just enough to tell
+ * tags from text, comments and the contents of scripts and stylesheets,
+ * with quoted attribute values, and it passes everything it does not
+ * rewrite through untouched, in as few writes as possible. Since the
+ * whole body is in memory, the one place that needs to look ahead, a
+ * <sup> element that might be a citation needed marker, looks ahead in
+ * the body rather than buffering output. So do chunks, which are filled
+ * in just before their end tag.
+ */
+
+/* Hides a broken image, and the thumbnail frame around it if there is
+ * one, like hide_caption() in hide-broken-images.js did. The frame is
+ * the image's great-grandparent in MediaWiki thumbnails. */
+#define ONERROR_ATTRIBUTE \
+  " onerror=\"this.style.display='none';" \
+  "try{var t=this.parentNode.parentNode.parentNode;" \
+  "if(t.classList.contains('thumb'))t.style.display='none'}catch(e){}\""
+
+typedef enum {
+  TOKEN_TEXT,
+  TOKEN_START_TAG,
+  TOKEN_END_TAG,
+  TOKEN_OTHER /* comments, doctypes and the like */
+} TokenType;
+
+/* The attributes of start tags that the rewriter looks at */
+typedef enum {
+  ATTRIBUTE_CLASS,
+  ATTRIBUTE_CHUNK_TYPE,
+  ATTRIBUTE_HREF,
+  ATTRIBUTE_ID,
+  ATTRIBUTE_LINK_TABLE_IDX,
+  ATTRIBUTE_LINK_TYPE,
+  ATTRIBUTE_ONERROR,
+  N_ATTRIBUTES
+} AttributeId;
+
+static const char *attribute_names[N_ATTRIBUTES] = {
+  "class",
+  "data-ekn-chunk-type",
+  "href",
+  "id",
+  "data-ekn-link-table-idx",
+  "data-ekn-link-type",
+  "onerror"
+};
+
+typedef struct {
+  const char *start; /* of the name, or %NULL if the tag does not have it */
+  const char *value; /* not nul-terminated */
+  gsize value_length;
+  const char *end; /* just past the value and its closing quote, if any */
+} Attribute;
+
+typedef struct {
+  TokenType type;
+  const char *name; /* tags only, not nul-terminated */
+  gsize name_length;
+  Attribute attributes[N_ATTRIBUTES]; /* start tags only */
+  gboolean self_closing; /* start tags only */
+  const char *end; /* just past the token */
+} Token;
+
+/* Where a rewrite writes to, and how much of the body it has read but
+ * not yet written */
+typedef struct {
+  EknrHtmlBodyFeatures features;
+  const EknrArticleLinks *links; /* (nullable) */
+  EknrTemplateWriteFunc write;
+  gpointer user_data;
+  const char *pending;
+} Rewriter;
+
+static const char *void_elements[] = {
+  "area", "base", "br", "col", "embed", "hr", "img", "input", "link",
+  "meta", "param", "source", "track", "wbr"
+};
+
+static gboolean
+name_is (const Token *token,
+         const char  *name)
+{
+  gsize length = strlen (name);
+
+  return token->name_length == length &&
+         g_ascii_strncasecmp (token->name, name, length) == 0;
+}
+
+static gboolean
+is_void_element (const Token *token)
+{
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (void_elements); ++i)
+    if (name_is (token, void_elements[i]))
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Find @needle in [p, end), ignoring ASCII case */
+static const char *
+find_ascii_caseless (const char *p,
+                     const char *end,
+                     const char *needle)
+{
+  gsize length = strlen (needle);
+
+  for (; (gsize) (end - p) >= length; ++p)
+    if (g_ascii_strncasecmp (p, needle, length) == 0)
+      return p;
+
+  return NULL;
+}
+
+static gboolean
+is_name_end (char c)
+{
+  return c == '>' || c == '/' || c == '=' || g_ascii_isspace (c);
+}
+
+/* The attribute of @token called @name, if the rewriter looks at it
+ * and it has not been seen before; the first one wins, as in HTML */
+static Attribute *
+find_attribute (Token      *token,
+                const char *name,
+                gsize       length)
+{
+  gsize i;
+
+  for (i = 0; i < N_ATTRIBUTES; ++i)
+    {
+      if (strlen (attribute_names[i]) == length &&
+          g_ascii_strncasecmp (name, attribute_names[i], length) == 0)
+        return token->attributes[i].start == NULL ? &token->attributes[i] : NULL;
+    }
+
+  return NULL;
+}
+
+static gboolean
+attribute_is (const Attribute *attribute,
+              const char      *value)
+{
+  return attribute->start != NULL &&
+         attribute->value_length == strlen (value) &&
+         memcmp (attribute->value, value, attribute->value_length) == 0;
+}
+
+/* Read the attributes of a start tag from @p, which is just past its
+ * name. Returns a pointer just past the closing '>', or %NULL if the
+ * tag is not closed. */
+static const char *
+read_attributes (const char *p,
+                 const char *end,
+                 Token      *token)
+{
+  while (p < end)
+    {
+      const char *name = p;
+      Attribute *attribute;
+
+      if (*p == '>')
+        return p + 1;
+
+      if (g_ascii_isspace (*p))
+        {
+          ++p;
+          continue;
+        }
+
+      if (*p == '/')
+        {
+          token->self_closing = p + 1 < end && p[1] == '>';
+          ++p;
+          continue;
+        }
+
+      /* An attribute name, which may be followed by a value */
+      while (p < end && !is_name_end (*p))
+        ++p;
+
+      attribute = find_attribute (token, name, p - name);
+      if (attribute != NULL)
+        {
+          attribute->start = name;
+          attribute->value = p;
+          attribute->value_length = 0;
+          attribute->end = p;
+        }
+
+      while (p < end && g_ascii_isspace (*p))
+        ++p;
+      if (p == end || *p != '=')
+        continue;
+
+      ++p;
+      while (p < end && g_ascii_isspace (*p))
+        ++p;
+      if (p < end && (*p == '"' || *p == '\''))
+        {
+          const char *close = memchr (p + 1, *p, end - p - 1);
+
+          if (close == NULL)
+            return NULL;
+          if (attribute != NULL)
+            {
+              attribute->value = p + 1;
+              attribute->value_length = close - p - 1;
+            }
+          p = close + 1;
+        }
+      else
+        {
+          const char *value = p;
+
+          while (p < end && *p != '>' && !g_ascii_isspace (*p))
+            ++p;
+          if (attribute != NULL)
+            {
+              attribute->value = value;
+              attribute->value_length = p - value;
+            }
+        }
+
+      if (attribute != NULL)
+        attribute->end = p;
+    }
+
+  return NULL;
+}
+
+/* Read the token starting at @p, which is a '<'. Anything that is not
+ * a well-formed tag, comment or declaration is text. */
+static void
+read_markup (const char *p,
+             const char *end,
+             Token      *token)
+{
+  const char *name = p + 1;
+  const char *close;
+
+  memset (token, 0, sizeof (*token));
+  token->type = TOKEN_TEXT;
+  token->end = p + 1;
+
+  if (name == end)
+    return;
+
+  if (end - name >= 3 && memcmp (name, "!--", 3) == 0)
+    {
+      close = find_ascii_caseless (name + 3, end, "-->");
+      token->type = TOKEN_OTHER;
+      token->end = close != NULL ? close + 3 : end;
+      return;
+    }
+
+  if (*name == '!' || *name == '?')
+    {
+      close = memchr (name, '>', end - name);
+      token->type = TOKEN_OTHER;
+      token->end = close != NULL ? close + 1 : end;
+      return;
+    }
+
+  if (*name == '/')
+    {
+      ++name;
+      if (name == end || !g_ascii_isalpha (*name))
+        return;
+
+      token->name = name;
+      while (name < end && !is_name_end (*name))
+        ++name;
+      token->name_length = name - token->name;
+
+      close = memchr (name, '>', end - name);
+      if (close == NULL)
+        return;
+
+      token->type = TOKEN_END_TAG;
+      token->end = close + 1;
+      return;
+    }
+
+  if (!g_ascii_isalpha (*name))
+    return;
+
+  token->name = name;
+  while (name < end && !is_name_end (*name))
+    ++name;
+  token->name_length = name - token->name;
+
+  close = read_attributes (name, end, token);
+  if (close == NULL)
+    return;
+
+  token->type = TOKEN_START_TAG;
+  token->end = close;
+}
+
+/* Read the next token from @p. Text runs up to the next '<'. */
+static void
+read_token (const char *p,
+            const char *end,
+            Token      *token)
+{
+  const char *next;
+
+  if (*p == '<')
+    {
+      read_markup (p, end, token);
+      return;
+    }
+
+  next = memchr (p, '<', end - p);
+  memset (token, 0, sizeof (*token));
+  token->type = TOKEN_TEXT;
+  token->end = next != NULL ? next : end;
+}
+
+/* Where the contents of @token, a start tag, end if it is a script or
+ * a stylesheet whose contents are not HTML; otherwise just past the
+ * tag. */
+static const char *
+skip_raw_text (const Token *token,
+               const char  *end)
+{
+  const char *close = NULL;
+
+  if (name_is (token, "script"))
+    close = find_ascii_caseless (token->end, end, "</script");
+  else if (name_is (token, "style"))
+    close = find_ascii_caseless (token->end, end, "</style");
+  else
+    return token->end;
+
+  return close != NULL ? close : end;
+}
+
+/**
+ * eknr_html_starts_with_bracket:
+ * @p: Where to look
+ * @end: The end of the text @p is in
+ *
+ * Whether the text at @p starts with an opening square bracket, either
+ * literally or as a character reference, which is what a check like
+ * `element.innerHTML[0] === "["` sees.
+ *
+ * Returns: Whether @p starts with a bracket
+ */
+gboolean
+eknr_html_starts_with_bracket (const char *p,
+                               const char *end)
+{
+  static const char *references[] = { "&#91;", "&#x5b;", "&lsqb;", "&lbrack;" };
+  gsize i;
+
+  if (p < end && *p == '[')
+    return TRUE;
+
+  for (i = 0; i < G_N_ELEMENTS (references); ++i)
+    {
+      gsize length = strlen (references[i]);
+
+      if ((gsize) (end - p) >= length &&
+          g_ascii_strncasecmp (p, references[i], length) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* How far to look for the end of a <sup> that might be a citation
+ * needed marker. A marker is about ten tokens; this only keeps a body
+ * full of unclosed <sup> elements from being scanned to the end for
+ * each of them. */
+#define MAX_CITATION_TOKENS 32
+
+/* Look at the <sup> element whose contents start at @p. If it is a
+ * citation needed marker, that is, its contents start with a bracket
+ * and it has an <a> child of an <i> child, return a pointer just past
+ * its end tag, so that it can be dropped the way content-fixes.js used
+ * to hide it. Otherwise return %NULL.
+ *
+ * The look ahead gives up, and the <sup> is kept, if it reaches
+ * another <sup>, the end tag of an element that the <sup> is inside,
+ * or MAX_CITATION_TOKENS tokens, so that an unclosed <sup> costs no
+ * more than a closed one. */
+static const char *
+find_citation_needed_end (const char *p,
+                          const char *end)
+{
+  gsize depth = 0; /* of elements open inside the <sup> */
+  gboolean in_i = FALSE; /* whether the open child of the <sup> is an <i> */
+  gboolean found = FALSE;
+  guint n_tokens;
+
+  if (!eknr_html_starts_with_bracket (p, end))
+    return NULL;
+
+  for (n_tokens = 0; p < end && n_tokens < MAX_CITATION_TOKENS; ++n_tokens)
+    {
+      Token token;
+
+      read_token (p, end, &token);
+
+      switch (token.type)
+        {
+        case TOKEN_START_TAG:
+          if (name_is (&token, "sup"))
+            return NULL;
+          if (depth == 1 && in_i && name_is (&token, "a"))
+            found = TRUE;
+          if (!token.self_closing && !is_void_element (&token))
+            {
+              if (depth == 0)
+                in_i = name_is (&token, "i");
+              ++depth;
+            }
+          p = skip_raw_text (&token, end);
+          continue;
+
+        case TOKEN_END_TAG:
+          if (depth == 0)
+            return found && name_is (&token, "sup") ? token.end : NULL;
+          else if (--depth == 0)
+            {
+              in_i = FALSE;
+            }
+          break;
+
+        case TOKEN_TEXT:
+        case TOKEN_OTHER:
+        default:
+          break;
+        }
+
+      p = token.end;
+    }
+
+  return NULL;
+}
+
+/* Where the element that @token starts ends, that is, the start of its
+ * end tag, allowing for elements of the same name inside it. Like in
+ * HTML, a non-void element is not closed by a "/>". Returns @end if it
+ * is never closed. */
+static const char *
+find_element_end (const Token *token,
+                  const char  *end)
+{
+  const char *p = skip_raw_text (token, end);
+  gsize depth = 0;
+
+  while (p < end)
+    {
+      Token inner;
+
+      read_token (p, end, &inner);
+
+      if (inner.type == TOKEN_START_TAG &&
+          inner.name_length == token->name_length &&
+          g_ascii_strncasecmp (inner.name, token->name, token->name_length) == 0)
+        {
+          ++depth;
+        }
+      else if (inner.type == TOKEN_END_TAG &&
+               inner.name_length == token->name_length &&
+               g_ascii_strncasecmp (inner.name, token->name, token->name_length) == 0)
+        {
+          if (depth == 0)
+            return p;
+          --depth;
+        }
+
+      p = inner.type == TOKEN_START_TAG ? skip_raw_text (&inner, end) : inner.end;
+    }
+
+  return end;
+}
+
+/* Write out what has been read up to @p */
+static gboolean
+write_pending (Rewriter    *rewriter,
+               const char  *p,
+               GError     **error)
+{
+  const char *pending = rewriter->pending;
+
+  if (p <= pending)
+    return TRUE;
+
+  rewriter->pending = p;
+  return rewriter->write (rewriter->user_data, pending, p - pending, error);
+}
+
+static gboolean
+write_literal (Rewriter    *rewriter,
+               const char  *literal,
+               GError     **error)
+{
+  return rewriter->write (rewriter->user_data, literal, strlen (literal), error);
+}
+
+static gboolean
+write_escaped (Rewriter    *rewriter,
+               const char  *text,
+               GError     **error)
+{
+  return eknr_html_escape_write (text, strlen (text),
+                                 rewriter->write, rewriter->user_data, error);
+}
+
+/* Whether @attribute has @name among its space-separated words */
+static gboolean
+has_class (const Attribute *attribute,
+           const char      *name)
+{
+  const char *p = attribute->value;
+  const char *end = attribute->value + attribute->value_length;
+  gsize length = strlen (name);
+
+  while (p < end)
+    {
+      const char *word;
+
+      while (p < end && g_ascii_isspace (*p))
+        ++p;
+      word = p;
+      while (p < end && !g_ascii_isspace (*p))
+        ++p;
+      if ((gsize) (p - word) == length && memcmp (word, name, length) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Point a link into the link table at what it links to, or disable it
+ * if it is an internal link to something that is not there, like
+ * crosslink_init() did */
+static gboolean
+rewrite_link (Rewriter     *rewriter,
+              const Token  *token,
+              GError      **error)
+{
+  const Attribute *table_index = &token->attributes[ATTRIBUTE_LINK_TABLE_IDX];
+  const Attribute *href = &token->attributes[ATTRIBUTE_HREF];
+  const Attribute *classes = &token->attributes[ATTRIBUTE_CLASS];
+  const char *after_name = token->name + token->name_length;
+  const char *ekn_id = eknr_article_links_lookup (rewriter->links,
+                                                  table_index->value,
+                                                  table_index->value_length);
+
+  if (ekn_id != NULL)
+    {
+      if (!write_pending (rewriter, href->start != NULL ? href->start : after_name, error) ||
+          !write_literal (rewriter, href->start != NULL ? "href=\"" : " href=\"", error) ||
+          !write_escaped (rewriter, ekn_id, error) ||
+          !write_literal (rewriter, "\"", error))
+        return FALSE;
+
+      if (href->start != NULL)
+        rewriter->pending = href->end;
+      return TRUE;
+    }
+
+  if (!attribute_is (&token->attributes[ATTRIBUTE_LINK_TYPE], "Internal"))
+    return TRUE;
+
+  if (classes->start == NULL)
+    return write_pending (rewriter, after_name, error) &&
+           write_literal (rewriter, " class=\"eos-no-link\"", error);
+
+  /* Like classList.add(), leave the class alone if it is already there */
+  if (has_class (classes, "eos-no-link"))
+    return TRUE;
+
+  /* A quoted value can be added to in place; an unquoted one, or none
+   * at all, needs quoting now that it will have a space in it */
+  if (classes->value + classes->value_length < classes->end)
+    return write_pending (rewriter, classes->value + classes->value_length, error) &&
+           write_literal (rewriter, classes->value_length > 0 ? " eos-no-link" : "eos-no-link", error);
+
+  if (!write_pending (rewriter, classes->start, error) ||
+      !write_literal (rewriter, "class=\"", error) ||
+      !rewriter->write (rewriter->user_data, classes->value, classes->value_length, error) ||
+      !write_literal (rewriter, classes->value_length > 0 ? " eos-no-link\"" : "eos-no-link\"", error))
+    return FALSE;
+
+  rewriter->pending = classes->end;
+  return TRUE;
+}
+
+/* Write the contents that chunk_init() appended to a chunk, at the end
+ * of the chunk */
+static gboolean
+write_chunk (Rewriter         *rewriter,
+             const Attribute  *type,
+             GError          **error)
+{
+  const EknrArticleLinks *links = rewriter->links;
+  gsize i;
+
+  if (!attribute_is (type, "ParentFeaturedSets"))
+    {
+      g_set_error (error, EKNR_ERROR, EKNR_ERROR_UNKNOWN_CHUNK_TYPE,
+                   "Cannot make chunk type %.*s",
+                   (int) type->value_length, type->value);
+      return FALSE;
+    }
+
+  if (links->parent_featured_set_ids == NULL)
+    {
+      g_set_error (error, EKNR_ERROR, EKNR_ERROR_MISSING_CHUNK_DATA,
+                   "Cannot find chunk data %.*s",
+                   (int) type->value_length, type->value);
+      return FALSE;
+    }
+
+  if (!write_literal (rewriter, "<p>", error))
+    return FALSE;
+
+  for (i = 0; links->parent_featured_set_ids[i] != NULL; ++i)
+    {
+      if (!write_literal (rewriter, "<a href=\"", error) ||
+          !write_escaped (rewriter, links->parent_featured_set_ids[i], error) ||
+          !write_literal (rewriter, "\">", error) ||
+          !write_escaped (rewriter, links->parent_featured_set_titles[i], error) ||
+          !write_literal (rewriter, "</a>", error))
+        return FALSE;
+    }
+
+  return write_literal (rewriter, "</p>", error);
+}
+
+/* Rewrite [@p, @end), writing out everything before @end */
+static gboolean
+rewrite_range (Rewriter    *rewriter,
+               const char  *p,
+               const char  *end,
+               GError     **error)
+{
+  EknrHtmlBodyFeatures features = rewriter->features;
+  gboolean images = (features & EKNR_HTML_BODY_HAS_IMAGES) != 0;
+  gboolean citations = (features & EKNR_HTML_BODY_HAS_CITATIONS) != 0;
+  gboolean links = rewriter->links != NULL && (features & EKNR_HTML_BODY_HAS_LINKS) != 0;
+  gboolean chunks = rewriter->links != NULL && (features & EKNR_HTML_BODY_HAS_CHUNKS) != 0;
+
+  while (p < end)
+    {
+      Token token;
+      const Attribute *chunk_type;
+
+      read_token (p, end, &token);
+
+      if (token.type != TOKEN_START_TAG)
+        {
+          p = token.end;
+          continue;
+        }
+
+      if (images && token.attributes[ATTRIBUTE_ONERROR].start == NULL &&
+          name_is (&token, "img"))
+        {
+          if (!write_pending (rewriter, token.name + token.name_length, error) ||
+              !write_literal (rewriter, ONERROR_ATTRIBUTE, error))
+            return FALSE;
+        }
+      else if (links && token.attributes[ATTRIBUTE_LINK_TABLE_IDX].start != NULL &&
+               (name_is (&token, "a") || name_is (&token, "area")))
+        {
+          if (!rewrite_link (rewriter, &token, error))
+            return FALSE;
+        }
+      else if (citations && name_is (&token, "sup"))
+        {
+          const char *sup_end = find_citation_needed_end (token.end, end);
+
+          if (sup_end != NULL)
+            {
+              if (!write_pending (rewriter, p, error))
+                return FALSE;
+              rewriter->pending = p = sup_end;
+              continue;
+            }
+        }
+
+      chunk_type = &token.attributes[ATTRIBUTE_CHUNK_TYPE];
+      if (chunks && chunk_type->start != NULL && !is_void_element (&token))
+        {
+          const char *chunk_end = find_element_end (&token, end);
+
+          if (!rewrite_range (rewriter, token.end, chunk_end, error) ||
+              !write_chunk (rewriter, chunk_type, error))
+            return FALSE;
+          p = chunk_end;
+          continue;
+        }
+
+      p = skip_raw_text (&token, end);
+    }
+
+  return write_pending (rewriter, end, error);
+}
+
+/* Append @value to the string being built in @arena with its character
+ * references decoded. Only numeric references and the named ones that
+ * attribute values are normally escaped with are decoded; anything
+ * else is kept as it is. */
+static void
+append_decoded (EknrArena  *arena,
+                const char *value,
+                gsize       length)
+{
+  static const struct {
+    const char *name;
+    char c;
+  } named[] = {
+    { "amp;", '&' }, { "lt;", '<' }, { "gt;", '>' }, { "quot;", '"' }, { "apos;", '\'' }
+  };
+  const char *end = value + length;
+  const char *p = value;
+
+  while (p < end)
+    {
+      const char *amp = memchr (p, '&', end - p);
+      const char *reference;
+      gsize i;
+
+      if (amp == NULL)
+        break;
+
+      eknr_arena_append (arena, p, amp - p);
+      reference = amp + 1;
+      p = reference;
+
+      if (reference < end && *reference == '#')
+        {
+          gboolean hex = reference + 1 < end && (reference[1] == 'x' || reference[1] == 'X');
+          const char *digits = reference + (hex ? 2 : 1);
+          gunichar c = 0;
+
+          for (p = digits; p < end && c <= 0x10ffff; ++p)
+            {
+              if (hex && g_ascii_isxdigit (*p))
+                c = c * 16 + g_ascii_xdigit_value (*p);
+              else if (!hex && g_ascii_isdigit (*p))
+                c = c * 10 + g_ascii_digit_value (*p);
+              else
+                break;
+            }
+
+          if (p > digits && p < end && *p == ';' && g_unichar_validate (c) && c != 0)
+            {
+              char utf8[6];
+
+              eknr_arena_append (arena, utf8, g_unichar_to_utf8 (c, utf8));
+              ++p;
+              continue;
+            }
+        }
+      else
+        {
+          for (i = 0; i < G_N_ELEMENTS (named); ++i)
+            {
+              gsize name_length = strlen (named[i].name);
+
+              if ((gsize) (end - reference) >= name_length &&
+                  memcmp (reference, named[i].name, name_length) == 0)
+                break;
+            }
+
+          if (i < G_N_ELEMENTS (named))
+            {
+              eknr_arena_append (arena, &named[i].c, 1);
+              p = reference + strlen (named[i].name);
+              continue;
+            }
+        }
+
+      /* Not a reference we know, so keep it as it is */
+      p = reference;
+      eknr_arena_append (arena, "&", 1);
+    }
+
+  eknr_arena_append (arena, p, end - p);
+}
+
+typedef struct _Heading Heading;
+
+struct _Heading {
+  Heading *next;
+  const char *id;
+};
+
+/**
+ * eknr_html_collect_headings:
+ * @arena: An #EknrArena to allocate the result from
+ * @body: The article body, as returned by eknr_html_strip_body_tags()
+ * @length: The length of @body in bytes
+ *
+ * Find the ids of the elements in @body with the `mw-headline` class,
+ * which are the headings that the scroll manager watches, in the order
+ * they appear. Headings without an id are left out.
+ *
+ * Returns: (transfer none) (array zero-terminated=1): The heading ids,
+ *   which last until @arena is reset
+ */
+const char **
+eknr_html_collect_headings (EknrArena  *arena,
+                            const char *body,
+                            gsize       length)
+{
+  Heading *first = NULL;
+  Heading **last = &first;
+  gsize n_headings = 0, i;
+  const char **headings;
+  const char *end = body + length;
+  const char *p = body;
+
+  while (p < end)
+    {
+      Token token;
+      const Attribute *id;
+
+      read_token (p, end, &token);
+
+      if (token.type != TOKEN_START_TAG)
+        {
+          p = token.end;
+          continue;
+        }
+
+      id = &token.attributes[ATTRIBUTE_ID];
+      if (id->value_length > 0 &&
+          has_class (&token.attributes[ATTRIBUTE_CLASS], "mw-headline"))
+        {
+          Heading *heading;
+          const char *decoded;
+
+          eknr_arena_begin_string (arena);
+          append_decoded (arena, id->value, id->value_length);
+          decoded = eknr_arena_end_string (arena, NULL);
+
+          heading = eknr_arena_alloc (arena, sizeof (Heading));
+          heading->next = NULL;
+          heading->id = decoded;
+          *last = heading;
+          last = &heading->next;
+          ++n_headings;
+        }
+
+      p = skip_raw_text (&token, end);
+    }
+
+  headings = eknr_arena_alloc (arena, (n_headings + 1) * sizeof (char *));
+  for (i = 0; first != NULL; first = first->next)
+    headings[i++] = first->id;
+  headings[i] = NULL;
+
+  return headings;
+}
+
+/**
+ * eknr_html_rewrite_max_growth:
+ * @body: The article body, as returned by eknr_html_strip_body_tags()
+ * @length: The length of @body in bytes
+ * @features: What eknr_html_scan_body() found in @body
+ *
+ * Work out how much longer eknr_html_rewrite_body() can make @body
+ * without links, without tokenizing it. Only images make the body
+ * longer, by their onerror handler; citation needed markers are only
+ * ever left out. Every `<img` is counted, including any in comments
+ * and scripts, so the result may be more than is needed.
+ *
+ * Returns: The most bytes that rewriting @body can add
+ */
+gsize
+eknr_html_rewrite_max_growth (const char           *body,
+                              gsize                 length,
+                              EknrHtmlBodyFeatures  features)
+{
+  const char *end = body + length;
+  const char *p;
+  gsize n_images = 0;
+
+  if ((features & EKNR_HTML_BODY_HAS_IMAGES) == 0)
+    return 0;
+
+  for (p = memchr (body, '<', length); p != NULL; p = memchr (p, '<', end - p))
+    {
+      ++p;
+      if (end - p >= 3 && g_ascii_strncasecmp (p, "img", 3) == 0 &&
+          (end - p == 3 || is_name_end (p[3])))
+        n_images++;
+    }
+
+  return n_images * (sizeof (ONERROR_ATTRIBUTE) - 1);
+}
+
+/**
+ * eknr_html_rewrite_body:
+ * @body: The article body, as returned by eknr_html_strip_body_tags()
+ * @length: The length of @body in bytes
+ * @features: What eknr_html_scan_body() found in @body
+ * @links: (nullable): The article's links, if they should be resolved
+ * @write: Function to write the rewritten body with
+ * @user_data: Data to pass to @write
+ * @error: A #GError
+ *
+ * Write out @body, rewriting it on the way so that the web view does
+ * not have to fix it up after the page has loaded:
+ *
+ * - If @features has %EKNR_HTML_BODY_HAS_IMAGES, each `<img>` tag that
+ *   does not have an onerror handler gets one that hides the image, and
+ *   its thumbnail frame if there is one, when it fails to load.
+ * - If @features has %EKNR_HTML_BODY_HAS_CITATIONS, each `<sup>` element
+ *   that is a citation needed marker is left out.
+ * - If @links is given and @features has %EKNR_HTML_BODY_HAS_LINKS, each
+ *   `<a>` or `<area>` with a `data-ekn-link-table-idx` attribute links
+ *   to the EKN ID at that index in the link table. If there is none and
+ *   its `data-ekn-link-type` is `Internal`, it gets the `eos-no-link`
+ *   class instead.
+ * - If @links is given and @features has %EKNR_HTML_BODY_HAS_CHUNKS,
+ *   each element with a `data-ekn-chunk-type` attribute has the chunk
+ *   of that type added at its end.
+ *
+ * Everything else is written out as it is. The contents of scripts,
+ * stylesheets and comments are never rewritten.
+ *
+ * Returns: %FALSE if @write failed, or if a chunk could not be made
+ */
+gboolean
+eknr_html_rewrite_body (const char              *body,
+                        gsize                    length,
+                        EknrHtmlBodyFeatures     features,
+                        const EknrArticleLinks  *links,
+                        EknrTemplateWriteFunc    write,
+                        gpointer                 user_data,
+                        GError                 **error)
+{
+  Rewriter rewriter = { features, links, write, user_data, body };
+
+  return rewrite_range (&rewriter, body, body + length, error);
+}
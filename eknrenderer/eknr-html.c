@@ -0,0 +1,324 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-html-private.h"
+
+#define HTML_OPEN_TAG "<html>"
+#define BODY_OPEN_TAG "<body>"
+#define HTML_CLOSE_TAG "</html>"
+#define BODY_CLOSE_TAG "</body>"
+
+static const char *
+skip_space_forward (const char *p,
+                    const char *end)
+{
+  while (p < end && g_ascii_isspace (*p))
+    ++p;
+
+  return p;
+}
+
+static const char *
+skip_space_backward (const char *start,
+                     const char *p)
+{
+  while (p > start && g_ascii_isspace (p[-1]))
+    --p;
+
+  return p;
+}
+
+/* If the text at *p starts with @literal, advance *p past it. */
+static gboolean
+consume_prefix (const char **p,
+                const char  *end,
+                const char  *literal,
+                gsize        literal_length)
+{
+  if ((gsize) (end - *p) < literal_length ||
+      memcmp (*p, literal, literal_length) != 0)
+    return FALSE;
+
+  *p += literal_length;
+  return TRUE;
+}
+
+/* If the text ending at *p ends with @literal, move *p back before it. */
+static gboolean
+consume_suffix (const char  *start,
+                const char **p,
+                const char  *literal,
+                gsize        literal_length)
+{
+  if ((gsize) (*p - start) < literal_length ||
+      memcmp (*p - literal_length, literal, literal_length) != 0)
+    return FALSE;
+
+  *p -= literal_length;
+  return TRUE;
+}
+
+/**
+ * eknr_html_strip_body_tags:
+ * @html: The article HTML
+ * @length: The length of @html in bytes, or -1 if it is nul-terminated
+ * @out_length: (out): Return location for the length of the stripped body
+ *
+ * Find the part of @html that lies inside a leading
+ * `<html><body>` and a trailing `</body></html>`, allowing for
+ * whitespace around the tags. This is equivalent to removing the
+ * `^\s*<html>\s*<body>` and `<\/body>\s*<\/html>\s*$` patterns, but
+ * only the head and tail of the document are ever examined and nothing
+ * is copied.
+ *
+ * Returns: (transfer none): A pointer into @html where the stripped
+ *   body starts. The body is not nul-terminated; use @out_length.
+ */
+const char *
+eknr_html_strip_body_tags (const char *html,
+                           gssize      length,
+                           gsize      *out_length)
+{
+  const char *start = html;
+  const char *end;
+  const char *p;
+
+  g_return_val_if_fail (html != NULL, NULL);
+  g_return_val_if_fail (out_length != NULL, NULL);
+
+  end = html + (length < 0 ? strlen (html) : (gsize) length);
+
+  p = skip_space_forward (html, end);
+  if (consume_prefix (&p, end, HTML_OPEN_TAG, strlen (HTML_OPEN_TAG)))
+    {
+      p = skip_space_forward (p, end);
+      if (consume_prefix (&p, end, BODY_OPEN_TAG, strlen (BODY_OPEN_TAG)))
+        start = p;
+    }
+
+  p = skip_space_backward (start, end);
+  if (consume_suffix (start, &p, HTML_CLOSE_TAG, strlen (HTML_CLOSE_TAG)))
+    {
+      p = skip_space_backward (start, p);
+      if (consume_suffix (start, &p, BODY_CLOSE_TAG, strlen (BODY_CLOSE_TAG)))
+        end = p;
+    }
+
+  *out_length = end - start;
+  return start;
+}
+
+/* Whether the tag whose name starts at @p is @name. */
+static gboolean
+is_tag (const char *p,
+        const char *end,
+        const char *name,
+        gsize       name_length)
+{
+  char next;
+
+  if ((gsize) (end - p) <= name_length ||
+      g_ascii_strncasecmp (p, name, name_length) != 0)
+    return FALSE;
+
+  next = p[name_length];
+  return next == '>' || next == '/' || g_ascii_isspace (next);
+}
+
+#define IS_TAG(p, end, name) is_tag ((p), (end), (name), strlen (name))
+
+/* Whether the text at @p starts with @literal, ignoring ASCII case */
+static gboolean
+has_caseless_prefix (const char *p,
+                     const char *end,
+                     const char *literal,
+                     gsize       literal_length)
+{
+  return (gsize) (end - p) >= literal_length &&
+         g_ascii_strncasecmp (p, literal, literal_length) == 0;
+}
+
+#define HAS_CASELESS_PREFIX(p, end, literal) \
+  has_caseless_prefix ((p), (end), (literal), strlen (literal))
+
+/* Find where the tag that @p is inside ends, allowing for quoted
+ * attribute values. Returns a pointer just past the '>', or %NULL. */
+static const char *
+find_tag_end (const char *p,
+              const char *end)
+{
+  char quote = '\0';
+
+  for (; p < end; ++p)
+    {
+      if (quote != '\0')
+        {
+          if (*p == quote)
+            quote = '\0';
+        }
+      else if (*p == '"' || *p == '\'')
+        {
+          quote = *p;
+        }
+      else if (*p == '>')
+        {
+          return p + 1;
+        }
+    }
+
+  return NULL;
+}
+
+/**
+ * eknr_html_scan_body:
+ * @body: The article body, as returned by eknr_html_strip_body_tags()
+ * @length: The length of @body in bytes
+ *
+ * Look through @body for the things that the scripts included in legacy
+ * articles deal with, so that those scripts can be left out when there
+ * is nothing for them to do.
+ *
+ * Math is recognized by `<math>` tags and by the TeX delimiters MathJax
+ * is configured to look for. Citation needed markers are recognized by
+ * a `<sup>` element whose contents start with a bracket; whether it
+ * really is one is left to eknr_html_rewrite_body(). Links and chunks
+ * are recognized by their attribute names, and headings by their class
+ * name, wherever they appear. This errs on the side of finding features
+ * that are not there, which only costs work that finds nothing to do.
+ *
+ * The scan stops as soon as every feature has been found.
+ *
+ * Returns: The features found in @body
+ */
+EknrHtmlBodyFeatures
+eknr_html_scan_body (const char *body,
+                     gsize       length)
+{
+  EknrHtmlBodyFeatures features = EKNR_HTML_BODY_FEATURES_NONE;
+  const char *end = body + length;
+  const char *p;
+
+  for (p = body; p < end && features != EKNR_HTML_BODY_ALL_FEATURES; ++p)
+    {
+      const char *name = p + 1;
+
+      switch (*p)
+        {
+        case '<':
+          if (IS_TAG (name, end, "math"))
+            features |= EKNR_HTML_BODY_HAS_MATH;
+          else if (IS_TAG (name, end, "img"))
+            features |= EKNR_HTML_BODY_HAS_IMAGES;
+          else if (IS_TAG (name, end, "sup"))
+            {
+              const char *contents = find_tag_end (name, end);
+
+              if (contents != NULL && eknr_html_starts_with_bracket (contents, end))
+                features |= EKNR_HTML_BODY_HAS_CITATIONS;
+            }
+          break;
+
+        case '\\':
+          if (name < end && (*name == '(' || *name == '['))
+            features |= EKNR_HTML_BODY_HAS_MATH;
+          else if (consume_prefix (&name, end, "begin{", strlen ("begin{")))
+            features |= EKNR_HTML_BODY_HAS_MATH;
+          break;
+
+        case '$':
+          if (name < end && *name == '$')
+            features |= EKNR_HTML_BODY_HAS_MATH;
+          break;
+
+        case 'm':
+          /* Class names are case-sensitive, as they are for
+           * eknr_html_collect_headings() */
+          if (consume_prefix (&name, end, "w-headline", strlen ("w-headline")))
+            features |= EKNR_HTML_BODY_HAS_HEADINGS;
+          break;
+
+        case 'd':
+        case 'D':
+          if (HAS_CASELESS_PREFIX (name, end, "ata-ekn-link-table-idx"))
+            features |= EKNR_HTML_BODY_HAS_LINKS;
+          else if (HAS_CASELESS_PREFIX (name, end, "ata-ekn-chunk-type"))
+            features |= EKNR_HTML_BODY_HAS_CHUNKS;
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  return features;
+}
+
+/**
+ * eknr_html_format_script_strings:
+ * @arena: An #EknrArena to allocate the result from
+ * @strings: (array zero-terminated=1): UTF-8 strings
+ * @out_length: (out): Return location for the length of the result
+ *
+ * Format @strings as a JavaScript array literal that is safe to put
+ * inside a `<script>` element: besides what JSON escapes, `<`, `>` and
+ * `&` are escaped so that nothing in it can close the element, and so
+ * are the line separators that JavaScript does not allow in strings.
+ *
+ * Returns: (transfer none): The array literal, which lasts until @arena
+ *   is reset
+ */
+const char *
+eknr_html_format_script_strings (EknrArena          *arena,
+                                 const char * const *strings,
+                                 gsize              *out_length)
+{
+  const char * const *string;
+
+  eknr_arena_begin_string (arena);
+  eknr_arena_append (arena, "[", 1);
+
+  for (string = strings; *string != NULL; ++string)
+    {
+      const char *p, *run;
+
+      if (string != strings)
+        eknr_arena_append (arena, ",", 1);
+      eknr_arena_append (arena, "\"", 1);
+
+      /* Characters that need no escaping are appended in runs */
+      for (p = run = *string; *p != '\0'; ++p)
+        {
+          guchar c = *p;
+
+          if (c == '"' || c == '\\')
+            {
+              eknr_arena_append (arena, run, p - run);
+              eknr_arena_append (arena, "\\", 1);
+              run = p;
+            }
+          else if (c < 0x20 || c == '<' || c == '>' || c == '&')
+            {
+              eknr_arena_append (arena, run, p - run);
+              eknr_arena_append_printf (arena, "\\u%04x", c);
+              run = p + 1;
+            }
+          else if (c == 0xe2 && (guchar) p[1] == 0x80 &&
+                   ((guchar) p[2] == 0xa8 || (guchar) p[2] == 0xa9))
+            {
+              /* U+2028 and U+2029 */
+              eknr_arena_append (arena, run, p - run);
+              eknr_arena_append_printf (arena, "\\u%04x", 0x2000 + (guchar) p[2] - 0x80);
+              p += 2;
+              run = p + 1;
+            }
+        }
+
+      eknr_arena_append (arena, run, p - run);
+      eknr_arena_append (arena, "\"", 1);
+    }
+
+  eknr_arena_append (arena, "]", 1);
+
+  return eknr_arena_end_string (arena, out_length);
+}
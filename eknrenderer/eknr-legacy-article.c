@@ -0,0 +1,86 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "eknr-legacy-article.h"
+
+G_DEFINE_BOXED_TYPE (EknrLegacyArticle,
+                     eknr_legacy_article,
+                     eknr_legacy_article_copy,
+                     eknr_legacy_article_free)
+
+/**
+ * eknr_legacy_article_new:
+ * @body_html: The underlying HTML body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @flags: #EknrRenderFlags to render the article with
+ *
+ * Create a new #EknrLegacyArticle. All of the strings are copied.
+ *
+ * Returns: (transfer full): A new #EknrLegacyArticle.
+ */
+EknrLegacyArticle *
+eknr_legacy_article_new (const char      *body_html,
+                         const char      *source,
+                         const char      *source_name,
+                         const char      *original_uri,
+                         const char      *license,
+                         const char      *title,
+                         EknrRenderFlags  flags)
+{
+  EknrLegacyArticle *article = g_new0 (EknrLegacyArticle, 1);
+
+  article->body_html = g_strdup (body_html);
+  article->source = g_strdup (source);
+  article->source_name = g_strdup (source_name);
+  article->original_uri = g_strdup (original_uri);
+  article->license = g_strdup (license);
+  article->title = g_strdup (title);
+  article->flags = flags;
+
+  return article;
+}
+
+/**
+ * eknr_legacy_article_copy:
+ * @article: An #EknrLegacyArticle
+ *
+ * Make a deep copy of @article.
+ *
+ * Returns: (transfer full): A copy of @article.
+ */
+EknrLegacyArticle *
+eknr_legacy_article_copy (const EknrLegacyArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  return eknr_legacy_article_new (article->body_html,
+                                  article->source,
+                                  article->source_name,
+                                  article->original_uri,
+                                  article->license,
+                                  article->title,
+                                  article->flags);
+}
+
+/**
+ * eknr_legacy_article_free:
+ * @article: An #EknrLegacyArticle
+ *
+ * Free @article and all of its strings.
+ */
+void
+eknr_legacy_article_free (EknrLegacyArticle *article)
+{
+  g_return_if_fail (article != NULL);
+
+  g_free (article->body_html);
+  g_free (article->source);
+  g_free (article->source_name);
+  g_free (article->original_uri);
+  g_free (article->license);
+  g_free (article->title);
+  g_free (article);
+}
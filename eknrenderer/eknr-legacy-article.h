@@ -0,0 +1,64 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrRenderFlags:
+ * @EKNR_RENDER_FLAGS_NONE: No flags
+ * @EKNR_RENDER_FLAGS_SHOW_TITLE: Render the article title too
+ * @EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER: Include the scroll manager
+ *
+ * Options controlling how a legacy article is rendered.
+ */
+typedef enum {
+  EKNR_RENDER_FLAGS_NONE = 0,
+  EKNR_RENDER_FLAGS_SHOW_TITLE = 1 << 0,
+  EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER = 1 << 1
+} EknrRenderFlags;
+
+#define EKNR_TYPE_LEGACY_ARTICLE (eknr_legacy_article_get_type ())
+
+/**
+ * EknrLegacyArticle:
+ * @body_html: The underlying HTML body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @flags: #EknrRenderFlags to render the article with
+ *
+ * Everything needed to render one legacy article, for use with
+ * eknr_renderer_render_legacy_batch().
+ */
+typedef struct _EknrLegacyArticle {
+  char *body_html;
+  char *source;
+  char *source_name;
+  char *original_uri;
+  char *license;
+  char *title;
+  EknrRenderFlags flags;
+} EknrLegacyArticle;
+
+GType eknr_legacy_article_get_type (void);
+
+EknrLegacyArticle * eknr_legacy_article_new (const char      *body_html,
+                                             const char      *source,
+                                             const char      *source_name,
+                                             const char      *original_uri,
+                                             const char      *license,
+                                             const char      *title,
+                                             EknrRenderFlags  flags);
+
+EknrLegacyArticle * eknr_legacy_article_copy (const EknrLegacyArticle *article);
+
+void eknr_legacy_article_free (EknrLegacyArticle *article);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrLegacyArticle, eknr_legacy_article_free)
+
+G_END_DECLS
@@ -0,0 +1,100 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-arena-private.h"
+#include "eknr-asset-cache-private.h"
+#include "eknr-legacy-source-private.h"
+#include "eknr-template-private.h"
+
+G_BEGIN_DECLS
+
+/**
+ * EknrLegacyFragments:
+ * @css_files: The stylesheets to link to
+ * @inline_css: The contents of the stylesheets to inline
+ * @javascript_files: The scripts to include with `defer`, which are
+ *   the scroll manager and the source's own scripts
+ * @inline_javascript: The contents of those scripts that are inlined
+ * @include_mathjax: Whether to include MathJax in articles with math
+ *
+ * The parts of a rendered legacy article that only depend on its
+ * source, source name, license, whether the scroll manager is used and
+ * whether assets are inlined, already escaped and localized. These are
+ * shared by every article with the same values, so they are immutable
+ * and reference counted.
+ *
+ * When assets are inlined, each stylesheet or script is either linked
+ * to or inlined, never both; assets that are not in the renderer's
+ * resources are still linked to.
+ */
+typedef struct _EknrLegacyFragments {
+  /*< private >*/
+  volatile gint ref_count;
+  EknrLegacySource *source;
+  char *source_name;
+  char *license;
+  gboolean use_scroll_manager;
+  gboolean inline_assets;
+  guint hash;
+
+  /* What the fragments were translated for, since a render cache
+   * entry made from them is only good for the same */
+  char *messages_locale;
+  char *language;
+
+  /* The disclaimer, split where the link to the original article goes */
+  char **disclaimer_pieces;
+  char *disclaimer_link_text; /* escaped, or %NULL to use the title */
+
+  /* What the lists of files and inlined contents point into */
+  GPtrArray *owned_lists;
+  GPtrArray *assets;
+
+  /*< public >*/
+  const EknrTemplateString *css_files;
+  const EknrTemplateString *inline_css;
+  const EknrTemplateString *javascript_files;
+  const EknrTemplateString *inline_javascript;
+  gboolean include_mathjax;
+} EknrLegacyFragments;
+
+G_GNUC_INTERNAL
+EknrLegacyFragments * eknr_legacy_fragments_ref (EknrLegacyFragments *fragments);
+
+G_GNUC_INTERNAL
+void eknr_legacy_fragments_unref (EknrLegacyFragments *fragments);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrLegacyFragments, eknr_legacy_fragments_unref)
+
+G_GNUC_INTERNAL
+const char * eknr_legacy_fragments_format_disclaimer (const EknrLegacyFragments *fragments,
+                                                      EknrArena                 *arena,
+                                                      const char                *original_uri,
+                                                      const char                *title,
+                                                      gsize                     *out_length);
+
+typedef struct _EknrLegacyFragmentsCache EknrLegacyFragmentsCache;
+
+G_GNUC_INTERNAL
+EknrLegacyFragmentsCache * eknr_legacy_fragments_cache_new (void);
+
+G_GNUC_INTERNAL
+void eknr_legacy_fragments_cache_free (EknrLegacyFragmentsCache *cache);
+
+G_GNUC_INTERNAL
+void eknr_legacy_fragments_cache_register_source (EknrLegacyFragmentsCache *cache,
+                                                  EknrLegacySource         *source);
+
+G_GNUC_INTERNAL
+EknrLegacyFragments * eknr_legacy_fragments_cache_lookup (EknrLegacyFragmentsCache  *cache,
+                                                          const char                *source,
+                                                          const char                *source_name,
+                                                          const char                *license,
+                                                          gboolean                   use_scroll_manager,
+                                                          gboolean                   inline_assets,
+                                                          GError                   **error);
+
+G_END_DECLS
@@ -0,0 +1,445 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <locale.h>
+#include <string.h>
+
+#include "eknr-errors.h"
+#include "eknr-html-private.h"
+#include "eknr-legacy-fragments-private.h"
+
+/* Memoizes the source-specific parts of legacy articles.
+ *
+ * A collection only has a handful of distinct sources and licenses, so
+ * rather than escaping and translating strings for every article, we
+ * build everything that does not depend on the article itself once and
+ * keep it. The disclaimer is the one fragment with an article-specific
+ * part, the link to the original article; it is stored split around
+ * that link so only the link is formatted for each article.
+ *
+ * The cache also holds the registry of known sources. A source name is
+ * resolved to its #EknrLegacySource once per article through its
+ * #GQuark; g_quark_try_string() means names that were never registered
+ * are rejected without being interned.
+ *
+ * Fragments for articles with inlined assets point into the contents
+ * kept by the cache's #EknrAssetCache, which outlives the fragments'
+ * memoization since those contents never change.
+ *
+ * Translations depend on the locale, so the memoized fragments are
+ * dropped whenever the locale for messages changes, as well as when a
+ * source is registered.
+ */
+struct _EknrLegacyFragmentsCache {
+  GMutex lock;
+  GHashTable *sources; /* (locked-by lock) key-type=GQuark, value-type=EknrLegacySource */
+  GHashTable *fragments; /* (locked-by lock) key-type=EknrLegacyFragments, value-type=EknrLegacyFragments */
+  EknrAssetCache *assets; /* has its own lock */
+  char *messages_locale; /* (locked-by lock) */
+  char *language; /* (locked-by lock) */
+};
+
+/* Stands in for the link to the original article while the rest of the
+ * disclaimer is formatted. This cannot appear in a translation. */
+#define LINK_PLACEHOLDER "\001"
+
+/* The scroll manager comes with the rest of the runtime that legacy
+ * articles can use, which is built into one bundle */
+static const EknrTemplateString scroll_manager_javascript_file =
+  EKNR_TEMPLATE_STRING ("legacy-article.js");
+
+static EknrTemplateString *
+build_javascript_files (EknrLegacySource *source,
+                        gboolean          use_scroll_manager)
+{
+  GArray *files = g_array_new (TRUE, TRUE, sizeof (EknrTemplateString));
+  const EknrTemplateString *file;
+
+  if (use_scroll_manager)
+    g_array_append_val (files, scroll_manager_javascript_file);
+
+  /* These point into the source, which the fragments keep alive */
+  for (file = source->javascript_files; file->str != NULL; ++file)
+    g_array_append_val (files, *file);
+
+  return (EknrTemplateString *) g_array_free (files, FALSE);
+}
+
+/* Split @files into the ones to link to and the contents of the ones to
+ * inline, which is all of those found in @assets if it is non-%NULL.
+ * Both lists belong to @fragments. */
+static void
+fragments_add_files (EknrLegacyFragments        *fragments,
+                     EknrAssetCache             *assets,
+                     EknrAssetKind               kind,
+                     const EknrTemplateString   *files,
+                     const EknrTemplateString  **out_linked,
+                     const EknrTemplateString  **out_inlined)
+{
+  GArray *linked = g_array_new (TRUE, TRUE, sizeof (EknrTemplateString));
+  GArray *inlined = g_array_new (TRUE, TRUE, sizeof (EknrTemplateString));
+  const EknrTemplateString *file;
+
+  for (file = files; file->str != NULL; ++file)
+    {
+      g_autoptr(GBytes) contents = NULL;
+      EknrTemplateString string;
+
+      if (assets != NULL)
+        contents = eknr_asset_cache_lookup (assets, kind, file->str);
+
+      if (contents == NULL)
+        {
+          g_array_append_val (linked, *file);
+          continue;
+        }
+
+      /* An empty asset has nothing to inline, and no data to end the
+       * list early with */
+      string.str = g_bytes_get_data (contents, &string.length);
+      if (string.length == 0)
+        continue;
+
+      g_array_append_val (inlined, string);
+      g_ptr_array_add (fragments->assets, g_steal_pointer (&contents));
+    }
+
+  *out_linked = (const EknrTemplateString *) g_array_free (linked, FALSE);
+  *out_inlined = (const EknrTemplateString *) g_array_free (inlined, FALSE);
+  g_ptr_array_add (fragments->owned_lists, (gpointer) *out_linked);
+  g_ptr_array_add (fragments->owned_lists, (gpointer) *out_inlined);
+}
+
+static guint
+hash_string (const char *string)
+{
+  return string != NULL ? g_str_hash (string) : 0;
+}
+
+static guint
+fragments_compute_hash (EknrLegacySource *source,
+                        const char       *source_name,
+                        const char       *license,
+                        gboolean          use_scroll_manager,
+                        gboolean          inline_assets)
+{
+  guint hash = g_direct_hash (source);
+
+  hash = hash * 31 + hash_string (source_name);
+  hash = hash * 31 + hash_string (license);
+  hash = hash * 31 + (use_scroll_manager ? 1 : 0);
+  hash = hash * 31 + (inline_assets ? 1 : 0);
+
+  return hash;
+}
+
+static guint
+fragments_hash (gconstpointer key)
+{
+  return ((const EknrLegacyFragments *) key)->hash;
+}
+
+static gboolean
+fragments_equal (gconstpointer a,
+                 gconstpointer b)
+{
+  const EknrLegacyFragments *fragments_a = a;
+  const EknrLegacyFragments *fragments_b = b;
+
+  return fragments_a->source == fragments_b->source &&
+         fragments_a->use_scroll_manager == fragments_b->use_scroll_manager &&
+         fragments_a->inline_assets == fragments_b->inline_assets &&
+         g_strcmp0 (fragments_a->source_name, fragments_b->source_name) == 0 &&
+         g_strcmp0 (fragments_a->license, fragments_b->license) == 0;
+}
+
+/* Assets are inlined if @assets is non-%NULL */
+static EknrLegacyFragments *
+fragments_new (EknrLegacySource *source,
+               const char       *source_name,
+               const char       *license,
+               gboolean          use_scroll_manager,
+               EknrAssetCache   *assets,
+               const char       *messages_locale,
+               const char       *language)
+{
+  EknrLegacyFragments *fragments = g_new0 (EknrLegacyFragments, 1);
+  g_autofree char *disclaimer = NULL;
+  g_autofree EknrTemplateString *javascript_files = NULL;
+
+  fragments->ref_count = 1;
+  fragments->source = eknr_legacy_source_ref (source);
+  fragments->source_name = g_strdup (source_name);
+  fragments->license = g_strdup (license);
+  fragments->use_scroll_manager = use_scroll_manager;
+  fragments->inline_assets = assets != NULL;
+  fragments->messages_locale = g_strdup (messages_locale);
+  fragments->language = g_strdup (language);
+  fragments->hash = fragments_compute_hash (source,
+                                            source_name,
+                                            license,
+                                            use_scroll_manager,
+                                            fragments->inline_assets);
+  fragments->owned_lists = g_ptr_array_new_with_free_func (g_free);
+  fragments->assets = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+
+  disclaimer = eknr_legacy_source_build_disclaimer (source,
+                                                    source_name,
+                                                    license,
+                                                    LINK_PLACEHOLDER,
+                                                    &fragments->disclaimer_link_text);
+  if (disclaimer != NULL)
+    fragments->disclaimer_pieces = g_strsplit (disclaimer, LINK_PLACEHOLDER, -1);
+
+  javascript_files = build_javascript_files (source, use_scroll_manager);
+  fragments_add_files (fragments, assets, EKNR_ASSET_CSS,
+                       source->css_files,
+                       &fragments->css_files,
+                       &fragments->inline_css);
+  fragments_add_files (fragments, assets, EKNR_ASSET_JAVASCRIPT,
+                       javascript_files,
+                       &fragments->javascript_files,
+                       &fragments->inline_javascript);
+  fragments->include_mathjax = source->include_mathjax;
+
+  return fragments;
+}
+
+EknrLegacyFragments *
+eknr_legacy_fragments_ref (EknrLegacyFragments *fragments)
+{
+  g_atomic_int_inc (&fragments->ref_count);
+  return fragments;
+}
+
+void
+eknr_legacy_fragments_unref (EknrLegacyFragments *fragments)
+{
+  if (!g_atomic_int_dec_and_test (&fragments->ref_count))
+    return;
+
+  g_ptr_array_unref (fragments->owned_lists);
+  g_ptr_array_unref (fragments->assets);
+  eknr_legacy_source_unref (fragments->source);
+  g_free (fragments->source_name);
+  g_free (fragments->license);
+  g_free (fragments->messages_locale);
+  g_free (fragments->language);
+  g_strfreev (fragments->disclaimer_pieces);
+  g_free (fragments->disclaimer_link_text);
+  g_free (fragments);
+}
+
+/**
+ * eknr_legacy_fragments_format_disclaimer:
+ * @fragments: An #EknrLegacyFragments
+ * @arena: An #EknrArena to allocate the disclaimer from
+ * @original_uri: URI the article came from
+ * @title: The article's title
+ * @out_length: (out): Return location for the length of the disclaimer
+ *
+ * Put together the disclaimer for one article.
+ *
+ * Returns: (transfer none) (nullable): The disclaimer HTML, which lasts
+ *   until @arena is reset, or %NULL if the source has no disclaimer.
+ */
+const char *
+eknr_legacy_fragments_format_disclaimer (const EknrLegacyFragments *fragments,
+                                         EknrArena                 *arena,
+                                         const char                *original_uri,
+                                         const char                *title,
+                                         gsize                     *out_length)
+{
+  const char *link_text = fragments->disclaimer_link_text;
+  char **piece;
+
+  *out_length = 0;
+
+  if (fragments->disclaimer_pieces == NULL)
+    return NULL;
+
+  if (original_uri == NULL)
+    original_uri = "";
+
+  if (link_text == NULL)
+    {
+      if (title == NULL)
+        title = "";
+
+      eknr_arena_begin_string (arena);
+      eknr_html_escape_write (title, strlen (title), eknr_arena_write, arena, NULL);
+      link_text = eknr_arena_end_string (arena, NULL);
+    }
+
+  eknr_arena_begin_string (arena);
+
+  for (piece = fragments->disclaimer_pieces; *piece != NULL; ++piece)
+    {
+      if (piece != fragments->disclaimer_pieces)
+        eknr_arena_append_printf (arena,
+                                  EKNR_LEGACY_LINK_FORMAT,
+                                  original_uri,
+                                  link_text);
+
+      eknr_arena_append (arena, *piece, strlen (*piece));
+    }
+
+  return eknr_arena_end_string (arena, out_length);
+}
+
+EknrLegacyFragmentsCache *
+eknr_legacy_fragments_cache_new (void)
+{
+  EknrLegacyFragmentsCache *cache = g_new0 (EknrLegacyFragmentsCache, 1);
+  g_autoptr(GPtrArray) builtins = eknr_legacy_source_new_builtins ();
+  guint i;
+
+  g_mutex_init (&cache->lock);
+  cache->sources = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) eknr_legacy_source_unref);
+  cache->fragments = g_hash_table_new_full (fragments_hash,
+                                            fragments_equal,
+                                            NULL,
+                                            (GDestroyNotify) eknr_legacy_fragments_unref);
+  cache->assets = eknr_asset_cache_new ();
+
+  for (i = 0; i < builtins->len; ++i)
+    {
+      EknrLegacySource *source = g_ptr_array_index (builtins, i);
+
+      g_hash_table_replace (cache->sources,
+                            GUINT_TO_POINTER (source->name),
+                            eknr_legacy_source_ref (source));
+    }
+
+  return cache;
+}
+
+void
+eknr_legacy_fragments_cache_free (EknrLegacyFragmentsCache *cache)
+{
+  g_hash_table_unref (cache->fragments);
+  g_hash_table_unref (cache->sources);
+  eknr_asset_cache_free (cache->assets);
+  g_free (cache->messages_locale);
+  g_free (cache->language);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/**
+ * eknr_legacy_fragments_cache_register_source:
+ * @cache: An #EknrLegacyFragmentsCache
+ * @source: An #EknrLegacySource
+ *
+ * Add @source to the registry, replacing any source with the same name.
+ * @source can no longer be changed after this.
+ */
+void
+eknr_legacy_fragments_cache_register_source (EknrLegacyFragmentsCache *cache,
+                                             EknrLegacySource         *source)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  source->frozen = TRUE;
+  g_hash_table_replace (cache->sources,
+                        GUINT_TO_POINTER (source->name),
+                        eknr_legacy_source_ref (source));
+  g_hash_table_remove_all (cache->fragments);
+}
+
+/* Must be called with cache->lock held. gettext picks translations from
+ * the LC_MESSAGES locale and the LANGUAGE environment variable. */
+static gboolean
+cache_check_locale_changed_locked (EknrLegacyFragmentsCache *cache)
+{
+  const char *messages_locale = setlocale (LC_MESSAGES, NULL);
+  const char *language = g_getenv ("LANGUAGE");
+
+  if (g_strcmp0 (messages_locale, cache->messages_locale) == 0 &&
+      g_strcmp0 (language, cache->language) == 0)
+    return FALSE;
+
+  g_free (cache->messages_locale);
+  cache->messages_locale = g_strdup (messages_locale);
+  g_free (cache->language);
+  cache->language = g_strdup (language);
+
+  return TRUE;
+}
+
+/**
+ * eknr_legacy_fragments_cache_lookup:
+ * @cache: An #EknrLegacyFragmentsCache
+ * @source: Where the article came from
+ * @source_name: Name of the source
+ * @license: The article's license
+ * @use_scroll_manager: Whether the scroll manager is used
+ * @inline_assets: Whether stylesheets and scripts are inlined
+ * @error: A #GError
+ *
+ * Get the fragments for articles with these values, building them if
+ * this is the first article with them in the current locale.
+ *
+ * Returns: (transfer full): An #EknrLegacyFragments, or %NULL with
+ *   %EKNR_ERROR_UNKNOWN_LEGACY_SOURCE if @source is not registered.
+ */
+EknrLegacyFragments *
+eknr_legacy_fragments_cache_lookup (EknrLegacyFragmentsCache  *cache,
+                                    const char                *source,
+                                    const char                *source_name,
+                                    const char                *license,
+                                    gboolean                   use_scroll_manager,
+                                    gboolean                   inline_assets,
+                                    GError                   **error)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  GQuark source_quark = g_quark_try_string (source);
+  EknrLegacySource *legacy_source = NULL;
+  EknrLegacyFragments key = { 0 };
+  EknrLegacyFragments *fragments = NULL;
+
+  if (source_quark != 0)
+    legacy_source = g_hash_table_lookup (cache->sources,
+                                         GUINT_TO_POINTER (source_quark));
+
+  if (legacy_source == NULL)
+    {
+      g_set_error (error,
+                   EKNR_ERROR,
+                   EKNR_ERROR_UNKNOWN_LEGACY_SOURCE,
+                   "Attempted to legacy-render HTML, but no renderer exists for %s",
+                   source);
+      return NULL;
+    }
+
+  if (cache_check_locale_changed_locked (cache))
+    g_hash_table_remove_all (cache->fragments);
+
+  key.source = legacy_source;
+  key.source_name = (char *) source_name;
+  key.license = (char *) license;
+  key.use_scroll_manager = use_scroll_manager;
+  key.inline_assets = inline_assets;
+  key.hash = fragments_compute_hash (legacy_source,
+                                     source_name,
+                                     license,
+                                     use_scroll_manager,
+                                     inline_assets);
+
+  fragments = g_hash_table_lookup (cache->fragments, &key);
+  if (fragments == NULL)
+    {
+      fragments = fragments_new (legacy_source,
+                                 source_name,
+                                 license,
+                                 use_scroll_manager,
+                                 inline_assets ? cache->assets : NULL,
+                                 cache->messages_locale,
+                                 cache->language);
+      g_hash_table_add (cache->fragments, fragments);
+    }
+
+  return eknr_legacy_fragments_ref (fragments);
+}
@@ -0,0 +1,54 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-legacy-source.h"
+#include "eknr-template-private.h"
+
+G_BEGIN_DECLS
+
+/* How links in disclaimers are written, given their URI and their
+ * already escaped text */
+#define EKNR_LEGACY_LINK_FORMAT "<a class=\"eos-show-link\" href=\"%s\">%s</a>"
+
+/* Builds the disclaimer for a source with the link to the original
+ * article replaced by @link_placeholder. Sets @out_link_text to the
+ * escaped text of that link, or %NULL to use the article's title. */
+typedef char * (*EknrLegacyDisclaimerBuilder) (const char  *source_name,
+                                               const char  *license,
+                                               const char  *link_placeholder,
+                                               char       **out_link_text);
+
+struct _EknrLegacySource {
+  volatile gint ref_count;
+  GQuark name;
+
+  /* Set once the source has been registered with a renderer, after
+   * which it is shared between threads and must not change */
+  gboolean frozen;
+
+  EknrTemplateString *css_files; /* terminated by a NULL str */
+  EknrTemplateString *javascript_files; /* terminated by a NULL str */
+  gboolean include_mathjax;
+
+  /* Built-in sources have translated disclaimers built by code */
+  EknrLegacyDisclaimerBuilder build_disclaimer;
+
+  /* Registered sources give the disclaimer as HTML with placeholders */
+  char *disclaimer;
+  EknrLegacyDisclaimerLink disclaimer_link;
+};
+
+G_GNUC_INTERNAL
+GPtrArray * eknr_legacy_source_new_builtins (void);
+
+G_GNUC_INTERNAL
+char * eknr_legacy_source_build_disclaimer (EknrLegacySource  *source,
+                                            const char        *source_name,
+                                            const char        *license,
+                                            const char        *link_placeholder,
+                                            char             **out_link_text);
+
+G_END_DECLS
@@ -0,0 +1,366 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <endless/endless.h>
+
+#include "eknr-html-private.h"
+#include "eknr-legacy-source-private.h"
+
+#include <glib/gi18n-lib.h>
+
+/**
+ * SECTION:legacy-source
+ * @title: Legacy sources
+ * @short_description: Describes how to render articles from a source
+ *
+ * An #EknrLegacySource says what goes around the body of a legacy
+ * article from a particular source: which stylesheets and scripts to
+ * include, whether to include MathJax, and what disclaimer to show.
+ *
+ * The renderer knows about the "wikipedia", "wikibooks", "wikisource"
+ * and "wikihow" sources out of the box. Others can be added with
+ * eknr_renderer_register_legacy_source().
+ */
+
+G_DEFINE_BOXED_TYPE (EknrLegacySource,
+                     eknr_legacy_source,
+                     eknr_legacy_source_ref,
+                     eknr_legacy_source_unref)
+
+static char *
+format_a_href_link (const char *uri,
+                    const char *text)
+{
+  g_autofree char *escaped = eknr_html_escape (text, -1, NULL);
+
+  return g_strdup_printf (EKNR_LEGACY_LINK_FORMAT, uri, escaped);
+}
+
+static char *
+format_license_link (const char *license)
+{
+  g_autofree char *escaped = g_uri_escape_string (license, NULL, TRUE);
+  g_autofree char *license_link = g_strdup_printf ("license://%s", escaped);
+  return format_a_href_link (license_link,
+                             eos_get_license_display_name (license));
+}
+
+static char *
+build_wikimedia_disclaimer (const char  *source_name,
+                            const char  *license,
+                            const char  *link_placeholder,
+                            char       **out_link_text)
+{
+  g_autofree char *license_link = format_license_link (license);
+
+  *out_link_text = eknr_html_escape (source_name != NULL ? source_name : "", -1, NULL);
+  return g_strdup_printf (_("This page contains content from %s, available under a %s license."),
+                          link_placeholder,
+                          license_link);
+}
+
+static char *
+build_wikihow_disclaimer (G_GNUC_UNUSED const char  *source_name,
+                          G_GNUC_UNUSED const char  *license,
+                          const char                *link_placeholder,
+                          char                     **out_link_text)
+{
+  g_autofree char *wikihow_link = format_a_href_link (_("http://wikihow.com"),
+                                                      "WikiHow");
+
+  *out_link_text = NULL;
+  return g_strdup_printf (_("See %s for more details, videos, pictures and attribution. Courtesy of %s, where anyone can easily learn how to do anything."),
+                          link_placeholder,
+                          wikihow_link);
+}
+
+static EknrTemplateString *
+template_strings_new (const char * const *strv)
+{
+  gsize n_strings = strv != NULL ? g_strv_length ((char **) strv) : 0;
+  EknrTemplateString *strings = g_new0 (EknrTemplateString, n_strings + 1);
+  gsize i;
+
+  for (i = 0; i < n_strings; ++i)
+    {
+      strings[i].str = g_strdup (strv[i]);
+      strings[i].length = strlen (strv[i]);
+    }
+
+  return strings;
+}
+
+static void
+template_strings_free (EknrTemplateString *strings)
+{
+  EknrTemplateString *string;
+
+  for (string = strings; string->str != NULL; ++string)
+    g_free ((char *) string->str);
+
+  g_free (strings);
+}
+
+/**
+ * eknr_legacy_source_new:
+ * @name: The name of the source, as passed to
+ *   eknr_renderer_render_legacy_content()
+ *
+ * Create a new legacy source with no stylesheets, no extra scripts, no
+ * MathJax and no disclaimer.
+ *
+ * Returns: (transfer full): A new #EknrLegacySource.
+ */
+EknrLegacySource *
+eknr_legacy_source_new (const char *name)
+{
+  EknrLegacySource *source = NULL;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  source = g_new0 (EknrLegacySource, 1);
+  source->ref_count = 1;
+  source->name = g_quark_from_string (name);
+  source->css_files = template_strings_new (NULL);
+  source->javascript_files = template_strings_new (NULL);
+
+  return source;
+}
+
+/**
+ * eknr_legacy_source_ref:
+ * @source: An #EknrLegacySource
+ *
+ * Returns: (transfer full): @source
+ */
+EknrLegacySource *
+eknr_legacy_source_ref (EknrLegacySource *source)
+{
+  g_return_val_if_fail (source != NULL, NULL);
+
+  g_atomic_int_inc (&source->ref_count);
+  return source;
+}
+
+/**
+ * eknr_legacy_source_unref:
+ * @source: An #EknrLegacySource
+ *
+ * Drop a reference on @source, freeing it if it was the last one.
+ */
+void
+eknr_legacy_source_unref (EknrLegacySource *source)
+{
+  g_return_if_fail (source != NULL);
+
+  if (!g_atomic_int_dec_and_test (&source->ref_count))
+    return;
+
+  template_strings_free (source->css_files);
+  template_strings_free (source->javascript_files);
+  g_free (source->disclaimer);
+  g_free (source);
+}
+
+/**
+ * eknr_legacy_source_get_name:
+ * @source: An #EknrLegacySource
+ *
+ * Returns: The name of the source.
+ */
+const char *
+eknr_legacy_source_get_name (EknrLegacySource *source)
+{
+  g_return_val_if_fail (source != NULL, NULL);
+
+  return g_quark_to_string (source->name);
+}
+
+/**
+ * eknr_legacy_source_set_css_files:
+ * @source: An #EknrLegacySource
+ * @css_files: (array zero-terminated=1) (nullable): The names of the
+ *   stylesheets to link to, relative to the renderer's stylesheet
+ *   resource directory
+ *
+ * Set the stylesheets that articles from @source link to.
+ */
+void
+eknr_legacy_source_set_css_files (EknrLegacySource   *source,
+                                  const char * const *css_files)
+{
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (!source->frozen);
+
+  template_strings_free (source->css_files);
+  source->css_files = template_strings_new (css_files);
+}
+
+/**
+ * eknr_legacy_source_set_javascript_files:
+ * @source: An #EknrLegacySource
+ * @javascript_files: (array zero-terminated=1) (nullable): The names of
+ *   the scripts to include, relative to the renderer's script resource
+ *   directory
+ *
+ * Set the scripts that articles from @source include. These are loaded
+ * with `defer`, so they run once the article has been parsed.
+ */
+void
+eknr_legacy_source_set_javascript_files (EknrLegacySource   *source,
+                                         const char * const *javascript_files)
+{
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (!source->frozen);
+
+  template_strings_free (source->javascript_files);
+  source->javascript_files = template_strings_new (javascript_files);
+}
+
+/**
+ * eknr_legacy_source_set_include_mathjax:
+ * @source: An #EknrLegacySource
+ * @include_mathjax: Whether articles from @source need MathJax
+ *
+ * Set whether articles from @source include MathJax. Even then, it is
+ * only included in articles whose body contains math.
+ */
+void
+eknr_legacy_source_set_include_mathjax (EknrLegacySource *source,
+                                        gboolean          include_mathjax)
+{
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (!source->frozen);
+
+  source->include_mathjax = include_mathjax;
+}
+
+/**
+ * eknr_legacy_source_set_disclaimer:
+ * @source: An #EknrLegacySource
+ * @disclaimer: (nullable): The disclaimer HTML, or %NULL for none
+ * @link_text: What text to use for the link to the original article
+ *
+ * Set the disclaimer shown below articles from @source. The disclaimer
+ * is HTML and is used as is, so it should already be translated and
+ * escaped. `{original-link}` in it is replaced with a link to the
+ * original article, and `{license-link}` with a link to the article's
+ * license.
+ */
+void
+eknr_legacy_source_set_disclaimer (EknrLegacySource         *source,
+                                   const char               *disclaimer,
+                                   EknrLegacyDisclaimerLink  link_text)
+{
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (!source->frozen);
+
+  g_free (source->disclaimer);
+  source->disclaimer = g_strdup (disclaimer);
+  source->disclaimer_link = link_text;
+  source->build_disclaimer = NULL;
+}
+
+/* Replace every @placeholder in @text with @replacement */
+static char *
+replace_placeholder (const char *text,
+                     const char *placeholder,
+                     const char *replacement)
+{
+  g_auto(GStrv) pieces = g_strsplit (text, placeholder, -1);
+
+  return g_strjoinv (replacement, pieces);
+}
+
+/**
+ * eknr_legacy_source_build_disclaimer:
+ * @source: An #EknrLegacySource
+ * @source_name: The name of the source to show
+ * @license: The article's license
+ * @link_placeholder: Text to put where the link to the original article
+ *   goes
+ * @out_link_text: (out) (transfer full) (nullable): Return location for
+ *   the escaped text of the link to the original article, or %NULL if
+ *   the link should use the article's title
+ *
+ * Build the parts of the disclaimer for articles from @source that do
+ * not depend on the article itself.
+ *
+ * Returns: (transfer full) (nullable): The disclaimer HTML, or %NULL if
+ *   @source has no disclaimer.
+ */
+char *
+eknr_legacy_source_build_disclaimer (EknrLegacySource  *source,
+                                     const char        *source_name,
+                                     const char        *license,
+                                     const char        *link_placeholder,
+                                     char             **out_link_text)
+{
+  g_autofree char *license_link = NULL;
+  g_autofree char *with_license = NULL;
+
+  *out_link_text = NULL;
+
+  if (source->build_disclaimer != NULL)
+    return source->build_disclaimer (source_name,
+                                     license,
+                                     link_placeholder,
+                                     out_link_text);
+
+  if (source->disclaimer == NULL)
+    return NULL;
+
+  if (source->disclaimer_link == EKNR_LEGACY_DISCLAIMER_LINK_SOURCE_NAME)
+    *out_link_text = eknr_html_escape (source_name != NULL ? source_name : "", -1, NULL);
+
+  license_link = format_license_link (license != NULL ? license : "");
+  with_license = replace_placeholder (source->disclaimer,
+                                      "{license-link}",
+                                      license_link != NULL ? license_link : "");
+
+  return replace_placeholder (with_license, "{original-link}", link_placeholder);
+}
+
+static EknrLegacySource *
+new_builtin_source (const char                  *name,
+                    const char                  *css_file,
+                    gboolean                     include_mathjax,
+                    EknrLegacyDisclaimerBuilder  build_disclaimer)
+{
+  const char *css_files[] = { css_file, NULL };
+  EknrLegacySource *source = eknr_legacy_source_new (name);
+
+  eknr_legacy_source_set_css_files (source, css_files);
+  eknr_legacy_source_set_include_mathjax (source, include_mathjax);
+  source->build_disclaimer = build_disclaimer;
+  source->frozen = TRUE;
+
+  return source;
+}
+
+/**
+ * eknr_legacy_source_new_builtins:
+ *
+ * Create the legacy sources the renderer supports out of the box.
+ *
+ * Returns: (transfer full) (element-type EknrLegacySource): The sources.
+ */
+GPtrArray *
+eknr_legacy_source_new_builtins (void)
+{
+  GPtrArray *sources = g_ptr_array_new_with_free_func ((GDestroyNotify) eknr_legacy_source_unref);
+
+  g_ptr_array_add (sources, new_builtin_source ("wikipedia", "wikimedia.css", TRUE,
+                                                build_wikimedia_disclaimer));
+  g_ptr_array_add (sources, new_builtin_source ("wikibooks", "wikimedia.css", TRUE,
+                                                build_wikimedia_disclaimer));
+  g_ptr_array_add (sources, new_builtin_source ("wikisource", "wikimedia.css", TRUE,
+                                                build_wikimedia_disclaimer));
+  g_ptr_array_add (sources, new_builtin_source ("wikihow", "wikihow.css", FALSE,
+                                                build_wikihow_disclaimer));
+
+  return sources;
+}
@@ -0,0 +1,53 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrLegacyDisclaimerLink:
+ * @EKNR_LEGACY_DISCLAIMER_LINK_SOURCE_NAME: Link to the original article
+ *   using the name of the source as the link text
+ * @EKNR_LEGACY_DISCLAIMER_LINK_TITLE: Link to the original article using
+ *   the title of the article as the link text
+ *
+ * What text to use for the link to the original article in a legacy
+ * source's disclaimer.
+ */
+typedef enum {
+  EKNR_LEGACY_DISCLAIMER_LINK_SOURCE_NAME,
+  EKNR_LEGACY_DISCLAIMER_LINK_TITLE
+} EknrLegacyDisclaimerLink;
+
+#define EKNR_TYPE_LEGACY_SOURCE (eknr_legacy_source_get_type ())
+
+typedef struct _EknrLegacySource EknrLegacySource;
+
+GType eknr_legacy_source_get_type (void);
+
+EknrLegacySource * eknr_legacy_source_new (const char *name);
+
+EknrLegacySource * eknr_legacy_source_ref (EknrLegacySource *source);
+
+void eknr_legacy_source_unref (EknrLegacySource *source);
+
+const char * eknr_legacy_source_get_name (EknrLegacySource *source);
+
+void eknr_legacy_source_set_css_files (EknrLegacySource   *source,
+                                       const char * const *css_files);
+
+void eknr_legacy_source_set_javascript_files (EknrLegacySource   *source,
+                                              const char * const *javascript_files);
+
+void eknr_legacy_source_set_include_mathjax (EknrLegacySource *source,
+                                             gboolean          include_mathjax);
+
+void eknr_legacy_source_set_disclaimer (EknrLegacySource         *source,
+                                        const char               *disclaimer,
+                                        EknrLegacyDisclaimerLink  link_text);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrLegacySource, eknr_legacy_source_unref)
+
+G_END_DECLS
@@ -0,0 +1,86 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrRenderCacheKey:
+ *
+ * Everything that affects the output of rendering a legacy article,
+ * including the locale that its disclaimer was translated for. The
+ * body's hash and length are what keys are hashed by, but keys with the
+ * same hash are only equal if their bodies are too. The strings are
+ * borrowed from the caller; the cache makes its own copy when an entry
+ * is inserted.
+ */
+typedef struct _EknrRenderCacheKey {
+  const char *body;
+  guint64 body_hash;
+  gsize body_length;
+  const char *source;
+  const char *source_name;
+  const char *original_uri;
+  const char *license;
+  const char *title;
+  const char *messages_locale;
+  const char *language;
+  guint flags;
+
+  /*< private >*/
+  guint hash;
+} EknrRenderCacheKey;
+
+G_GNUC_INTERNAL
+void eknr_render_cache_key_init (EknrRenderCacheKey *key,
+                                 const char         *body_html,
+                                 const char         *source,
+                                 const char         *source_name,
+                                 const char         *original_uri,
+                                 const char         *license,
+                                 const char         *title,
+                                 const char         *messages_locale,
+                                 const char         *language,
+                                 guint               flags);
+
+typedef struct _EknrRenderCache EknrRenderCache;
+
+G_GNUC_INTERNAL
+EknrRenderCache * eknr_render_cache_new (void);
+
+G_GNUC_INTERNAL
+void eknr_render_cache_free (EknrRenderCache *cache);
+
+G_GNUC_INTERNAL
+void eknr_render_cache_set_max_bytes (EknrRenderCache *cache,
+                                      guint64          max_bytes);
+
+G_GNUC_INTERNAL
+guint64 eknr_render_cache_get_max_bytes (EknrRenderCache *cache);
+
+G_GNUC_INTERNAL
+void eknr_render_cache_clear (EknrRenderCache *cache);
+
+G_GNUC_INTERNAL
+guint eknr_render_cache_get_generation (EknrRenderCache *cache);
+
+G_GNUC_INTERNAL
+GBytes * eknr_render_cache_lookup (EknrRenderCache          *cache,
+                                   const EknrRenderCacheKey *key);
+
+G_GNUC_INTERNAL
+void eknr_render_cache_insert (EknrRenderCache          *cache,
+                               const EknrRenderCacheKey *key,
+                               const char               *html,
+                               gsize                     length,
+                               guint                     generation);
+
+G_GNUC_INTERNAL
+void eknr_render_cache_get_stats (EknrRenderCache *cache,
+                                  guint64         *out_hits,
+                                  guint64         *out_misses,
+                                  guint64         *out_evictions);
+
+G_END_DECLS
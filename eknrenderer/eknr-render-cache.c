@@ -0,0 +1,406 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-hash-private.h"
+#include "eknr-render-cache-private.h"
+
+/* A byte-budgeted LRU cache of rendered legacy articles.
+ *
+ * Entries live in a hash table for lookup and in a queue ordered from
+ * most to least recently used for eviction. Rendered HTML is kept in a
+ * GBytes, so a lookup only has to take a reference under the lock and
+ * the caller can copy the HTML out after releasing it.
+ *
+ * Clearing the cache starts a new generation. A render reads the
+ * generation before it looks up anything that the output depends on,
+ * and passes it back when it inserts the output, so that an article
+ * rendered from what was there before the clear is not inserted after
+ * it.
+ */
+struct _EknrRenderCache {
+  GMutex lock;
+
+  GHashTable *entries; /* (locked-by lock) key-type=EknrRenderCacheKey, value-type=RenderCacheEntry */
+  GQueue lru; /* (locked-by lock) element-type=RenderCacheEntry, most recent first */
+  guint64 size; /* (locked-by lock) */
+  guint64 max_bytes; /* (locked-by lock) */
+  volatile gint generation; /* (atomic), only changed with lock held */
+
+  guint64 hits; /* (locked-by lock) */
+  guint64 misses; /* (locked-by lock) */
+  guint64 evictions; /* (locked-by lock) */
+};
+
+typedef struct _RenderCacheEntry {
+  EknrRenderCacheKey key; /* owns its strings */
+  GBytes *html;
+  gsize size;
+  GList link;
+} RenderCacheEntry;
+
+static guint
+hash_string (const char *string)
+{
+  return string != NULL ? g_str_hash (string) : 0;
+}
+
+static guint
+render_cache_key_compute_hash (const EknrRenderCacheKey *key)
+{
+  guint hash = (guint) (key->body_hash ^ (key->body_hash >> 32));
+
+  hash = hash * 31 + (guint) key->body_length;
+  hash = hash * 31 + hash_string (key->source);
+  hash = hash * 31 + hash_string (key->source_name);
+  hash = hash * 31 + hash_string (key->original_uri);
+  hash = hash * 31 + hash_string (key->license);
+  hash = hash * 31 + hash_string (key->title);
+  hash = hash * 31 + hash_string (key->messages_locale);
+  hash = hash * 31 + hash_string (key->language);
+  hash = hash * 31 + key->flags;
+
+  return hash;
+}
+
+/**
+ * eknr_render_cache_key_init:
+ * @key: An uninitialized #EknrRenderCacheKey
+ * @body_html: The article body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @messages_locale: (nullable): The `LC_MESSAGES` locale the article is
+ *   translated for
+ * @language: (nullable): The `LANGUAGE` the article is translated for
+ * @flags: The #EknrRenderFlags the article is rendered with
+ *
+ * Fill in @key for rendering an article with these arguments. The
+ * strings are borrowed, so they must outlive @key.
+ */
+void
+eknr_render_cache_key_init (EknrRenderCacheKey *key,
+                            const char         *body_html,
+                            const char         *source,
+                            const char         *source_name,
+                            const char         *original_uri,
+                            const char         *license,
+                            const char         *title,
+                            const char         *messages_locale,
+                            const char         *language,
+                            guint               flags)
+{
+  key->body = body_html;
+  key->body_length = strlen (body_html);
+  key->body_hash = eknr_hash_bytes (body_html, key->body_length);
+  key->source = source;
+  key->source_name = source_name;
+  key->original_uri = original_uri;
+  key->license = license;
+  key->title = title;
+  key->messages_locale = messages_locale;
+  key->language = language;
+  key->flags = flags;
+  key->hash = render_cache_key_compute_hash (key);
+}
+
+static guint
+render_cache_key_hash (gconstpointer key)
+{
+  return ((const EknrRenderCacheKey *) key)->hash;
+}
+
+static gboolean
+render_cache_key_equal (gconstpointer a,
+                        gconstpointer b)
+{
+  const EknrRenderCacheKey *key_a = a;
+  const EknrRenderCacheKey *key_b = b;
+
+  return key_a->body_hash == key_b->body_hash &&
+         key_a->body_length == key_b->body_length &&
+         key_a->flags == key_b->flags &&
+         memcmp (key_a->body, key_b->body, key_a->body_length) == 0 &&
+         g_strcmp0 (key_a->source, key_b->source) == 0 &&
+         g_strcmp0 (key_a->source_name, key_b->source_name) == 0 &&
+         g_strcmp0 (key_a->original_uri, key_b->original_uri) == 0 &&
+         g_strcmp0 (key_a->license, key_b->license) == 0 &&
+         g_strcmp0 (key_a->title, key_b->title) == 0 &&
+         g_strcmp0 (key_a->messages_locale, key_b->messages_locale) == 0 &&
+         g_strcmp0 (key_a->language, key_b->language) == 0;
+}
+
+static gsize
+string_size (const char *string)
+{
+  return string != NULL ? strlen (string) + 1 : 0;
+}
+
+static RenderCacheEntry *
+render_cache_entry_new (const EknrRenderCacheKey *key,
+                        const char               *html,
+                        gsize                     length)
+{
+  RenderCacheEntry *entry = g_new0 (RenderCacheEntry, 1);
+
+  entry->key = *key;
+  entry->key.body = g_strndup (key->body, key->body_length);
+  entry->key.source = g_strdup (key->source);
+  entry->key.source_name = g_strdup (key->source_name);
+  entry->key.original_uri = g_strdup (key->original_uri);
+  entry->key.license = g_strdup (key->license);
+  entry->key.title = g_strdup (key->title);
+  entry->key.messages_locale = g_strdup (key->messages_locale);
+  entry->key.language = g_strdup (key->language);
+
+  /* Keep the nul terminator so the HTML can be copied out as a string */
+  entry->html = g_bytes_new (html, length + 1);
+  entry->link.data = entry;
+
+  entry->size = sizeof (RenderCacheEntry) + length + 1 +
+                key->body_length + 1 +
+                string_size (key->source) +
+                string_size (key->source_name) +
+                string_size (key->original_uri) +
+                string_size (key->license) +
+                string_size (key->title) +
+                string_size (key->messages_locale) +
+                string_size (key->language);
+
+  return entry;
+}
+
+static void
+render_cache_entry_free (RenderCacheEntry *entry)
+{
+  g_free ((char *) entry->key.body);
+  g_free ((char *) entry->key.source);
+  g_free ((char *) entry->key.source_name);
+  g_free ((char *) entry->key.original_uri);
+  g_free ((char *) entry->key.license);
+  g_free ((char *) entry->key.title);
+  g_free ((char *) entry->key.messages_locale);
+  g_free ((char *) entry->key.language);
+  g_bytes_unref (entry->html);
+  g_free (entry);
+}
+
+/* Must be called with cache->lock held */
+static void
+render_cache_remove_entry_locked (EknrRenderCache  *cache,
+                                  RenderCacheEntry *entry)
+{
+  g_hash_table_remove (cache->entries, &entry->key);
+  g_queue_unlink (&cache->lru, &entry->link);
+  cache->size -= entry->size;
+  render_cache_entry_free (entry);
+}
+
+/* Must be called with cache->lock held */
+static void
+render_cache_evict_locked (EknrRenderCache *cache,
+                           guint64          max_size)
+{
+  while (cache->size > max_size)
+    {
+      render_cache_remove_entry_locked (cache, g_queue_peek_tail (&cache->lru));
+      ++cache->evictions;
+    }
+}
+
+EknrRenderCache *
+eknr_render_cache_new (void)
+{
+  EknrRenderCache *cache = g_new0 (EknrRenderCache, 1);
+
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new (render_cache_key_hash, render_cache_key_equal);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+void
+eknr_render_cache_free (EknrRenderCache *cache)
+{
+  RenderCacheEntry *entry;
+
+  while ((entry = g_queue_peek_head (&cache->lru)) != NULL)
+    render_cache_remove_entry_locked (cache, entry);
+
+  g_hash_table_unref (cache->entries);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/**
+ * eknr_render_cache_set_max_bytes:
+ * @cache: An #EknrRenderCache
+ * @max_bytes: The most memory the cache may use, in bytes, or 0 to
+ *   disable it
+ *
+ * Set the cache's budget, evicting the least recently used entries
+ * straight away if it is over the new budget.
+ */
+void
+eknr_render_cache_set_max_bytes (EknrRenderCache *cache,
+                                 guint64          max_bytes)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  cache->max_bytes = max_bytes;
+  render_cache_evict_locked (cache, max_bytes);
+}
+
+guint64
+eknr_render_cache_get_max_bytes (EknrRenderCache *cache)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  return cache->max_bytes;
+}
+
+/**
+ * eknr_render_cache_clear:
+ * @cache: An #EknrRenderCache
+ *
+ * Drop everything in the cache, for when rendered articles would no
+ * longer come out the same, and start a new generation. This does not
+ * count as evicting them.
+ */
+void
+eknr_render_cache_clear (EknrRenderCache *cache)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  RenderCacheEntry *entry;
+
+  g_atomic_int_inc (&cache->generation);
+
+  while ((entry = g_queue_peek_head (&cache->lru)) != NULL)
+    render_cache_remove_entry_locked (cache, entry);
+}
+
+/**
+ * eknr_render_cache_get_generation:
+ * @cache: An #EknrRenderCache
+ *
+ * Get the cache's generation, which changes every time it is cleared.
+ * Read this before anything that the rendered article depends on, and
+ * pass it to eknr_render_cache_insert().
+ *
+ * Returns: The current generation
+ */
+guint
+eknr_render_cache_get_generation (EknrRenderCache *cache)
+{
+  return (guint) g_atomic_int_get (&cache->generation);
+}
+
+/**
+ * eknr_render_cache_lookup:
+ * @cache: An #EknrRenderCache
+ * @key: The #EknrRenderCacheKey to look up
+ *
+ * Look up the rendered HTML for @key, marking it as the most recently
+ * used entry and counting a hit or a miss.
+ *
+ * Returns: (transfer full) (nullable): The rendered HTML including its
+ *   nul terminator, or %NULL if it is not in the cache.
+ */
+GBytes *
+eknr_render_cache_lookup (EknrRenderCache          *cache,
+                          const EknrRenderCacheKey *key)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  RenderCacheEntry *entry = g_hash_table_lookup (cache->entries, key);
+
+  if (entry == NULL)
+    {
+      ++cache->misses;
+      return NULL;
+    }
+
+  ++cache->hits;
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  return g_bytes_ref (entry->html);
+}
+
+/**
+ * eknr_render_cache_insert:
+ * @cache: An #EknrRenderCache
+ * @key: The #EknrRenderCacheKey that @html was rendered for
+ * @html: The rendered HTML
+ * @length: The length of @html in bytes, not including its nul terminator
+ * @generation: What eknr_render_cache_get_generation() returned before
+ *   @html was rendered
+ *
+ * Add a copy of @html to the cache, evicting the least recently used
+ * entries to make room for it. Nothing is added if @html would not fit
+ * in the cache's budget on its own, or if the cache has been cleared
+ * since @generation, since @html may then be out of date.
+ */
+void
+eknr_render_cache_insert (EknrRenderCache          *cache,
+                          const EknrRenderCacheKey *key,
+                          const char               *html,
+                          gsize                     length,
+                          guint                     generation)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  RenderCacheEntry *entry = NULL;
+  RenderCacheEntry *existing = NULL;
+
+  if (cache->max_bytes == 0 || length >= cache->max_bytes)
+    return;
+
+  if (generation != (guint) cache->generation)
+    return;
+
+  /* Another thread may have rendered the same article meanwhile */
+  existing = g_hash_table_lookup (cache->entries, key);
+  if (existing != NULL)
+    render_cache_remove_entry_locked (cache, existing);
+
+  entry = render_cache_entry_new (key, html, length);
+  if (entry->size > cache->max_bytes)
+    {
+      render_cache_entry_free (entry);
+      return;
+    }
+
+  render_cache_evict_locked (cache, cache->max_bytes - entry->size);
+
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->size += entry->size;
+}
+
+/**
+ * eknr_render_cache_get_stats:
+ * @cache: An #EknrRenderCache
+ * @out_hits: (out) (optional): Return location for the number of hits
+ * @out_misses: (out) (optional): Return location for the number of misses
+ * @out_evictions: (out) (optional): Return location for the number of
+ *   entries evicted to stay within the budget
+ *
+ * Get the cache's counters.
+ */
+void
+eknr_render_cache_get_stats (EknrRenderCache *cache,
+                             guint64         *out_hits,
+                             guint64         *out_misses,
+                             guint64         *out_evictions)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  if (out_hits != NULL)
+    *out_hits = cache->hits;
+  if (out_misses != NULL)
+    *out_misses = cache->misses;
+  if (out_evictions != NULL)
+    *out_evictions = cache->evictions;
+}
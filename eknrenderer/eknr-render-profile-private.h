@@ -0,0 +1,79 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-render-profile.h"
+
+G_BEGIN_DECLS
+
+struct _EknrRenderProfile {
+  EknrRenderKind kind;
+  guint stages; /* bit mask of the stages that ran */
+  gint64 start; /* nanoseconds */
+  gint64 last_mark; /* nanoseconds */
+  guint64 duration;
+  guint64 stage_durations[EKNR_N_RENDER_STAGES];
+  guint64 stage_bytes[EKNR_N_RENDER_STAGES];
+};
+
+G_GNUC_INTERNAL
+EknrRenderProfile * eknr_render_profile_new (EknrRenderKind kind);
+
+G_GNUC_INTERNAL
+void eknr_render_profile_mark_stage (EknrRenderProfile *profile,
+                                     EknrRenderStage    stage,
+                                     gsize              bytes);
+
+G_GNUC_INTERNAL
+void eknr_render_profile_skip (EknrRenderProfile *profile);
+
+G_GNUC_INTERNAL
+void eknr_render_profile_finish (EknrRenderProfile *profile);
+
+/**
+ * EKNR_RENDER_PROFILE_MARK:
+ * @profile: (nullable): An #EknrRenderProfile, or %NULL if the render
+ *   is not being profiled
+ * @stage: The #EknrRenderStage that just finished
+ * @bytes: How many bytes @stage dealt with
+ *
+ * Record that @stage finished just now, having started when the
+ * previous stage finished. When @profile is %NULL this costs a single
+ * well-predicted branch, and @bytes is not evaluated.
+ */
+#define EKNR_RENDER_PROFILE_MARK(profile, stage, bytes) \
+  G_STMT_START { \
+    if (G_UNLIKELY ((profile) != NULL)) \
+      eknr_render_profile_mark_stage ((profile), (stage), (bytes)); \
+  } G_STMT_END
+
+typedef struct _EknrRenderStats EknrRenderStats;
+
+G_GNUC_INTERNAL
+EknrRenderStats * eknr_render_stats_new (void);
+
+G_GNUC_INTERNAL
+void eknr_render_stats_free (EknrRenderStats *stats);
+
+G_GNUC_INTERNAL
+void eknr_render_stats_add (EknrRenderStats         *stats,
+                            const EknrRenderProfile *profile);
+
+G_GNUC_INTERNAL
+void eknr_render_stats_reset (EknrRenderStats *stats);
+
+G_GNUC_INTERNAL
+void eknr_render_stats_get_histogram (EknrRenderStats *stats,
+                                      EknrRenderStage  stage,
+                                      guint64          buckets[EKNR_RENDER_HISTOGRAM_N_BUCKETS]);
+
+G_GNUC_INTERNAL
+void eknr_render_stats_get_totals (EknrRenderStats *stats,
+                                   EknrRenderStage  stage,
+                                   guint64         *out_count,
+                                   guint64         *out_duration,
+                                   guint64         *out_bytes);
+
+G_END_DECLS
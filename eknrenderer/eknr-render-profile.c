@@ -0,0 +1,363 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* For clock_gettime(), which strict C99 hides */
+#define _POSIX_C_SOURCE 199309L
+
+#include "config.h"
+
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+#include "eknr-render-profile-private.h"
+
+G_DEFINE_BOXED_TYPE (EknrRenderProfile,
+                     eknr_render_profile,
+                     eknr_render_profile_copy,
+                     eknr_render_profile_free)
+
+G_STATIC_ASSERT (EKNR_N_RENDER_STAGES == EKNR_RENDER_STAGE_SUBSTITUTE + 1);
+
+/* Names for the marks that show up in sysprof and perf */
+G_GNUC_UNUSED static const char *stage_names[EKNR_N_RENDER_STAGES] = {
+  "fragments",
+  "render-cache",
+  "strip-body",
+  "disclaimer",
+  "template",
+  "variables",
+  "substitute"
+};
+
+/* The same clock as g_get_monotonic_time() and sysprof, but in
+ * nanoseconds, since most stages take less than a microsecond */
+static gint64
+now_nsec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/**
+ * eknr_render_profile_new:
+ * @kind: What is about to be rendered
+ *
+ * Start profiling a render. The first stage starts now.
+ *
+ * Returns: (transfer full): A new #EknrRenderProfile
+ */
+EknrRenderProfile *
+eknr_render_profile_new (EknrRenderKind kind)
+{
+  EknrRenderProfile *profile = g_new0 (EknrRenderProfile, 1);
+
+  profile->kind = kind;
+  profile->start = now_nsec ();
+  profile->last_mark = profile->start;
+
+  return profile;
+}
+
+/**
+ * eknr_render_profile_mark_stage:
+ * @profile: An #EknrRenderProfile
+ * @stage: The #EknrRenderStage that just finished
+ * @bytes: How many bytes @stage dealt with
+ *
+ * Record that @stage ran from the previous mark until now. A stage that
+ * runs more than once in a render adds up. Use EKNR_RENDER_PROFILE_MARK()
+ * rather than calling this directly.
+ */
+void
+eknr_render_profile_mark_stage (EknrRenderProfile *profile,
+                                EknrRenderStage    stage,
+                                gsize              bytes)
+{
+  gint64 now = now_nsec ();
+  gint64 duration = now - profile->last_mark;
+
+  g_return_if_fail (stage < EKNR_N_RENDER_STAGES);
+
+  profile->stages |= 1u << stage;
+  profile->stage_durations[stage] += duration;
+  profile->stage_bytes[stage] += bytes;
+
+#ifdef HAVE_SYSPROF
+  sysprof_collector_mark_printf (profile->last_mark, duration, "eknr", stage_names[stage],
+                                 "%" G_GSIZE_FORMAT " bytes", bytes);
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+  DTRACE_PROBE3 (eknr, render_stage, stage_names[stage], duration, bytes);
+#endif
+
+  profile->last_mark = now;
+}
+
+/**
+ * eknr_render_profile_skip:
+ * @profile: (nullable): An #EknrRenderProfile
+ *
+ * Start the next stage now, without counting the time since the
+ * previous mark toward any stage; for example, the time a render spends
+ * waiting for a worker thread. It still counts toward the duration of
+ * the whole render.
+ */
+void
+eknr_render_profile_skip (EknrRenderProfile *profile)
+{
+  if (G_LIKELY (profile == NULL))
+    return;
+
+  profile->last_mark = now_nsec ();
+}
+
+/**
+ * eknr_render_profile_finish:
+ * @profile: An #EknrRenderProfile
+ *
+ * Record that the render is over.
+ */
+void
+eknr_render_profile_finish (EknrRenderProfile *profile)
+{
+  profile->duration = now_nsec () - profile->start;
+
+#ifdef HAVE_SYSPROF
+  sysprof_collector_mark (profile->start, profile->duration, "eknr",
+                          profile->kind == EKNR_RENDER_KIND_LEGACY ? "legacy" : "mustache",
+                          NULL);
+#endif
+}
+
+/**
+ * eknr_render_profile_copy:
+ * @profile: An #EknrRenderProfile
+ *
+ * Returns: (transfer full): A copy of @profile
+ */
+EknrRenderProfile *
+eknr_render_profile_copy (const EknrRenderProfile *profile)
+{
+  EknrRenderProfile *copy = NULL;
+
+  g_return_val_if_fail (profile != NULL, NULL);
+
+  copy = g_new (EknrRenderProfile, 1);
+  *copy = *profile;
+  return copy;
+}
+
+/**
+ * eknr_render_profile_free:
+ * @profile: An #EknrRenderProfile
+ *
+ * Free @profile.
+ */
+void
+eknr_render_profile_free (EknrRenderProfile *profile)
+{
+  g_free (profile);
+}
+
+/**
+ * eknr_render_profile_get_kind:
+ * @profile: An #EknrRenderProfile
+ *
+ * Returns: What was rendered
+ */
+EknrRenderKind
+eknr_render_profile_get_kind (const EknrRenderProfile *profile)
+{
+  g_return_val_if_fail (profile != NULL, EKNR_RENDER_KIND_LEGACY);
+
+  return profile->kind;
+}
+
+/**
+ * eknr_render_profile_get_duration:
+ * @profile: An #EknrRenderProfile
+ *
+ * Returns: How long the whole render took, in nanoseconds
+ */
+guint64
+eknr_render_profile_get_duration (const EknrRenderProfile *profile)
+{
+  g_return_val_if_fail (profile != NULL, 0);
+
+  return profile->duration;
+}
+
+/**
+ * eknr_render_profile_has_stage:
+ * @profile: An #EknrRenderProfile
+ * @stage: An #EknrRenderStage
+ *
+ * Returns: %TRUE if the render went through @stage
+ */
+gboolean
+eknr_render_profile_has_stage (const EknrRenderProfile *profile,
+                               EknrRenderStage          stage)
+{
+  g_return_val_if_fail (profile != NULL, FALSE);
+  g_return_val_if_fail (stage < EKNR_N_RENDER_STAGES, FALSE);
+
+  return (profile->stages & (1u << stage)) != 0;
+}
+
+/**
+ * eknr_render_profile_get_stage_duration:
+ * @profile: An #EknrRenderProfile
+ * @stage: An #EknrRenderStage
+ *
+ * Returns: How long @stage took, in nanoseconds, or 0 if the render did
+ *   not go through it
+ */
+guint64
+eknr_render_profile_get_stage_duration (const EknrRenderProfile *profile,
+                                        EknrRenderStage          stage)
+{
+  g_return_val_if_fail (profile != NULL, 0);
+  g_return_val_if_fail (stage < EKNR_N_RENDER_STAGES, 0);
+
+  return profile->stage_durations[stage];
+}
+
+/**
+ * eknr_render_profile_get_stage_bytes:
+ * @profile: An #EknrRenderProfile
+ * @stage: An #EknrRenderStage
+ *
+ * Get how many bytes @stage dealt with: the size of the body left after
+ * stripping, of the disclaimer, of the template source, of the
+ * variables, or of the output.
+ *
+ * Returns: The number of bytes, or 0 if the render did not go through
+ *   @stage
+ */
+guint64
+eknr_render_profile_get_stage_bytes (const EknrRenderProfile *profile,
+                                     EknrRenderStage          stage)
+{
+  g_return_val_if_fail (profile != NULL, 0);
+  g_return_val_if_fail (stage < EKNR_N_RENDER_STAGES, 0);
+
+  return profile->stage_bytes[stage];
+}
+
+typedef struct _StageStats {
+  guint64 count;
+  guint64 duration;
+  guint64 bytes;
+  guint64 buckets[EKNR_RENDER_HISTOGRAM_N_BUCKETS];
+} StageStats;
+
+/* Cumulative statistics of every profiled render. Only profiled renders
+ * come here, so a lock is cheap enough. */
+struct _EknrRenderStats {
+  GMutex lock;
+  StageStats stages[EKNR_N_RENDER_STAGES]; /* (locked-by lock) */
+};
+
+EknrRenderStats *
+eknr_render_stats_new (void)
+{
+  EknrRenderStats *stats = g_new0 (EknrRenderStats, 1);
+
+  g_mutex_init (&stats->lock);
+
+  return stats;
+}
+
+void
+eknr_render_stats_free (EknrRenderStats *stats)
+{
+  g_mutex_clear (&stats->lock);
+  g_free (stats);
+}
+
+static guint
+histogram_bucket (guint64 duration)
+{
+  guint bucket = duration < 2 ? 0 : g_bit_storage (duration) - 1;
+
+  return MIN (bucket, EKNR_RENDER_HISTOGRAM_N_BUCKETS - 1);
+}
+
+void
+eknr_render_stats_add (EknrRenderStats         *stats,
+                       const EknrRenderProfile *profile)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  guint stage;
+
+  for (stage = 0; stage < EKNR_N_RENDER_STAGES; ++stage)
+    {
+      StageStats *stage_stats = &stats->stages[stage];
+
+      if ((profile->stages & (1u << stage)) == 0)
+        continue;
+
+      stage_stats->count++;
+      stage_stats->duration += profile->stage_durations[stage];
+      stage_stats->bytes += profile->stage_bytes[stage];
+      stage_stats->buckets[histogram_bucket (profile->stage_durations[stage])]++;
+    }
+}
+
+void
+eknr_render_stats_reset (EknrRenderStats *stats)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  memset (stats->stages, 0, sizeof (stats->stages));
+}
+
+void
+eknr_render_stats_get_histogram (EknrRenderStats *stats,
+                                 EknrRenderStage  stage,
+                                 guint64          buckets[EKNR_RENDER_HISTOGRAM_N_BUCKETS])
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  memcpy (buckets, stats->stages[stage].buckets, sizeof (stats->stages[stage].buckets));
+}
+
+/**
+ * eknr_render_stats_get_totals:
+ * @stats: An #EknrRenderStats
+ * @stage: An #EknrRenderStage
+ * @out_count: (out) (optional): Return location for the number of
+ *   renders that went through @stage
+ * @out_duration: (out) (optional): Return location for the total time
+ *   spent in @stage, in nanoseconds
+ * @out_bytes: (out) (optional): Return location for the total number
+ *   of bytes @stage dealt with
+ *
+ * Get the totals for @stage over every render added to @stats.
+ */
+void
+eknr_render_stats_get_totals (EknrRenderStats *stats,
+                              EknrRenderStage  stage,
+                              guint64         *out_count,
+                              guint64         *out_duration,
+                              guint64         *out_bytes)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  if (out_count != NULL)
+    *out_count = stats->stages[stage].count;
+  if (out_duration != NULL)
+    *out_duration = stats->stages[stage].duration;
+  if (out_bytes != NULL)
+    *out_bytes = stats->stages[stage].bytes;
+}
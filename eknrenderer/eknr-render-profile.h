@@ -0,0 +1,101 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrRenderKind:
+ * @EKNR_RENDER_KIND_LEGACY: A legacy article
+ * @EKNR_RENDER_KIND_MUSTACHE: A mustache document
+ *
+ * What was rendered.
+ */
+typedef enum {
+  EKNR_RENDER_KIND_LEGACY,
+  EKNR_RENDER_KIND_MUSTACHE
+} EknrRenderKind;
+
+/**
+ * EknrRenderStage:
+ * @EKNR_RENDER_STAGE_FRAGMENTS: Looking up what a legacy article's
+ *   source adds to it
+ * @EKNR_RENDER_STAGE_RENDER_CACHE: Looking up a legacy article in the
+ *   render cache and adding it there
+ * @EKNR_RENDER_STAGE_STRIP_BODY: Stripping the tags around a legacy
+ *   article's body and scanning it for what scripts it needs
+ * @EKNR_RENDER_STAGE_DISCLAIMER: Building a legacy article's disclaimer
+ * @EKNR_RENDER_STAGE_TEMPLATE: Looking up, loading or compiling a
+ *   mustache template
+ * @EKNR_RENDER_STAGE_VARIABLES: Unpacking the variables of a mustache
+ *   document
+ * @EKNR_RENDER_STAGE_SUBSTITUTE: Filling in the template and writing
+ *   out the result
+ *
+ * The stages that a render goes through. A legacy article goes through
+ * the fragments, render cache, strip body, disclaimer and substitute
+ * stages, in that order, skipping the ones after the render cache when
+ * the article is found there. A mustache document goes through the
+ * template, variables and substitute stages.
+ */
+typedef enum {
+  EKNR_RENDER_STAGE_FRAGMENTS,
+  EKNR_RENDER_STAGE_RENDER_CACHE,
+  EKNR_RENDER_STAGE_STRIP_BODY,
+  EKNR_RENDER_STAGE_DISCLAIMER,
+  EKNR_RENDER_STAGE_TEMPLATE,
+  EKNR_RENDER_STAGE_VARIABLES,
+  EKNR_RENDER_STAGE_SUBSTITUTE
+} EknrRenderStage;
+
+/**
+ * EKNR_N_RENDER_STAGES:
+ *
+ * The number of values of #EknrRenderStage.
+ */
+#define EKNR_N_RENDER_STAGES 7
+
+/**
+ * EKNR_RENDER_HISTOGRAM_N_BUCKETS:
+ *
+ * The number of buckets in a render stage histogram. Bucket 0 counts
+ * durations under 2 nanoseconds, bucket n counts durations from 2^n up
+ * to 2^(n+1) nanoseconds, and the last bucket also counts everything
+ * longer than that.
+ */
+#define EKNR_RENDER_HISTOGRAM_N_BUCKETS 40
+
+#define EKNR_TYPE_RENDER_PROFILE (eknr_render_profile_get_type ())
+
+/**
+ * EknrRenderProfile:
+ *
+ * How long each stage of one render took and how many bytes it dealt
+ * with. See #EknrRenderer::render-profiled.
+ */
+typedef struct _EknrRenderProfile EknrRenderProfile;
+
+GType eknr_render_profile_get_type (void);
+
+EknrRenderProfile * eknr_render_profile_copy (const EknrRenderProfile *profile);
+
+void eknr_render_profile_free (EknrRenderProfile *profile);
+
+EknrRenderKind eknr_render_profile_get_kind (const EknrRenderProfile *profile);
+
+guint64 eknr_render_profile_get_duration (const EknrRenderProfile *profile);
+
+gboolean eknr_render_profile_has_stage (const EknrRenderProfile *profile,
+                                        EknrRenderStage          stage);
+
+guint64 eknr_render_profile_get_stage_duration (const EknrRenderProfile *profile,
+                                                EknrRenderStage          stage);
+
+guint64 eknr_render_profile_get_stage_bytes (const EknrRenderProfile *profile,
+                                             EknrRenderStage          stage);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrRenderProfile, eknr_render_profile_free)
+
+G_END_DECLS
@@ -0,0 +1,46 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-html-private.h"
+#include "eknr-rendered-article.h"
+
+G_BEGIN_DECLS
+
+struct _EknrRenderedArticle {
+  volatile gint ref_count;
+
+  GBytes *head;
+  GBytes *body;
+  GBytes *tail;
+  EknrHtmlBodyFeatures body_features;
+  char **headings;
+
+  /* What the article was rendered from, for rendering it again with
+   * other flags */
+  char *source;
+  char *source_name;
+  char *original_uri;
+  char *license;
+  char *title;
+  EknrRenderFlags flags;
+
+  char *html; /* (atomic) built the first time it is asked for */
+};
+
+G_GNUC_INTERNAL
+EknrRenderedArticle * eknr_rendered_article_new (GBytes                *head,
+                                                 GBytes                *body,
+                                                 GBytes                *tail,
+                                                 EknrHtmlBodyFeatures   body_features,
+                                                 const char * const    *headings,
+                                                 const char            *source,
+                                                 const char            *source_name,
+                                                 const char            *original_uri,
+                                                 const char            *license,
+                                                 const char            *title,
+                                                 EknrRenderFlags        flags);
+
+G_END_DECLS
@@ -0,0 +1,253 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-rendered-article-private.h"
+
+/**
+ * SECTION:rendered-article
+ * @title: Rendered articles
+ * @short_description: A rendered legacy article in pieces
+ *
+ * An #EknrRenderedArticle holds a rendered legacy article as three
+ * pieces: the head, which is everything before the article body, the
+ * body itself, and the tail, which is everything after it. Unless the
+ * body had to be rewritten, the body piece shares memory with the body
+ * the article was rendered from. Either way, it is shared again when
+ * the article is rendered with other flags by
+ * eknr_renderer_rerender_legacy_article(), so changing whether the
+ * title or the scroll manager is shown only renders the small head and
+ * tail again.
+ *
+ * Callers that can write the pieces out one after the other, for
+ * example to a #GOutputStream, should do so. For callers that need the
+ * whole document as one string, eknr_rendered_article_get_html() joins
+ * the pieces the first time it is called.
+ *
+ * An #EknrRenderedArticle never changes once it is created, so it can
+ * be used from any thread.
+ */
+
+G_DEFINE_BOXED_TYPE (EknrRenderedArticle,
+                     eknr_rendered_article,
+                     eknr_rendered_article_ref,
+                     eknr_rendered_article_unref)
+
+/* Takes references on the pieces and copies the strings and @headings */
+EknrRenderedArticle *
+eknr_rendered_article_new (GBytes                *head,
+                           GBytes                *body,
+                           GBytes                *tail,
+                           EknrHtmlBodyFeatures   body_features,
+                           const char * const    *headings,
+                           const char            *source,
+                           const char            *source_name,
+                           const char            *original_uri,
+                           const char            *license,
+                           const char            *title,
+                           EknrRenderFlags        flags)
+{
+  EknrRenderedArticle *article = g_new0 (EknrRenderedArticle, 1);
+
+  article->ref_count = 1;
+  article->head = g_bytes_ref (head);
+  article->body = g_bytes_ref (body);
+  article->tail = g_bytes_ref (tail);
+  article->body_features = body_features;
+  article->headings = g_strdupv ((char **) headings);
+  article->source = g_strdup (source);
+  article->source_name = g_strdup (source_name);
+  article->original_uri = g_strdup (original_uri);
+  article->license = g_strdup (license);
+  article->title = g_strdup (title);
+  article->flags = flags;
+
+  return article;
+}
+
+/**
+ * eknr_rendered_article_ref:
+ * @article: An #EknrRenderedArticle
+ *
+ * Returns: (transfer full): @article
+ */
+EknrRenderedArticle *
+eknr_rendered_article_ref (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  g_atomic_int_inc (&article->ref_count);
+  return article;
+}
+
+/**
+ * eknr_rendered_article_unref:
+ * @article: An #EknrRenderedArticle
+ *
+ * Drop a reference on @article, freeing it if it was the last one.
+ */
+void
+eknr_rendered_article_unref (EknrRenderedArticle *article)
+{
+  g_return_if_fail (article != NULL);
+
+  if (!g_atomic_int_dec_and_test (&article->ref_count))
+    return;
+
+  g_bytes_unref (article->head);
+  g_bytes_unref (article->body);
+  g_bytes_unref (article->tail);
+  g_strfreev (article->headings);
+  g_free (article->source);
+  g_free (article->source_name);
+  g_free (article->original_uri);
+  g_free (article->license);
+  g_free (article->title);
+  g_free (article->html);
+  g_free (article);
+}
+
+/**
+ * eknr_rendered_article_get_head:
+ * @article: An #EknrRenderedArticle
+ *
+ * Returns: (transfer none): Everything that comes before the body
+ */
+GBytes *
+eknr_rendered_article_get_head (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  return article->head;
+}
+
+/**
+ * eknr_rendered_article_get_body:
+ * @article: An #EknrRenderedArticle
+ *
+ * Get the article body, without the tags that were stripped from around
+ * it. Unless the body had to be rewritten, this shares memory with the
+ * body the article was rendered from.
+ *
+ * Returns: (transfer none): The body
+ */
+GBytes *
+eknr_rendered_article_get_body (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  return article->body;
+}
+
+/**
+ * eknr_rendered_article_get_tail:
+ * @article: An #EknrRenderedArticle
+ *
+ * Returns: (transfer none): Everything that comes after the body
+ */
+GBytes *
+eknr_rendered_article_get_tail (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  return article->tail;
+}
+
+/**
+ * eknr_rendered_article_get_headings:
+ * @article: An #EknrRenderedArticle
+ *
+ * Get the ids of the headings in the article body, in the order they
+ * appear, for use as a table of contents. These are the elements with
+ * the `mw-headline` class that the scroll manager reports scrolling
+ * past.
+ *
+ * Returns: (transfer none) (array zero-terminated=1): The heading ids
+ */
+const char * const *
+eknr_rendered_article_get_headings (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, NULL);
+
+  return (const char * const *) article->headings;
+}
+
+/**
+ * eknr_rendered_article_get_flags:
+ * @article: An #EknrRenderedArticle
+ *
+ * Returns: The #EknrRenderFlags that @article was rendered with
+ */
+EknrRenderFlags
+eknr_rendered_article_get_flags (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, EKNR_RENDER_FLAGS_NONE);
+
+  return article->flags;
+}
+
+/**
+ * eknr_rendered_article_get_length:
+ * @article: An #EknrRenderedArticle
+ *
+ * Returns: The length of the whole document in bytes
+ */
+gsize
+eknr_rendered_article_get_length (EknrRenderedArticle *article)
+{
+  g_return_val_if_fail (article != NULL, 0);
+
+  return g_bytes_get_size (article->head) +
+         g_bytes_get_size (article->body) +
+         g_bytes_get_size (article->tail);
+}
+
+/**
+ * eknr_rendered_article_get_html:
+ * @article: An #EknrRenderedArticle
+ *
+ * Get the whole document as one string. The pieces are joined the
+ * first time this is called, and the result is kept for as long as
+ * @article lives.
+ *
+ * Returns: (transfer none): The rendered HTML
+ */
+const char *
+eknr_rendered_article_get_html (EknrRenderedArticle *article)
+{
+  GBytes *pieces[3];
+  char *html, *position;
+  gsize i;
+
+  g_return_val_if_fail (article != NULL, NULL);
+
+  html = g_atomic_pointer_get (&article->html);
+  if (html != NULL)
+    return html;
+
+  pieces[0] = article->head;
+  pieces[1] = article->body;
+  pieces[2] = article->tail;
+
+  html = g_malloc (eknr_rendered_article_get_length (article) + 1);
+  position = html;
+  for (i = 0; i < G_N_ELEMENTS (pieces); ++i)
+    {
+      gsize size;
+      const char *data = g_bytes_get_data (pieces[i], &size);
+
+      if (size > 0)
+        memcpy (position, data, size);
+      position += size;
+    }
+  *position = '\0';
+
+  /* Another thread may have got there first */
+  if (!g_atomic_pointer_compare_and_exchange (&article->html, NULL, html))
+    {
+      g_free (html);
+      html = g_atomic_pointer_get (&article->html);
+    }
+
+  return html;
+}
@@ -0,0 +1,37 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "eknr-legacy-article.h"
+
+G_BEGIN_DECLS
+
+#define EKNR_TYPE_RENDERED_ARTICLE (eknr_rendered_article_get_type ())
+
+typedef struct _EknrRenderedArticle EknrRenderedArticle;
+
+GType eknr_rendered_article_get_type (void);
+
+EknrRenderedArticle * eknr_rendered_article_ref (EknrRenderedArticle *article);
+
+void eknr_rendered_article_unref (EknrRenderedArticle *article);
+
+GBytes * eknr_rendered_article_get_head (EknrRenderedArticle *article);
+
+GBytes * eknr_rendered_article_get_body (EknrRenderedArticle *article);
+
+GBytes * eknr_rendered_article_get_tail (EknrRenderedArticle *article);
+
+const char * const * eknr_rendered_article_get_headings (EknrRenderedArticle *article);
+
+EknrRenderFlags eknr_rendered_article_get_flags (EknrRenderedArticle *article);
+
+gsize eknr_rendered_article_get_length (EknrRenderedArticle *article);
+
+const char * eknr_rendered_article_get_html (EknrRenderedArticle *article);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrRenderedArticle, eknr_rendered_article_unref)
+
+G_END_DECLS
@@ -5,12 +5,22 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include <endless/endless.h>
 #include <json-glib/json-glib.h>
 #include <mustache.h>
 
+#include "eknr-arena-private.h"
 #include "eknr-errors.h"
+#include "eknr-hash-private.h"
+#include "eknr-html-private.h"
+#include "eknr-legacy-article-template.h"
+#include "eknr-legacy-fragments-private.h"
+#include "eknr-render-cache-private.h"
+#include "eknr-render-profile-private.h"
+#include "eknr-rendered-article-private.h"
 #include "eknr-renderer.h"
+#include "eknr-template-blob-private.h"
+#include "eknr-template-cache-private.h"
+#include "eknr-template-private.h"
 
 #include <glib/gi18n-lib.h>
 
@@ -22,6 +32,42 @@
  * The renderer is responsible for adding some final postprocessing to
  * articles on the client side before it is displayed to the user. What
  * postprocessing happens depends on the article's source.
+ *
+ * A single #EknrRenderer may be shared between threads. All of the
+ * rendering functions can be called on the same renderer from several
+ * threads at once; compiled templates are cached in a way that lets
+ * concurrent lookups of an already compiled template proceed without
+ * taking any locks, and a template that several threads ask for at the
+ * same time is only read and compiled once.
+ *
+ * Compiled mustache templates are kept for as long as the renderer
+ * lives unless #EknrRenderer:template-cache-max-entries or
+ * #EknrRenderer:template-cache-max-bytes is set. Templates can be
+ * loaded ahead of time with eknr_renderer_preload_templates_async().
+ *
+ * Compiled templates are also saved to disk, in the eknr/templates
+ * directory under g_get_user_cache_dir() (usually
+ * `$XDG_CACHE_HOME/eknr/templates`), so that the next process to load
+ * the same template does not have to compile it again. The renderer
+ * deletes the least recently used of them once they take up more than
+ * a few megabytes, and the directory can be deleted at any time.
+ *
+ * The renderer can also keep the HTML of recently rendered legacy
+ * articles, so that going back to an article does not render it all
+ * over again. The cache is off by default; set
+ * #EknrRenderer:render-cache-max-bytes to turn it on.
+ *
+ * To find out where the time goes when rendering, set
+ * #EknrRenderer:instrument. The renderer then times each stage of every
+ * render, reports it with #EknrRenderer::render-profiled, and keeps
+ * histograms of each stage that can be read with
+ * eknr_renderer_get_stage_histogram().
+ *
+ * What a legacy render only needs while it runs, such as the disclaimer
+ * and the list of headings, is allocated from a scratch arena that the
+ * renderer keeps between renders, so that rendering an article to a
+ * string makes no allocations besides the string itself once the
+ * renderer has warmed up.
  */
 struct _EknrRenderer
 {
@@ -30,20 +76,112 @@ struct _EknrRenderer
 
 typedef struct _EknrRendererPrivate
 {
-  GHashTable *cache; /* key-type=char *, char * */
+  EknrTemplateCache *cache;
+  char *template_blob_dir;
+  EknrRenderCache *render_cache;
+  EknrLegacyFragmentsCache *legacy_fragments;
+  volatile gint instrument; /* (atomic) */
+  EknrRenderStats *stats;
+  volatile gint inline_assets; /* (atomic) */
+  gpointer scratch; /* (atomic) (nullable) (owned), an idle EknrArena */
 } EknrRendererPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (EknrRenderer,
                             eknr_renderer,
                             G_TYPE_OBJECT)
 
-/* This struct is the "closure" that we usually pass to
- * mustache so that we can keep track of some data as it
- * gets passed to callbacks that we register with mustache.
- *
- * Notably, this struct is used for input *and* output - when
- * a value is to be written mustache will call _renderer_write_to_closure
- * where we write the output to the "output" member.
+enum {
+  PROP_0,
+  PROP_RENDER_CACHE_MAX_BYTES,
+  PROP_RENDER_CACHE_HITS,
+  PROP_RENDER_CACHE_MISSES,
+  PROP_RENDER_CACHE_EVICTIONS,
+  PROP_TEMPLATE_CACHE_MAX_ENTRIES,
+  PROP_TEMPLATE_CACHE_MAX_BYTES,
+  PROP_TEMPLATE_CACHE_REVALIDATE,
+  PROP_TEMPLATE_CACHE_ENTRIES,
+  PROP_TEMPLATE_CACHE_BYTES,
+  PROP_TEMPLATE_CACHE_HITS,
+  PROP_TEMPLATE_CACHE_MISSES,
+  PROP_TEMPLATE_CACHE_EVICTIONS,
+  PROP_INSTRUMENT,
+  PROP_INLINE_ASSETS,
+  NPROPS
+};
+
+static GParamSpec *eknr_renderer_props [NPROPS] = { NULL, };
+
+enum {
+  SIGNAL_RENDER_PROFILED,
+  N_SIGNALS
+};
+
+static guint eknr_renderer_signals [N_SIGNALS] = { 0, };
+
+/* Start profiling a render, if the renderer is instrumented. Returns
+ * %NULL otherwise, which is all that the rest of the render checks, so
+ * an uninstrumented render only pays for reading one integer. */
+static EknrRenderProfile *
+_renderer_begin_profile (EknrRenderer   *renderer,
+                         EknrRenderKind  kind)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+
+  if (G_LIKELY (!g_atomic_int_get (&priv->instrument)))
+    return NULL;
+
+  return eknr_render_profile_new (kind);
+}
+
+/* Takes ownership of @profile, which may be %NULL. This is called in
+ * whichever thread did the render. */
+static void
+_renderer_finish_profile (EknrRenderer      *renderer,
+                          EknrRenderProfile *profile)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+  g_autoptr(EknrRenderProfile) owned_profile = profile;
+
+  if (G_LIKELY (profile == NULL))
+    return;
+
+  eknr_render_profile_finish (profile);
+  eknr_render_stats_add (priv->stats, profile);
+  g_signal_emit (renderer, eknr_renderer_signals[SIGNAL_RENDER_PROFILED], 0, profile);
+}
+
+/* Take the renderer's scratch arena for one render. There is only one,
+ * so a render that runs while another has it gets an arena of its own,
+ * which it gives back if the renderer's is still out. */
+static EknrArena *
+_renderer_take_scratch (EknrRenderer *renderer)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+  EknrArena *scratch = g_atomic_pointer_get (&priv->scratch);
+
+  if (scratch != NULL &&
+      g_atomic_pointer_compare_and_exchange (&priv->scratch, scratch, NULL))
+    return scratch;
+
+  return eknr_arena_new ();
+}
+
+/* Takes ownership of @scratch, once the render it was taken for is
+ * completely done with what it allocated from it */
+static void
+_renderer_return_scratch (EknrRenderer *renderer,
+                          EknrArena    *scratch)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+
+  eknr_arena_reset (scratch);
+  if (!g_atomic_pointer_compare_and_exchange (&priv->scratch, NULL, scratch))
+    eknr_arena_free (scratch);
+}
+
+/* This struct is the "closure" that we pass to mustache_c when it
+ * compiles a template. mustache_c reads the template text from "input"
+ * through _renderer_read_from_closure.
  *
  * Also note that we also get to define our own error handler - in this
  * case we keep an error-out location in the "error" member of the
@@ -52,27 +190,19 @@ G_DEFINE_TYPE_WITH_PRIVATE (EknrRenderer,
  * a location of an error pointer on the stack.
  */
 typedef struct _RendererMustacheData {
-  GVariantDict  *variables;
-  GError       **error; /* non-owned */
+  GError **error; /* non-owned */
 
   mustache_str_ctx input;
-  mustache_str_ctx output;
-
-  const char *section_variable;
 } RendererMustacheData;
 
 static RendererMustacheData *
-renderer_mustache_data_new (GVariantDict  *variables,
-                            GError       **error,
-                            const char    *input)
+renderer_mustache_data_new (GError     **error,
+                            const char  *input)
 {
   RendererMustacheData *data = g_new0 (RendererMustacheData, 1);
-  data->variables = variables ? g_variant_dict_ref (variables) : NULL;
   data->error = error;
-  data->input.string = input ? g_strdup (input) : NULL;
+  data->input.string = g_strdup (input);
   data->input.offset = 0;
-  data->output.string = NULL;
-  data->output.offset = 0;
 
   return data;
 }
@@ -80,8 +210,6 @@ renderer_mustache_data_new (GVariantDict  *variables,
 static void
 renderer_mustache_data_free (RendererMustacheData *data)
 {
-  g_clear_pointer (&data->variables, g_variant_dict_unref);
-  g_clear_pointer (&data->output.string, free);
   g_clear_pointer (&data->input.string, g_free);
   g_free (data);
 }
@@ -111,277 +239,462 @@ _renderer_read_from_closure (mustache_api_t *api,
   return mustache_std_strread (api, &data->input, buffer, buffer_size);
 }
 
-static uintmax_t
-_renderer_write_to_closure (mustache_api_t *api,
-                            void           *userdata,
-                            const char     *buffer,
-                            uintmax_t       buffer_size)
+static void
+_renderer_set_error (G_GNUC_UNUSED mustache_api_t *api,
+                     void                         *userdata,
+                     uintmax_t                     lineno,
+                     const char                   *msg)
 {
   RendererMustacheData *data = userdata;
 
-  /* 'buffer' here is actually a read-only buffer, but we have to cast it to
-   * (char *) because that's the way that mustache_std_strwrite was declared. */
-  return mustache_std_strwrite (api, &data->output, (char *) buffer, buffer_size);
+  g_set_error (data->error,
+               EKNR_ERROR,
+               EKNR_ERROR_SUBSTITUTION_FAILED,
+               "Failed to perform template substitution: %s (at line %lu)",
+               msg,
+               lineno);
 }
 
-static const char *
-_lookup_in_gvariant_dict (RendererMustacheData *data,
-                          const char           *text,
-                          mustache_api_t       *api)
+static mustache_api_t _renderer_mustache_data_vfuncs = {
+  .read = &_renderer_read_from_closure,
+  .error = &_renderer_set_error
+};
+
+/* Copy the tree that mustache_c parsed into a flat blob, which is what
+ * actually gets rendered */
+static void
+_renderer_flatten_template (EknrTemplateBlobBuilder *builder,
+                            mustache_template_t     *tmpl)
 {
-  g_autoptr(GVariant) value_v = g_variant_dict_lookup_value (data->variables, text, G_VARIANT_TYPE_STRING);
+  mustache_token_t *token;
 
-  if (value_v == NULL)
+  for (token = tmpl; token != NULL; token = token->next)
     {
-      g_autofree char *msg = g_strdup_printf ("No such variable %s", text);
-      (*api->error) (api, data, __LINE__, msg);
-      return NULL;
+      switch (token->type)
+        {
+        case TOKEN_TEXT:
+          eknr_template_blob_builder_add_text (builder,
+                                               token->token_simple.text,
+                                               token->token_simple.text_length);
+          break;
+        case TOKEN_VARIABLE:
+          eknr_template_blob_builder_add_variable (builder,
+                                                   token->token_simple.text,
+                                                   token->token_simple.escaped == 1);
+          break;
+        case TOKEN_SECTION:
+          eknr_template_blob_builder_begin_section (builder,
+                                                    token->token_section.name);
+          _renderer_flatten_template (builder, token->token_section.section);
+          eknr_template_blob_builder_end_section (builder);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
     }
-
-  return g_variant_get_string (value_v, NULL);
 }
 
-/**
- * maybe_escape_value:
- * @value: The string to escape
- * @is_escaped: Whether or not to apply escaping
- *
- * Based on what mustache.js does to escape HTML.
- *
- * Returns: (transfer full): an escaped value.
- */
-static char *
-maybe_escape_value (const char     *value,
-                    gboolean        is_escaped)
-{
-  if (!is_escaped)
-    return g_strdup (value);
-
-  return g_markup_escape_text (value, -1);
-}
+/* mustache_c does not promise that its parser is reentrant, so only
+ * compile one template at a time. Compiling is rare compared to
+ * rendering, which does not need the lock. */
+static GMutex compile_lock;
 
-static uintmax_t
-_renderer_var_from_ht (mustache_api_t            *api,
-                       void                      *userdata,
-                       mustache_token_variable_t *token)
+static EknrTemplateBlob *
+_renderer_compile_template (const char  *tmpl_text,
+                            gsize        length,
+                            guint64      source_hash,
+                            GError     **error)
 {
-  RendererMustacheData *data = userdata;
-  const char *value = NULL;
-  g_autofree char *maybe_escaped_value = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(RendererMustacheData) data = renderer_mustache_data_new (&local_error,
+                                                                     tmpl_text);
+  g_autoptr(mustache_template_t) tmpl = NULL;
+  g_autoptr(EknrTemplateBlobBuilder) builder = eknr_template_blob_builder_new ();
+  g_autoptr(GBytes) bytes = NULL;
 
-  /* First, if we're in a section in the value is ".", then we
-   * need to replace it with the section name. */
-  if (data->section_variable != NULL && token->text[0] == '.')
-    value = data->section_variable;
-  else
-    value = _lookup_in_gvariant_dict (data, token->text, api);
+  g_mutex_lock (&compile_lock);
+  tmpl = mustache_compile (&_renderer_mustache_data_vfuncs, data);
+  g_mutex_unlock (&compile_lock);
 
-  if (value == NULL)
-    return 0;
+  /* mustache_c returns NULL for an empty template as well as on
+   * errors, so only the error tells them apart */
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return NULL;
+    }
 
-  /* Take ownership here */
-  maybe_escaped_value = maybe_escape_value (value,
-                                            token->escaped == 1);
+  _renderer_flatten_template (builder, tmpl);
+  bytes = eknr_template_blob_builder_end (g_steal_pointer (&builder),
+                                          source_hash,
+                                          length);
 
-  (*api->write) (api,
-                 userdata,
-                 maybe_escaped_value,
-                 strlen (maybe_escaped_value));
-  return 1;
+  return eknr_template_blob_new (bytes, error);
 }
 
-static uintmax_t
-_renderer_strv_sect_from_ht (mustache_api_t           *api,
-                             void                     *userdata,
-                             mustache_token_section_t *token,
-                             GVariant                 *variant)
+/* The most space that saved compiled templates may take up; beyond
+ * that, the least recently used ones are deleted */
+#define TEMPLATE_BLOB_DIR_MAX_BYTES (8 * 1024 * 1024)
+
+/* An EknrTemplateCacheCompileFunc for the renderer's template cache.
+ * Compiled templates are also saved in @user_data, the directory of
+ * compiled templates, and are used from there without compiling them
+ * again by the next renderer that loads the same template, whichever
+ * process it is in. */
+static gpointer
+_renderer_compile_cached_template (const char  *contents,
+                                   gsize        length,
+                                   gsize       *out_compiled_size,
+                                   gpointer     user_data,
+                                   GError     **error)
 {
-  RendererMustacheData *data = userdata;
-  g_autofree const char **strv = g_variant_get_strv (variant, NULL);
-  const char **iter = strv;
+  const char *blob_dir = user_data;
+  guint64 source_hash = eknr_hash_bytes (contents, length);
+  g_autoptr(GError) local_error = NULL;
+  EknrTemplateBlob *blob = eknr_template_blob_load (blob_dir,
+                                                    source_hash,
+                                                    length,
+                                                    &local_error);
+
+  if (blob != NULL)
+    {
+      *out_compiled_size = g_bytes_get_size (eknr_template_blob_get_bytes (blob));
+      return blob;
+    }
 
-  /* Keep track of the current section variable, then pop it once we're
-   * done */
-  const char *last_section_variable = data->section_variable;
+  if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    g_debug ("Not using saved compiled template: %s", local_error->message);
+  g_clear_error (&local_error);
 
-  /* Need to render each sub-template from here */
-  for (; *iter != NULL; ++iter)
-    {
-      data->section_variable = *iter;
+  blob = _renderer_compile_template (contents, length, source_hash, error);
+  if (blob == NULL)
+    return NULL;
 
-      if (!mustache_render (api, userdata, token->section))
-        {
-          data->section_variable = last_section_variable;
-          return 0;
-        }
-    }
+  if (!eknr_template_blob_save (blob, blob_dir, TEMPLATE_BLOB_DIR_MAX_BYTES, &local_error))
+    g_debug ("Could not save compiled template: %s", local_error->message);
 
-  data->section_variable = last_section_variable;
-  return 1;
+  *out_compiled_size = g_bytes_get_size (eknr_template_blob_get_bytes (blob));
+  return blob;
 }
 
-static uintmax_t
-_renderer_bool_sect_from_ht (mustache_api_t           *api,
-                             void                     *userdata,
-                             mustache_token_section_t *token,
-                             GVariant                 *variant)
+static gboolean
+write_to_string (gpointer                 user_data,
+                 const char              *buffer,
+                 gsize                    length,
+                 G_GNUC_UNUSED GError   **error)
 {
-  /* Need to render each sub-template from here */
-  if (g_variant_get_boolean (variant))
-    return mustache_render (api, userdata, token->section);
+  GString *output = user_data;
 
-  /* Nothing to do */
-  return 1;
+  g_string_append_len (output, buffer, length);
+  return TRUE;
 }
 
-static uintmax_t
-_renderer_str_sect_from_ht (mustache_api_t           *api,
-                            void                     *userdata,
-                            mustache_token_section_t *token,
-                            GVariant                 *variant)
+static char *
+_renderer_render_mustache_document_internal (EknrTemplateBlob   *blob,
+                                             GVariant           *variables,
+                                             EknrRenderProfile  *profile,
+                                             GError            **error)
 {
-  RendererMustacheData *data = userdata;
-  uintmax_t rv = 0;
-  const char *last_section_variable = data->section_variable;
+  g_autoptr(EknrTemplateContext) context = eknr_template_context_new (variables);
+  g_autoptr(GString) output = NULL;
 
-  data->section_variable = g_variant_get_string (variant, NULL);
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_VARIABLES,
+                            variables != NULL ? g_variant_get_size (variables) : 0);
 
-  /* Need to render each sub-template from here */
-  rv = mustache_render (api, userdata, token->section);
+  output = g_string_sized_new (eknr_template_blob_get_source_length (blob));
+  if (!eknr_template_blob_render (blob, context, write_to_string, output, error))
+    return NULL;
 
-  data->section_variable = last_section_variable;
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_SUBSTITUTE, output->len);
 
-  return rv;
+  return g_string_free (g_steal_pointer (&output), FALSE);
 }
 
-static uintmax_t
-_renderer_section_from_ht_variant (GVariant                 *variant,
-                                   mustache_api_t           *api,
-                                   void                     *userdata,
-                                   mustache_token_section_t *token)
+/**
+ * eknr_renderer_render_mustache_document_from_file:
+ * @renderer: An #EknrRenderer
+ * @file: A #GFile specifying the location of the template file
+ * @variables: The variables and sections to use when rendering.
+ * @error: A #GError
+ *
+ * Use mustache_c to render a document, similar to
+ * eknr_renderer_render_mustache_document, but read the template
+ * from the file specified at @file. If that file has already been
+ * read, its contents will be read from the internal cache.
+ *
+ * The compiled template is also saved in the user's cache directory,
+ * so that the next time any process renders a template with the same
+ * contents it does not have to be compiled again.
+ *
+ * Returns: (transfer full): The renderered document on success, %NULL on error.
+ */
+char *
+eknr_renderer_render_mustache_document_from_file (EknrRenderer *renderer,
+                                                  GFile        *file,
+                                                  GVariant     *variables,
+                                                  GError      **error)
 {
-  g_autofree char *msg = NULL;
+  EknrRendererPrivate *priv = NULL;
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  char *html = NULL;
 
-  if (g_variant_is_of_type (variant, G_VARIANT_TYPE_STRING_ARRAY))
-    return _renderer_strv_sect_from_ht (api, userdata, token, variant);
-  else if (g_variant_is_of_type (variant, G_VARIANT_TYPE_BOOLEAN))
-    return _renderer_bool_sect_from_ht (api, userdata, token, variant);
-  else if (g_variant_is_of_type (variant, G_VARIANT_TYPE_STRING))
-    return _renderer_str_sect_from_ht (api, userdata, token, variant);
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
 
-  msg = g_strdup_printf ("No handler for section type %s on token %s",
-                         g_variant_get_type_string (variant),
-                         token->name);
-  (*api->error) (api, userdata, __LINE__, msg);
-  return 1;
-}
+  priv = eknr_renderer_get_instance_private (renderer);
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_MUSTACHE);
+  template = eknr_template_cache_lookup (priv->cache, file, error);
 
-static uintmax_t
-_renderer_sect_from_ht (mustache_api_t           *api,
-                        void                     *userdata,
-                        mustache_token_section_t *token)
-{
-  RendererMustacheData *data = userdata;
-  g_autoptr(GVariant) value = g_variant_dict_lookup_value (data->variables,
-                                                           token->name,
-                                                           NULL);
+  if (template == NULL)
+    return NULL;
 
-  if (value == NULL)
-    {
-      g_autofree char *msg = g_strdup_printf ("No such section %s", token->name);
-      (*api->error) (api, data, __LINE__, msg);
-      return 0;
-    }
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_TEMPLATE, template->source_length);
 
-  if (!_renderer_section_from_ht_variant (value, api, userdata, token))
-    return 0;
+  /* We hold our own reference on the compiled template while rendering
+   * with it, so it stays valid whatever happens to the cache meanwhile */
+  html = _renderer_render_mustache_document_internal (template->compiled,
+                                                      variables,
+                                                      profile,
+                                                      error);
+  if (html != NULL)
+    _renderer_finish_profile (renderer, g_steal_pointer (&profile));
 
-  return 1;
+  return html;
 }
 
+typedef struct _RenderFromFileData {
+  GVariant *variables;
+  EknrRenderProfile *profile;
+} RenderFromFileData;
+
 static void
-_renderer_set_error (G_GNUC_UNUSED mustache_api_t *api,
-                     void                         *userdata,
-                     uintmax_t                     lineno,
-                     const char                   *msg)
+render_from_file_data_free (RenderFromFileData *data)
 {
-  RendererMustacheData *data = userdata;
-
-  g_set_error (data->error,
-               EKNR_ERROR,
-               EKNR_ERROR_SUBSTITUTION_FAILED,
-               "Failed to perform template substitution: %s (at line %lu)",
-               msg,
-               lineno);
+  g_clear_pointer (&data->variables, g_variant_unref);
+  g_clear_pointer (&data->profile, eknr_render_profile_free);
+  g_free (data);
 }
 
-static mustache_api_t _renderer_mustache_data_vfuncs = {
-  .read = &_renderer_read_from_closure,
-  .write = &_renderer_write_to_closure,
-  .varget = &_renderer_var_from_ht,
-  .sectget = &_renderer_sect_from_ht,
-  .error = &_renderer_set_error
-};
-
-static char *
-_renderer_render_mustache_document_internal (mustache_template_t  *tmpl,
-                                             GVariant             *variables,
-                                             GError              **error)
+static void
+on_template_looked_up (G_GNUC_UNUSED GObject *source_object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
 {
-  g_autoptr(GVariantDict) variables_dict = g_variant_dict_new (variables);
-  g_autoptr(RendererMustacheData) data = renderer_mustache_data_new (variables_dict,
-                                                                     error,
-                                                                     NULL);
+  g_autoptr(GTask) task = user_data;
+  EknrRenderer *renderer = g_task_get_source_object (task);
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+  RenderFromFileData *data = g_task_get_task_data (task);
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  g_autoptr(GError) local_error = NULL;
+  char *html;
 
-  if (!mustache_render (&_renderer_mustache_data_vfuncs, data, tmpl))
-    return NULL;
+  template = eknr_template_cache_lookup_finish (priv->cache, result, &local_error);
+  if (template == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  /* This includes any time spent waiting for the main loop */
+  EKNR_RENDER_PROFILE_MARK (data->profile, EKNR_RENDER_STAGE_TEMPLATE,
+                            template->source_length);
+
+  html = _renderer_render_mustache_document_internal (template->compiled,
+                                                      data->variables,
+                                                      data->profile,
+                                                      &local_error);
+  if (html == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
 
-  return g_steal_pointer (&data->output.string);
+  _renderer_finish_profile (renderer, g_steal_pointer (&data->profile));
+  g_task_return_pointer (task, html, g_free);
 }
 
 /**
- * eknr_renderer_render_mustache_document_from_file:
+ * eknr_renderer_render_mustache_document_from_file_async:
  * @renderer: An #EknrRenderer
  * @file: A #GFile specifying the location of the template file
  * @variables: The variables and sections to use when rendering.
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: A #GAsyncReadyCallback to call when the document is rendered
+ * @user_data: Data to pass to @callback
+ *
+ * Asynchronous version of
+ * eknr_renderer_render_mustache_document_from_file(). If the template
+ * is not in the cache yet, it is read without blocking and compiled in
+ * a worker thread. If the same template is asked for again while it is
+ * still being read, the second request waits for the first one's read
+ * rather than starting another.
+ */
+void
+eknr_renderer_render_mustache_document_from_file_async (EknrRenderer        *renderer,
+                                                        GFile               *file,
+                                                        GVariant            *variables,
+                                                        GCancellable        *cancellable,
+                                                        GAsyncReadyCallback  callback,
+                                                        gpointer             user_data)
+{
+  EknrRendererPrivate *priv = NULL;
+  GTask *task = NULL;
+  RenderFromFileData *data = NULL;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (G_IS_FILE (file));
+
+  priv = eknr_renderer_get_instance_private (renderer);
+
+  task = g_task_new (renderer, cancellable, callback, user_data);
+  g_task_set_source_tag (task, eknr_renderer_render_mustache_document_from_file_async);
+
+  data = g_new0 (RenderFromFileData, 1);
+  data->variables = variables != NULL ? g_variant_ref_sink (variables) : NULL;
+  data->profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_MUSTACHE);
+  g_task_set_task_data (task, data, (GDestroyNotify) render_from_file_data_free);
+
+  /* The task keeps the renderer, and so the cache, alive until the
+   * lookup finishes */
+  eknr_template_cache_lookup_async (priv->cache,
+                                    file,
+                                    cancellable,
+                                    on_template_looked_up,
+                                    task);
+}
+
+/**
+ * eknr_renderer_render_mustache_document_from_file_finish:
+ * @renderer: An #EknrRenderer
+ * @result: A #GAsyncResult
  * @error: A #GError
  *
- * Use mustache_c to render a document, similar to
- * eknr_renderer_render_mustache_document, but read the template
- * from the file specified at @file. If that file has already been
- * read, its contents will be read from the internal cache.
+ * Finish an operation started with
+ * eknr_renderer_render_mustache_document_from_file_async().
  *
  * Returns: (transfer full): The renderered document on success, %NULL on error.
  */
 char *
-eknr_renderer_render_mustache_document_from_file (EknrRenderer *renderer,
-                                                  GFile        *file,
-                                                  GVariant     *variables,
-                                                  GError      **error)
+eknr_renderer_render_mustache_document_from_file_finish (EknrRenderer  *renderer,
+                                                         GAsyncResult  *result,
+                                                         GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, renderer), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+typedef struct _PreloadTemplatesData {
+  guint n_pending;
+  GError *error; /* the first error */
+} PreloadTemplatesData;
+
+static void
+preload_templates_data_free (PreloadTemplatesData *data)
+{
+  g_clear_error (&data->error);
+  g_free (data);
+}
+
+static void
+on_template_preloaded (G_GNUC_UNUSED GObject *source_object,
+                       GAsyncResult          *result,
+                       gpointer               user_data)
 {
-  g_autofree char *uri = g_file_get_uri (file);
+  g_autoptr(GTask) task = user_data;
+  EknrRenderer *renderer = g_task_get_source_object (task);
   EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
-  mustache_template_t *tmpl = g_hash_table_lookup (priv->cache, uri);
-  g_autofree char *contents = NULL;
-  g_autoptr(RendererMustacheData) data = NULL;
+  PreloadTemplatesData *data = g_task_get_task_data (task);
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  g_autoptr(GError) local_error = NULL;
 
-  if (tmpl != NULL)
-    return _renderer_render_mustache_document_internal (tmpl, variables, error);
+  template = eknr_template_cache_lookup_finish (priv->cache, result, &local_error);
+  if (template == NULL && data->error == NULL)
+    data->error = g_steal_pointer (&local_error);
 
-  if (!g_file_load_contents (file, NULL, &contents, NULL, NULL, error))
-    return NULL;
+  if (--data->n_pending > 0)
+    return;
 
-  data = renderer_mustache_data_new (NULL,
-                                     error,
-                                     contents);
-  tmpl = mustache_compile (&_renderer_mustache_data_vfuncs, data);
+  if (data->error != NULL)
+    g_task_return_error (task, g_steal_pointer (&data->error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
 
-  if (tmpl == NULL)
-    return NULL;
+/**
+ * eknr_renderer_preload_templates_async:
+ * @renderer: An #EknrRenderer
+ * @files: (element-type GFile): The mustache template files to load
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: A #GAsyncReadyCallback to call when all of @files are loaded
+ * @user_data: Data to pass to @callback
+ *
+ * Load and compile templates into the renderer's template cache ahead
+ * of time, for example at startup, so that the first
+ * eknr_renderer_render_mustache_document_from_file() of each of them
+ * does not have to wait. Files are read without blocking and compiled
+ * in worker threads, as with
+ * eknr_renderer_render_mustache_document_from_file_async().
+ */
+void
+eknr_renderer_preload_templates_async (EknrRenderer        *renderer,
+                                       GPtrArray           *files,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  EknrRendererPrivate *priv = NULL;
+  g_autoptr(GTask) task = NULL;
+  PreloadTemplatesData *data = NULL;
+  guint i;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (files != NULL);
+
+  priv = eknr_renderer_get_instance_private (renderer);
+
+  task = g_task_new (renderer, cancellable, callback, user_data);
+  g_task_set_source_tag (task, eknr_renderer_preload_templates_async);
+
+  if (files->len == 0)
+    {
+      g_task_return_boolean (task, TRUE);
+      return;
+    }
+
+  data = g_new0 (PreloadTemplatesData, 1);
+  data->n_pending = files->len;
+  g_task_set_task_data (task, data, (GDestroyNotify) preload_templates_data_free);
+
+  for (i = 0; i < files->len; ++i)
+    eknr_template_cache_lookup_async (priv->cache,
+                                      g_ptr_array_index (files, i),
+                                      cancellable,
+                                      on_template_preloaded,
+                                      g_object_ref (task));
+}
 
-  g_hash_table_replace (priv->cache, g_steal_pointer (&uri), tmpl);
+/**
+ * eknr_renderer_preload_templates_finish:
+ * @renderer: An #EknrRenderer
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish an operation started with
+ * eknr_renderer_preload_templates_async(). If some templates could not
+ * be loaded, the others are still in the cache.
+ *
+ * Returns: %TRUE if every template was loaded, %FALSE with @error set
+ *   to the first error otherwise.
+ */
+gboolean
+eknr_renderer_preload_templates_finish (EknrRenderer  *renderer,
+                                        GAsyncResult  *result,
+                                        GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, renderer), FALSE);
 
-  return _renderer_render_mustache_document_internal (tmpl, variables, error);
+  return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 /**
@@ -404,230 +717,601 @@ eknr_renderer_render_mustache_document (EknrRenderer  *renderer,
                                         GVariant      *variables,
                                         GError       **error)
 {
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  g_autoptr(EknrTemplateBlob) blob = NULL;
+  char *html = NULL;
+
   g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
 
-  g_autoptr(GVariantDict) variables_dict = g_variant_dict_new (variables);
-  g_autoptr(RendererMustacheData) data = renderer_mustache_data_new (variables_dict,
-                                                                     error,
-                                                                     tmpl_text);
-  g_autoptr(mustache_template_t) tmpl = mustache_compile (&_renderer_mustache_data_vfuncs,
-                                                          data);
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_MUSTACHE);
+  blob = _renderer_compile_template (tmpl_text, strlen (tmpl_text), 0, error);
 
-  if (!tmpl)
+  if (!blob)
     return NULL;
 
-  return _renderer_render_mustache_document_internal (tmpl, variables, error);
-}
-
-static char *
-format_a_href_link (const char *uri,
-                    const char *text)
-{
-  g_autofree char *escaped = g_markup_escape_text (text, -1);
-
-  if (escaped == NULL)
-    return NULL;
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_TEMPLATE, strlen (tmpl_text));
 
-  return g_strdup_printf ("<a class=\"eos-show-link\" href=\"%s\">%s</a>",
-                          uri,
-                          escaped);
-}
+  html = _renderer_render_mustache_document_internal (blob, variables, profile, error);
+  if (html != NULL)
+    _renderer_finish_profile (renderer, g_steal_pointer (&profile));
 
-static char *
-format_license_link (const char *license)
-{
-  g_autofree char *escaped = g_uri_escape_string (license, NULL, TRUE);
-  g_autofree char *license_link = g_strdup_printf ("license://%s", escaped);
-  return format_a_href_link (license_link,
-                             eos_get_license_display_name (license));
+  return html;
 }
 
-static GVariant *
-get_legacy_disclaimer_section_content (const char   *source,
-                                       const char   *source_name,
-                                       const char   *original_uri,
-                                       const char   *license,
-                                       const char   *title)
+/* Rendered legacy articles go into a buffer of the right size,
+ * measured by rendering once with count_bytes. The measuring pass
+ * writes the body by reference without rewriting it, so it costs next
+ * to nothing; if the body is to be rewritten, room for what the
+ * rewrite can add is left on top, and the body is only tokenized by
+ * the pass that writes it out. That way the output is allocated once
+ * and never moved. A GString would round the allocation up to a power
+ * of two, which for a large body can be nearly twice the size of the
+ * output. */
+typedef struct _RendererBuffer {
+  char *data;
+  gsize length;
+  gsize allocated;
+} RendererBuffer;
+
+static gboolean
+count_bytes (gpointer                  user_data,
+             G_GNUC_UNUSED const char *buffer,
+             gsize                     length,
+             G_GNUC_UNUSED GError    **error)
 {
-  if (g_strcmp0 (source, "wikisource") == 0 ||
-      g_strcmp0 (source, "wikibooks") == 0 ||
-      g_strcmp0 (source, "wikipedia") == 0)
-    {
-      g_autofree char *original_link = format_a_href_link (original_uri,
-                                                           source_name);
-      g_autofree char *license_link = format_license_link (license);
-      g_autofree char *disclaimer = g_strdup_printf (_("This page contains content from %s, available under a %s license."),
-                                                     original_link,
-                                                     license_link);
-
-      return g_variant_new_take_string (g_steal_pointer (&disclaimer));
-    }
-  else if (g_strcmp0 (source, "wikihow") == 0)
-    {
-      g_autofree char *wikihow_article_link = format_a_href_link (original_uri,
-                                                                  title);
-      g_autofree char *wikihow_link = format_a_href_link (_("http://wikihow.com"),
-                                                          "WikiHow");
-      g_autofree char *disclaimer = g_strdup_printf (_("See %s for more details, videos, pictures and attribution. Courtesy of %s, where anyone can easily learn how to do anything."),
-                                                     wikihow_article_link,
-                                                     wikihow_link);
-
-      return g_variant_new_take_string (g_steal_pointer (&disclaimer));
-    }
+  gsize *count = user_data;
 
-  return g_variant_new_boolean (FALSE);
+  *count += length;
+  return TRUE;
 }
 
-static GVariant *
-get_legacy_css_files (const char *source)
+static gboolean
+write_to_buffer (gpointer                user_data,
+                 const char             *buffer,
+                 gsize                   length,
+                 G_GNUC_UNUSED GError  **error)
 {
-  const char * const empty_css_files[] = { NULL };
+  RendererBuffer *output = user_data;
 
-  if (g_strcmp0 (source, "wikisource") == 0 ||
-      g_strcmp0 (source, "wikibooks") == 0 ||
-      g_strcmp0 (source, "wikipedia") == 0)
-    {
-      const char * const css_files[] = {
-        "wikimedia.css",
-        NULL
-      };
-      return g_variant_new_strv (css_files, -1);
-    }
-  else if (g_strcmp0 (source, "wikihow") == 0)
+  /* Only if the measuring pass got it wrong */
+  if (G_UNLIKELY (output->length + length > output->allocated))
     {
-      const char * const css_files[] = {
-        "wikihow.css",
-        NULL
-      };
-      return g_variant_new_strv (css_files, -1);
+      output->allocated = MAX (output->allocated * 2, output->length + length);
+      output->data = g_realloc (output->data, output->allocated + 1);
     }
 
-  return g_variant_new_strv (empty_css_files, -1);
+  memcpy (output->data + output->length, buffer, length);
+  output->length += length;
+  return TRUE;
 }
 
-static GVariant *
-get_legacy_javascript_files (gboolean use_scroll_manager)
+typedef struct _RendererStreamWriter {
+  GOutputStream *stream; /* non-owned */
+  GCancellable  *cancellable; /* non-owned */
+} RendererStreamWriter;
+
+static gboolean
+write_to_stream (gpointer     user_data,
+                 const char  *buffer,
+                 gsize        length,
+                 GError     **error)
 {
-  g_autoptr(GPtrArray) javascript_files = g_ptr_array_new ();
+  RendererStreamWriter *writer = user_data;
+
+  return g_output_stream_write_all (writer->stream,
+                                    buffer,
+                                    length,
+                                    NULL,
+                                    writer->cancellable,
+                                    error);
+}
 
-  g_ptr_array_add (javascript_files, (gpointer) "content-fixes.js");
-  g_ptr_array_add (javascript_files, (gpointer) "hide-broken-images.js");
+/* Only used when profiling, to find out how much was written */
+typedef struct _RendererStreamCounter {
+  RendererStreamWriter *writer;
+  gsize length;
+} RendererStreamCounter;
+
+static gboolean
+write_to_stream_counted (gpointer     user_data,
+                         const char  *buffer,
+                         gsize        length,
+                         GError     **error)
+{
+  RendererStreamCounter *counter = user_data;
 
-  if (use_scroll_manager)
-    g_ptr_array_add (javascript_files, (gpointer) "scroll-manager.js");
+  counter->length += length;
+  return write_to_stream (counter->writer, buffer, length, error);
+}
 
-  /* NULL-terminate */
-  g_ptr_array_add (javascript_files, NULL);
+/* Get the memoized source-specific fragments of a legacy article. This
+ * is also where an unknown source is caught. */
+static EknrLegacyFragments *
+_renderer_lookup_legacy_fragments (EknrRenderer  *renderer,
+                                   const char    *source,
+                                   const char    *source_name,
+                                   const char    *license,
+                                   gboolean       use_scroll_manager,
+                                   GError       **error)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
 
-  return g_variant_new_strv ((const char * const *) javascript_files->pdata, -1);
+  return eknr_legacy_fragments_cache_lookup (priv->legacy_fragments,
+                                             source,
+                                             source_name,
+                                             license,
+                                             use_scroll_manager,
+                                             g_atomic_int_get (&priv->inline_assets),
+                                             error);
 }
 
-static GVariant *
-get_legacy_should_include_mathjax (const char *source)
+/* Fill in everything in @context except the body, including MathJax
+ * only if a body with @features needs it. The disclaimer that @context
+ * points to is allocated from @scratch. */
+static void
+_renderer_init_legacy_context (EknrLegacyArticleTemplateContext *context,
+                               const EknrLegacyFragments        *fragments,
+                               EknrArena                        *scratch,
+                               EknrHtmlBodyFeatures              features,
+                               const char                       *original_uri,
+                               const char                       *title,
+                               gboolean                          show_title,
+                               EknrRenderProfile                *profile)
 {
-  if (g_strcmp0 (source, "wikisource") == 0 ||
-      g_strcmp0 (source, "wikibooks") == 0 ||
-      g_strcmp0 (source, "wikipedia") == 0)
-    return g_variant_new_boolean (TRUE);
-
-  return g_variant_new_boolean (FALSE);
+  const char *disclaimer = eknr_legacy_fragments_format_disclaimer (fragments,
+                                                                    scratch,
+                                                                    original_uri,
+                                                                    title,
+                                                                    &context->disclaimer_length);
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_DISCLAIMER,
+                            context->disclaimer_length);
+
+  context->css_files = fragments->css_files;
+  context->disclaimer = disclaimer;
+  context->include_mathjax = fragments->include_mathjax &&
+                             (features & EKNR_HTML_BODY_HAS_MATH) != 0;
+  context->inline_css = fragments->inline_css;
+  context->inline_javascript = fragments->inline_javascript;
+  context->javascript_files = fragments->javascript_files;
+  context->mathjax_path = MATHJAX_PATH;
+  context->mathjax_path_length = sizeof (MATHJAX_PATH) - 1;
+  context->title = show_title ? title : NULL;
+  context->title_length = show_title && title != NULL ? strlen (title) : 0;
 }
 
-static char *
-regex_substitute (const char   *regex,
-                  const char   *substitution,
-                  const char   *content,
-                  GError      **error)
+/* Point @context at the ids of @headings for the scroll manager to
+ * watch, if it is used. The list is there even if it is empty, since
+ * the scroll manager only runs where it is. The array that @context
+ * points to is allocated from @scratch. */
+static void
+_renderer_init_scroll_headings (EknrLegacyArticleTemplateContext *context,
+                                const EknrLegacyFragments        *fragments,
+                                EknrArena                        *scratch,
+                                const char * const               *headings)
 {
-  g_autoptr(GRegex) regex_compiled = g_regex_new (regex, 0, 0, error);
+  static const char * const no_headings[] = { NULL };
 
-  if (regex == NULL)
-    return NULL;
+  if (!fragments->use_scroll_manager)
+    return;
+
+  if (headings == NULL)
+    headings = no_headings;
 
-  return g_regex_replace (regex_compiled,
-                          content,
-                          -1,
-                          0,
-                          substitution,
-                          0,
-                          error);
+  context->scroll_manager_headings =
+    eknr_html_format_script_strings (scratch,
+                                     headings,
+                                     &context->scroll_manager_headings_length);
 }
 
-static char *
-strip_body_tags (const char  *html,
-                 GError     **error)
+/* Passes everything through to another writer, rewriting the body on
+ * the way. The body is recognized by its address, as in
+ * write_to_segments(). */
+typedef struct _RendererBodyRewriter {
+  const char *body; /* non-owned */
+  gsize body_length;
+  EknrHtmlBodyFeatures features;
+  EknrTemplateWriteFunc write;
+  gpointer user_data;
+} RendererBodyRewriter;
+
+static gboolean
+write_rewriting_body (gpointer     user_data,
+                      const char  *buffer,
+                      gsize        length,
+                      GError     **error)
 {
-  g_autofree char *stripped_start_tags = regex_substitute ("^\\s*<html>\\s*<body>",
-                                                            "",
-                                                            html,
-                                                            error);
+  RendererBodyRewriter *rewriter = user_data;
+
+  if (buffer == rewriter->body && length == rewriter->body_length)
+    return eknr_html_rewrite_body (buffer,
+                                   length,
+                                   rewriter->features,
+                                   NULL,
+                                   rewriter->write,
+                                   rewriter->user_data,
+                                   error);
+
+  return rewriter->write (rewriter->user_data, buffer, length, error);
+}
 
-  if (stripped_start_tags == NULL)
-    return NULL;
+/* Render the legacy article template, rewriting the body if it has
+ * @features that call for it */
+static gboolean
+_renderer_render_legacy_template (const EknrLegacyArticleTemplateContext  *context,
+                                  EknrHtmlBodyFeatures                     features,
+                                  EknrTemplateWriteFunc                    write,
+                                  gpointer                                 user_data,
+                                  GError                                 **error)
+{
+  RendererBodyRewriter rewriter = {
+    context->body_html,
+    context->body_html_length,
+    features,
+    write,
+    user_data
+  };
 
-  return regex_substitute ("<\\/body>\\s*<\\/html>\\s*$",
-                           "",
-                           stripped_start_tags,
-                           error);
+  if ((features & EKNR_HTML_BODY_REWRITTEN_FEATURES) == 0)
+    return eknr_legacy_article_template_render (context, write, user_data, error);
+
+  return eknr_legacy_article_template_render (context,
+                                              write_rewriting_body,
+                                              &rewriter,
+                                              error);
 }
 
-static GFile *
-template_file (const char *filename)
+/* Render a legacy article. If @stream is non-%NULL, the output is
+ * written to it as it is produced, otherwise it is returned in
+ * @out_html and its length in @out_length. Everything about the
+ * article that does not depend on the article itself comes from
+ * @fragments.
+ *
+ * @body_html is never copied; it is written to the output straight
+ * from the caller's buffer. @body_length may be -1 if it is
+ * nul-terminated.
+ *
+ * The stages of the render are marked in @profile, if it is non-%NULL.
+ * Everything that only lasts as long as the render is allocated from
+ * @scratch, so the only allocation that a render to a string makes
+ * otherwise is the output.
+ *
+ * This does not touch the renderer, so it is safe to call from a worker
+ * thread. */
+static gboolean
+_renderer_render_legacy_content (const EknrLegacyFragments  *fragments,
+                                 EknrArena                  *scratch,
+                                 GOutputStream              *stream,
+                                 GCancellable               *cancellable,
+                                 const char                 *body_html,
+                                 gssize                      body_length,
+                                 const char                 *original_uri,
+                                 const char                 *title,
+                                 gboolean                    show_title,
+                                 EknrRenderProfile          *profile,
+                                 char                      **out_html,
+                                 gsize                      *out_length,
+                                 GError                    **error)
 {
-  g_autofree char *uri = g_strdup_printf ("resource:///com/endlessm/knowledge/data/templates/%s", filename);
-  return g_file_new_for_uri (uri);
-}
+  EknrLegacyArticleTemplateContext context = { 0 };
+  EknrHtmlBodyFeatures features;
+  const char **headings = NULL;
+  RendererStreamWriter stream_writer = { stream, cancellable };
+  RendererBuffer output = { NULL, 0, 0 };
+
+  context.body_html = eknr_html_strip_body_tags (body_html,
+                                                 body_length,
+                                                 &context.body_html_length);
+  features = eknr_html_scan_body (context.body_html, context.body_html_length);
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_STRIP_BODY,
+                            context.body_html_length);
+
+  _renderer_init_legacy_context (&context,
+                                 fragments,
+                                 scratch,
+                                 features,
+                                 original_uri,
+                                 title,
+                                 show_title,
+                                 profile);
+
+  if (fragments->use_scroll_manager && (features & EKNR_HTML_BODY_HAS_HEADINGS) != 0)
+    headings = eknr_html_collect_headings (scratch,
+                                           context.body_html,
+                                           context.body_html_length);
+  _renderer_init_scroll_headings (&context,
+                                  fragments,
+                                  scratch,
+                                  (const char * const *) headings);
+
+  if (stream != NULL)
+    {
+      RendererStreamCounter counter = { &stream_writer, 0 };
+
+      if (G_LIKELY (profile == NULL))
+        return _renderer_render_legacy_template (&context,
+                                                 features,
+                                                 write_to_stream,
+                                                 &stream_writer,
+                                                 error);
+
+      if (!_renderer_render_legacy_template (&context,
+                                             features,
+                                             write_to_stream_counted,
+                                             &counter,
+                                             error))
+        return FALSE;
+
+      EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_SUBSTITUTE, counter.length);
+      return TRUE;
+    }
 
-static char *
-_renderer_render_legacy_content (EknrRenderer *renderer,
-                                 const char   *body_html,
-                                 const char   *source,
-                                 const char   *source_name,
-                                 const char   *original_uri,
-                                 const char   *license,
-                                 const char   *title,
-                                 gboolean      show_title,
-                                 gboolean      use_scroll_manager,
-                                 GError      **error)
-{
-  g_autoptr(GFile) file = template_file ("legacy-article.mst");
-  g_autofree char *stripped_body = strip_body_tags (body_html, error);
-  GVariantDict vardict;
-  g_autoptr(GVariant) variant = NULL;
-  GVariant *disclaimer = NULL; /* floating */
-
-  if (stripped_body == NULL)
-    return NULL;
+  if (!eknr_legacy_article_template_render (&context,
+                                            count_bytes,
+                                            &output.allocated,
+                                            error))
+    return FALSE;
+
+  if ((features & EKNR_HTML_BODY_REWRITTEN_FEATURES) != 0)
+    output.allocated += eknr_html_rewrite_max_growth (context.body_html,
+                                                      context.body_html_length,
+                                                      features);
 
-  disclaimer = get_legacy_disclaimer_section_content (source,
-                                                      source_name,
-                                                      original_uri,
-                                                      license,
-                                                      title);
+  output.data = g_malloc (output.allocated + 1);
+
+  if (!_renderer_render_legacy_template (&context,
+                                         features,
+                                         write_to_buffer,
+                                         &output,
+                                         error))
+    {
+      g_free (output.data);
+      return FALSE;
+    }
 
-  g_variant_dict_init (&vardict, NULL);
+  output.data[output.length] = '\0';
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_SUBSTITUTE, output.length);
 
-  g_variant_dict_insert_value (&vardict,
-                               "title",
-                               show_title ? g_variant_new_string (title) : g_variant_new_boolean (FALSE));
-  g_variant_dict_insert_value (&vardict, "body-html", g_variant_new_take_string (g_steal_pointer (&stripped_body)));
-  g_variant_dict_insert_value (&vardict, "disclaimer", disclaimer);
-  g_variant_dict_insert_value (&vardict, "copy-button-text", g_variant_new_string (_("Copy")));
-  g_variant_dict_insert_value (&vardict, "css-files", get_legacy_css_files (source));
-  g_variant_dict_insert_value (&vardict, "javascript-files", get_legacy_javascript_files (use_scroll_manager));
-  g_variant_dict_insert_value (&vardict, "include-mathjax", get_legacy_should_include_mathjax (source));
-  g_variant_dict_insert_value (&vardict, "mathjax-path", g_variant_new_string (MATHJAX_PATH));
+  if (out_length != NULL)
+    *out_length = output.length;
 
-  variant = g_variant_dict_end (&vardict);
+  if (out_html != NULL)
+    *out_html = output.data;
+  else
+    g_free (output.data);
 
-  return eknr_renderer_render_mustache_document_from_file (renderer,
-                                                           file,
-                                                           variant,
-                                                           error);
+  return TRUE;
 }
 
-/**
- * eknr_renderer_render_content:
+/* Splits a rendered legacy article around its body. The body is
+ * recognized by its address, since the template writes it straight
+ * from the context in a single write. */
+typedef struct _RendererSegmentWriter {
+  const char *body; /* non-owned */
+  gsize body_length;
+  gboolean after_body;
+  GString *head;
+  GString *tail;
+} RendererSegmentWriter;
+
+static gboolean
+write_to_segments (gpointer                user_data,
+                   const char             *buffer,
+                   gsize                   length,
+                   G_GNUC_UNUSED GError  **error)
+{
+  RendererSegmentWriter *writer = user_data;
+
+  if (!writer->after_body && buffer == writer->body && length == writer->body_length)
+    {
+      writer->after_body = TRUE;
+      return TRUE;
+    }
+
+  g_string_append_len (writer->after_body ? writer->tail : writer->head,
+                       buffer,
+                       length);
+  return TRUE;
+}
+
+/* Render the parts of a legacy article on either side of @body, which
+ * has already had its surrounding tags stripped and been found to have
+ * @features and @headings. Like _renderer_render_legacy_content(), this
+ * is safe to call from any thread, and allocates what it only needs for
+ * the render from @scratch. */
+static EknrRenderedArticle *
+_renderer_render_legacy_segments (const EknrLegacyFragments  *fragments,
+                                  EknrArena                  *scratch,
+                                  GBytes                     *body,
+                                  EknrHtmlBodyFeatures        features,
+                                  const char * const         *headings,
+                                  const char                 *source,
+                                  const char                 *source_name,
+                                  const char                 *original_uri,
+                                  const char                 *license,
+                                  const char                 *title,
+                                  EknrRenderFlags             flags,
+                                  EknrRenderProfile          *profile,
+                                  GError                    **error)
+{
+  EknrLegacyArticleTemplateContext context = { 0 };
+  RendererSegmentWriter writer = { NULL, 0, FALSE, NULL, NULL };
+  g_autoptr(GString) head = g_string_new (NULL);
+  g_autoptr(GString) tail = g_string_new (NULL);
+  g_autoptr(GBytes) head_bytes = NULL;
+  g_autoptr(GBytes) tail_bytes = NULL;
+  gsize head_length, tail_length;
+
+  context.body_html = g_bytes_get_data (body, &context.body_html_length);
+  _renderer_init_legacy_context (&context,
+                                 fragments,
+                                 scratch,
+                                 features,
+                                 original_uri,
+                                 title,
+                                 (flags & EKNR_RENDER_FLAGS_SHOW_TITLE) != 0,
+                                 profile);
+  _renderer_init_scroll_headings (&context, fragments, scratch, headings);
+
+  /* An empty GBytes may have no data at all */
+  if (context.body_html == NULL)
+    context.body_html = "";
+
+  writer.body = context.body_html;
+  writer.body_length = context.body_html_length;
+  writer.head = head;
+  writer.tail = tail;
+
+  if (!eknr_legacy_article_template_render (&context,
+                                            write_to_segments,
+                                            &writer,
+                                            error))
+    return NULL;
+
+  head_length = head->len;
+  tail_length = tail->len;
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_SUBSTITUTE,
+                            head_length + tail_length);
+
+  head_bytes = g_bytes_new_take (g_string_free (g_steal_pointer (&head), FALSE),
+                                 head_length);
+  tail_bytes = g_bytes_new_take (g_string_free (g_steal_pointer (&tail), FALSE),
+                                 tail_length);
+
+  return eknr_rendered_article_new (head_bytes,
+                                    body,
+                                    tail_bytes,
+                                    features,
+                                    headings,
+                                    source,
+                                    source_name,
+                                    original_uri,
+                                    license,
+                                    title,
+                                    flags);
+}
+
+/* Distinguishes articles rendered with inlined assets in the render
+ * cache, past the bits of #EknrRenderFlags */
+#define RENDER_CACHE_INLINE_ASSETS (1u << 31)
+
+static EknrRenderFlags
+render_flags (gboolean show_title,
+              gboolean use_scroll_manager)
+{
+  return (show_title ? EKNR_RENDER_FLAGS_SHOW_TITLE : 0) |
+         (use_scroll_manager ? EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER : 0);
+}
+
+/* Render legacy content to a string, going through the renderer's cache
+ * of rendered articles if it is turned on. This is safe to call from
+ * any thread. */
+static char *
+_renderer_render_legacy_content_cached (EknrRenderer  *renderer,
+                                        GCancellable  *cancellable,
+                                        const char    *body_html,
+                                        const char    *source,
+                                        const char    *source_name,
+                                        const char    *original_uri,
+                                        const char    *license,
+                                        const char    *title,
+                                        gboolean       show_title,
+                                        gboolean       use_scroll_manager,
+                                        GError       **error)
+{
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (renderer);
+  gboolean use_cache = eknr_render_cache_get_max_bytes (priv->render_cache) > 0;
+  g_autoptr(EknrLegacyFragments) fragments = NULL;
+  EknrRenderCacheKey key;
+  guint generation;
+  gssize body_length = -1;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  EknrArena *scratch;
+  char *html = NULL;
+  gsize html_length;
+  gboolean rendered;
+
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_LEGACY);
+
+  /* Read before the fragments, so that if a source is registered after
+   * they are looked up, this render is not inserted into the cache */
+  generation = eknr_render_cache_get_generation (priv->render_cache);
+  fragments = _renderer_lookup_legacy_fragments (renderer,
+                                                 source,
+                                                 source_name,
+                                                 license,
+                                                 use_scroll_manager,
+                                                 error);
+  if (fragments == NULL)
+    return NULL;
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_FRAGMENTS, 0);
+
+  if (use_cache)
+    {
+      g_autoptr(GBytes) cached = NULL;
+
+      eknr_render_cache_key_init (&key,
+                                  body_html,
+                                  source,
+                                  source_name,
+                                  original_uri,
+                                  license,
+                                  title,
+                                  fragments->messages_locale,
+                                  fragments->language,
+                                  render_flags (show_title, use_scroll_manager) |
+                                  (fragments->inline_assets ? RENDER_CACHE_INLINE_ASSETS : 0));
+      cached = eknr_render_cache_lookup (priv->render_cache, &key);
+      body_length = key.body_length;
+
+      if (cached != NULL)
+        {
+          gsize size;
+          const char *data = g_bytes_get_data (cached, &size);
+
+          html = g_malloc (size);
+          memcpy (html, data, size);
+
+          EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_RENDER_CACHE, size);
+          _renderer_finish_profile (renderer, g_steal_pointer (&profile));
+          return html;
+        }
+
+      EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_RENDER_CACHE, 0);
+    }
+
+  scratch = _renderer_take_scratch (renderer);
+  rendered = _renderer_render_legacy_content (fragments,
+                                              scratch,
+                                              NULL,
+                                              cancellable,
+                                              body_html,
+                                              body_length,
+                                              original_uri,
+                                              title,
+                                              show_title,
+                                              profile,
+                                              &html,
+                                              &html_length,
+                                              error);
+  _renderer_return_scratch (renderer, scratch);
+
+  if (!rendered)
+    return NULL;
+
+  if (use_cache)
+    {
+      eknr_render_cache_insert (priv->render_cache, &key, html, html_length, generation);
+      EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_RENDER_CACHE, html_length);
+    }
+
+  _renderer_finish_profile (renderer, g_steal_pointer (&profile));
+  return html;
+}
+
+/**
+ * eknr_renderer_render_content:
  * @renderer: An #EknrRenderer
  * @body_html: The underlying HTML body
  * @source: Where this content came from
@@ -641,6 +1325,9 @@ _renderer_render_legacy_content (EknrRenderer *renderer,
  *
  * Render the content and return the rendered content.
  *
+ * If #EknrRenderer:render-cache-max-bytes is set, the result is taken
+ * from or added to the renderer's cache of rendered articles.
+ *
  * Returns: (transfer full): A string of rendered HTML or %NULL on error.
  */
 char *
@@ -657,28 +1344,1031 @@ eknr_renderer_render_legacy_content (EknrRenderer *renderer,
 {
   g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
 
-  if (g_strcmp0 (source, "wikipedia") == 0 ||
-      g_strcmp0 (source, "wikihow") == 0 ||
-      g_strcmp0 (source, "wikisource") == 0 ||
-      g_strcmp0 (source, "wikibooks") == 0)
-    return _renderer_render_legacy_content (renderer,
-                                            body_html,
-                                            source,
-                                            source_name,
-                                            original_uri,
-                                            license,
-                                            title,
-                                            show_title,
-                                            use_scroll_manager,
-                                            error);
-
-  g_set_error (error,
-               EKNR_ERROR,
-               EKNR_ERROR_UNKNOWN_LEGACY_SOURCE,
-               "Attempted to legacy-render HTML, but no renderer exists for %s",
-               source);
+  return _renderer_render_legacy_content_cached (renderer,
+                                                 NULL,
+                                                 body_html,
+                                                 source,
+                                                 source_name,
+                                                 original_uri,
+                                                 license,
+                                                 title,
+                                                 show_title,
+                                                 use_scroll_manager,
+                                                 error);
+}
 
-  return NULL;
+/**
+ * eknr_renderer_render_legacy_content_to_stream:
+ * @renderer: An #EknrRenderer
+ * @stream: A #GOutputStream to write the rendered content to
+ * @body_html: The underlying HTML body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @show_title: %TRUE if the article title should be rendered out too.
+ * @use_scroll_manager: %TRUE if the scroll manager should be used, %FALSE otherwise
+ * @cancellable: (nullable): A #GCancellable
+ * @error: A #GError
+ *
+ * Like eknr_renderer_render_legacy_content(), but write the rendered
+ * content to @stream as it is produced instead of building up a string.
+ * The article body is written straight from @body_html without being
+ * copied.
+ *
+ * The output is written in many small pieces, so consider wrapping
+ * @stream in a #GBufferedOutputStream if writes to it are expensive.
+ * @stream is not closed.
+ *
+ * Returns: %TRUE on success, %FALSE on error.
+ */
+gboolean
+eknr_renderer_render_legacy_content_to_stream (EknrRenderer  *renderer,
+                                               GOutputStream *stream,
+                                               const char    *body_html,
+                                               const char    *source,
+                                               const char    *source_name,
+                                               const char    *original_uri,
+                                               const char    *license,
+                                               const char    *title,
+                                               gboolean       show_title,
+                                               gboolean       use_scroll_manager,
+                                               GCancellable  *cancellable,
+                                               GError       **error)
+{
+  g_autoptr(EknrLegacyFragments) fragments = NULL;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  EknrArena *scratch;
+  gboolean rendered;
+
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), FALSE);
+  g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_LEGACY);
+  fragments = _renderer_lookup_legacy_fragments (renderer,
+                                                 source,
+                                                 source_name,
+                                                 license,
+                                                 use_scroll_manager,
+                                                 error);
+  if (fragments == NULL)
+    return FALSE;
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_FRAGMENTS, 0);
+
+  scratch = _renderer_take_scratch (renderer);
+  rendered = _renderer_render_legacy_content (fragments,
+                                              scratch,
+                                              stream,
+                                              cancellable,
+                                              body_html,
+                                              -1,
+                                              original_uri,
+                                              title,
+                                              show_title,
+                                              profile,
+                                              NULL,
+                                              NULL,
+                                              error);
+  _renderer_return_scratch (renderer, scratch);
+
+  if (!rendered)
+    return FALSE;
+
+  _renderer_finish_profile (renderer, g_steal_pointer (&profile));
+  return TRUE;
+}
+
+/**
+ * eknr_renderer_render_legacy_article:
+ * @renderer: An #EknrRenderer
+ * @body_html: The underlying HTML body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @links: (nullable): The article's links and chunk data, or %NULL to
+ *   leave them to crosslink.js and chunk.js
+ * @flags: #EknrRenderFlags to render the article with
+ * @error: A #GError
+ *
+ * Like eknr_renderer_render_legacy_content(), but return the rendered
+ * article in pieces, with the body sharing memory with @body_html
+ * rather than being copied, unless the body had to be rewritten. Use
+ * eknr_renderer_rerender_legacy_article() to render it again with
+ * different flags.
+ *
+ * If @links is given, the links in the body are resolved and its
+ * chunks filled in while it is rendered, as crosslink_init() and
+ * chunk_init() would have done, so the article is ready to show as it
+ * is. This fails with %EKNR_ERROR_UNKNOWN_CHUNK_TYPE or
+ * %EKNR_ERROR_MISSING_CHUNK_DATA if the body asks for a chunk that
+ * cannot be filled in.
+ *
+ * The render cache is not used.
+ *
+ * Returns: (transfer full): The rendered article, or %NULL on error.
+ */
+EknrRenderedArticle *
+eknr_renderer_render_legacy_article (EknrRenderer     *renderer,
+                                     GBytes           *body_html,
+                                     const char       *source,
+                                     const char       *source_name,
+                                     const char       *original_uri,
+                                     const char       *license,
+                                     const char       *title,
+                                     EknrArticleLinks *links,
+                                     EknrRenderFlags   flags,
+                                     GError          **error)
+{
+  g_autoptr(EknrLegacyFragments) fragments = NULL;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  g_autoptr(GBytes) body = NULL;
+  static const char * const no_headings[] = { NULL };
+  const char * const *headings = no_headings;
+  EknrArena *scratch;
+  EknrRenderedArticle *article = NULL;
+  EknrHtmlBodyFeatures features;
+  const char *data, *stripped;
+  gsize size, stripped_length;
+
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
+  g_return_val_if_fail (body_html != NULL, NULL);
+
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_LEGACY);
+  fragments = _renderer_lookup_legacy_fragments (renderer,
+                                                 source,
+                                                 source_name,
+                                                 license,
+                                                 (flags & EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER) != 0,
+                                                 error);
+  if (fragments == NULL)
+    return NULL;
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_FRAGMENTS, 0);
+
+  data = g_bytes_get_data (body_html, &size);
+  stripped = eknr_html_strip_body_tags (data != NULL ? data : "", size, &stripped_length);
+  features = eknr_html_scan_body (stripped, stripped_length);
+
+  /* A body that needs rewriting is rewritten once here, so that
+   * rendering the article again reuses the rewritten body */
+  if ((features & EKNR_HTML_BODY_REWRITTEN_FEATURES) != 0 ||
+      (links != NULL && (features & EKNR_HTML_BODY_LINKED_FEATURES) != 0))
+    {
+      GString *rewritten = g_string_sized_new (stripped_length);
+      gsize rewritten_length;
+
+      if (!eknr_html_rewrite_body (stripped, stripped_length, features, links,
+                                   write_to_string, rewritten, error))
+        {
+          g_string_free (rewritten, TRUE);
+          return NULL;
+        }
+      rewritten_length = rewritten->len;
+      body = g_bytes_new_take (g_string_free (rewritten, FALSE), rewritten_length);
+    }
+  else if (size > 0)
+    {
+      body = g_bytes_new_from_bytes (body_html, stripped - data, stripped_length);
+    }
+  else
+    {
+      body = g_bytes_ref (body_html);
+    }
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_STRIP_BODY, stripped_length);
+
+  scratch = _renderer_take_scratch (renderer);
+
+  /* Collected whether or not the scroll manager is used, for the
+   * table of contents */
+  if ((features & EKNR_HTML_BODY_HAS_HEADINGS) != 0)
+    headings = (const char * const *) eknr_html_collect_headings (scratch,
+                                                                  stripped,
+                                                                  stripped_length);
+
+  article = _renderer_render_legacy_segments (fragments,
+                                              scratch,
+                                              body,
+                                              features,
+                                              headings,
+                                              source,
+                                              source_name,
+                                              original_uri,
+                                              license,
+                                              title,
+                                              flags,
+                                              profile,
+                                              error);
+  _renderer_return_scratch (renderer, scratch);
+
+  if (article != NULL)
+    _renderer_finish_profile (renderer, g_steal_pointer (&profile));
+
+  return article;
+}
+
+/**
+ * eknr_renderer_rerender_legacy_article:
+ * @renderer: An #EknrRenderer
+ * @article: An #EknrRenderedArticle from
+ *   eknr_renderer_render_legacy_article()
+ * @flags: The #EknrRenderFlags to render the article with now
+ * @error: A #GError
+ *
+ * Render @article again with different @flags, for example to show or
+ * hide its title. Only the head and tail are rendered again; the result
+ * shares its body with @article.
+ *
+ * Returns: (transfer full): The rendered article, or %NULL on error.
+ *   This is @article itself if @flags are the same as before.
+ */
+EknrRenderedArticle *
+eknr_renderer_rerender_legacy_article (EknrRenderer         *renderer,
+                                       EknrRenderedArticle  *article,
+                                       EknrRenderFlags       flags,
+                                       GError              **error)
+{
+  g_autoptr(EknrLegacyFragments) fragments = NULL;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  EknrArena *scratch;
+  EknrRenderedArticle *rerendered = NULL;
+
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
+  g_return_val_if_fail (article != NULL, NULL);
+
+  if (flags == article->flags)
+    return eknr_rendered_article_ref (article);
+
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_LEGACY);
+  fragments = _renderer_lookup_legacy_fragments (renderer,
+                                                 article->source,
+                                                 article->source_name,
+                                                 article->license,
+                                                 (flags & EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER) != 0,
+                                                 error);
+  if (fragments == NULL)
+    return NULL;
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_FRAGMENTS, 0);
+
+  scratch = _renderer_take_scratch (renderer);
+  rerendered = _renderer_render_legacy_segments (fragments,
+                                                 scratch,
+                                                 article->body,
+                                                 article->body_features,
+                                                 (const char * const *) article->headings,
+                                                 article->source,
+                                                 article->source_name,
+                                                 article->original_uri,
+                                                 article->license,
+                                                 article->title,
+                                                 flags,
+                                                 profile,
+                                                 error);
+  _renderer_return_scratch (renderer, scratch);
+
+  if (rerendered != NULL)
+    _renderer_finish_profile (renderer, g_steal_pointer (&profile));
+
+  return rerendered;
+}
+
+/**
+ * eknr_renderer_register_legacy_source:
+ * @renderer: An #EknrRenderer
+ * @source: An #EknrLegacySource
+ *
+ * Teach @renderer how to render legacy articles from a new source, or
+ * change how it renders articles from a source it already knows. After
+ * this, @source is shared with @renderer and can no longer be changed.
+ */
+void
+eknr_renderer_register_legacy_source (EknrRenderer     *renderer,
+                                      EknrLegacySource *source)
+{
+  EknrRendererPrivate *priv = NULL;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (source != NULL);
+
+  priv = eknr_renderer_get_instance_private (renderer);
+  eknr_legacy_fragments_cache_register_source (priv->legacy_fragments, source);
+
+  /* Articles from this source may now come out differently. Renders
+   * that already have the old fragments see the new generation when
+   * they try to insert into the cache. */
+  eknr_render_cache_clear (priv->render_cache);
+}
+
+typedef struct _RenderLegacyToStreamData {
+  EknrLegacyFragments *fragments;
+  GOutputStream *stream;
+  char *body_html;
+  char *original_uri;
+  char *title;
+  gboolean show_title;
+  EknrRenderProfile *profile;
+} RenderLegacyToStreamData;
+
+static void
+render_legacy_to_stream_data_free (RenderLegacyToStreamData *data)
+{
+  g_clear_pointer (&data->fragments, eknr_legacy_fragments_unref);
+  g_clear_object (&data->stream);
+  g_free (data->body_html);
+  g_free (data->original_uri);
+  g_free (data->title);
+  g_clear_pointer (&data->profile, eknr_render_profile_free);
+  g_free (data);
+}
+
+static void
+render_legacy_to_stream_thread (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+  EknrRenderer *renderer = EKNR_RENDERER (source_object);
+  RenderLegacyToStreamData *data = task_data;
+  g_autoptr(GError) local_error = NULL;
+  EknrArena *scratch;
+  gboolean rendered;
+
+  /* Don't count waiting for this thread as part of the first stage */
+  eknr_render_profile_skip (data->profile);
+
+  scratch = _renderer_take_scratch (renderer);
+  rendered = _renderer_render_legacy_content (data->fragments,
+                                              scratch,
+                                              data->stream,
+                                              cancellable,
+                                              data->body_html,
+                                              -1,
+                                              data->original_uri,
+                                              data->title,
+                                              data->show_title,
+                                              data->profile,
+                                              NULL,
+                                              NULL,
+                                              &local_error);
+  _renderer_return_scratch (renderer, scratch);
+
+  if (!rendered)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  _renderer_finish_profile (renderer, g_steal_pointer (&data->profile));
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * eknr_renderer_render_legacy_content_to_stream_async:
+ * @renderer: An #EknrRenderer
+ * @stream: A #GOutputStream to write the rendered content to
+ * @body_html: The underlying HTML body
+ * @source: Where this content came from
+ * @source_name: Name of the source
+ * @original_uri: URI this content came from
+ * @license: Content license
+ * @title: Content title
+ * @show_title: %TRUE if the article title should be rendered out too.
+ * @use_scroll_manager: %TRUE if the scroll manager should be used, %FALSE otherwise
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: A #GAsyncReadyCallback to call when the content is written
+ * @user_data: Data to pass to @callback
+ *
+ * Asynchronous version of eknr_renderer_render_legacy_content_to_stream().
+ * Rendering and writing to @stream happen in a worker thread. @stream
+ * must not be used by anything else until the operation has finished.
+ */
+void
+eknr_renderer_render_legacy_content_to_stream_async (EknrRenderer        *renderer,
+                                                     GOutputStream       *stream,
+                                                     const char          *body_html,
+                                                     const char          *source,
+                                                     const char          *source_name,
+                                                     const char          *original_uri,
+                                                     const char          *license,
+                                                     const char          *title,
+                                                     gboolean             show_title,
+                                                     gboolean             use_scroll_manager,
+                                                     GCancellable        *cancellable,
+                                                     GAsyncReadyCallback  callback,
+                                                     gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(EknrLegacyFragments) fragments = NULL;
+  g_autoptr(EknrRenderProfile) profile = NULL;
+  RenderLegacyToStreamData *data = NULL;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+
+  task = g_task_new (renderer, cancellable, callback, user_data);
+  g_task_set_source_tag (task, eknr_renderer_render_legacy_content_to_stream_async);
+
+  profile = _renderer_begin_profile (renderer, EKNR_RENDER_KIND_LEGACY);
+  fragments = _renderer_lookup_legacy_fragments (renderer,
+                                                 source,
+                                                 source_name,
+                                                 license,
+                                                 use_scroll_manager,
+                                                 &local_error);
+  if (fragments == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  EKNR_RENDER_PROFILE_MARK (profile, EKNR_RENDER_STAGE_FRAGMENTS, 0);
+
+  data = g_new0 (RenderLegacyToStreamData, 1);
+  data->fragments = g_steal_pointer (&fragments);
+  data->profile = g_steal_pointer (&profile);
+  data->stream = g_object_ref (stream);
+  data->body_html = g_strdup (body_html);
+  data->original_uri = g_strdup (original_uri);
+  data->title = g_strdup (title);
+  data->show_title = show_title;
+
+  g_task_set_task_data (task,
+                        data,
+                        (GDestroyNotify) render_legacy_to_stream_data_free);
+  g_task_run_in_thread (task, render_legacy_to_stream_thread);
+}
+
+/**
+ * eknr_renderer_render_legacy_content_to_stream_finish:
+ * @renderer: An #EknrRenderer
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish an operation started with
+ * eknr_renderer_render_legacy_content_to_stream_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error.
+ */
+gboolean
+eknr_renderer_render_legacy_content_to_stream_finish (EknrRenderer  *renderer,
+                                                      GAsyncResult  *result,
+                                                      GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, renderer), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* The result of rendering one article of a batch */
+typedef struct _RenderBatchResult {
+  guint index;
+  char *html;
+  GError *error;
+} RenderBatchResult;
+
+static void
+render_batch_result_free (RenderBatchResult *result)
+{
+  g_free (result->html);
+  g_clear_error (&result->error);
+  g_free (result);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RenderBatchResult, render_batch_result_free)
+
+/* Called in the thread running the batch with each result as it comes
+ * in. Takes ownership of @result. */
+typedef void (*RenderBatchDispatchFunc) (RenderBatchResult *result,
+                                         gpointer           user_data);
+
+typedef struct _RenderBatch {
+  EknrRenderer *renderer; /* non-owned */
+  GPtrArray *articles; /* (element-type EknrLegacyArticle) non-owned */
+  GCancellable *cancellable; /* non-owned */
+  GAsyncQueue *results; /* (element-type RenderBatchResult) */
+} RenderBatch;
+
+/* Runs on one of the batch's pool threads. The legacy article template
+ * is compiled into the library, so every thread shares it as is, and
+ * rendered articles go into the renderer's cache if it is turned on. */
+static void
+render_batch_item (gpointer item,
+                   gpointer user_data)
+{
+  RenderBatch *batch = user_data;
+  RenderBatchResult *result = g_new0 (RenderBatchResult, 1);
+  const EknrLegacyArticle *article = NULL;
+
+  result->index = GPOINTER_TO_UINT (item) - 1;
+  article = g_ptr_array_index (batch->articles, result->index);
+
+  if (!g_cancellable_set_error_if_cancelled (batch->cancellable, &result->error))
+    result->html =
+      _renderer_render_legacy_content_cached (batch->renderer,
+                                              batch->cancellable,
+                                              article->body_html,
+                                              article->source,
+                                              article->source_name,
+                                              article->original_uri,
+                                              article->license,
+                                              article->title,
+                                              (article->flags & EKNR_RENDER_FLAGS_SHOW_TITLE) != 0,
+                                              (article->flags & EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER) != 0,
+                                              &result->error);
+
+  g_async_queue_push (batch->results, result);
+}
+
+/* Render every article in @articles on a pool of at most @max_threads
+ * threads, or one per processor if @max_threads is not positive, and
+ * hand each result to @dispatch in the calling thread as it arrives.
+ * Only fails if the pool cannot be created or the batch is cancelled. */
+static gboolean
+_renderer_render_legacy_batch (EknrRenderer             *renderer,
+                               GPtrArray                *articles,
+                               int                       max_threads,
+                               RenderBatchDispatchFunc   dispatch,
+                               gpointer                  dispatch_data,
+                               GCancellable             *cancellable,
+                               GError                  **error)
+{
+  RenderBatch batch = {
+    .renderer = renderer,
+    .articles = articles,
+    .cancellable = cancellable,
+    .results = NULL
+  };
+  GThreadPool *pool = NULL;
+  guint n_threads;
+  guint i;
+
+  if (articles->len == 0)
+    return !g_cancellable_set_error_if_cancelled (cancellable, error);
+
+  n_threads = max_threads > 0 ? (guint) max_threads : g_get_num_processors ();
+  n_threads = MIN (n_threads, articles->len);
+
+  batch.results = g_async_queue_new ();
+  pool = g_thread_pool_new (render_batch_item, &batch, n_threads, TRUE, error);
+  if (pool == NULL)
+    {
+      g_async_queue_unref (batch.results);
+      return FALSE;
+    }
+
+  /* Thread pool items cannot be NULL, so offset the indices by one */
+  for (i = 0; i < articles->len; ++i)
+    g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+
+  for (i = 0; i < articles->len; ++i)
+    dispatch (g_async_queue_pop (batch.results), dispatch_data);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  g_async_queue_unref (batch.results);
+
+  return !g_cancellable_set_error_if_cancelled (cancellable, error);
+}
+
+typedef struct _RenderBatchCallback {
+  EknrRenderBatchFunc func;
+  gpointer user_data;
+} RenderBatchCallback;
+
+static void
+render_batch_dispatch_sync (RenderBatchResult *result,
+                            gpointer           user_data)
+{
+  g_autoptr(RenderBatchResult) owned_result = result;
+  RenderBatchCallback *callback = user_data;
+
+  callback->func (result->index, result->html, result->error, callback->user_data);
+}
+
+/**
+ * eknr_renderer_render_legacy_batch:
+ * @renderer: An #EknrRenderer
+ * @articles: (element-type EknrLegacyArticle): The articles to render
+ * @max_threads: The most threads to render on, or 0 to use one per
+ *   processor
+ * @item_callback: (scope call) (closure item_user_data): Function to
+ *   call with the result of rendering each article
+ * @item_user_data: Data to pass to @item_callback
+ * @cancellable: (nullable): A #GCancellable
+ * @error: A #GError
+ *
+ * Render many articles at once, as with
+ * eknr_renderer_render_legacy_content(), spread across a pool of worker
+ * threads. This is meant for warming up a cache of rendered articles
+ * for a whole collection.
+ *
+ * @item_callback is called in the calling thread once for each article,
+ * as soon as it has been rendered. A failure to render one article is
+ * reported to @item_callback and does not stop the rest of the batch.
+ *
+ * Returns: %TRUE if every article was attempted, %FALSE if the batch
+ *   was cancelled or could not be started.
+ */
+gboolean
+eknr_renderer_render_legacy_batch (EknrRenderer         *renderer,
+                                   GPtrArray            *articles,
+                                   int                   max_threads,
+                                   EknrRenderBatchFunc   item_callback,
+                                   gpointer              item_user_data,
+                                   GCancellable         *cancellable,
+                                   GError              **error)
+{
+  RenderBatchCallback callback = {
+    .func = item_callback,
+    .user_data = item_user_data
+  };
+
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), FALSE);
+  g_return_val_if_fail (articles != NULL, FALSE);
+  g_return_val_if_fail (item_callback != NULL, FALSE);
+
+  return _renderer_render_legacy_batch (renderer,
+                                        articles,
+                                        max_threads,
+                                        render_batch_dispatch_sync,
+                                        &callback,
+                                        cancellable,
+                                        error);
+}
+
+typedef struct _RenderLegacyBatchData {
+  GPtrArray *articles; /* (element-type EknrLegacyArticle) */
+  int max_threads;
+  EknrRenderBatchFunc item_callback;
+  gpointer item_user_data;
+  GDestroyNotify item_destroy;
+} RenderLegacyBatchData;
+
+static void
+render_legacy_batch_data_free (RenderLegacyBatchData *data)
+{
+  g_ptr_array_unref (data->articles);
+  g_free (data);
+}
+
+/* An item result on its way from the batch thread to the task's main
+ * context */
+typedef struct _RenderBatchIdle {
+  GTask *task;
+  RenderBatchResult *result;
+} RenderBatchIdle;
+
+static void
+render_batch_idle_free (RenderBatchIdle *idle)
+{
+  g_object_unref (idle->task);
+  g_clear_pointer (&idle->result, render_batch_result_free);
+  g_free (idle);
+}
+
+static gboolean
+render_batch_dispatch_idle (gpointer user_data)
+{
+  RenderBatchIdle *idle = user_data;
+  RenderLegacyBatchData *data = g_task_get_task_data (idle->task);
+
+  if (idle->result != NULL)
+    data->item_callback (idle->result->index,
+                         idle->result->html,
+                         idle->result->error,
+                         data->item_user_data);
+  else if (data->item_destroy != NULL)
+    data->item_destroy (data->item_user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Passing a %NULL @result schedules @item_destroy instead. Everything is
+ * attached to the task's context at the same priority as the task's own
+ * completion, so it all runs in order, before the task's callback.
+ *
+ * Note that this always goes through an idle source rather than
+ * g_main_context_invoke(), which could run the callback right here in
+ * the batch thread if the context happened to be free. */
+static void
+render_batch_dispatch_async (RenderBatchResult *result,
+                             gpointer           user_data)
+{
+  GTask *task = user_data;
+  RenderBatchIdle *idle = g_new0 (RenderBatchIdle, 1);
+  g_autoptr(GSource) source = g_idle_source_new ();
+
+  idle->task = g_object_ref (task);
+  idle->result = result;
+
+  g_source_set_priority (source, g_task_get_priority (task));
+  g_source_set_callback (source,
+                         render_batch_dispatch_idle,
+                         idle,
+                         (GDestroyNotify) render_batch_idle_free);
+  g_source_attach (source, g_task_get_context (task));
+}
+
+static void
+render_legacy_batch_thread (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  RenderLegacyBatchData *data = task_data;
+  g_autoptr(GError) local_error = NULL;
+  gboolean success = _renderer_render_legacy_batch (EKNR_RENDERER (source_object),
+                                                    data->articles,
+                                                    data->max_threads,
+                                                    render_batch_dispatch_async,
+                                                    task,
+                                                    cancellable,
+                                                    &local_error);
+
+  /* Release the item callback in the caller's context rather than
+   * whichever thread happens to drop the last reference on the task */
+  render_batch_dispatch_async (NULL, task);
+
+  if (!success)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * eknr_renderer_render_legacy_batch_async:
+ * @renderer: An #EknrRenderer
+ * @articles: (element-type EknrLegacyArticle): The articles to render
+ * @max_threads: The most threads to render on, or 0 to use one per
+ *   processor
+ * @item_callback: (scope notified) (closure item_user_data) (destroy item_destroy):
+ *   Function to call with the result of rendering each article
+ * @item_user_data: Data to pass to @item_callback
+ * @item_destroy: (nullable): Function to free @item_user_data with
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: A #GAsyncReadyCallback to call when the whole batch is done
+ * @user_data: Data to pass to @callback
+ *
+ * Asynchronous version of eknr_renderer_render_legacy_batch(). The
+ * articles are copied, so @articles can be modified or freed as soon as
+ * this returns. @item_callback is called in the thread-default main
+ * context of the calling thread, and every call to it happens before
+ * @callback is called.
+ */
+void
+eknr_renderer_render_legacy_batch_async (EknrRenderer        *renderer,
+                                         GPtrArray           *articles,
+                                         int                  max_threads,
+                                         EknrRenderBatchFunc  item_callback,
+                                         gpointer             item_user_data,
+                                         GDestroyNotify       item_destroy,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  RenderLegacyBatchData *data = NULL;
+  guint i;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (articles != NULL);
+  g_return_if_fail (item_callback != NULL);
+
+  task = g_task_new (renderer, cancellable, callback, user_data);
+  g_task_set_source_tag (task, eknr_renderer_render_legacy_batch_async);
+
+  data = g_new0 (RenderLegacyBatchData, 1);
+  data->articles = g_ptr_array_new_full (articles->len,
+                                         (GDestroyNotify) eknr_legacy_article_free);
+  for (i = 0; i < articles->len; ++i)
+    g_ptr_array_add (data->articles,
+                     eknr_legacy_article_copy (g_ptr_array_index (articles, i)));
+  data->max_threads = max_threads;
+  data->item_callback = item_callback;
+  data->item_user_data = item_user_data;
+  data->item_destroy = item_destroy;
+
+  g_task_set_task_data (task,
+                        data,
+                        (GDestroyNotify) render_legacy_batch_data_free);
+  g_task_run_in_thread (task, render_legacy_batch_thread);
+}
+
+/**
+ * eknr_renderer_render_legacy_batch_finish:
+ * @renderer: An #EknrRenderer
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish an operation started with
+ * eknr_renderer_render_legacy_batch_async().
+ *
+ * Returns: %TRUE if every article was attempted, %FALSE if the batch
+ *   was cancelled or could not be started.
+ */
+gboolean
+eknr_renderer_render_legacy_batch_finish (EknrRenderer  *renderer,
+                                          GAsyncResult  *result,
+                                          GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, renderer), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * eknr_renderer_get_stage_histogram:
+ * @renderer: An #EknrRenderer
+ * @stage: An #EknrRenderStage
+ * @n_buckets: (out): Return location for the number of buckets, which
+ *   is always %EKNR_RENDER_HISTOGRAM_N_BUCKETS
+ *
+ * Get a histogram of how long @stage has taken over every render since
+ * #EknrRenderer:instrument was set, or since
+ * eknr_renderer_reset_stage_stats() was last called. Bucket n counts
+ * the renders in which @stage took from 2^n up to 2^(n+1) nanoseconds.
+ *
+ * Returns: (array length=n_buckets) (transfer full): The number of
+ *   renders in each bucket
+ */
+guint64 *
+eknr_renderer_get_stage_histogram (EknrRenderer    *renderer,
+                                   EknrRenderStage  stage,
+                                   gsize           *n_buckets)
+{
+  EknrRendererPrivate *priv = NULL;
+  guint64 *buckets = NULL;
+
+  g_return_val_if_fail (renderer && EKNR_IS_RENDERER (renderer), NULL);
+  g_return_val_if_fail (stage < EKNR_N_RENDER_STAGES, NULL);
+  g_return_val_if_fail (n_buckets != NULL, NULL);
+
+  priv = eknr_renderer_get_instance_private (renderer);
+  buckets = g_new (guint64, EKNR_RENDER_HISTOGRAM_N_BUCKETS);
+  eknr_render_stats_get_histogram (priv->stats, stage, buckets);
+
+  *n_buckets = EKNR_RENDER_HISTOGRAM_N_BUCKETS;
+  return buckets;
+}
+
+/**
+ * eknr_renderer_get_stage_totals:
+ * @renderer: An #EknrRenderer
+ * @stage: An #EknrRenderStage
+ * @out_count: (out) (optional): Return location for the number of
+ *   renders that went through @stage
+ * @out_duration: (out) (optional): Return location for the total time
+ *   spent in @stage, in nanoseconds
+ * @out_bytes: (out) (optional): Return location for the total number
+ *   of bytes @stage dealt with
+ *
+ * Get the totals for @stage over the same renders as
+ * eknr_renderer_get_stage_histogram().
+ */
+void
+eknr_renderer_get_stage_totals (EknrRenderer    *renderer,
+                                EknrRenderStage  stage,
+                                guint64         *out_count,
+                                guint64         *out_duration,
+                                guint64         *out_bytes)
+{
+  EknrRendererPrivate *priv = NULL;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+  g_return_if_fail (stage < EKNR_N_RENDER_STAGES);
+
+  priv = eknr_renderer_get_instance_private (renderer);
+  eknr_render_stats_get_totals (priv->stats, stage, out_count, out_duration, out_bytes);
+}
+
+/**
+ * eknr_renderer_reset_stage_stats:
+ * @renderer: An #EknrRenderer
+ *
+ * Forget the histograms and totals of every render stage.
+ */
+void
+eknr_renderer_reset_stage_stats (EknrRenderer *renderer)
+{
+  EknrRendererPrivate *priv = NULL;
+
+  g_return_if_fail (renderer && EKNR_IS_RENDERER (renderer));
+
+  priv = eknr_renderer_get_instance_private (renderer);
+  eknr_render_stats_reset (priv->stats);
+}
+
+static void
+eknr_renderer_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  EknrRenderer *self = EKNR_RENDERER (object);
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (self);
+  guint max_entries;
+  guint64 max_bytes;
+
+  switch (prop_id)
+    {
+    case PROP_RENDER_CACHE_MAX_BYTES:
+      eknr_render_cache_set_max_bytes (priv->render_cache,
+                                       g_value_get_uint64 (value));
+      break;
+    case PROP_TEMPLATE_CACHE_MAX_ENTRIES:
+      eknr_template_cache_get_limits (priv->cache, NULL, &max_bytes);
+      eknr_template_cache_set_limits (priv->cache, g_value_get_uint (value), max_bytes);
+      break;
+    case PROP_TEMPLATE_CACHE_MAX_BYTES:
+      eknr_template_cache_get_limits (priv->cache, &max_entries, NULL);
+      eknr_template_cache_set_limits (priv->cache, max_entries, g_value_get_uint64 (value));
+      break;
+    case PROP_TEMPLATE_CACHE_REVALIDATE:
+      eknr_template_cache_set_revalidate (priv->cache, g_value_get_boolean (value));
+      break;
+    case PROP_INSTRUMENT:
+      g_atomic_int_set (&priv->instrument, g_value_get_boolean (value));
+      break;
+    case PROP_INLINE_ASSETS:
+      g_atomic_int_set (&priv->inline_assets, g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+eknr_renderer_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  EknrRenderer *self = EKNR_RENDERER (object);
+  EknrRendererPrivate *priv = eknr_renderer_get_instance_private (self);
+  guint64 hits, misses, evictions;
+  EknrTemplateCacheStats template_stats;
+  guint max_entries;
+  guint64 max_bytes;
+
+  eknr_render_cache_get_stats (priv->render_cache, &hits, &misses, &evictions);
+  eknr_template_cache_get_stats (priv->cache, &template_stats);
+  eknr_template_cache_get_limits (priv->cache, &max_entries, &max_bytes);
+
+  switch (prop_id)
+    {
+    case PROP_RENDER_CACHE_MAX_BYTES:
+      g_value_set_uint64 (value, eknr_render_cache_get_max_bytes (priv->render_cache));
+      break;
+    case PROP_RENDER_CACHE_HITS:
+      g_value_set_uint64 (value, hits);
+      break;
+    case PROP_RENDER_CACHE_MISSES:
+      g_value_set_uint64 (value, misses);
+      break;
+    case PROP_RENDER_CACHE_EVICTIONS:
+      g_value_set_uint64 (value, evictions);
+      break;
+    case PROP_TEMPLATE_CACHE_MAX_ENTRIES:
+      g_value_set_uint (value, max_entries);
+      break;
+    case PROP_TEMPLATE_CACHE_MAX_BYTES:
+      g_value_set_uint64 (value, max_bytes);
+      break;
+    case PROP_TEMPLATE_CACHE_REVALIDATE:
+      g_value_set_boolean (value, eknr_template_cache_get_revalidate (priv->cache));
+      break;
+    case PROP_TEMPLATE_CACHE_ENTRIES:
+      g_value_set_uint (value, template_stats.entries);
+      break;
+    case PROP_TEMPLATE_CACHE_BYTES:
+      g_value_set_uint64 (value, template_stats.bytes);
+      break;
+    case PROP_TEMPLATE_CACHE_HITS:
+      g_value_set_uint64 (value, template_stats.hits);
+      break;
+    case PROP_TEMPLATE_CACHE_MISSES:
+      g_value_set_uint64 (value, template_stats.misses);
+      break;
+    case PROP_TEMPLATE_CACHE_EVICTIONS:
+      g_value_set_uint64 (value, template_stats.evictions);
+      break;
+    case PROP_INSTRUMENT:
+      g_value_set_boolean (value, g_atomic_int_get (&priv->instrument));
+      break;
+    case PROP_INLINE_ASSETS:
+      g_value_set_boolean (value, g_atomic_int_get (&priv->inline_assets));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
 }
 
 static void
@@ -687,7 +2377,12 @@ eknr_renderer_finalize (GObject *object)
   EknrRenderer *self = EKNR_RENDERER (object);
   EknrRendererPrivate *priv = eknr_renderer_get_instance_private (self);
 
-  g_hash_table_unref (priv->cache);
+  eknr_template_cache_free (priv->cache);
+  g_free (priv->template_blob_dir);
+  eknr_render_cache_free (priv->render_cache);
+  eknr_legacy_fragments_cache_free (priv->legacy_fragments);
+  eknr_render_stats_free (priv->stats);
+  g_clear_pointer (&priv->scratch, eknr_arena_free);
 
   G_OBJECT_CLASS (eknr_renderer_parent_class)->finalize (object);
 }
@@ -697,7 +2392,245 @@ eknr_renderer_class_init (EknrRendererClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->get_property = eknr_renderer_get_property;
+  object_class->set_property = eknr_renderer_set_property;
   object_class->finalize = eknr_renderer_finalize;
+
+  /**
+   * EknrRenderer:render-cache-max-bytes:
+   *
+   * The most memory, in bytes, to spend on keeping rendered legacy
+   * articles, or 0 to not keep them at all. When the cache is full,
+   * the least recently used articles are dropped first.
+   */
+  eknr_renderer_props[PROP_RENDER_CACHE_MAX_BYTES] =
+    g_param_spec_uint64 ("render-cache-max-bytes",
+                         "Render cache maximum bytes",
+                         "The most memory to use for cached rendered articles",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:render-cache-hits:
+   *
+   * How many times a rendered article was found in the render cache.
+   * Changes to this property are not notified.
+   */
+  eknr_renderer_props[PROP_RENDER_CACHE_HITS] =
+    g_param_spec_uint64 ("render-cache-hits",
+                         "Render cache hits",
+                         "How many times a rendered article was found in the cache",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:render-cache-misses:
+   *
+   * How many times an article had to be rendered because it was not in
+   * the render cache. Changes to this property are not notified.
+   */
+  eknr_renderer_props[PROP_RENDER_CACHE_MISSES] =
+    g_param_spec_uint64 ("render-cache-misses",
+                         "Render cache misses",
+                         "How many times a rendered article was not in the cache",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:render-cache-evictions:
+   *
+   * How many rendered articles were dropped from the render cache to
+   * keep it within #EknrRenderer:render-cache-max-bytes. Changes to
+   * this property are not notified.
+   */
+  eknr_renderer_props[PROP_RENDER_CACHE_EVICTIONS] =
+    g_param_spec_uint64 ("render-cache-evictions",
+                         "Render cache evictions",
+                         "How many rendered articles were dropped from the cache",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-max-entries:
+   *
+   * The most compiled mustache templates to keep, or 0 for no limit.
+   * When there are more, the least recently used templates are dropped
+   * first.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_MAX_ENTRIES] =
+    g_param_spec_uint ("template-cache-max-entries",
+                       "Template cache maximum entries",
+                       "The most compiled templates to keep",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-max-bytes:
+   *
+   * The most memory, in bytes, to spend on compiled mustache templates,
+   * or 0 for no limit. When the cache is over the limit, the least
+   * recently used templates are dropped first.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_MAX_BYTES] =
+    g_param_spec_uint64 ("template-cache-max-bytes",
+                         "Template cache maximum bytes",
+                         "The most memory to use for compiled templates",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-revalidate:
+   *
+   * Whether to check, every time a cached template is used, that its
+   * file has not changed since it was read, and read it again if it
+   * has. The check compares the file's etag, which for local files
+   * comes from its modification time, and costs a query of the file's
+   * metadata each time.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_REVALIDATE] =
+    g_param_spec_boolean ("template-cache-revalidate",
+                          "Template cache revalidate",
+                          "Whether to reload templates whose files have changed",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-entries:
+   *
+   * How many compiled mustache templates are cached. Changes to this
+   * property are not notified.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_ENTRIES] =
+    g_param_spec_uint ("template-cache-entries",
+                       "Template cache entries",
+                       "How many compiled templates are cached",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-bytes:
+   *
+   * The memory, in bytes, used by cached compiled mustache templates.
+   * Changes to this property are not notified.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_BYTES] =
+    g_param_spec_uint64 ("template-cache-bytes",
+                         "Template cache bytes",
+                         "The memory used by cached compiled templates",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-hits:
+   *
+   * How many times a mustache template was found already compiled.
+   * Changes to this property are not notified.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_HITS] =
+    g_param_spec_uint64 ("template-cache-hits",
+                         "Template cache hits",
+                         "How many times a template was found already compiled",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-misses:
+   *
+   * How many times a mustache template had to be loaded because it was
+   * not in the template cache. Changes to this property are not
+   * notified.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_MISSES] =
+    g_param_spec_uint64 ("template-cache-misses",
+                         "Template cache misses",
+                         "How many times a template had to be loaded",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:template-cache-evictions:
+   *
+   * How many compiled mustache templates were dropped to keep within
+   * #EknrRenderer:template-cache-max-entries and
+   * #EknrRenderer:template-cache-max-bytes. Changes to this property
+   * are not notified.
+   */
+  eknr_renderer_props[PROP_TEMPLATE_CACHE_EVICTIONS] =
+    g_param_spec_uint64 ("template-cache-evictions",
+                         "Template cache evictions",
+                         "How many compiled templates were dropped from the cache",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:instrument:
+   *
+   * Whether to time each stage of every render. When this is set,
+   * #EknrRenderer::render-profiled is emitted after each successful
+   * render, and the histograms returned by
+   * eknr_renderer_get_stage_histogram() are kept up to date. When the
+   * renderer is built with sysprof support, or on a system with SDT
+   * probes, each stage is also marked for sysprof or perf.
+   *
+   * This is off by default, in which case rendering does no extra work
+   * beyond checking this property.
+   */
+  eknr_renderer_props[PROP_INSTRUMENT] =
+    g_param_spec_boolean ("instrument",
+                          "Instrument",
+                          "Whether to time each stage of every render",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * EknrRenderer:inline-assets:
+   *
+   * Whether legacy articles include the contents of their stylesheets
+   * and scripts, rather than linking to them. This saves the web view
+   * from looking up and decompressing each of them from the resources
+   * for every article it loads. The contents are read from the
+   * resources once and kept for as long as the renderer lives.
+   *
+   * Stylesheets and scripts that are not in the renderer's resources,
+   * such as those of registered sources, are still linked to.
+   *
+   * Inlined scripts cannot be deferred, so they run as soon as they are
+   * reached, at the end of the article. Linked scripts of registered
+   * sources are still deferred and run after the page has been parsed,
+   * so with this set, the inlined scripts run before them rather than
+   * in the order they are listed.
+   */
+  eknr_renderer_props[PROP_INLINE_ASSETS] =
+    g_param_spec_boolean ("inline-assets",
+                          "Inline assets",
+                          "Whether to include stylesheets and scripts in legacy articles",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class,
+                                     NPROPS,
+                                     eknr_renderer_props);
+
+  /**
+   * EknrRenderer::render-profiled:
+   * @renderer: The #EknrRenderer
+   * @profile: An #EknrRenderProfile of the render
+   *
+   * Emitted after each successful render while #EknrRenderer:instrument
+   * is set, with how long each stage of the render took.
+   *
+   * This is emitted in the thread that did the render, which for
+   * eknr_renderer_render_legacy_content_to_stream_async() and for
+   * batches is a worker thread. @profile is only valid during the
+   * emission; copy it to keep it.
+   */
+  eknr_renderer_signals[SIGNAL_RENDER_PROFILED] =
+    g_signal_new ("render-profiled",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 1,
+                  EKNR_TYPE_RENDER_PROFILE | G_SIGNAL_TYPE_STATIC_SCOPE);
 }
 
 static void
@@ -723,10 +2656,16 @@ eknr_renderer_init (EknrRenderer *self)
    * and bind_textdomain_codeset () */
   init_i18n ();
 
-  priv->cache = g_hash_table_new_full (g_str_hash,
-                                       g_str_equal,
-                                       g_free,
-                                       (GDestroyNotify) free_mustache_template);
+  priv->template_blob_dir = g_build_filename (g_get_user_cache_dir (),
+                                              "eknr",
+                                              "templates",
+                                              NULL);
+  priv->cache = eknr_template_cache_new (_renderer_compile_cached_template,
+                                         (GDestroyNotify) eknr_template_blob_free,
+                                         priv->template_blob_dir);
+  priv->render_cache = eknr_render_cache_new ();
+  priv->legacy_fragments = eknr_legacy_fragments_cache_new ();
+  priv->stats = eknr_render_stats_new ();
 }
 
 EknrRenderer *
@@ -5,11 +5,33 @@
 #include <gio/gio.h>
 #include <glib-object.h>
 
+#include "eknr-article-links.h"
+#include "eknr-legacy-article.h"
+#include "eknr-legacy-source.h"
+#include "eknr-render-profile.h"
+#include "eknr-rendered-article.h"
+
 G_BEGIN_DECLS
 
 #define EKNR_TYPE_RENDERER eknr_renderer_get_type ()
 G_DECLARE_FINAL_TYPE (EknrRenderer, eknr_renderer, EKNR, RENDERER, GObject)
 
+/**
+ * EknrRenderBatchFunc:
+ * @index: The index of the article in the batch
+ * @html: (nullable): The rendered HTML, or %NULL if rendering failed
+ * @error: (nullable): The error rendering the article, or %NULL
+ * @user_data: The user data passed along with the callback
+ *
+ * Called with the result of rendering each article in a batch. Results
+ * arrive in the order the articles finish rendering, not necessarily
+ * the order they appear in the batch.
+ */
+typedef void (*EknrRenderBatchFunc) (guint         index,
+                                     const char   *html,
+                                     const GError *error,
+                                     gpointer      user_data);
+
 char * eknr_renderer_render_mustache_document (EknrRenderer *renderer,
                                                const char   *tmpl_text,
                                                GVariant     *variables,
@@ -20,6 +42,27 @@ char * eknr_renderer_render_mustache_document_from_file (EknrRenderer *renderer,
                                                          GVariant     *variables,
                                                          GError      **error);
 
+void eknr_renderer_render_mustache_document_from_file_async (EknrRenderer        *renderer,
+                                                             GFile               *file,
+                                                             GVariant            *variables,
+                                                             GCancellable        *cancellable,
+                                                             GAsyncReadyCallback  callback,
+                                                             gpointer             user_data);
+
+char * eknr_renderer_render_mustache_document_from_file_finish (EknrRenderer  *renderer,
+                                                                GAsyncResult  *result,
+                                                                GError       **error);
+
+void eknr_renderer_preload_templates_async (EknrRenderer        *renderer,
+                                            GPtrArray           *files,
+                                            GCancellable        *cancellable,
+                                            GAsyncReadyCallback  callback,
+                                            gpointer             user_data);
+
+gboolean eknr_renderer_preload_templates_finish (EknrRenderer  *renderer,
+                                                 GAsyncResult  *result,
+                                                 GError       **error);
+
 char * eknr_renderer_render_legacy_content (EknrRenderer  *renderer,
                                             const char    *body_html,
                                             const char    *source,
@@ -31,6 +74,90 @@ char * eknr_renderer_render_legacy_content (EknrRenderer  *renderer,
                                             gboolean       use_scroll_manager,
                                             GError       **error);
 
+gboolean eknr_renderer_render_legacy_content_to_stream (EknrRenderer   *renderer,
+                                                        GOutputStream  *stream,
+                                                        const char     *body_html,
+                                                        const char     *source,
+                                                        const char     *source_name,
+                                                        const char     *original_uri,
+                                                        const char     *license,
+                                                        const char     *title,
+                                                        gboolean        show_title,
+                                                        gboolean        use_scroll_manager,
+                                                        GCancellable   *cancellable,
+                                                        GError        **error);
+
+void eknr_renderer_render_legacy_content_to_stream_async (EknrRenderer        *renderer,
+                                                          GOutputStream       *stream,
+                                                          const char          *body_html,
+                                                          const char          *source,
+                                                          const char          *source_name,
+                                                          const char          *original_uri,
+                                                          const char          *license,
+                                                          const char          *title,
+                                                          gboolean             show_title,
+                                                          gboolean             use_scroll_manager,
+                                                          GCancellable        *cancellable,
+                                                          GAsyncReadyCallback  callback,
+                                                          gpointer             user_data);
+
+gboolean eknr_renderer_render_legacy_content_to_stream_finish (EknrRenderer  *renderer,
+                                                               GAsyncResult  *result,
+                                                               GError       **error);
+
+gboolean eknr_renderer_render_legacy_batch (EknrRenderer         *renderer,
+                                            GPtrArray            *articles,
+                                            int                   max_threads,
+                                            EknrRenderBatchFunc   item_callback,
+                                            gpointer              item_user_data,
+                                            GCancellable         *cancellable,
+                                            GError              **error);
+
+void eknr_renderer_render_legacy_batch_async (EknrRenderer        *renderer,
+                                              GPtrArray           *articles,
+                                              int                  max_threads,
+                                              EknrRenderBatchFunc  item_callback,
+                                              gpointer             item_user_data,
+                                              GDestroyNotify       item_destroy,
+                                              GCancellable        *cancellable,
+                                              GAsyncReadyCallback  callback,
+                                              gpointer             user_data);
+
+gboolean eknr_renderer_render_legacy_batch_finish (EknrRenderer  *renderer,
+                                                   GAsyncResult  *result,
+                                                   GError       **error);
+
+EknrRenderedArticle * eknr_renderer_render_legacy_article (EknrRenderer     *renderer,
+                                                           GBytes           *body_html,
+                                                           const char       *source,
+                                                           const char       *source_name,
+                                                           const char       *original_uri,
+                                                           const char       *license,
+                                                           const char       *title,
+                                                           EknrArticleLinks *links,
+                                                           EknrRenderFlags   flags,
+                                                           GError          **error);
+
+EknrRenderedArticle * eknr_renderer_rerender_legacy_article (EknrRenderer         *renderer,
+                                                             EknrRenderedArticle  *article,
+                                                             EknrRenderFlags       flags,
+                                                             GError              **error);
+
+guint64 * eknr_renderer_get_stage_histogram (EknrRenderer    *renderer,
+                                             EknrRenderStage  stage,
+                                             gsize           *n_buckets);
+
+void eknr_renderer_get_stage_totals (EknrRenderer    *renderer,
+                                     EknrRenderStage  stage,
+                                     guint64         *out_count,
+                                     guint64         *out_duration,
+                                     guint64         *out_bytes);
+
+void eknr_renderer_reset_stage_stats (EknrRenderer *renderer);
+
+void eknr_renderer_register_legacy_source (EknrRenderer     *renderer,
+                                           EknrLegacySource *source);
+
 EknrRenderer * eknr_renderer_new (void);
 
 G_END_DECLS
@@ -0,0 +1,88 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+#include "eknr-template-private.h"
+
+G_BEGIN_DECLS
+
+/**
+ * EKNR_TEMPLATE_BLOB_VERSION:
+ *
+ * The version of the compiled template format. Bump this whenever the
+ * layout of a blob or the meaning of its tokens changes, so that blobs
+ * left in the cache directory by an older version are compiled again.
+ */
+#define EKNR_TEMPLATE_BLOB_VERSION 1
+
+typedef struct _EknrTemplateBlobBuilder EknrTemplateBlobBuilder;
+
+G_GNUC_INTERNAL
+EknrTemplateBlobBuilder * eknr_template_blob_builder_new (void);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_builder_add_text (EknrTemplateBlobBuilder *builder,
+                                          const char              *text,
+                                          gsize                    length);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_builder_add_variable (EknrTemplateBlobBuilder *builder,
+                                              const char              *name,
+                                              gboolean                 escaped);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_builder_begin_section (EknrTemplateBlobBuilder *builder,
+                                               const char              *name);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_builder_end_section (EknrTemplateBlobBuilder *builder);
+
+G_GNUC_INTERNAL
+GBytes * eknr_template_blob_builder_end (EknrTemplateBlobBuilder *builder,
+                                         guint64                  source_hash,
+                                         gsize                    source_length);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_builder_free (EknrTemplateBlobBuilder *builder);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrTemplateBlobBuilder, eknr_template_blob_builder_free)
+
+typedef struct _EknrTemplateBlob EknrTemplateBlob;
+
+G_GNUC_INTERNAL
+EknrTemplateBlob * eknr_template_blob_new (GBytes   *bytes,
+                                           GError  **error);
+
+G_GNUC_INTERNAL
+void eknr_template_blob_free (EknrTemplateBlob *blob);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrTemplateBlob, eknr_template_blob_free)
+
+G_GNUC_INTERNAL
+GBytes * eknr_template_blob_get_bytes (EknrTemplateBlob *blob);
+
+G_GNUC_INTERNAL
+gsize eknr_template_blob_get_source_length (EknrTemplateBlob *blob);
+
+G_GNUC_INTERNAL
+EknrTemplateBlob * eknr_template_blob_load (const char  *cache_dir,
+                                            guint64      source_hash,
+                                            gsize        source_length,
+                                            GError     **error);
+
+G_GNUC_INTERNAL
+gboolean eknr_template_blob_save (EknrTemplateBlob  *blob,
+                                  const char        *cache_dir,
+                                  guint64            max_dir_bytes,
+                                  GError           **error);
+
+G_GNUC_INTERNAL
+gboolean eknr_template_blob_render (EknrTemplateBlob       *blob,
+                                    EknrTemplateContext    *context,
+                                    EknrTemplateWriteFunc   write,
+                                    gpointer                user_data,
+                                    GError                **error);
+
+G_END_DECLS
@@ -0,0 +1,794 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "eknr-errors.h"
+#include "eknr-hash-private.h"
+#include "eknr-template-blob-private.h"
+
+/* A compiled mustache template, flattened so that it can be written to
+ * disk and used straight from a memory mapping.
+ *
+ * A blob is a header, then an array of tokens, then a string table:
+ *
+ *   BlobHeader
+ *   BlobToken[n_tokens]
+ *   char strings[strings_length]
+ *
+ * Every string in the table is followed by a nul byte, so that variable
+ * and section names can be looked up without copying them. A section's
+ * contents are the tokens that follow it, up to the index in its "end"
+ * field, so nesting needs no pointers.
+ *
+ * Numbers are in the host's byte order; a blob from a machine of the
+ * other byte order fails the magic check and is compiled again.
+ */
+#define BLOB_MAGIC "EKNRTPL"
+#define BLOB_FILE_SUFFIX ".tmpl"
+
+typedef struct _BlobHeader {
+  char magic[8];
+  guint32 version;
+  guint32 n_tokens;
+  guint32 strings_length;
+  guint32 reserved;
+  guint64 source_hash;
+  guint64 source_length;
+  guint64 checksum; /* of everything after the header */
+} BlobHeader;
+
+typedef enum {
+  BLOB_TOKEN_TEXT,
+  BLOB_TOKEN_VARIABLE,
+  BLOB_TOKEN_RAW_VARIABLE,
+  BLOB_TOKEN_SECTION,
+  BLOB_N_TOKEN_TYPES
+} BlobTokenType;
+
+typedef struct _BlobToken {
+  guint32 type; /* BlobTokenType */
+  guint32 string; /* offset of the text or name in the string table */
+  guint32 length; /* length of the text or name, not counting the nul */
+  guint32 end; /* for sections, the index of the first token after it */
+} BlobToken;
+
+G_STATIC_ASSERT (sizeof (BlobHeader) % 8 == 0);
+G_STATIC_ASSERT (sizeof (BlobToken) == 16);
+
+struct _EknrTemplateBlobBuilder {
+  GArray *tokens; /* element-type=BlobToken */
+  GString *strings;
+  GHashTable *names; /* key-type=char *, value-type=offset in strings */
+  GArray *open_sections; /* element-type=guint32, indices into tokens */
+};
+
+/**
+ * eknr_template_blob_builder_new:
+ *
+ * Start building a compiled template blob. Add the template's tokens in
+ * order with the other eknr_template_blob_builder functions, then call
+ * eknr_template_blob_builder_end() to get the blob.
+ *
+ * Returns: (transfer full): A new #EknrTemplateBlobBuilder
+ */
+EknrTemplateBlobBuilder *
+eknr_template_blob_builder_new (void)
+{
+  EknrTemplateBlobBuilder *builder = g_new0 (EknrTemplateBlobBuilder, 1);
+
+  builder->tokens = g_array_new (FALSE, FALSE, sizeof (BlobToken));
+  builder->strings = g_string_new (NULL);
+  builder->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  builder->open_sections = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  return builder;
+}
+
+void
+eknr_template_blob_builder_free (EknrTemplateBlobBuilder *builder)
+{
+  g_array_unref (builder->tokens);
+  g_string_free (builder->strings, TRUE);
+  g_hash_table_unref (builder->names);
+  g_array_unref (builder->open_sections);
+  g_free (builder);
+}
+
+static guint32
+builder_add_string (EknrTemplateBlobBuilder *builder,
+                    const char              *string,
+                    gsize                    length)
+{
+  guint32 offset = builder->strings->len;
+
+  g_string_append_len (builder->strings, string, length);
+  g_string_append_c (builder->strings, '\0');
+
+  return offset;
+}
+
+/* Names tend to repeat, so store each one only once */
+static guint32
+builder_add_name (EknrTemplateBlobBuilder *builder,
+                  const char              *name)
+{
+  gpointer offset;
+
+  if (!g_hash_table_lookup_extended (builder->names, name, NULL, &offset))
+    {
+      offset = GUINT_TO_POINTER (builder_add_string (builder, name, strlen (name)));
+      g_hash_table_insert (builder->names, g_strdup (name), offset);
+    }
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static void
+builder_add_token (EknrTemplateBlobBuilder *builder,
+                   BlobTokenType            type,
+                   guint32                  string,
+                   gsize                    length)
+{
+  BlobToken token = { type, string, length, 0 };
+
+  g_array_append_val (builder->tokens, token);
+}
+
+void
+eknr_template_blob_builder_add_text (EknrTemplateBlobBuilder *builder,
+                                     const char              *text,
+                                     gsize                    length)
+{
+  if (length == 0)
+    return;
+
+  builder_add_token (builder,
+                     BLOB_TOKEN_TEXT,
+                     builder_add_string (builder, text, length),
+                     length);
+}
+
+void
+eknr_template_blob_builder_add_variable (EknrTemplateBlobBuilder *builder,
+                                         const char              *name,
+                                         gboolean                 escaped)
+{
+  builder_add_token (builder,
+                     escaped ? BLOB_TOKEN_VARIABLE : BLOB_TOKEN_RAW_VARIABLE,
+                     builder_add_name (builder, name),
+                     strlen (name));
+}
+
+void
+eknr_template_blob_builder_begin_section (EknrTemplateBlobBuilder *builder,
+                                          const char              *name)
+{
+  guint32 index = builder->tokens->len;
+
+  builder_add_token (builder,
+                     BLOB_TOKEN_SECTION,
+                     builder_add_name (builder, name),
+                     strlen (name));
+  g_array_append_val (builder->open_sections, index);
+}
+
+void
+eknr_template_blob_builder_end_section (EknrTemplateBlobBuilder *builder)
+{
+  guint n_open = builder->open_sections->len;
+  guint32 index;
+
+  g_return_if_fail (n_open > 0);
+
+  index = g_array_index (builder->open_sections, guint32, n_open - 1);
+  g_array_index (builder->tokens, BlobToken, index).end = builder->tokens->len;
+  g_array_set_size (builder->open_sections, n_open - 1);
+}
+
+/**
+ * eknr_template_blob_builder_end:
+ * @builder: (transfer full): An #EknrTemplateBlobBuilder
+ * @source_hash: The eknr_hash_bytes() of the template source
+ * @source_length: The length of the template source in bytes
+ *
+ * Finish building a blob. The source's hash and length are recorded in
+ * the blob so that a blob saved to disk can be matched to its source.
+ * This frees @builder.
+ *
+ * Returns: (transfer full): The compiled template blob, which can be
+ *   passed to eknr_template_blob_new().
+ */
+GBytes *
+eknr_template_blob_builder_end (EknrTemplateBlobBuilder *builder,
+                                guint64                  source_hash,
+                                gsize                    source_length)
+{
+  g_autoptr(EknrTemplateBlobBuilder) owned_builder = builder;
+  gsize tokens_size = builder->tokens->len * sizeof (BlobToken);
+  BlobHeader header = { BLOB_MAGIC, };
+  GByteArray *blob;
+  guint8 *payload;
+
+  g_return_val_if_fail (builder->open_sections->len == 0, NULL);
+
+  header.version = EKNR_TEMPLATE_BLOB_VERSION;
+  header.n_tokens = builder->tokens->len;
+  header.strings_length = builder->strings->len;
+  header.source_hash = source_hash;
+  header.source_length = source_length;
+
+  blob = g_byte_array_sized_new (sizeof (header) + tokens_size + builder->strings->len);
+  g_byte_array_set_size (blob, sizeof (header) + tokens_size + builder->strings->len);
+
+  payload = blob->data + sizeof (header);
+  memcpy (payload, builder->tokens->data, tokens_size);
+  memcpy (payload + tokens_size, builder->strings->str, builder->strings->len);
+
+  header.checksum = eknr_hash_bytes (payload, tokens_size + builder->strings->len);
+  memcpy (blob->data, &header, sizeof (header));
+
+  return g_byte_array_free_to_bytes (blob);
+}
+
+struct _EknrTemplateBlob {
+  GBytes *bytes;
+  const BlobHeader *header;
+  const BlobToken *tokens;
+  const char *strings;
+};
+
+static gboolean
+set_invalid_blob_error (GError     **error,
+                        const char  *reason)
+{
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               "Invalid compiled template: %s", reason);
+  return FALSE;
+}
+
+/* How deeply sections may nest. Blobs are loaded from a directory that
+ * anyone running as the user can write to, and rendering recurses once
+ * per level, so deeper nesting is rejected rather than trusted; real
+ * templates nest a few levels at most. */
+#define MAX_SECTION_DEPTH 64
+
+/* Check that every token is in range and that the sections nest
+ * properly. This does not recurse: the ends of the sections that token
+ * @i is inside are kept in @section_ends, innermost last. */
+static gboolean
+blob_validate (EknrTemplateBlob  *blob,
+               GError           **error)
+{
+  guint32 section_ends[MAX_SECTION_DEPTH];
+  guint depth = 0;
+  guint32 i;
+
+  for (i = 0; i < blob->header->n_tokens; ++i)
+    {
+      const BlobToken *token = &blob->tokens[i];
+      guint32 end;
+
+      while (depth > 0 && section_ends[depth - 1] == i)
+        --depth;
+      end = depth > 0 ? section_ends[depth - 1] : blob->header->n_tokens;
+
+      if (token->type >= BLOB_N_TOKEN_TYPES)
+        return set_invalid_blob_error (error, "unknown token type");
+
+      if (token->string >= blob->header->strings_length ||
+          token->length >= blob->header->strings_length - token->string ||
+          blob->strings[token->string + token->length] != '\0')
+        return set_invalid_blob_error (error, "string out of range");
+
+      if (token->type != BLOB_TOKEN_SECTION)
+        continue;
+
+      if (token->end <= i || token->end > end)
+        return set_invalid_blob_error (error, "section out of range");
+
+      if (depth == MAX_SECTION_DEPTH)
+        return set_invalid_blob_error (error, "sections nested too deeply");
+
+      section_ends[depth++] = token->end;
+    }
+
+  return TRUE;
+}
+
+/**
+ * eknr_template_blob_new:
+ * @bytes: A blob made by eknr_template_blob_builder_end(), or loaded
+ *   from disk
+ * @error: A #GError
+ *
+ * Check that @bytes is a compiled template of the current version and
+ * that it is intact, and wrap it for rendering. Nothing is copied out
+ * of @bytes, so if it wraps a memory mapping the template is used
+ * straight from the mapping.
+ *
+ * Returns: (transfer full): A new #EknrTemplateBlob, or %NULL with
+ *   @error set if @bytes is not a valid blob.
+ */
+EknrTemplateBlob *
+eknr_template_blob_new (GBytes  *bytes,
+                        GError **error)
+{
+  g_autoptr(EknrTemplateBlob) blob = g_new0 (EknrTemplateBlob, 1);
+  gsize size;
+  const guint8 *data = g_bytes_get_data (bytes, &size);
+  const BlobHeader *header = (const BlobHeader *) data;
+  gsize payload_size;
+
+  blob->bytes = g_bytes_ref (bytes);
+
+  if (size < sizeof (BlobHeader) ||
+      memcmp (header->magic, BLOB_MAGIC, sizeof (header->magic)) != 0)
+    {
+      set_invalid_blob_error (error, "bad magic");
+      return NULL;
+    }
+
+  if (GPOINTER_TO_SIZE (data) % 8 != 0)
+    {
+      set_invalid_blob_error (error, "misaligned");
+      return NULL;
+    }
+
+  if (header->version != EKNR_TEMPLATE_BLOB_VERSION)
+    {
+      set_invalid_blob_error (error, "wrong version");
+      return NULL;
+    }
+
+  payload_size = size - sizeof (BlobHeader);
+  if (header->n_tokens > payload_size / sizeof (BlobToken) ||
+      header->strings_length != payload_size - header->n_tokens * sizeof (BlobToken))
+    {
+      set_invalid_blob_error (error, "truncated");
+      return NULL;
+    }
+
+  if (eknr_hash_bytes (data + sizeof (BlobHeader), payload_size) != header->checksum)
+    {
+      set_invalid_blob_error (error, "checksum mismatch");
+      return NULL;
+    }
+
+  blob->header = header;
+  blob->tokens = (const BlobToken *) (data + sizeof (BlobHeader));
+  blob->strings = (const char *) (blob->tokens + header->n_tokens);
+
+  if (!blob_validate (blob, error))
+    return NULL;
+
+  return g_steal_pointer (&blob);
+}
+
+void
+eknr_template_blob_free (EknrTemplateBlob *blob)
+{
+  g_bytes_unref (blob->bytes);
+  g_free (blob);
+}
+
+/**
+ * eknr_template_blob_get_bytes:
+ * @blob: An #EknrTemplateBlob
+ *
+ * Returns: (transfer none): The serialized form of @blob
+ */
+GBytes *
+eknr_template_blob_get_bytes (EknrTemplateBlob *blob)
+{
+  return blob->bytes;
+}
+
+/**
+ * eknr_template_blob_get_source_length:
+ * @blob: An #EknrTemplateBlob
+ *
+ * Returns: The length of the template source that @blob was compiled
+ *   from, which is a reasonable guess at the size of its output.
+ */
+gsize
+eknr_template_blob_get_source_length (EknrTemplateBlob *blob)
+{
+  return blob->header->source_length;
+}
+
+static char *
+blob_path (const char *cache_dir,
+           guint64     source_hash)
+{
+  g_autofree char *basename = g_strdup_printf ("%016" G_GINT64_MODIFIER "x" BLOB_FILE_SUFFIX,
+                                               source_hash);
+
+  return g_build_filename (cache_dir, basename, NULL);
+}
+
+/**
+ * eknr_template_blob_load:
+ * @cache_dir: The directory that compiled templates are saved in
+ * @source_hash: The eknr_hash_bytes() of the template source
+ * @source_length: The length of the template source in bytes
+ * @error: A #GError
+ *
+ * Map the blob that eknr_template_blob_save() saved for the template
+ * source with @source_hash and @source_length, if there is one. A blob
+ * that is damaged, from a different version, or was compiled from
+ * different source, is rejected with an error, in which case the
+ * caller should compile the template again.
+ *
+ * Returns: (transfer full): The compiled template, or %NULL with @error
+ *   set; the error is %G_FILE_ERROR_NOENT if nothing was saved.
+ */
+EknrTemplateBlob *
+eknr_template_blob_load (const char  *cache_dir,
+                         guint64      source_hash,
+                         gsize        source_length,
+                         GError     **error)
+{
+  g_autofree char *path = blob_path (cache_dir, source_hash);
+  g_autoptr(GMappedFile) mapped_file = g_mapped_file_new (path, FALSE, error);
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(EknrTemplateBlob) blob = NULL;
+  g_autoptr(GFile) file = NULL;
+
+  if (mapped_file == NULL)
+    return NULL;
+
+  /* The bytes keep the mapping alive for as long as the blob needs it */
+  bytes = g_mapped_file_get_bytes (mapped_file);
+  blob = eknr_template_blob_new (bytes, error);
+
+  if (blob == NULL)
+    return NULL;
+
+  if (blob->header->source_hash != source_hash ||
+      blob->header->source_length != source_length)
+    {
+      set_invalid_blob_error (error, "compiled from different source");
+      return NULL;
+    }
+
+  /* The modification time records when the blob was last used, for
+   * blob_dir_prune(); it does not matter if this fails */
+  file = g_file_new_for_path (path);
+  g_file_set_attribute_uint64 (file,
+                               G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                               g_get_real_time () / G_USEC_PER_SEC,
+                               G_FILE_QUERY_INFO_NONE,
+                               NULL,
+                               NULL);
+
+  return g_steal_pointer (&blob);
+}
+
+typedef struct _SavedBlob {
+  char *name;
+  guint64 size;
+  guint64 last_used; /* modification time, in microseconds */
+} SavedBlob;
+
+static void
+saved_blob_clear (gpointer data)
+{
+  SavedBlob *saved = data;
+
+  g_free (saved->name);
+}
+
+static gint
+saved_blob_compare_last_used (gconstpointer a,
+                              gconstpointer b)
+{
+  const SavedBlob *saved_a = a, *saved_b = b;
+
+  if (saved_a->last_used != saved_b->last_used)
+    return saved_a->last_used < saved_b->last_used ? -1 : 1;
+  return strcmp (saved_a->name, saved_b->name);
+}
+
+/* Delete the least recently used blobs in @cache_dir, other than the
+ * one named @keep_name, until the blobs there take up no more than
+ * @max_bytes. Blobs that another process is using stay mapped, so
+ * deleting them only costs that process a compile next time. */
+static void
+blob_dir_prune (const char *cache_dir,
+                const char *keep_name,
+                guint64     max_bytes)
+{
+  g_autoptr(GFile) dir = g_file_new_for_path (cache_dir);
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GArray) saved_blobs = g_array_new (FALSE, FALSE, sizeof (SavedBlob));
+  g_autoptr(GError) error = NULL;
+  guint64 total_size = 0;
+  guint i;
+
+  g_array_set_clear_func (saved_blobs, saved_blob_clear);
+
+  enumerator = g_file_enumerate_children (dir,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                          G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          NULL,
+                                          &error);
+
+  while (enumerator != NULL)
+    {
+      g_autoptr(GFileInfo) info = g_file_enumerator_next_file (enumerator, NULL, &error);
+      SavedBlob saved;
+
+      if (info == NULL)
+        break;
+
+      /* Leave alone anything that is not a blob, such as the temporary
+       * file of a save in progress */
+      if (!g_str_has_suffix (g_file_info_get_name (info), BLOB_FILE_SUFFIX))
+        continue;
+
+      saved.name = g_strdup (g_file_info_get_name (info));
+      saved.size = g_file_info_get_size (info);
+      saved.last_used = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+      g_array_append_val (saved_blobs, saved);
+      total_size += saved.size;
+    }
+
+  if (error != NULL)
+    {
+      g_debug ("Could not list compiled templates in %s: %s", cache_dir, error->message);
+      return;
+    }
+
+  g_array_sort (saved_blobs, saved_blob_compare_last_used);
+
+  for (i = 0; i < saved_blobs->len && total_size > max_bytes; ++i)
+    {
+      const SavedBlob *saved = &g_array_index (saved_blobs, SavedBlob, i);
+      g_autofree char *path = NULL;
+
+      if (strcmp (saved->name, keep_name) == 0)
+        continue;
+
+      path = g_build_filename (cache_dir, saved->name, NULL);
+      if (g_unlink (path) == 0 || errno == ENOENT)
+        total_size -= saved->size;
+    }
+}
+
+/**
+ * eknr_template_blob_save:
+ * @blob: An #EknrTemplateBlob
+ * @cache_dir: The directory to save compiled templates in
+ * @max_dir_bytes: The most space the blobs in @cache_dir may take up
+ * @error: A #GError
+ *
+ * Save @blob in @cache_dir so that eknr_template_blob_load() can find
+ * it, creating the directory if needed. The file is replaced
+ * atomically, so other processes loading the same template at the same
+ * time either see the whole blob or none of it.
+ *
+ * If the blobs in @cache_dir then take up more than @max_dir_bytes, the
+ * ones that were loaded or saved least recently are deleted, so that
+ * templates which are no longer used do not pile up.
+ *
+ * Returns: %TRUE on success, %FALSE with @error set on failure.
+ */
+gboolean
+eknr_template_blob_save (EknrTemplateBlob  *blob,
+                         const char        *cache_dir,
+                         guint64            max_dir_bytes,
+                         GError           **error)
+{
+  g_autofree char *path = blob_path (cache_dir, blob->header->source_hash);
+  g_autofree char *name = NULL;
+  gsize size;
+  const char *data = g_bytes_get_data (blob->bytes, &size);
+
+  if (g_mkdir_with_parents (cache_dir, 0700) != 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Could not create %s: %s", cache_dir, g_strerror (saved_errno));
+      return FALSE;
+    }
+
+  if (!g_file_set_contents (path, data, size, error))
+    return FALSE;
+
+  name = g_path_get_basename (path);
+  blob_dir_prune (cache_dir, name, max_dir_bytes);
+  return TRUE;
+}
+
+typedef struct _BlobRender {
+  EknrTemplateBlob *blob;
+  EknrTemplateContext *context;
+  EknrTemplateWriteFunc write;
+  gpointer user_data;
+
+  /* The value of {{.}} in the innermost string or list section */
+  const EknrTemplateString *dot;
+} BlobRender;
+
+static gboolean
+set_substitution_error (GError     **error,
+                        const char  *format,
+                        ...) G_GNUC_PRINTF (2, 3);
+
+static gboolean
+set_substitution_error (GError     **error,
+                        const char  *format,
+                        ...)
+{
+  g_autofree char *msg = NULL;
+  va_list args;
+
+  va_start (args, format);
+  msg = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_set_error (error,
+               EKNR_ERROR,
+               EKNR_ERROR_SUBSTITUTION_FAILED,
+               "Failed to perform template substitution: %s",
+               msg);
+  return FALSE;
+}
+
+static gboolean blob_render_range (BlobRender  *render,
+                                   guint32      start,
+                                   guint32      end,
+                                   GError     **error);
+
+static gboolean
+blob_render_variable (BlobRender       *render,
+                      const BlobToken  *token,
+                      GError          **error)
+{
+  const char *name = render->blob->strings + token->string;
+  const EknrTemplateString *value = NULL;
+
+  /* Inside a section, "." refers to the section's value */
+  if (render->dot != NULL && name[0] == '.')
+    {
+      value = render->dot;
+    }
+  else
+    {
+      const EknrTemplateValue *variable = eknr_template_context_lookup (render->context,
+                                                                        name);
+
+      if (variable == NULL || variable->type != EKNR_TEMPLATE_VALUE_STRING)
+        return set_substitution_error (error, "No such variable %s", name);
+
+      value = &variable->string;
+    }
+
+  if (token->type == BLOB_TOKEN_VARIABLE)
+    return eknr_template_write_escaped (render->write,
+                                        render->user_data,
+                                        value->str,
+                                        value->length,
+                                        error);
+
+  return render->write (render->user_data, value->str, value->length, error);
+}
+
+static gboolean
+blob_render_section (BlobRender  *render,
+                     guint32      index,
+                     GError     **error)
+{
+  const BlobToken *token = &render->blob->tokens[index];
+  const char *name = render->blob->strings + token->string;
+  const EknrTemplateValue *value = eknr_template_context_lookup (render->context, name);
+  const EknrTemplateString *last_dot = render->dot;
+  const EknrTemplateString *iter;
+  gboolean ok = TRUE;
+
+  if (value == NULL)
+    return set_substitution_error (error, "No such section %s", name);
+
+  switch (value->type)
+    {
+    case EKNR_TEMPLATE_VALUE_STRV:
+      for (iter = value->strv; ok && iter->str != NULL; ++iter)
+        {
+          render->dot = iter;
+          ok = blob_render_range (render, index + 1, token->end, error);
+        }
+      break;
+    case EKNR_TEMPLATE_VALUE_BOOLEAN:
+      if (value->boolean)
+        ok = blob_render_range (render, index + 1, token->end, error);
+      break;
+    case EKNR_TEMPLATE_VALUE_STRING:
+      render->dot = &value->string;
+      ok = blob_render_range (render, index + 1, token->end, error);
+      break;
+    case EKNR_TEMPLATE_VALUE_UNSUPPORTED:
+    default:
+      return set_substitution_error (error,
+                                     "No handler for section type %s on token %s",
+                                     g_variant_get_type_string (value->variant),
+                                     name);
+    }
+
+  render->dot = last_dot;
+  return ok;
+}
+
+static gboolean
+blob_render_range (BlobRender  *render,
+                   guint32      start,
+                   guint32      end,
+                   GError     **error)
+{
+  guint32 i = start;
+
+  while (i < end)
+    {
+      const BlobToken *token = &render->blob->tokens[i];
+
+      switch (token->type)
+        {
+        case BLOB_TOKEN_TEXT:
+          if (!render->write (render->user_data,
+                              render->blob->strings + token->string,
+                              token->length,
+                              error))
+            return FALSE;
+          ++i;
+          break;
+        case BLOB_TOKEN_VARIABLE:
+        case BLOB_TOKEN_RAW_VARIABLE:
+          if (!blob_render_variable (render, token, error))
+            return FALSE;
+          ++i;
+          break;
+        case BLOB_TOKEN_SECTION:
+        default:
+          if (!blob_render_section (render, i, error))
+            return FALSE;
+          i = token->end;
+          break;
+        }
+    }
+
+  return TRUE;
+}
+
+/**
+ * eknr_template_blob_render:
+ * @blob: An #EknrTemplateBlob
+ * @context: The template variables
+ * @write: Where to send the output
+ * @user_data: The closure to pass to @write
+ * @error: A #GError
+ *
+ * Render @blob with the values in @context. A blob is never modified
+ * after it is created, so this can be called from several threads at
+ * once.
+ *
+ * Returns: %TRUE on success, %FALSE with @error set on failure.
+ */
+gboolean
+eknr_template_blob_render (EknrTemplateBlob       *blob,
+                           EknrTemplateContext    *context,
+                           EknrTemplateWriteFunc   write,
+                           gpointer                user_data,
+                           GError                **error)
+{
+  BlobRender render = { blob, context, write, user_data, NULL };
+
+  return blob_render_range (&render, 0, blob->header->n_tokens, error);
+}
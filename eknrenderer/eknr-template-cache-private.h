@@ -0,0 +1,127 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrCachedTemplate:
+ * @compiled: The compiled template, as returned by the cache's
+ *   #EknrTemplateCacheCompileFunc
+ * @source_length: The length of the template source in bytes
+ * @compiled_size: The memory used by @compiled, in bytes
+ *
+ * A reference-counted compiled template held by an #EknrTemplateCache.
+ * Once it is in the cache it is never modified, so it can be used from
+ * any thread that holds a reference.
+ */
+typedef struct _EknrCachedTemplate {
+  /*< private >*/
+  volatile gint ref_count;
+  GDestroyNotify compiled_free;
+  char *etag;
+  volatile gsize last_used; /* (atomic) */
+
+  /*< public >*/
+  gpointer compiled;
+  gsize source_length;
+  gsize compiled_size;
+} EknrCachedTemplate;
+
+G_GNUC_INTERNAL
+EknrCachedTemplate * eknr_cached_template_ref (EknrCachedTemplate *template);
+
+G_GNUC_INTERNAL
+void eknr_cached_template_unref (EknrCachedTemplate *template);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrCachedTemplate, eknr_cached_template_unref)
+
+/**
+ * EknrTemplateCacheCompileFunc:
+ * @contents: The template source
+ * @length: The length of @contents in bytes
+ * @out_compiled_size: (out): Return location for the memory used by
+ *   the compiled template, in bytes
+ * @user_data: The user data passed to eknr_template_cache_new()
+ * @error: A #GError
+ *
+ * Compile a template. This may be called from any thread.
+ *
+ * Returns: The compiled template, or %NULL with @error set on failure.
+ */
+typedef gpointer (*EknrTemplateCacheCompileFunc) (const char  *contents,
+                                                  gsize        length,
+                                                  gsize       *out_compiled_size,
+                                                  gpointer     user_data,
+                                                  GError     **error);
+
+typedef struct _EknrTemplateCache EknrTemplateCache;
+
+G_GNUC_INTERNAL
+EknrTemplateCache * eknr_template_cache_new (EknrTemplateCacheCompileFunc compile,
+                                             GDestroyNotify               compiled_free,
+                                             gpointer                     user_data);
+
+G_GNUC_INTERNAL
+void eknr_template_cache_free (EknrTemplateCache *cache);
+
+G_GNUC_INTERNAL
+void eknr_template_cache_set_limits (EknrTemplateCache *cache,
+                                     guint              max_entries,
+                                     guint64            max_bytes);
+
+G_GNUC_INTERNAL
+void eknr_template_cache_get_limits (EknrTemplateCache *cache,
+                                     guint             *max_entries,
+                                     guint64           *max_bytes);
+
+G_GNUC_INTERNAL
+void eknr_template_cache_set_revalidate (EknrTemplateCache *cache,
+                                         gboolean           revalidate);
+
+G_GNUC_INTERNAL
+gboolean eknr_template_cache_get_revalidate (EknrTemplateCache *cache);
+
+/**
+ * EknrTemplateCacheStats:
+ * @entries: How many templates are in the cache
+ * @bytes: The memory used by the compiled templates in the cache
+ * @hits: How many lookups found their template in the cache
+ * @misses: How many lookups had to load their template
+ * @evictions: How many templates were dropped to stay within the limits
+ *
+ * A snapshot of what an #EknrTemplateCache holds and how well it is
+ * doing.
+ */
+typedef struct _EknrTemplateCacheStats {
+  guint entries;
+  guint64 bytes;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+} EknrTemplateCacheStats;
+
+G_GNUC_INTERNAL
+void eknr_template_cache_get_stats (EknrTemplateCache      *cache,
+                                    EknrTemplateCacheStats *stats);
+
+G_GNUC_INTERNAL
+EknrCachedTemplate * eknr_template_cache_lookup (EknrTemplateCache  *cache,
+                                                 GFile              *file,
+                                                 GError            **error);
+
+G_GNUC_INTERNAL
+void eknr_template_cache_lookup_async (EknrTemplateCache   *cache,
+                                       GFile               *file,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data);
+
+G_GNUC_INTERNAL
+EknrCachedTemplate * eknr_template_cache_lookup_finish (EknrTemplateCache  *cache,
+                                                        GAsyncResult       *result,
+                                                        GError            **error);
+
+G_END_DECLS
@@ -0,0 +1,867 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "eknr-template-cache-private.h"
+
+/* The template cache is built for many concurrent readers and rare
+ * writers.
+ *
+ * Readers never take a lock. The cache contents live in an immutable
+ * snapshot hash table which is replaced atomically whenever a template
+ * is added. A reader announces itself by incrementing "readers", reads
+ * the current snapshot, takes a reference on the template it finds and
+ * then decrements "readers" again.
+ *
+ * Writers serialize on "lock". A replaced snapshot goes onto the
+ * "retired" list, since a reader may still be looking at it, and
+ * retired snapshots are only freed once a writer sees that there are
+ * no readers at all. Any reader that starts after a new snapshot is
+ * published can only see the new one.
+ *
+ * If several threads miss on the same URI at once, only the first one
+ * loads and compiles it. The others wait on "cond" and then pick the
+ * result up from the new snapshot. If compiling fails, the next waiter
+ * tries again so that it gets its own error.
+ *
+ * Asynchronous lookups that miss on a URI that is already being loaded,
+ * either way, queue their task on the pending load and all get its
+ * result. A synchronous lookup never waits for an asynchronous load,
+ * since the load may need the main loop of the very thread that is
+ * waiting; it loads the template itself instead.
+ *
+ * The cache can be limited to a number of templates and a number of
+ * bytes of compiled templates. Every lookup stamps the template it
+ * finds with the next tick of "clock", without taking the lock, and
+ * whenever a new snapshot would be over the limits, the templates with
+ * the oldest stamps are left out of it. There are only ever a handful
+ * of templates, so finding the oldest is a plain scan.
+ *
+ * If "revalidate" is set, a lookup that finds a template also checks
+ * that the file's etag is still the one it had when the template was
+ * read, and reads it again if not.
+ */
+struct _EknrTemplateCache {
+  GHashTable *snapshot; /* (atomic) key-type=char *, value-type=EknrCachedTemplate */
+  volatile gint readers;
+
+  GMutex lock;
+  GCond cond;
+  GHashTable *pending; /* (locked-by lock) key-type=char *, value-type=PendingLoad */
+  GSList *retired; /* (locked-by lock) old snapshots */
+
+  volatile gsize clock; /* (atomic) */
+  volatile gint revalidate; /* (atomic) */
+  volatile gsize hits; /* (atomic) */
+  volatile gsize misses; /* (atomic) */
+
+  guint max_entries; /* (locked-by lock) 0 for no limit */
+  guint64 max_bytes; /* (locked-by lock) 0 for no limit */
+  guint64 bytes; /* (locked-by lock) total compiled_size in the snapshot */
+  guint64 evictions; /* (locked-by lock) */
+
+  EknrTemplateCacheCompileFunc compile;
+  GDestroyNotify compiled_free;
+  gpointer user_data;
+};
+
+/* A template that is being loaded and compiled */
+typedef struct _PendingLoad {
+  gboolean is_async;
+  GPtrArray *waiters; /* element-type=GTask, asynchronous lookups waiting for it */
+} PendingLoad;
+
+static PendingLoad *
+pending_load_new (gboolean is_async)
+{
+  PendingLoad *pending = g_new0 (PendingLoad, 1);
+
+  pending->is_async = is_async;
+  pending->waiters = g_ptr_array_new_with_free_func (g_object_unref);
+
+  return pending;
+}
+
+static void
+pending_load_free (PendingLoad *pending)
+{
+  g_clear_pointer (&pending->waiters, g_ptr_array_unref);
+  g_free (pending);
+}
+
+/* Takes ownership of @compiled and @etag */
+static EknrCachedTemplate *
+cached_template_new (gpointer        compiled,
+                     GDestroyNotify  compiled_free,
+                     gsize           source_length,
+                     gsize           compiled_size,
+                     char           *etag)
+{
+  EknrCachedTemplate *template = g_new0 (EknrCachedTemplate, 1);
+
+  template->ref_count = 1;
+  template->compiled = compiled;
+  template->compiled_free = compiled_free;
+  template->source_length = source_length;
+  template->compiled_size = compiled_size;
+  template->etag = etag;
+
+  return template;
+}
+
+EknrCachedTemplate *
+eknr_cached_template_ref (EknrCachedTemplate *template)
+{
+  g_atomic_int_inc (&template->ref_count);
+  return template;
+}
+
+void
+eknr_cached_template_unref (EknrCachedTemplate *template)
+{
+  if (!g_atomic_int_dec_and_test (&template->ref_count))
+    return;
+
+  template->compiled_free (template->compiled);
+  g_free (template->etag);
+  g_free (template);
+}
+
+static GHashTable *
+snapshot_new (void)
+{
+  return g_hash_table_new_full (g_str_hash,
+                                g_str_equal,
+                                g_free,
+                                (GDestroyNotify) eknr_cached_template_unref);
+}
+
+static GHashTable *
+snapshot_copy (GHashTable *snapshot)
+{
+  GHashTable *copy = snapshot_new ();
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, snapshot);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_hash_table_insert (copy, g_strdup (key), eknr_cached_template_ref (value));
+
+  return copy;
+}
+
+EknrTemplateCache *
+eknr_template_cache_new (EknrTemplateCacheCompileFunc compile,
+                         GDestroyNotify               compiled_free,
+                         gpointer                     user_data)
+{
+  EknrTemplateCache *cache = g_new0 (EknrTemplateCache, 1);
+
+  cache->snapshot = snapshot_new ();
+  cache->pending = g_hash_table_new_full (g_str_hash,
+                                          g_str_equal,
+                                          g_free,
+                                          (GDestroyNotify) pending_load_free);
+  g_mutex_init (&cache->lock);
+  g_cond_init (&cache->cond);
+
+  cache->compile = compile;
+  cache->compiled_free = compiled_free;
+  cache->user_data = user_data;
+
+  return cache;
+}
+
+void
+eknr_template_cache_free (EknrTemplateCache *cache)
+{
+  g_hash_table_unref (cache->snapshot);
+  g_slist_free_full (cache->retired, (GDestroyNotify) g_hash_table_unref);
+  g_hash_table_unref (cache->pending);
+  g_mutex_clear (&cache->lock);
+  g_cond_clear (&cache->cond);
+  g_free (cache);
+}
+
+/* The lock-free read side. Returns a new reference or %NULL. */
+static EknrCachedTemplate *
+cache_lookup_snapshot (EknrTemplateCache *cache,
+                       const char        *uri)
+{
+  GHashTable *snapshot = NULL;
+  EknrCachedTemplate *template = NULL;
+
+  g_atomic_int_inc (&cache->readers);
+
+  snapshot = g_atomic_pointer_get (&cache->snapshot);
+  template = g_hash_table_lookup (snapshot, uri);
+  if (template != NULL)
+    eknr_cached_template_ref (template);
+
+  g_atomic_int_add (&cache->readers, -1);
+
+  return template;
+}
+
+/* Must be called with cache->lock held */
+static void
+cache_publish_snapshot_locked (EknrTemplateCache *cache,
+                               GHashTable        *snapshot)
+{
+  GHashTable *old_snapshot = cache->snapshot;
+
+  g_atomic_pointer_set (&cache->snapshot, snapshot);
+  cache->retired = g_slist_prepend (cache->retired, old_snapshot);
+
+  if (g_atomic_int_get (&cache->readers) == 0)
+    g_slist_free_full (g_steal_pointer (&cache->retired),
+                       (GDestroyNotify) g_hash_table_unref);
+}
+
+/* Mark @template as the most recently used */
+static void
+cache_touch (EknrTemplateCache  *cache,
+             EknrCachedTemplate *template)
+{
+  gsize now = (gsize) g_atomic_pointer_add (&cache->clock, 1) + 1;
+
+  g_atomic_pointer_set (&template->last_used, now);
+}
+
+static void
+cache_record_hit (EknrTemplateCache  *cache,
+                  EknrCachedTemplate *template)
+{
+  cache_touch (cache, template);
+  g_atomic_pointer_add (&cache->hits, 1);
+}
+
+/* Must be called with cache->lock held */
+static gboolean
+cache_is_over_limits_locked (EknrTemplateCache *cache,
+                             GHashTable        *snapshot)
+{
+  return (cache->max_entries > 0 && g_hash_table_size (snapshot) > cache->max_entries) ||
+         (cache->max_bytes > 0 && cache->bytes > cache->max_bytes);
+}
+
+/* Must be called with cache->lock held. Drops the least recently used
+ * templates other than @keep from @snapshot, which must not have been
+ * published yet, until it is within the cache's limits. */
+static void
+cache_evict_locked (EknrTemplateCache  *cache,
+                    GHashTable         *snapshot,
+                    EknrCachedTemplate *keep)
+{
+  while (cache_is_over_limits_locked (cache, snapshot))
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      const char *oldest_uri = NULL;
+      EknrCachedTemplate *oldest = NULL;
+
+      g_hash_table_iter_init (&iter, snapshot);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          EknrCachedTemplate *template = value;
+
+          if (template == keep)
+            continue;
+
+          if (oldest == NULL ||
+              (gsize) g_atomic_pointer_get (&template->last_used) <
+              (gsize) g_atomic_pointer_get (&oldest->last_used))
+            {
+              oldest_uri = key;
+              oldest = template;
+            }
+        }
+
+      if (oldest == NULL)
+        break;
+
+      cache->bytes -= oldest->compiled_size;
+      cache->evictions++;
+      g_hash_table_remove (snapshot, oldest_uri);
+    }
+}
+
+/* Must be called with cache->lock held */
+static void
+cache_insert_locked (EknrTemplateCache  *cache,
+                     const char         *uri,
+                     EknrCachedTemplate *template)
+{
+  GHashTable *snapshot = snapshot_copy (cache->snapshot);
+  EknrCachedTemplate *old_template = g_hash_table_lookup (snapshot, uri);
+
+  if (old_template != NULL)
+    cache->bytes -= old_template->compiled_size;
+
+  g_hash_table_replace (snapshot,
+                        g_strdup (uri),
+                        eknr_cached_template_ref (template));
+  cache->bytes += template->compiled_size;
+  cache_touch (cache, template);
+
+  cache_evict_locked (cache, snapshot, template);
+  cache_publish_snapshot_locked (cache, snapshot);
+}
+
+/* Must be called with cache->lock held. Removes @template from the
+ * cache, unless something has already replaced it. */
+static void
+cache_remove_locked (EknrTemplateCache  *cache,
+                     const char         *uri,
+                     EknrCachedTemplate *template)
+{
+  GHashTable *snapshot;
+
+  if (g_hash_table_lookup (cache->snapshot, uri) != template)
+    return;
+
+  snapshot = snapshot_copy (cache->snapshot);
+  g_hash_table_remove (snapshot, uri);
+  cache->bytes -= template->compiled_size;
+  cache_publish_snapshot_locked (cache, snapshot);
+}
+
+/* Whether @template was read from @file as it is now. Blocks on I/O. */
+static gboolean
+cached_template_is_current (EknrCachedTemplate *template,
+                            GFile              *file)
+{
+  g_autoptr(GFileInfo) info = g_file_query_info (file,
+                                                 G_FILE_ATTRIBUTE_ETAG_VALUE,
+                                                 G_FILE_QUERY_INFO_NONE,
+                                                 NULL,
+                                                 NULL);
+
+  return info != NULL && g_strcmp0 (g_file_info_get_etag (info), template->etag) == 0;
+}
+
+/**
+ * eknr_template_cache_set_limits:
+ * @cache: An #EknrTemplateCache
+ * @max_entries: The most templates to keep, or 0 for no limit
+ * @max_bytes: The most memory to use for compiled templates, or 0 for
+ *   no limit
+ *
+ * Limit the size of @cache. When it is over either limit, the least
+ * recently used templates are dropped, except that the template that
+ * was added most recently is always kept.
+ */
+void
+eknr_template_cache_set_limits (EknrTemplateCache *cache,
+                                guint              max_entries,
+                                guint64            max_bytes)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  GHashTable *snapshot;
+
+  cache->max_entries = max_entries;
+  cache->max_bytes = max_bytes;
+
+  if (!cache_is_over_limits_locked (cache, cache->snapshot))
+    return;
+
+  snapshot = snapshot_copy (cache->snapshot);
+  cache_evict_locked (cache, snapshot, NULL);
+  cache_publish_snapshot_locked (cache, snapshot);
+}
+
+void
+eknr_template_cache_get_limits (EknrTemplateCache *cache,
+                                guint             *max_entries,
+                                guint64           *max_bytes)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  if (max_entries != NULL)
+    *max_entries = cache->max_entries;
+  if (max_bytes != NULL)
+    *max_bytes = cache->max_bytes;
+}
+
+/**
+ * eknr_template_cache_set_revalidate:
+ * @cache: An #EknrTemplateCache
+ * @revalidate: Whether to check that templates are up to date
+ *
+ * If @revalidate is %TRUE, every lookup that finds a template checks
+ * whether its file has changed since it was read, by comparing the
+ * file's etag, and reads it again if it has. This costs a query of the
+ * file's metadata on every lookup.
+ */
+void
+eknr_template_cache_set_revalidate (EknrTemplateCache *cache,
+                                    gboolean           revalidate)
+{
+  g_atomic_int_set (&cache->revalidate, !!revalidate);
+}
+
+gboolean
+eknr_template_cache_get_revalidate (EknrTemplateCache *cache)
+{
+  return g_atomic_int_get (&cache->revalidate);
+}
+
+/**
+ * eknr_template_cache_get_stats:
+ * @cache: An #EknrTemplateCache
+ * @stats: (out caller-allocates): Return location for the statistics
+ *
+ * Get the current size of @cache and its counters.
+ */
+void
+eknr_template_cache_get_stats (EknrTemplateCache      *cache,
+                               EknrTemplateCacheStats *stats)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+
+  stats->entries = g_hash_table_size (cache->snapshot);
+  stats->bytes = cache->bytes;
+  stats->hits = (gsize) g_atomic_pointer_get (&cache->hits);
+  stats->misses = (gsize) g_atomic_pointer_get (&cache->misses);
+  stats->evictions = cache->evictions;
+}
+
+/* Must be called with cache->lock held. Removes the pending load for
+ * @uri and returns the lookups that were waiting for it. */
+static GPtrArray *
+cache_finish_pending_locked (EknrTemplateCache *cache,
+                             const char        *uri)
+{
+  PendingLoad *pending = g_hash_table_lookup (cache->pending, uri);
+  GPtrArray *waiters = g_steal_pointer (&pending->waiters);
+
+  g_hash_table_remove (cache->pending, uri);
+  g_cond_broadcast (&cache->cond);
+
+  return waiters;
+}
+
+/* Call without cache->lock held, since returning a task may call its
+ * callback straight away */
+static void
+complete_waiters (GPtrArray          *waiters,
+                  EknrCachedTemplate *template,
+                  const GError       *error)
+{
+  guint i;
+
+  for (i = 0; i < waiters->len; ++i)
+    {
+      GTask *task = g_ptr_array_index (waiters, i);
+
+      if (template != NULL)
+        g_task_return_pointer (task,
+                               eknr_cached_template_ref (template),
+                               (GDestroyNotify) eknr_cached_template_unref);
+      else
+        g_task_return_error (task, g_error_copy (error));
+    }
+
+  g_ptr_array_unref (waiters);
+}
+
+/**
+ * eknr_template_cache_lookup:
+ * @cache: An #EknrTemplateCache
+ * @file: The template file
+ * @error: A #GError
+ *
+ * Look up the compiled template for @file, loading and compiling it if
+ * it is not in the cache yet. This is safe to call from any thread.
+ *
+ * Returns: (transfer full): A compiled template, or %NULL on error.
+ */
+EknrCachedTemplate *
+eknr_template_cache_lookup (EknrTemplateCache  *cache,
+                            GFile              *file,
+                            GError            **error)
+{
+  g_autofree char *uri = g_file_get_uri (file);
+  EknrCachedTemplate *template = cache_lookup_snapshot (cache, uri);
+  g_autoptr(GError) local_error = NULL;
+  g_autofree char *contents = NULL;
+  gsize contents_length = 0;
+  g_autofree char *etag = NULL;
+  gpointer compiled = NULL;
+  gsize compiled_size = 0;
+  PendingLoad *pending = NULL;
+  gboolean owns_pending;
+  GPtrArray *waiters = NULL;
+
+  if (template != NULL &&
+      g_atomic_int_get (&cache->revalidate) &&
+      !cached_template_is_current (template, file))
+    {
+      g_mutex_lock (&cache->lock);
+      cache_remove_locked (cache, uri, template);
+      g_mutex_unlock (&cache->lock);
+
+      g_clear_pointer (&template, eknr_cached_template_unref);
+    }
+
+  if (template != NULL)
+    {
+      cache_record_hit (cache, template);
+      return template;
+    }
+
+  g_atomic_pointer_add (&cache->misses, 1);
+
+  g_mutex_lock (&cache->lock);
+
+  /* Someone else may be compiling this template, in which case wait
+   * for them to finish */
+  while ((template = cache_lookup_snapshot (cache, uri)) == NULL &&
+         (pending = g_hash_table_lookup (cache->pending, uri)) != NULL &&
+         !pending->is_async)
+    g_cond_wait (&cache->cond, &cache->lock);
+
+  if (template != NULL)
+    {
+      g_mutex_unlock (&cache->lock);
+      return template;
+    }
+
+  owns_pending = (pending == NULL);
+  if (owns_pending)
+    g_hash_table_insert (cache->pending, g_strdup (uri), pending_load_new (FALSE));
+
+  g_mutex_unlock (&cache->lock);
+
+  if (g_file_load_contents (file, NULL, &contents, &contents_length, &etag, &local_error))
+    compiled = cache->compile (contents,
+                               contents_length,
+                               &compiled_size,
+                               cache->user_data,
+                               &local_error);
+
+  g_mutex_lock (&cache->lock);
+
+  if (owns_pending)
+    waiters = cache_finish_pending_locked (cache, uri);
+
+  if (compiled != NULL)
+    {
+      template = cached_template_new (compiled,
+                                      cache->compiled_free,
+                                      contents_length,
+                                      compiled_size,
+                                      g_steal_pointer (&etag));
+      cache_insert_locked (cache, uri, template);
+    }
+
+  g_mutex_unlock (&cache->lock);
+
+  if (waiters != NULL)
+    complete_waiters (waiters, template, local_error);
+
+  if (local_error != NULL)
+    g_propagate_error (error, g_steal_pointer (&local_error));
+
+  return template;
+}
+
+/* An asynchronous load of a template that is not in the cache yet. It
+ * does not belong to any one lookup, so that it finishes even if the
+ * lookup that started it is cancelled. */
+typedef struct _AsyncLoad {
+  EknrTemplateCache *cache;
+  char *uri;
+  char *contents;
+  gsize contents_length;
+  char *etag;
+  gsize compiled_size;
+} AsyncLoad;
+
+static void
+async_load_free (AsyncLoad *load)
+{
+  g_free (load->uri);
+  g_free (load->contents);
+  g_free (load->etag);
+  g_free (load);
+}
+
+static void
+async_load_finish (AsyncLoad    *load,
+                   gpointer      compiled,
+                   const GError *error)
+{
+  EknrTemplateCache *cache = load->cache;
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  GPtrArray *waiters;
+
+  g_mutex_lock (&cache->lock);
+
+  waiters = cache_finish_pending_locked (cache, load->uri);
+
+  if (compiled != NULL)
+    {
+      template = cached_template_new (compiled,
+                                      cache->compiled_free,
+                                      load->contents_length,
+                                      load->compiled_size,
+                                      g_steal_pointer (&load->etag));
+      cache_insert_locked (cache, load->uri, template);
+    }
+
+  g_mutex_unlock (&cache->lock);
+
+  complete_waiters (waiters, template, error);
+  async_load_free (load);
+}
+
+static void
+compile_thread (GTask                        *task,
+                G_GNUC_UNUSED gpointer        source_object,
+                gpointer                      task_data,
+                G_GNUC_UNUSED GCancellable   *cancellable)
+{
+  AsyncLoad *load = task_data;
+  EknrTemplateCache *cache = load->cache;
+  g_autoptr(GError) local_error = NULL;
+  gpointer compiled = cache->compile (load->contents,
+                                      load->contents_length,
+                                      &load->compiled_size,
+                                      cache->user_data,
+                                      &local_error);
+
+  if (compiled == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_pointer (task, compiled, cache->compiled_free);
+}
+
+static void
+on_compiled (G_GNUC_UNUSED GObject *source_object,
+             GAsyncResult          *result,
+             gpointer               user_data)
+{
+  AsyncLoad *load = user_data;
+  g_autoptr(GError) local_error = NULL;
+  gpointer compiled = g_task_propagate_pointer (G_TASK (result), &local_error);
+
+  async_load_finish (load, compiled, local_error);
+}
+
+static void
+on_contents_loaded (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  AsyncLoad *load = user_data;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GTask) compile_task = NULL;
+
+  if (!g_file_load_contents_finish (G_FILE (source_object),
+                                    result,
+                                    &load->contents,
+                                    &load->contents_length,
+                                    &load->etag,
+                                    &local_error))
+    {
+      async_load_finish (load, NULL, local_error);
+      return;
+    }
+
+  /* Compiling can take a while for a big template, so keep it off the
+   * main thread */
+  compile_task = g_task_new (NULL, NULL, on_compiled, load);
+  g_task_set_source_tag (compile_task, on_contents_loaded);
+  g_task_set_task_data (compile_task, load, NULL);
+  g_task_run_in_thread (compile_task, compile_thread);
+}
+
+/* The part of an asynchronous lookup that did not find a template.
+ * Takes ownership of @task. */
+static void
+cache_lookup_async_miss (EknrTemplateCache *cache,
+                         GTask             *task,
+                         GFile             *file,
+                         const char        *uri)
+{
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  PendingLoad *pending = NULL;
+  AsyncLoad *load = NULL;
+
+  g_atomic_pointer_add (&cache->misses, 1);
+
+  g_mutex_lock (&cache->lock);
+
+  template = cache_lookup_snapshot (cache, uri);
+  if (template != NULL)
+    {
+      g_mutex_unlock (&cache->lock);
+      g_task_return_pointer (task,
+                             g_steal_pointer (&template),
+                             (GDestroyNotify) eknr_cached_template_unref);
+      g_object_unref (task);
+      return;
+    }
+
+  pending = g_hash_table_lookup (cache->pending, uri);
+  if (pending != NULL)
+    {
+      g_ptr_array_add (pending->waiters, task);
+      g_mutex_unlock (&cache->lock);
+      return;
+    }
+
+  pending = pending_load_new (TRUE);
+  g_ptr_array_add (pending->waiters, task);
+  g_hash_table_insert (cache->pending, g_strdup (uri), pending);
+
+  g_mutex_unlock (&cache->lock);
+
+  load = g_new0 (AsyncLoad, 1);
+  load->cache = cache;
+  load->uri = g_strdup (uri);
+
+  g_file_load_contents_async (file, NULL, on_contents_loaded, load);
+}
+
+/* What an asynchronous lookup needs to carry across revalidation */
+typedef struct _AsyncLookup {
+  EknrTemplateCache *cache;
+  GFile *file;
+  char *uri;
+  EknrCachedTemplate *template;
+} AsyncLookup;
+
+static void
+async_lookup_free (AsyncLookup *lookup)
+{
+  g_object_unref (lookup->file);
+  g_free (lookup->uri);
+  g_clear_pointer (&lookup->template, eknr_cached_template_unref);
+  g_free (lookup);
+}
+
+static void
+on_revalidated (GObject      *source_object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+  GTask *task = user_data;
+  AsyncLookup *lookup = g_task_get_task_data (task);
+  EknrTemplateCache *cache = lookup->cache;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GFileInfo) info = g_file_query_info_finish (G_FILE (source_object),
+                                                        result,
+                                                        &local_error);
+
+  if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      g_object_unref (task);
+      return;
+    }
+
+  if (info != NULL &&
+      g_strcmp0 (g_file_info_get_etag (info), lookup->template->etag) == 0)
+    {
+      cache_record_hit (cache, lookup->template);
+      g_task_return_pointer (task,
+                             g_steal_pointer (&lookup->template),
+                             (GDestroyNotify) eknr_cached_template_unref);
+      g_object_unref (task);
+      return;
+    }
+
+  g_mutex_lock (&cache->lock);
+  cache_remove_locked (cache, lookup->uri, lookup->template);
+  g_mutex_unlock (&cache->lock);
+
+  g_clear_pointer (&lookup->template, eknr_cached_template_unref);
+  cache_lookup_async_miss (cache, task, lookup->file, lookup->uri);
+}
+
+/**
+ * eknr_template_cache_lookup_async:
+ * @cache: An #EknrTemplateCache
+ * @file: The template file
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: A #GAsyncReadyCallback to call with the template
+ * @user_data: Data to pass to @callback
+ *
+ * Asynchronous version of eknr_template_cache_lookup(). The template is
+ * read with g_file_load_contents_async() and compiled in a worker
+ * thread. Lookups of the same URI while it is loading all wait for the
+ * same load. Cancelling @cancellable makes this lookup fail when the
+ * load finishes, but does not stop the load, since other lookups may
+ * be waiting for it.
+ *
+ * @cache must outlive the lookup.
+ */
+void
+eknr_template_cache_lookup_async (EknrTemplateCache   *cache,
+                                  GFile               *file,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  GTask *task = g_task_new (NULL, cancellable, callback, user_data);
+  g_autofree char *uri = g_file_get_uri (file);
+  g_autoptr(EknrCachedTemplate) template = NULL;
+  AsyncLookup *lookup = NULL;
+
+  g_task_set_source_tag (task, eknr_template_cache_lookup_async);
+
+  template = cache_lookup_snapshot (cache, uri);
+  if (template == NULL)
+    {
+      cache_lookup_async_miss (cache, task, file, uri);
+      return;
+    }
+
+  if (!g_atomic_int_get (&cache->revalidate))
+    {
+      cache_record_hit (cache, template);
+      g_task_return_pointer (task,
+                             g_steal_pointer (&template),
+                             (GDestroyNotify) eknr_cached_template_unref);
+      g_object_unref (task);
+      return;
+    }
+
+  lookup = g_new0 (AsyncLookup, 1);
+  lookup->cache = cache;
+  lookup->file = g_object_ref (file);
+  lookup->uri = g_steal_pointer (&uri);
+  lookup->template = g_steal_pointer (&template);
+  g_task_set_task_data (task, lookup, (GDestroyNotify) async_lookup_free);
+
+  g_file_query_info_async (file,
+                           G_FILE_ATTRIBUTE_ETAG_VALUE,
+                           G_FILE_QUERY_INFO_NONE,
+                           G_PRIORITY_DEFAULT,
+                           cancellable,
+                           on_revalidated,
+                           task);
+}
+
+/**
+ * eknr_template_cache_lookup_finish:
+ * @cache: An #EknrTemplateCache
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish a lookup started with eknr_template_cache_lookup_async().
+ *
+ * Returns: (transfer full): A compiled template, or %NULL on error.
+ */
+EknrCachedTemplate *
+eknr_template_cache_lookup_finish (G_GNUC_UNUSED EknrTemplateCache  *cache,
+                                   GAsyncResult                     *result,
+                                   GError                          **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
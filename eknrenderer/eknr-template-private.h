@@ -0,0 +1,94 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknrTemplateString:
+ * @str: The string, not necessarily nul-terminated
+ * @length: The length of @str in bytes
+ *
+ * A string along with its length, so that template values never have
+ * to be measured while rendering.
+ */
+typedef struct _EknrTemplateString {
+  const char *str;
+  gsize length;
+} EknrTemplateString;
+
+/**
+ * EKNR_TEMPLATE_STRING:
+ * @literal: A string literal
+ *
+ * Initializer for an #EknrTemplateString from a string literal.
+ */
+#define EKNR_TEMPLATE_STRING(literal) { (literal), sizeof (literal) - 1 }
+
+/**
+ * EknrTemplateWriteFunc:
+ * @user_data: The closure passed to the render function
+ * @buffer: The bytes to write, not nul-terminated
+ * @length: The number of bytes in @buffer
+ * @error: A #GError
+ *
+ * Where templates compiled by meson-mst2c send their output.
+ *
+ * Returns: %TRUE on success, %FALSE with @error set on failure.
+ */
+typedef gboolean (*EknrTemplateWriteFunc) (gpointer     user_data,
+                                           const char  *buffer,
+                                           gsize        length,
+                                           GError     **error);
+
+G_GNUC_INTERNAL
+gboolean eknr_template_write_escaped (EknrTemplateWriteFunc   write,
+                                      gpointer                user_data,
+                                      const char             *value,
+                                      gsize                   length,
+                                      GError                **error);
+
+typedef enum {
+  EKNR_TEMPLATE_VALUE_STRING,
+  EKNR_TEMPLATE_VALUE_STRV,
+  EKNR_TEMPLATE_VALUE_BOOLEAN,
+  EKNR_TEMPLATE_VALUE_UNSUPPORTED
+} EknrTemplateValueType;
+
+/**
+ * EknrTemplateValue:
+ * @type: Which of the members below is valid
+ * @string: The value of an %EKNR_TEMPLATE_VALUE_STRING
+ * @strv: The values of an %EKNR_TEMPLATE_VALUE_STRV, terminated by an
+ *   entry with a %NULL str
+ * @boolean: The value of an %EKNR_TEMPLATE_VALUE_BOOLEAN
+ * @variant: The variant the value came from, which owns the strings
+ *
+ * A template variable, unpacked from its #GVariant once per render so
+ * that looking it up for each token does not allocate.
+ */
+typedef struct _EknrTemplateValue {
+  EknrTemplateValueType type;
+  EknrTemplateString string;
+  EknrTemplateString *strv;
+  gboolean boolean;
+  GVariant *variant;
+} EknrTemplateValue;
+
+typedef struct _EknrTemplateContext EknrTemplateContext;
+
+G_GNUC_INTERNAL
+EknrTemplateContext * eknr_template_context_new (GVariant *variables);
+
+G_GNUC_INTERNAL
+void eknr_template_context_free (EknrTemplateContext *context);
+
+G_GNUC_INTERNAL
+const EknrTemplateValue * eknr_template_context_lookup (EknrTemplateContext *context,
+                                                        const char          *name);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EknrTemplateContext, eknr_template_context_free)
+
+G_END_DECLS
@@ -0,0 +1,145 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include "eknr-html-private.h"
+#include "eknr-template-private.h"
+
+/**
+ * eknr_template_write_escaped:
+ * @write: An #EknrTemplateWriteFunc
+ * @user_data: The closure to pass to @write
+ * @value: The text to escape
+ * @length: The length of @value in bytes
+ * @error: A #GError
+ *
+ * Escape @value for HTML in the same way as an escaped mustache
+ * variable, and write it out with @write.
+ *
+ * Returns: %TRUE on success, %FALSE with @error set on failure.
+ */
+gboolean
+eknr_template_write_escaped (EknrTemplateWriteFunc   write,
+                             gpointer                user_data,
+                             const char             *value,
+                             gsize                   length,
+                             GError                **error)
+{
+  return eknr_html_escape_write (value, length, write, user_data, error);
+}
+
+struct _EknrTemplateContext {
+  GVariant *variables;
+  GHashTable *values; /* key-type=const char *, value-type=EknrTemplateValue */
+};
+
+static void
+template_value_free (EknrTemplateValue *value)
+{
+  g_clear_pointer (&value->strv, g_free);
+  g_clear_pointer (&value->variant, g_variant_unref);
+  g_free (value);
+}
+
+/* Takes ownership of @variant */
+static EknrTemplateValue *
+template_value_new (GVariant *variant)
+{
+  EknrTemplateValue *value = g_new0 (EknrTemplateValue, 1);
+
+  value->variant = variant;
+
+  if (g_variant_is_of_type (variant, G_VARIANT_TYPE_STRING))
+    {
+      value->type = EKNR_TEMPLATE_VALUE_STRING;
+      value->string.str = g_variant_get_string (variant, &value->string.length);
+    }
+  else if (g_variant_is_of_type (variant, G_VARIANT_TYPE_STRING_ARRAY))
+    {
+      GVariantIter iter;
+      const char *str;
+      gsize i = 0;
+
+      value->type = EKNR_TEMPLATE_VALUE_STRV;
+      value->strv = g_new0 (EknrTemplateString, g_variant_n_children (variant) + 1);
+
+      g_variant_iter_init (&iter, variant);
+      while (g_variant_iter_next (&iter, "&s", &str))
+        {
+          value->strv[i].str = str;
+          value->strv[i].length = strlen (str);
+          ++i;
+        }
+    }
+  else if (g_variant_is_of_type (variant, G_VARIANT_TYPE_BOOLEAN))
+    {
+      value->type = EKNR_TEMPLATE_VALUE_BOOLEAN;
+      value->boolean = g_variant_get_boolean (variant);
+    }
+  else
+    {
+      value->type = EKNR_TEMPLATE_VALUE_UNSUPPORTED;
+    }
+
+  return value;
+}
+
+/**
+ * eknr_template_context_new:
+ * @variables: (nullable): An 'a{sv}' #GVariant of template variables
+ *
+ * Unpack @variables into a table of typed values. Strings are not
+ * copied, they point into @variables, which is kept alive by the
+ * context. If @variables is floating, the context takes ownership of it.
+ *
+ * Returns: (transfer full): A new #EknrTemplateContext
+ */
+EknrTemplateContext *
+eknr_template_context_new (GVariant *variables)
+{
+  EknrTemplateContext *context = g_new0 (EknrTemplateContext, 1);
+  GVariantIter iter;
+  const char *name;
+  GVariant *variant;
+
+  context->values = g_hash_table_new_full (g_str_hash,
+                                           g_str_equal,
+                                           NULL,
+                                           (GDestroyNotify) template_value_free);
+
+  if (variables == NULL)
+    return context;
+
+  context->variables = g_variant_ref_sink (variables);
+
+  g_variant_iter_init (&iter, context->variables);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, &variant))
+    g_hash_table_replace (context->values,
+                          (gpointer) name,
+                          template_value_new (variant));
+
+  return context;
+}
+
+void
+eknr_template_context_free (EknrTemplateContext *context)
+{
+  g_clear_pointer (&context->values, g_hash_table_unref);
+  g_clear_pointer (&context->variables, g_variant_unref);
+  g_free (context);
+}
+
+/**
+ * eknr_template_context_lookup:
+ * @context: An #EknrTemplateContext
+ * @name: The name of a template variable
+ *
+ * Returns: (transfer none) (nullable): The value of @name, or %NULL if
+ *   there is no such variable.
+ */
+const EknrTemplateValue *
+eknr_template_context_lookup (EknrTemplateContext *context,
+                              const char          *name)
+{
+  return g_hash_table_lookup (context->values, name);
+}
@@ -9,7 +9,12 @@ G_BEGIN_DECLS
 #define _EKN_RENDERER_INSIDE_EKNR_H
 
 /* Pull in other header files */
+#include "eknr-article-links.h"
 #include "eknr-errors.h"
+#include "eknr-legacy-article.h"
+#include "eknr-legacy-source.h"
+#include "eknr-render-profile.h"
+#include "eknr-rendered-article.h"
 #include "eknr-renderer.h"
 
 #undef _EKN_RENDERER_INSIDE_EKNR_H
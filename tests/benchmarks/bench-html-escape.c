@@ -0,0 +1,119 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Compares g_markup_escape_text() against each implementation of
+ * eknr_html_escape() on typical titles and on long text. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-html-private.h"
+
+#define TARGET_DURATION_USEC (G_USEC_PER_SEC / 2)
+
+static char *
+make_text (gsize size)
+{
+  const char *sentence = "Ça va? Lorem ipsum \"dolor\" sit amet, consectetur & adipiscing elit. ";
+  gsize sentence_length = strlen (sentence);
+  GString *text = g_string_sized_new (size + sentence_length);
+
+  while (text->len < size)
+    g_string_append_len (text, sentence, sentence_length);
+  g_string_truncate (text, size);
+
+  /* Don't leave half a character at the end */
+  while (!g_utf8_validate (text->str, text->len, NULL))
+    g_string_truncate (text, text->len - 1);
+
+  return g_string_free (text, FALSE);
+}
+
+static double
+time_markup (const char *text,
+             gsize       length)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint iterations = 0;
+
+  do
+    {
+      g_autofree char *escaped = g_markup_escape_text (text, length);
+      ++iterations;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < TARGET_DURATION_USEC);
+
+  return (double) elapsed * 1000.0 / iterations;
+}
+
+static double
+time_escape (const char *text,
+             gsize       length)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint iterations = 0;
+
+  do
+    {
+      gsize escaped_length;
+      g_autofree char *escaped = eknr_html_escape (text, length, &escaped_length);
+      ++iterations;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < TARGET_DURATION_USEC);
+
+  return (double) elapsed * 1000.0 / iterations;
+}
+
+int
+main (void)
+{
+  const gsize sizes[] = { 16, 64, 256, 4 * 1024, 64 * 1024, 1024 * 1024 };
+  const struct {
+    const char *name;
+    EknrHtmlEscapeImplementation implementation;
+  } implementations[] = {
+    { "scalar", EKNR_HTML_ESCAPE_SCALAR },
+    { "sse2", EKNR_HTML_ESCAPE_SSE2 },
+    { "avx2", EKNR_HTML_ESCAPE_AVX2 }
+  };
+  gsize i, j;
+
+  g_print ("%10s %16s", "size", "markup ns/op");
+  for (j = 0; j < G_N_ELEMENTS (implementations); ++j)
+    g_print (" %13s ns/op", implementations[j].name);
+  g_print ("\n");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); ++i)
+    {
+      g_autofree char *text = make_text (sizes[i]);
+      gsize length = strlen (text);
+      g_autofree char *expected = g_markup_escape_text (text, length);
+
+      g_print ("%10" G_GSIZE_FORMAT " %16.0f", length, time_markup (text, length));
+
+      for (j = 0; j < G_N_ELEMENTS (implementations); ++j)
+        {
+          g_autofree char *escaped = NULL;
+          gsize escaped_length;
+
+          if (!eknr_html_escape_set_implementation (implementations[j].implementation))
+            {
+              g_print (" %19s", "-");
+              continue;
+            }
+
+          escaped = eknr_html_escape (text, length, &escaped_length);
+          g_assert_cmpstr (escaped, ==, expected);
+
+          g_print (" %19.0f", time_escape (text, length));
+        }
+
+      g_print ("\n");
+    }
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Renders a synthetic corpus of legacy articles with
+ * eknr_renderer_render_legacy_batch() on 1, 2, 4 and one thread per
+ * processor, to show how batch rendering scales with cores. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr.h"
+
+#define N_ARTICLES 10000
+
+static const char *sources[][2] = {
+  { "wikipedia", "Wikipedia" },
+  { "wikibooks", "Wikibooks" },
+  { "wikisource", "Wikisource" },
+  { "wikihow", "wikiHow" }
+};
+
+/* Bodies vary in size between about 2 KB and 40 KB, like a real
+ * collection of mostly short articles with a few long ones */
+static char *
+make_body (guint index)
+{
+  const char *paragraph = "<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.</p>\n";
+  gsize size = 2048 + (index * 7919) % (38 * 1024);
+  GString *body = g_string_sized_new (size + 64);
+
+  g_string_append (body, "<html><body>\n");
+  while (body->len < size)
+    g_string_append (body, paragraph);
+  g_string_append (body, "</body></html>\n");
+
+  return g_string_free (body, FALSE);
+}
+
+static GPtrArray *
+make_corpus (void)
+{
+  GPtrArray *articles = g_ptr_array_new_full (N_ARTICLES,
+                                              (GDestroyNotify) eknr_legacy_article_free);
+  guint i;
+
+  for (i = 0; i < N_ARTICLES; ++i)
+    {
+      g_autofree char *body = make_body (i);
+      g_autofree char *title = g_strdup_printf ("Article %u", i);
+      g_autofree char *uri = g_strdup_printf ("http://example.com/wiki/Article_%u", i);
+      guint source = i % G_N_ELEMENTS (sources);
+
+      g_ptr_array_add (articles,
+                       eknr_legacy_article_new (body,
+                                                sources[source][0],
+                                                sources[source][1],
+                                                uri,
+                                                "CC-BY-SA 3.0",
+                                                title,
+                                                EKNR_RENDER_FLAGS_SHOW_TITLE));
+    }
+
+  return articles;
+}
+
+static void
+count_result (guint         index,
+              const char   *html,
+              const GError *error,
+              gpointer      user_data)
+{
+  gsize *total_bytes = user_data;
+
+  g_assert_no_error ((GError *) error);
+  *total_bytes += strlen (html);
+}
+
+static double
+time_batch (EknrRenderer *renderer,
+            GPtrArray    *articles,
+            int           n_threads,
+            gsize        *out_bytes)
+{
+  g_autoptr(GError) error = NULL;
+  gint64 start = g_get_monotonic_time ();
+
+  *out_bytes = 0;
+  eknr_renderer_render_legacy_batch (renderer,
+                                     articles,
+                                     n_threads,
+                                     count_result,
+                                     out_bytes,
+                                     NULL,
+                                     &error);
+  g_assert_no_error (error);
+
+  return (double) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+}
+
+int
+main (void)
+{
+  g_autoptr(GPtrArray) articles = make_corpus ();
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  int n_processors = g_get_num_processors ();
+  int thread_counts[] = { 1, 2, 4, n_processors };
+  double single_thread_seconds = 0;
+  gsize i;
+
+  g_print ("%u articles, %d processors\n", N_ARTICLES, n_processors);
+  g_print ("%8s %12s %14s %14s %10s\n",
+           "threads", "seconds", "articles/s", "MB/s", "speedup");
+
+  for (i = 0; i < G_N_ELEMENTS (thread_counts); ++i)
+    {
+      gsize bytes;
+      double seconds;
+
+      /* Don't measure the per-processor run twice on small machines */
+      if (i == G_N_ELEMENTS (thread_counts) - 1 && n_processors <= 4)
+        break;
+
+      seconds = time_batch (renderer, articles, thread_counts[i], &bytes);
+      if (i == 0)
+        single_thread_seconds = seconds;
+
+      g_print ("%8d %12.3f %14.0f %14.1f %9.2fx\n",
+               thread_counts[i],
+               seconds,
+               N_ARTICLES / seconds,
+               bytes / seconds / (1024 * 1024),
+               single_thread_seconds / seconds);
+    }
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Compares growing the render output with mustache_std_strwrite, which
+ * reallocates on every write, against the pre-sized GString the
+ * renderer now uses. The write pattern mimics a legacy article: a few
+ * dozen small pieces of template text on either side of one large
+ * body. Besides the time per render, we count how many times the output
+ * buffer gets moved by realloc (), since each move copies everything
+ * written so far. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <mustache.h>
+
+#define TARGET_DURATION_USEC (G_USEC_PER_SEC / 2)
+#define N_CHUNKS_BEFORE_BODY 12
+#define N_CHUNKS_AFTER_BODY 40
+#define TEMPLATE_CHUNK "<script type=\"text/javascript\" src=\"resource:///com/endlessm/knowledge/data/templates/js/content-fixes.js\"></script>\n"
+
+typedef struct {
+  guint moves;
+  double ns_per_op;
+} Result;
+
+static void
+strwrite_render (const char *body,
+                 gsize       body_length,
+                 guint      *moves)
+{
+  mustache_str_ctx output = { NULL, 0 };
+  const char *last = NULL;
+  guint i;
+
+  for (i = 0; i < N_CHUNKS_BEFORE_BODY + 1 + N_CHUNKS_AFTER_BODY; ++i)
+    {
+      if (i == N_CHUNKS_BEFORE_BODY)
+        mustache_std_strwrite (NULL, &output, (char *) body, body_length);
+      else
+        mustache_std_strwrite (NULL, &output, (char *) TEMPLATE_CHUNK, strlen (TEMPLATE_CHUNK));
+
+      if (last != NULL && output.string != last)
+        ++*moves;
+      last = output.string;
+    }
+
+  free (output.string);
+}
+
+static void
+gstring_render (const char *body,
+                gsize       body_length,
+                guint      *moves)
+{
+  /* The renderer reserves the body length plus the template size
+   * plus a little slack before it starts */
+  gsize template_length = (N_CHUNKS_BEFORE_BODY + N_CHUNKS_AFTER_BODY) * strlen (TEMPLATE_CHUNK);
+  GString *output = g_string_sized_new (body_length + template_length + 1024);
+  const char *last = output->str;
+  guint i;
+
+  for (i = 0; i < N_CHUNKS_BEFORE_BODY + 1 + N_CHUNKS_AFTER_BODY; ++i)
+    {
+      if (i == N_CHUNKS_BEFORE_BODY)
+        g_string_append_len (output, body, body_length);
+      else
+        g_string_append_len (output, TEMPLATE_CHUNK, strlen (TEMPLATE_CHUNK));
+
+      if (output->str != last)
+        ++*moves;
+      last = output->str;
+    }
+
+  g_free (g_string_free (output, FALSE));
+}
+
+static Result
+time_render (void (*render) (const char *, gsize, guint *),
+             const char *body,
+             gsize       body_length)
+{
+  Result result = { 0, 0 };
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint iterations = 0;
+
+  render (body, body_length, &result.moves);
+
+  do
+    {
+      guint moves = 0;
+      render (body, body_length, &moves);
+      ++iterations;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < TARGET_DURATION_USEC);
+
+  result.ns_per_op = (double) elapsed * 1000.0 / iterations;
+  return result;
+}
+
+int
+main (void)
+{
+  const gsize sizes[] = {
+    100 * 1024,
+    1024 * 1024,
+    5 * 1024 * 1024
+  };
+  gsize i;
+
+  g_print ("%10s %18s %14s %18s %14s\n",
+           "body size",
+           "strwrite moves", "strwrite ns",
+           "gstring moves", "gstring ns");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); ++i)
+    {
+      g_autofree char *body = g_malloc (sizes[i]);
+      Result before, after;
+
+      memset (body, 'x', sizes[i]);
+
+      before = time_render (strwrite_render, body, sizes[i]);
+      after = time_render (gstring_render, body, sizes[i]);
+
+      g_print ("%10" G_GSIZE_FORMAT " %18u %14.0f %18u %14.0f\n",
+               sizes[i],
+               before.moves, before.ns_per_op,
+               after.moves, after.ns_per_op);
+    }
+
+  return 0;
+}
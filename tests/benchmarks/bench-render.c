@@ -0,0 +1,595 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Measures the renderer's public entry points: legacy articles from
+ * every built-in source with bodies from 1 KB to 5 MB, legacy articles
+ * with linked and inlined assets, a legacy article with 200 headings
+ * with and without the scroll manager, mustache documents with small and
+ * large sets of variables, and mustache documents from a file with a
+ * cold and a warm template cache.
+ *
+ * Each case is printed as one line of JSON, so that results can be
+ * collected and compared between runs to catch regressions:
+ *
+ *   {"name": "legacy/wikipedia/1024", "iterations": 52311,
+ *    "ns_per_op": 9531.2, "p50_ns": 9210, "p99_ns": 14873,
+ *    "bytes_allocated_per_op": 4126.0, "output_bytes": 3214}
+ *
+ * "bytes_allocated_per_op" counts what malloc() and friends hand out
+ * during each operation, and is null where the C library does not let
+ * us count that. */
+
+/* For clock_gettime(), which strict C99 hides */
+#define _POSIX_C_SOURCE 199309L
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#ifdef HAVE_LIBC_MALLOC
+#include <malloc.h>
+#endif
+
+#include "eknrenderer/eknr.h"
+
+#define TARGET_DURATION_NSEC (G_GINT64_CONSTANT (500000000))
+#define MIN_ITERATIONS 20
+#define N_WARMUP_ITERATIONS 3
+
+#ifdef HAVE_LIBC_MALLOC
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+/* Only allocations made by the thread running the benchmark count */
+static __thread gboolean counting;
+static guint64 bytes_allocated;
+
+static void *
+count_allocation (void *ptr)
+{
+  if (counting && ptr != NULL)
+    bytes_allocated += malloc_usable_size (ptr);
+  return ptr;
+}
+
+void *
+malloc (size_t size)
+{
+  return count_allocation (__libc_malloc (size));
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  return count_allocation (__libc_calloc (n_members, size));
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  return count_allocation (__libc_realloc (ptr, size));
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  return count_allocation (__libc_memalign (alignment, size));
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  return memalign (alignment, size);
+}
+
+int
+posix_memalign (void   **ptr,
+                size_t   alignment,
+                size_t   size)
+{
+  void *result = memalign (alignment, size);
+
+  if (result == NULL)
+    return ENOMEM;
+
+  *ptr = result;
+  return 0;
+}
+
+void
+free (void *ptr)
+{
+  __libc_free (ptr);
+}
+
+#endif /* HAVE_LIBC_MALLOC */
+
+/* Sets up one operation without it being measured. May be NULL. */
+typedef void (*BenchPrepareFunc) (gpointer data);
+
+/* Runs one operation and returns the size of its output */
+typedef gsize (*BenchRunFunc) (gpointer data);
+
+static gint64
+now_nsec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+compare_durations (gconstpointer a,
+                   gconstpointer b)
+{
+  gint64 first = *(const gint64 *) a;
+  gint64 second = *(const gint64 *) b;
+
+  return first < second ? -1 : first > second ? 1 : 0;
+}
+
+static gint64
+percentile (GArray *sorted_durations,
+            guint   percent)
+{
+  guint index = (sorted_durations->len - 1) * percent / 100;
+
+  return g_array_index (sorted_durations, gint64, index);
+}
+
+static void
+run_benchmark (const char       *name,
+               BenchPrepareFunc  prepare,
+               BenchRunFunc      run,
+               gpointer          data)
+{
+  g_autoptr(GArray) durations = g_array_new (FALSE, FALSE, sizeof (gint64));
+  gint64 total = 0;
+  guint64 total_allocated = 0;
+  gsize output_bytes = 0;
+  guint i;
+
+  for (i = 0; i < N_WARMUP_ITERATIONS; ++i)
+    {
+      if (prepare != NULL)
+        prepare (data);
+      run (data);
+    }
+
+  while (total < TARGET_DURATION_NSEC || durations->len < MIN_ITERATIONS)
+    {
+      gint64 start, duration;
+
+      if (prepare != NULL)
+        prepare (data);
+
+#ifdef HAVE_LIBC_MALLOC
+      bytes_allocated = 0;
+      counting = TRUE;
+#endif
+      start = now_nsec ();
+      output_bytes = run (data);
+      duration = now_nsec () - start;
+#ifdef HAVE_LIBC_MALLOC
+      counting = FALSE;
+      total_allocated += bytes_allocated;
+#endif
+
+      g_array_append_val (durations, duration);
+      total += duration;
+    }
+
+  g_array_sort (durations, compare_durations);
+
+  g_print ("{\"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.1f, "
+           "\"p50_ns\": %" G_GINT64_FORMAT ", \"p99_ns\": %" G_GINT64_FORMAT ", ",
+           name,
+           durations->len,
+           (double) total / durations->len,
+           percentile (durations, 50),
+           percentile (durations, 99));
+#ifdef HAVE_LIBC_MALLOC
+  g_print ("\"bytes_allocated_per_op\": %.1f, ",
+           (double) total_allocated / durations->len);
+#else
+  g_print ("\"bytes_allocated_per_op\": null, ");
+  (void) total_allocated;
+#endif
+  g_print ("\"output_bytes\": %" G_GSIZE_FORMAT "}\n", output_bytes);
+}
+
+/* Legacy articles */
+
+static const char *legacy_sources[][2] = {
+  { "wikipedia", "Wikipedia" },
+  { "wikibooks", "Wikibooks" },
+  { "wikisource", "Wikisource" },
+  { "wikihow", "wikiHow" }
+};
+
+typedef struct {
+  EknrRenderer *renderer;
+  const char *source;
+  const char *source_name;
+  char *body;
+} LegacyData;
+
+static char *
+make_body (gsize size)
+{
+  const char *paragraph = "<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.</p>\n";
+  GString *body = g_string_sized_new (size + 64);
+
+  g_string_append (body, "<html><body>\n");
+  while (body->len < size)
+    g_string_append (body, paragraph);
+  g_string_append (body, "</body></html>\n");
+
+  return g_string_free (body, FALSE);
+}
+
+static gsize
+run_legacy (gpointer user_data)
+{
+  LegacyData *data = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = eknr_renderer_render_legacy_content (data->renderer,
+                                                               data->body,
+                                                               data->source,
+                                                               data->source_name,
+                                                               "http://example.com/wiki/Lorem_ipsum",
+                                                               "CC-BY-SA 3.0",
+                                                               "Lorem ipsum",
+                                                               TRUE,
+                                                               TRUE,
+                                                               &error);
+
+  g_assert_no_error (error);
+  return strlen (html);
+}
+
+static void
+bench_legacy (void)
+{
+  const gsize body_sizes[] = { 1024, 16 * 1024, 256 * 1024, 5 * 1024 * 1024 };
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  gsize i, j;
+
+  /* Measure rendering, not the render cache */
+  g_object_set (renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (body_sizes); ++i)
+    {
+      g_autofree char *body = make_body (body_sizes[i]);
+
+      for (j = 0; j < G_N_ELEMENTS (legacy_sources); ++j)
+        {
+          LegacyData data = { renderer, legacy_sources[j][0], legacy_sources[j][1], body };
+          g_autofree char *name = g_strdup_printf ("legacy/%s/%" G_GSIZE_FORMAT,
+                                                   legacy_sources[j][0],
+                                                   body_sizes[i]);
+
+          run_benchmark (name, NULL, run_legacy, &data);
+        }
+    }
+}
+
+/* Legacy articles with linked and inlined assets
+ *
+ * Before a web view can paint an article that links to its stylesheets
+ * and scripts, it has to look each of them up in the resources and
+ * decompress it. Each case here stands in for that by looking up every
+ * resource that the article still links to, as the web view would for
+ * each article it loads. The page-load cases of bench-web-view.js load
+ * both kinds of article in a real web view. */
+
+static void
+resolve_resource_links (const char *html)
+{
+  const char *prefix = "resource://";
+  const char *p = html;
+
+  while ((p = strstr (p, prefix)) != NULL)
+    {
+      const char *path = p + strlen (prefix);
+      const char *end = strchr (path, '"');
+      g_autofree char *resource_path = g_strndup (path, end - path);
+      g_autoptr(GBytes) contents = g_resources_lookup_data (resource_path,
+                                                            G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                                            NULL);
+
+      g_assert_nonnull (contents);
+      p = end;
+    }
+}
+
+static gsize
+run_legacy_assets (gpointer user_data)
+{
+  LegacyData *data = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = eknr_renderer_render_legacy_content (data->renderer,
+                                                               data->body,
+                                                               data->source,
+                                                               data->source_name,
+                                                               "http://example.com/wiki/Lorem_ipsum",
+                                                               "CC-BY-SA 3.0",
+                                                               "Lorem ipsum",
+                                                               TRUE,
+                                                               TRUE,
+                                                               &error);
+
+  g_assert_no_error (error);
+  resolve_resource_links (html);
+
+  return strlen (html);
+}
+
+static void
+bench_legacy_assets (void)
+{
+  g_autoptr(EknrRenderer) linked_renderer = eknr_renderer_new ();
+  g_autoptr(EknrRenderer) inlined_renderer = g_object_new (EKNR_TYPE_RENDERER,
+                                                           "inline-assets", TRUE,
+                                                           NULL);
+  g_autofree char *text = make_body (16 * 1024);
+  g_autofree char *body = NULL;
+  LegacyData linked = { linked_renderer, "wikipedia", "Wikipedia", NULL };
+  LegacyData inlined = { inlined_renderer, "wikipedia", "Wikipedia", NULL };
+
+  /* Give the body rewriter something to do */
+  body = g_strconcat ("<html><body>\n"
+                      "<p><img src=\"a.png\"><sup><i><a href=\"#\">[citation needed]</a></i></sup></p>\n",
+                      text + strlen ("<html><body>\n"),
+                      NULL);
+  linked.body = inlined.body = body;
+
+  g_object_set (linked_renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+  g_object_set (inlined_renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+
+  run_benchmark ("legacy-assets/linked", NULL, run_legacy_assets, &linked);
+  run_benchmark ("legacy-assets/inlined", NULL, run_legacy_assets, &inlined);
+}
+
+/* Legacy articles with headings
+ *
+ * With the scroll manager, the renderer collects the heading ids for it
+ * to watch. bench-web-view.js measures what that saves while scrolling. */
+
+#define N_HEADINGS 200
+
+typedef struct {
+  LegacyData legacy;
+  gboolean use_scroll_manager;
+} HeadingsData;
+
+static char *
+make_headings_body (void)
+{
+  GString *body = g_string_new ("<html><body>\n");
+  guint i;
+
+  for (i = 0; i < N_HEADINGS; ++i)
+    g_string_append_printf (body,
+                            "<h2><span class=\"mw-headline\" id=\"Section_%u\">Section %u</span></h2>\n"
+                            "<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.</p>\n",
+                            i, i);
+  g_string_append (body, "</body></html>\n");
+
+  return g_string_free (body, FALSE);
+}
+
+static gsize
+run_legacy_headings (gpointer user_data)
+{
+  HeadingsData *data = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = eknr_renderer_render_legacy_content (data->legacy.renderer,
+                                                               data->legacy.body,
+                                                               data->legacy.source,
+                                                               data->legacy.source_name,
+                                                               "http://example.com/wiki/Lorem_ipsum",
+                                                               "CC-BY-SA 3.0",
+                                                               "Lorem ipsum",
+                                                               TRUE,
+                                                               data->use_scroll_manager,
+                                                               &error);
+
+  g_assert_no_error (error);
+  return strlen (html);
+}
+
+static void
+bench_legacy_headings (void)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autofree char *body = make_headings_body ();
+  HeadingsData without = { { renderer, "wikipedia", "Wikipedia", body }, FALSE };
+  HeadingsData with = { { renderer, "wikipedia", "Wikipedia", body }, TRUE };
+
+  g_object_set (renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+
+  run_benchmark ("legacy-headings/no-scroll-manager", NULL, run_legacy_headings, &without);
+  run_benchmark ("legacy-headings/scroll-manager", NULL, run_legacy_headings, &with);
+}
+
+/* Mustache documents */
+
+typedef struct {
+  EknrRenderer *renderer;
+  char *template;
+  GVariant *variables;
+  GFile *file;
+} MustacheData;
+
+static void
+mustache_data_clear (MustacheData *data)
+{
+  g_clear_object (&data->renderer);
+  g_clear_pointer (&data->template, g_free);
+  g_clear_pointer (&data->variables, g_variant_unref);
+  g_clear_object (&data->file);
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (MustacheData, mustache_data_clear)
+
+static void
+make_small_document (MustacheData *data)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "title", g_variant_new_string ("Lorem & ipsum"));
+  g_variant_builder_add (&builder, "{sv}", "subtitle", g_variant_new_string ("Dolor sit amet"));
+  g_variant_builder_add (&builder, "{sv}", "show-subtitle", g_variant_new_boolean (TRUE));
+
+  data->template = g_strdup ("<html><head><title>{{title}}</title></head><body>"
+                             "<h1>{{title}}</h1>"
+                             "{{#show-subtitle}}<h2>{{subtitle}}</h2>{{/show-subtitle}}"
+                             "</body></html>");
+  data->variables = g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+#define N_LARGE_VARIABLES 200
+#define N_LARGE_ITEMS 1000
+
+static void
+make_large_document (MustacheData *data)
+{
+  GVariantBuilder builder;
+  GString *template = g_string_new ("<html><body>");
+  g_autoptr(GPtrArray) items = g_ptr_array_new_with_free_func (g_free);
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (i = 0; i < N_LARGE_VARIABLES; ++i)
+    {
+      g_autofree char *name = g_strdup_printf ("field-%u", i);
+      g_autofree char *value = g_strdup_printf ("Value <%u> & more", i);
+
+      g_variant_builder_add (&builder, "{sv}", name, g_variant_new_string (value));
+      g_string_append_printf (template, "<p class=\"field-%u\">{{%s}}</p>", i, name);
+    }
+
+  for (i = 0; i < N_LARGE_ITEMS; ++i)
+    g_ptr_array_add (items, g_strdup_printf ("Item \"%u\"", i));
+  g_ptr_array_add (items, NULL);
+  g_variant_builder_add (&builder, "{sv}", "items",
+                         g_variant_new_strv ((const char * const *) items->pdata, -1));
+
+  g_string_append (template, "<ul>{{#items}}<li>{{.}}</li>{{/items}}</ul></body></html>");
+
+  data->template = g_string_free (template, FALSE);
+  data->variables = g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static gsize
+run_mustache (gpointer user_data)
+{
+  MustacheData *data = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = eknr_renderer_render_mustache_document (data->renderer,
+                                                                  data->template,
+                                                                  data->variables,
+                                                                  &error);
+
+  g_assert_no_error (error);
+  return strlen (html);
+}
+
+static gsize
+run_mustache_from_file (gpointer user_data)
+{
+  MustacheData *data = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = eknr_renderer_render_mustache_document_from_file (data->renderer,
+                                                                            data->file,
+                                                                            data->variables,
+                                                                            &error);
+
+  g_assert_no_error (error);
+  return strlen (html);
+}
+
+static void
+remove_saved_templates (void)
+{
+  g_autofree char *cache_dir = g_build_filename (g_get_user_cache_dir (),
+                                                 "eknr", "templates", NULL);
+  g_autoptr(GDir) dir = g_dir_open (cache_dir, 0, NULL);
+  const char *basename;
+
+  while (dir != NULL && (basename = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *path = g_build_filename (cache_dir, basename, NULL);
+      g_unlink (path);
+    }
+}
+
+/* Nothing cached in the renderer, and no compiled template saved on
+ * disk, as for the first render of a template after installing */
+static void
+prepare_cold_cache (gpointer user_data)
+{
+  MustacheData *data = user_data;
+
+  remove_saved_templates ();
+  g_clear_object (&data->renderer);
+  data->renderer = eknr_renderer_new ();
+}
+
+static void
+bench_mustache (const char *tmpdir)
+{
+  g_auto(MustacheData) small = { eknr_renderer_new (), NULL, NULL, NULL };
+  g_auto(MustacheData) large = { eknr_renderer_new (), NULL, NULL, NULL };
+  g_autofree char *path = g_build_filename (tmpdir, "large.mst", NULL);
+
+  make_small_document (&small);
+  make_large_document (&large);
+
+  run_benchmark ("mustache/small-variables", NULL, run_mustache, &small);
+  run_benchmark ("mustache/large-variables", NULL, run_mustache, &large);
+
+  g_assert_true (g_file_set_contents (path, large.template, -1, NULL));
+  large.file = g_file_new_for_path (path);
+
+  run_benchmark ("mustache-from-file/cold-cache", prepare_cold_cache,
+                 run_mustache_from_file, &large);
+  run_benchmark ("mustache-from-file/warm-cache", NULL,
+                 run_mustache_from_file, &large);
+
+  g_unlink (path);
+  remove_saved_templates ();
+}
+
+int
+main (void)
+{
+  g_autofree char *tmpdir = g_dir_make_tmp ("eknr-bench-XXXXXX", NULL);
+  g_autofree char *cache_home = g_build_filename (tmpdir, "cache", NULL);
+
+  /* Keep compiled templates out of the real cache directory. This has
+   * to happen before anything asks GLib for the cache directory. */
+  g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
+  bench_legacy ();
+  bench_legacy_assets ();
+  bench_legacy_headings ();
+  bench_mustache (tmpdir);
+
+  return 0;
+}
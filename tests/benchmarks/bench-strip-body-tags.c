@@ -0,0 +1,125 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Compares the old two-pass GRegex body tag stripping against
+ * eknr_html_strip_body_tags() over a range of body sizes. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-html-private.h"
+
+#define TARGET_DURATION_USEC (G_USEC_PER_SEC / 2)
+
+static char *
+regex_substitute (const char *regex,
+                  const char *content)
+{
+  g_autoptr(GRegex) regex_compiled = g_regex_new (regex, 0, 0, NULL);
+
+  return g_regex_replace (regex_compiled, content, -1, 0, "", 0, NULL);
+}
+
+/* This is what strip_body_tags used to do for every rendered article */
+static char *
+strip_body_tags_regex (const char *html)
+{
+  g_autofree char *stripped_start_tags = regex_substitute ("^\\s*<html>\\s*<body>",
+                                                            html);
+
+  return regex_substitute ("<\\/body>\\s*<\\/html>\\s*$", stripped_start_tags);
+}
+
+static char *
+make_body (gsize size)
+{
+  const char *paragraph = "<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.</p>\n";
+  gsize paragraph_length = strlen (paragraph);
+  GString *body = g_string_sized_new (size + 64);
+
+  g_string_append (body, "<html><body>\n");
+  while (body->len < size)
+    g_string_append_len (body, paragraph, paragraph_length);
+  g_string_append (body, "</body></html>\n");
+
+  return g_string_free (body, FALSE);
+}
+
+static double
+time_regex (const char *html)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint iterations = 0;
+
+  do
+    {
+      g_autofree char *stripped = strip_body_tags_regex (html);
+      ++iterations;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < TARGET_DURATION_USEC);
+
+  return (double) elapsed * 1000.0 / iterations;
+}
+
+static double
+time_scan (const char *html)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint iterations = 0;
+  gsize total = 0;
+
+  do
+    {
+      gsize length;
+
+      /* The renderer needs to know the length of the body anyway, so
+       * count the strlen () as part of the work. */
+      eknr_html_strip_body_tags (html, -1, &length);
+      total += length;
+      ++iterations;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < TARGET_DURATION_USEC);
+
+  g_assert_cmpuint (total, >, 0);
+
+  return (double) elapsed * 1000.0 / iterations;
+}
+
+int
+main (void)
+{
+  const gsize sizes[] = {
+    10 * 1024,
+    100 * 1024,
+    500 * 1024,
+    1024 * 1024,
+    2 * 1024 * 1024
+  };
+  gsize i;
+
+  g_print ("%10s %16s %16s %10s\n", "size", "regex ns/op", "scan ns/op", "speedup");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); ++i)
+    {
+      g_autofree char *html = make_body (sizes[i]);
+      g_autofree char *expected = strip_body_tags_regex (html);
+      gsize length;
+      const char *stripped = eknr_html_strip_body_tags (html, -1, &length);
+      double regex_ns, scan_ns;
+
+      g_assert_cmpuint (length, ==, strlen (expected));
+      g_assert_true (memcmp (stripped, expected, length) == 0);
+
+      regex_ns = time_regex (html);
+      scan_ns = time_scan (html);
+
+      g_print ("%10" G_GSIZE_FORMAT " %16.0f %16.0f %9.1fx\n",
+               sizes[i], regex_ns, scan_ns, regex_ns / scan_ns);
+    }
+
+  return 0;
+}
@@ -0,0 +1,242 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* Measures legacy articles in a web view:
+ *
+ * - Loading a legacy article, from load_html() to the load finishing,
+ *   which is after the article's stylesheets and scripts have been
+ *   loaded and it has first been laid out. This is done with the
+ *   renderer's inline-assets off and on, to compare linking to the
+ *   stylesheets and scripts with including them, and with jQuery in
+ *   front of the inlined article, to see what the scripts saved by no
+ *   longer needing it.
+ * - Scrolling through a legacy article with 200 headings, with and
+ *   without the scroll manager, from the top to the bottom one step per
+ *   frame, timing each frame.
+ *
+ * Each case is printed as one line of JSON, like bench-render does:
+ *
+ *   {"name":"page-load/inlined","iterations":50,
+ *    "ns_per_op":10512000.2,"p50_ns":10377000,"p99_ns":13020000}
+ *   {"name":"scroll/200-headings/scroll-manager","frames":400,
+ *    "ns_per_frame":16702400.5,"p50_ns":16666000,"p99_ns":17210000,
+ *    "hash_changes":199}
+ *
+ * "hash_changes" counts the scrolled-past notifications the scroll
+ * manager gave. Without a display or WebKit2 there is nothing to
+ * measure, so the benchmark exits with 77, which meson reports as
+ * skipped. */
+
+const System = imports.system;
+
+imports.gi.versions.Gtk = '3.0';
+imports.gi.versions.WebKit2 = '4.0';
+
+const N_HEADINGS = 200;
+const N_PARAGRAPHS_PER_HEADING = 3;
+const N_SCROLL_STEPS = 400;
+const SKIP = 77;
+
+const N_WARMUP_LOADS = 3;
+const N_LOADS = 50;
+
+let Eknr, Gio, GLib, Gtk, WebKit2;
+try {
+    ({Eknr, Gio, GLib, Gtk, WebKit2} = imports.gi);
+} catch (e) {
+    printerr(`Skipping: ${e.message}`);
+    System.exit(SKIP);
+}
+
+const [have_display] = Gtk.init_check(null);
+if (!have_display) {
+    printerr('Skipping: no display');
+    System.exit(SKIP);
+}
+
+// Scrolls one step per frame, then reports the frame times and how
+// many times the hash changed through the document title. The scroll
+// manager replaces window.scrollTo(), so scrollTop is set instead.
+const SCROLL_SCRIPT = `
+(function () {
+    var hashChanges = 0;
+    var durations = [];
+    var step = 0;
+    var last = 0;
+    var scroller = document.scrollingElement;
+    var maxScroll = scroller.scrollHeight - window.innerHeight;
+
+    window.addEventListener('hashchange', function () {
+        hashChanges++;
+    });
+
+    function frame(now) {
+        if (step > 0)
+            durations.push(now - last);
+        last = now;
+
+        if (step === ${N_SCROLL_STEPS}) {
+            document.title = JSON.stringify({
+                durations: durations,
+                hashChanges: hashChanges,
+            });
+            return;
+        }
+
+        step++;
+        scroller.scrollTop = maxScroll * step / ${N_SCROLL_STEPS};
+        window.requestAnimationFrame(frame);
+    }
+
+    window.requestAnimationFrame(frame);
+})();
+`;
+
+function make_article() {
+    let body = '<html><body>\n';
+    for (let i = 0; i < N_HEADINGS; i++) {
+        body += `<h2><span class="mw-headline" id="Section_${i}">Section ${i}</span></h2>\n`;
+        for (let j = 0; j < N_PARAGRAPHS_PER_HEADING; j++)
+            body += '<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.</p>\n';
+    }
+    return body + '</body></html>\n';
+}
+
+function percentile(sorted_durations, percent) {
+    let index = Math.floor((sorted_durations.length - 1) * percent / 100);
+    return sorted_durations[index];
+}
+
+function print_durations(name, durations) {
+    let total = durations.reduce((sum, duration) => sum + duration, 0);
+    durations.sort((a, b) => a - b);
+
+    print(JSON.stringify({
+        name,
+        iterations: durations.length,
+        ns_per_op: Number((total / durations.length).toFixed(1)),
+        p50_ns: percentile(durations, 50),
+        p99_ns: percentile(durations, 99),
+    }));
+}
+
+function new_web_view() {
+    let window = new Gtk.OffscreenWindow();
+    let web_view = new WebKit2.WebView();
+    window.set_default_size(1024, 768);
+    window.add(web_view);
+    window.show_all();
+    return [window, web_view];
+}
+
+// The jQuery that the scripts needed before they were ported, to
+// measure what it cost to load
+function read_jquery() {
+    let bytes = Gio.resources_lookup_data(
+        '/com/endlessm/knowledge/data/templates/js/jquery-min.js',
+        Gio.ResourceLookupFlags.NONE);
+    return imports.byteArray.toString(bytes.toArray());
+}
+
+function run_load_case(name, html, done) {
+    let [window, web_view] = new_web_view();
+    let durations = [];
+    let n_loads = 0;
+    let start;
+
+    function load() {
+        start = GLib.get_monotonic_time();
+        web_view.load_html(html, 'resource:///com/endlessm/knowledge/data/templates/');
+    }
+
+    web_view.connect('load-changed', (view, load_event) => {
+        if (load_event !== WebKit2.LoadEvent.FINISHED)
+            return;
+        // The monotonic time is in microseconds
+        if (n_loads++ >= N_WARMUP_LOADS)
+            durations.push((GLib.get_monotonic_time() - start) * 1000);
+        if (durations.length < N_LOADS) {
+            load();
+            return;
+        }
+        print_durations(name, durations);
+        window.destroy();
+        done();
+    });
+
+    load();
+}
+
+function print_result(name, result) {
+    // performance.now() is in milliseconds
+    let durations = result.durations.map(duration => Math.round(duration * 1e6));
+    let total = durations.reduce((sum, duration) => sum + duration, 0);
+    durations.sort((a, b) => a - b);
+
+    print(JSON.stringify({
+        name,
+        frames: durations.length,
+        ns_per_frame: Number((total / durations.length).toFixed(1)),
+        p50_ns: percentile(durations, 50),
+        p99_ns: percentile(durations, 99),
+        hash_changes: result.hashChanges,
+    }));
+}
+
+function run_case(renderer, body, use_scroll_manager, done) {
+    let name = `scroll/${N_HEADINGS}-headings/` +
+        (use_scroll_manager ? 'scroll-manager' : 'no-scroll-manager');
+    let html = renderer.render_legacy_content(body, 'wikipedia', 'Wikipedia',
+        'http://example.com/wiki/Lorem_ipsum', 'CC-BY-SA 3.0', 'Lorem ipsum',
+        true, use_scroll_manager);
+
+    let [window, web_view] = new_web_view();
+
+    web_view.connect('load-changed', (view, load_event) => {
+        if (load_event === WebKit2.LoadEvent.FINISHED)
+            view.run_javascript(SCROLL_SCRIPT, null, null);
+    });
+    web_view.connect('notify::title', view => {
+        let title = view.title;
+        if (!title || !title.startsWith('{'))
+            return;
+        print_result(name, JSON.parse(title));
+        window.destroy();
+        done();
+    });
+
+    web_view.load_html(html, 'resource:///com/endlessm/knowledge/data/templates/');
+}
+
+function render_article(renderer, body) {
+    return renderer.render_legacy_content(body, 'wikipedia', 'Wikipedia',
+        'http://example.com/wiki/Lorem_ipsum', 'CC-BY-SA 3.0', 'Lorem ipsum',
+        true, true);
+}
+
+let loop = new GLib.MainLoop(null, false);
+// Inline the scripts so that nothing has to be looked up while scrolling
+let renderer = new Eknr.Renderer({
+    inline_assets: true,
+    render_cache_max_bytes: 0,
+});
+let linked_renderer = new Eknr.Renderer({
+    inline_assets: false,
+    render_cache_max_bytes: 0,
+});
+let body = make_article();
+
+let linked_html = render_article(linked_renderer, body);
+let inlined_html = render_article(renderer, body);
+let jquery_html = `<script type="text/javascript">${read_jquery()}</script>\n` +
+    inlined_html;
+
+run_load_case('page-load/linked', linked_html, () => {
+    run_load_case('page-load/inlined', inlined_html, () => {
+        run_load_case('page-load/jquery+inlined', jquery_html, () => {
+            run_case(renderer, body, false, () => {
+                run_case(renderer, body, true, () => loop.quit());
+            });
+        });
+    });
+});
+loop.run();
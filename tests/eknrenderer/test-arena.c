@@ -0,0 +1,124 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks the scratch arena that renders allocate their temporary data
+ * from: allocations are aligned and do not overlap, strings keep their
+ * contents when they outgrow a block, and after a reset the arena has
+ * room for everything that was allocated before it without growing. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-arena-private.h"
+
+static void
+test_arena_alloc (void)
+{
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  char *previous = NULL;
+  gsize previous_size = 0, i;
+
+  for (i = 1; i < 2000; i += 7)
+    {
+      char *p = eknr_arena_alloc (arena, i);
+
+      g_assert_cmpuint (GPOINTER_TO_SIZE (p) % (2 * sizeof (gpointer)), ==, 0);
+      memset (p, i & 0xff, i);
+
+      if (previous != NULL)
+        {
+          gsize j;
+
+          for (j = 0; j < previous_size; ++j)
+            g_assert_cmpint ((guchar) previous[j], ==, (i - 7) & 0xff);
+        }
+
+      previous = p;
+      previous_size = i;
+    }
+}
+
+static void
+test_arena_strings (void)
+{
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  g_autoptr(GString) expected = g_string_new (NULL);
+  const char *first, *string;
+  gsize length, i;
+
+  eknr_arena_begin_string (arena);
+  eknr_arena_append (arena, "first", 5);
+  first = eknr_arena_end_string (arena, &length);
+  g_assert_cmpstr (first, ==, "first");
+  g_assert_cmpuint (length, ==, 5);
+
+  /* Long enough to move to a new block more than once */
+  eknr_arena_begin_string (arena);
+  for (i = 0; i < 5000; ++i)
+    {
+      eknr_arena_append (arena, "ab", 2);
+      eknr_arena_append_printf (arena, "%" G_GSIZE_FORMAT ";", i);
+      g_string_append_printf (expected, "ab%" G_GSIZE_FORMAT ";", i);
+    }
+  eknr_arena_write (arena, "end", 3, NULL);
+  g_string_append (expected, "end");
+  string = eknr_arena_end_string (arena, &length);
+
+  g_assert_cmpstr (string, ==, expected->str);
+  g_assert_cmpuint (length, ==, expected->len);
+  g_assert_cmpstr (first, ==, "first");
+
+  eknr_arena_begin_string (arena);
+  string = eknr_arena_end_string (arena, &length);
+  g_assert_cmpstr (string, ==, "");
+  g_assert_cmpuint (length, ==, 0);
+}
+
+/* Allocates the same things every time it is called, as a render of
+ * the same article does, and returns the last allocation */
+static gpointer
+fill_arena (EknrArena *arena)
+{
+  gpointer last = NULL;
+  gsize i;
+
+  for (i = 0; i < 100; ++i)
+    {
+      eknr_arena_begin_string (arena);
+      eknr_arena_append_printf (arena, "heading %" G_GSIZE_FORMAT, i);
+      eknr_arena_end_string (arena, NULL);
+      last = eknr_arena_alloc (arena, 200);
+    }
+
+  return last;
+}
+
+static void
+test_arena_reset (void)
+{
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  gpointer last;
+
+  fill_arena (arena);
+  eknr_arena_reset (arena);
+
+  /* Everything now fits in one block, so the same allocations come out
+   * of it in the same places */
+  last = fill_arena (arena);
+  eknr_arena_reset (arena);
+
+  g_assert_true (fill_arena (arena) == last);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/arena/alloc", test_arena_alloc);
+  g_test_add_func ("/arena/strings", test_arena_strings);
+  g_test_add_func ("/arena/reset", test_arena_reset);
+
+  return g_test_run ();
+}
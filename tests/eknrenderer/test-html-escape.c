@@ -0,0 +1,168 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that every implementation of the HTML escaper gives exactly
+ * the same output as g_markup_escape_text() on random UTF-8 text that
+ * is heavy in characters which need escaping. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-html-private.h"
+
+#define N_ITERATIONS 20000
+
+/* Characters around every boundary the escaper cares about */
+static const gunichar interesting_characters[] = {
+  '&', '<', '>', '\'', '"', ';', '#', 'x',
+  0x01, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x1f, 0x20, 0x7e, 0x7f,
+  0x80, 0x84, 0x85, 0x86, 0x9f, 0xa0, 0xbf, 0xc0, 0xc2, 0xff,
+  0x100, 0x142, 0x7ff, 0x800, 0x2028, 0xfeff, 0xffff,
+  0x10000, 0x1f600, 0x10ffff
+};
+
+static void
+append_random_character (GString *text)
+{
+  gunichar c;
+
+  switch (g_test_rand_int_range (0, 4))
+    {
+    case 0:
+      c = interesting_characters[g_test_rand_int_range (0, G_N_ELEMENTS (interesting_characters))];
+      break;
+    case 1:
+      c = g_test_rand_int_range (0x01, 0x100);
+      break;
+    default:
+      /* Mostly plain text, so that long runs need no escaping */
+      c = g_test_rand_int_range ('a', 'z' + 1);
+      break;
+    }
+
+  g_string_append_unichar (text, c);
+}
+
+static char *
+random_text (gsize *out_length)
+{
+  /* Mostly short strings, with some long enough to go through the
+   * vector loops many times */
+  gsize length = g_test_rand_bit () ? g_test_rand_int_range (0, 80)
+                                    : g_test_rand_int_range (0, 4096);
+  GString *text = g_string_sized_new (length * 4);
+
+  while (text->len < length)
+    append_random_character (text);
+
+  *out_length = text->len;
+  return g_string_free (text, FALSE);
+}
+
+static gboolean
+append_written (gpointer                user_data,
+              const char             *buffer,
+              gsize                   length,
+              G_GNUC_UNUSED GError  **error)
+{
+  g_string_append_len (user_data, buffer, length);
+  return TRUE;
+}
+
+static void
+check_matches_g_markup_escape_text (const char *text,
+                                    gsize       length)
+{
+  g_autofree char *expected = g_markup_escape_text (text, length);
+  g_autofree char *escaped = NULL;
+  g_autoptr(GString) written = g_string_new (NULL);
+  gsize escaped_length;
+
+  escaped = eknr_html_escape (text, length, &escaped_length);
+  g_assert_cmpstr (escaped, ==, expected);
+  g_assert_cmpuint (escaped_length, ==, strlen (expected));
+
+  g_assert_true (eknr_html_escape_write (text, length, append_written, written, NULL));
+  g_assert_cmpstr (written->str, ==, expected);
+}
+
+static void
+test_escape_fuzz (gconstpointer user_data)
+{
+  EknrHtmlEscapeImplementation implementation = GPOINTER_TO_INT (user_data);
+  guint i;
+
+  if (!eknr_html_escape_set_implementation (implementation))
+    {
+      g_test_skip ("Not supported on this machine");
+      return;
+    }
+
+  for (i = 0; i < N_ITERATIONS; ++i)
+    {
+      gsize length;
+      g_autofree char *text = random_text (&length);
+
+      check_matches_g_markup_escape_text (text, length);
+    }
+}
+
+static void
+test_escape_edges (gconstpointer user_data)
+{
+  EknrHtmlEscapeImplementation implementation = GPOINTER_TO_INT (user_data);
+  const char *texts[] = {
+    "",
+    "plain",
+    "&<>'\"",
+    "\x01\x1f\x7f\t\n\r",
+    "\xc2\x80\xc2\x85\xc2\x9f\xc2\xa0",
+    /* Special characters either side of a 16 and 32 byte boundary */
+    "0123456789abcde&<0123456789abcdef0123456789abcd\"\xc2\x80",
+    "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde\xc2\x9f"
+  };
+  gsize i;
+
+  if (!eknr_html_escape_set_implementation (implementation))
+    {
+      g_test_skip ("Not supported on this machine");
+      return;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (texts); ++i)
+    check_matches_g_markup_escape_text (texts[i], strlen (texts[i]));
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const struct {
+    const char *name;
+    EknrHtmlEscapeImplementation implementation;
+  } implementations[] = {
+    { "scalar", EKNR_HTML_ESCAPE_SCALAR },
+    { "sse2", EKNR_HTML_ESCAPE_SSE2 },
+    { "avx2", EKNR_HTML_ESCAPE_AVX2 }
+  };
+  gsize i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (implementations); ++i)
+    {
+      g_autofree char *fuzz_path = g_strdup_printf ("/html/escape/%s/fuzz",
+                                                    implementations[i].name);
+      g_autofree char *edges_path = g_strdup_printf ("/html/escape/%s/edges",
+                                                     implementations[i].name);
+
+      g_test_add_data_func (fuzz_path,
+                            GINT_TO_POINTER (implementations[i].implementation),
+                            test_escape_fuzz);
+      g_test_add_data_func (edges_path,
+                            GINT_TO_POINTER (implementations[i].implementation),
+                            test_escape_edges);
+    }
+
+  return g_test_run ();
+}
@@ -0,0 +1,253 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks eknr_html_rewrite_body() against the bodies in rewrite/. Each
+ * NAME.in.html is rewritten and compared with NAME.out.html, which was
+ * written by hand to show what content-fixes.js, hide-broken-images.js,
+ * crosslink.js and chunk.js did to the same body in the web view:
+ * images get an onerror handler that hides them, citation needed
+ * markers are gone, links point into the link table below, and chunks
+ * are filled in. Also checks collecting the heading ids that the scroll
+ * manager watches, which uses the same tokenizer. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-errors.h"
+#include "eknrenderer/eknr-html-private.h"
+
+#define INPUT_SUFFIX ".in.html"
+#define OUTPUT_SUFFIX ".out.html"
+
+static const char * const link_table[] = { "ekn:///first", "", "ekn:///a&b", NULL };
+static const char * const set_ids[] = { "ekn:///set1", "ekn:///set2", NULL };
+static const char * const set_titles[] = { "Set <1>", "Set 2", NULL };
+
+static EknrArticleLinks *
+links_new (void)
+{
+  EknrArticleLinks *links = eknr_article_links_new (link_table);
+
+  eknr_article_links_set_parent_featured_sets (links, set_ids, set_titles);
+  return links;
+}
+
+static gboolean
+write_to_string (gpointer                user_data,
+                 const char             *buffer,
+                 gsize                   length,
+                 G_GNUC_UNUSED GError  **error)
+{
+  GString *output = user_data;
+
+  g_string_append_len (output, buffer, length);
+  return TRUE;
+}
+
+static char *
+rewrite (const char             *body,
+         gsize                   length,
+         EknrHtmlBodyFeatures    features,
+         const EknrArticleLinks *links)
+{
+  g_autoptr(GError) error = NULL;
+  GString *output = g_string_new ("");
+
+  g_assert_true (eknr_html_rewrite_body (body, length, features, links,
+                                         write_to_string, output, &error));
+  g_assert_no_error (error);
+
+  return g_string_free (output, FALSE);
+}
+
+static void
+test_rewrite_file (gconstpointer data)
+{
+  const char *name = data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrArticleLinks) links = links_new ();
+  g_autofree char *input_name = g_strconcat (name, INPUT_SUFFIX, NULL);
+  g_autofree char *output_name = g_strconcat (name, OUTPUT_SUFFIX, NULL);
+  g_autofree char *input_path = g_test_build_filename (G_TEST_DIST, "eknrenderer", "rewrite",
+                                                       input_name, NULL);
+  g_autofree char *output_path = g_test_build_filename (G_TEST_DIST, "eknrenderer", "rewrite",
+                                                        output_name, NULL);
+  g_autofree char *input = NULL;
+  g_autofree char *expected = NULL;
+  g_autofree char *rewritten = NULL;
+  g_autofree char *scanned_rewritten = NULL;
+  gsize input_length;
+
+  g_file_get_contents (input_path, &input, &input_length, &error);
+  g_assert_no_error (error);
+  g_file_get_contents (output_path, &expected, NULL, &error);
+  g_assert_no_error (error);
+
+  rewritten = rewrite (input, input_length, EKNR_HTML_BODY_ALL_FEATURES, links);
+  g_assert_cmpstr (rewritten, ==, expected);
+
+  /* The renderer only rewrites what eknr_html_scan_body() found, so it
+   * must find everything that the rewrite changes */
+  scanned_rewritten = rewrite (input, input_length,
+                               eknr_html_scan_body (input, input_length), links);
+  g_assert_cmpstr (scanned_rewritten, ==, expected);
+}
+
+static void
+test_rewrite_nothing (void)
+{
+  const char *body = "<p><img src=\"a.png\"><sup>[<i><a href=\"#\">x</a></i>]</sup></p>";
+  g_autofree char *rewritten = rewrite (body, strlen (body), EKNR_HTML_BODY_FEATURES_NONE, NULL);
+
+  g_assert_cmpstr (rewritten, ==, body);
+}
+
+/* Links and chunks are left for the scripts without an EknrArticleLinks */
+static void
+test_rewrite_without_links (void)
+{
+  const char *body =
+    "<a href=\"x\" data-ekn-link-table-idx=\"0\">x</a>"
+    "<div data-ekn-chunk-type=\"Unknown\"></div>";
+  g_autofree char *rewritten = rewrite (body, strlen (body), EKNR_HTML_BODY_ALL_FEATURES, NULL);
+
+  g_assert_cmpstr (rewritten, ==, body);
+}
+
+static void
+assert_rewrite_fails (const char             *body,
+                      const EknrArticleLinks *links,
+                      EknrError               code)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GString) output = g_string_new ("");
+
+  g_assert_false (eknr_html_rewrite_body (body, strlen (body), EKNR_HTML_BODY_ALL_FEATURES,
+                                          links, write_to_string, output, &error));
+  g_assert_error (error, EKNR_ERROR, code);
+}
+
+/* Like chunk_init(), which threw */
+static void
+test_rewrite_bad_chunks (void)
+{
+  g_autoptr(EknrArticleLinks) links = links_new ();
+  g_autoptr(EknrArticleLinks) no_chunk_data = eknr_article_links_new (link_table);
+
+  assert_rewrite_fails ("<div data-ekn-chunk-type=\"Unknown\"></div>",
+                        links, EKNR_ERROR_UNKNOWN_CHUNK_TYPE);
+  assert_rewrite_fails ("<div data-ekn-chunk-type=\"ParentFeaturedSets\"></div>",
+                        no_chunk_data, EKNR_ERROR_MISSING_CHUNK_DATA);
+}
+
+/* Nothing past the given length may be looked at, so an unclosed
+ * element at the end is left alone */
+static void
+test_rewrite_stops_at_length (void)
+{
+  const char *body = "<p>x<sup>[<i><a href=\"#\">x</a></i>]</sup></p>";
+  gsize length = strlen ("<p>x<sup>[<i><a href=\"#\">x</a></i>]");
+  g_autofree char *rewritten = rewrite (body, length, EKNR_HTML_BODY_ALL_FEATURES, NULL);
+
+  g_assert_cmpuint (strlen (rewritten), ==, length);
+  g_assert_true (strncmp (rewritten, body, length) == 0);
+}
+
+static void
+test_collect_headings (void)
+{
+  const char *body =
+    "<h2><span class=\"mw-headline\" id=\"History\">History</span></h2>"
+    "<h2><span id=\"Early_&amp;_late\" class=\"toc mw-headline\">x</span></h2>"
+    "<h2><span class=\"mw-headline\">No id</span></h2>"
+    "<h2><span class=\"mw-headlines\" id=\"Other\">Other</span></h2>"
+    "<script>document.write('<span class=\"mw-headline\" id=\"Script\">');</script>"
+    "<!-- <span class=\"mw-headline\" id=\"Comment\"> -->"
+    "<h3><span class=mw-headline id=&#x4c;ast>Last</span></h3>";
+  const char * const expected[] = { "History", "Early_&_late", "Last", NULL };
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  const char **headings = eknr_html_collect_headings (arena, body, strlen (body));
+  gsize i;
+
+  g_assert_cmpuint (g_strv_length ((char **) headings), ==, G_N_ELEMENTS (expected) - 1);
+  for (i = 0; expected[i] != NULL; ++i)
+    g_assert_cmpstr (headings[i], ==, expected[i]);
+}
+
+static void
+test_collect_no_headings (void)
+{
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  const char **headings = eknr_html_collect_headings (arena, "", 0);
+
+  g_assert_nonnull (headings);
+  g_assert_null (headings[0]);
+}
+
+/* Nothing in an id may end the script element it is written into */
+static void
+test_format_script_strings (void)
+{
+  const char * const strings[] = {
+    "History",
+    "</script><script>alert(\"x\\\")</script>",
+    "a\nb\xe2\x80\xa8" "c\xc3\xa9",
+    NULL
+  };
+  const char * const none[] = { NULL };
+  g_autoptr(EknrArena) arena = eknr_arena_new ();
+  const char *formatted, *formatted_none;
+  gsize length;
+
+  formatted = eknr_html_format_script_strings (arena, strings, &length);
+  g_assert_cmpstr (formatted, ==,
+                   "[\"History\","
+                   "\"\\u003c/script\\u003e\\u003cscript\\u003ealert(\\\"x\\\\\\\")"
+                   "\\u003c/script\\u003e\","
+                   "\"a\\u000ab\\u2028c\xc3\xa9\"]");
+  g_assert_cmpuint (length, ==, strlen (formatted));
+
+  formatted_none = eknr_html_format_script_strings (arena, none, &length);
+  g_assert_cmpstr (formatted_none, ==, "[]");
+  g_assert_cmpuint (length, ==, 2);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autofree char *dir_path = NULL;
+  const char *file_name;
+
+  g_test_init (&argc, &argv, NULL);
+
+  dir_path = g_test_build_filename (G_TEST_DIST, "eknrenderer", "rewrite", NULL);
+  dir = g_dir_open (dir_path, 0, &error);
+  g_assert_no_error (error);
+
+  while ((file_name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *test_path = NULL;
+      char *name;
+
+      if (!g_str_has_suffix (file_name, INPUT_SUFFIX))
+        continue;
+
+      /* Owned by the test for the rest of the run */
+      name = g_strndup (file_name, strlen (file_name) - strlen (INPUT_SUFFIX));
+      test_path = g_strdup_printf ("/html/rewrite/file/%s", name);
+      g_test_add_data_func_full (test_path, name, test_rewrite_file, g_free);
+    }
+
+  g_test_add_func ("/html/rewrite/nothing", test_rewrite_nothing);
+  g_test_add_func ("/html/rewrite/without-links", test_rewrite_without_links);
+  g_test_add_func ("/html/rewrite/bad-chunks", test_rewrite_bad_chunks);
+  g_test_add_func ("/html/rewrite/stops-at-length", test_rewrite_stops_at_length);
+  g_test_add_func ("/html/headings/collect", test_collect_headings);
+  g_test_add_func ("/html/headings/none", test_collect_no_headings);
+  g_test_add_func ("/html/headings/script-strings", test_format_script_strings);
+
+  return g_test_run ();
+}
@@ -0,0 +1,94 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks which features eknr_html_scan_body() finds in article bodies,
+ * particularly around tags that only look like the ones it wants. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-html-private.h"
+
+typedef struct {
+  const char *body;
+  EknrHtmlBodyFeatures features;
+} ScanCase;
+
+static const ScanCase scan_cases[] = {
+  { "", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<p>Plain text</p>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<p>$5 and \\n</p>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<p>\\(x\\)</p>", EKNR_HTML_BODY_HAS_MATH },
+  { "<p>\\[x\\]</p>", EKNR_HTML_BODY_HAS_MATH },
+  { "<p>$$x$$</p>", EKNR_HTML_BODY_HAS_MATH },
+  { "\\begin{equation}x\\end{equation}", EKNR_HTML_BODY_HAS_MATH },
+  { "<MATH display=\"block\"></MATH>", EKNR_HTML_BODY_HAS_MATH },
+  { "<mathematics>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<img src=\"a.png\">", EKNR_HTML_BODY_HAS_IMAGES },
+  { "<img/>", EKNR_HTML_BODY_HAS_IMAGES },
+  { "<imgs>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "trailing <img", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<sup><i><a href=\"#\">x</a></i></sup>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<sup>[<i><a href=\"#\">x</a></i>]</sup>", EKNR_HTML_BODY_HAS_CITATIONS },
+  { "<SUP class=\"a>b\">&#91;1]</SUP>", EKNR_HTML_BODY_HAS_CITATIONS },
+  { "<sup>&lbrack;x]</sup>", EKNR_HTML_BODY_HAS_CITATIONS },
+  { "<sup> [x]</sup>", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<super>[x]", EKNR_HTML_BODY_FEATURES_NONE },
+  { "trailing <sup", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<sup><img src=\"a.png\">[", EKNR_HTML_BODY_HAS_IMAGES },
+  { "<a data-ekn-link-table-idx=\"0\">", EKNR_HTML_BODY_HAS_LINKS },
+  { "<AREA DATA-EKN-LINK-TABLE-IDX=0>", EKNR_HTML_BODY_HAS_LINKS },
+  { "<a data-ekn-link-type=\"Internal\">", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<div data-ekn-chunk-type=\"ParentFeaturedSets\">", EKNR_HTML_BODY_HAS_CHUNKS },
+  { "data-ekn-chunk", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<span class=\"mw-headline\" id=\"History\">", EKNR_HTML_BODY_HAS_HEADINGS },
+  { "<h2 class=\"mw-headlines\">", EKNR_HTML_BODY_HAS_HEADINGS },
+  { "<h2 class=\"mw-head\">", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<h2 class=\"mw-Headline\">", EKNR_HTML_BODY_FEATURES_NONE },
+  { "<sup>[<i><a>\\(x\\)<img src=\"a.png\">",
+    EKNR_HTML_BODY_HAS_MATH | EKNR_HTML_BODY_HAS_IMAGES | EKNR_HTML_BODY_HAS_CITATIONS },
+  { "<sup>[<i><a data-ekn-link-table-idx=1>$$<img><div data-ekn-chunk-type=x class=mw-headline>",
+    EKNR_HTML_BODY_ALL_FEATURES },
+};
+
+static void
+test_scan_cases (void)
+{
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (scan_cases); ++i)
+    {
+      const ScanCase *scan_case = &scan_cases[i];
+
+      g_test_message ("Scanning %s", scan_case->body);
+      g_assert_cmpint (eknr_html_scan_body (scan_case->body, strlen (scan_case->body)),
+                       ==,
+                       scan_case->features);
+    }
+}
+
+/* Nothing past the given length may be looked at */
+static void
+test_scan_stops_at_length (void)
+{
+  const char *body = "<p>x</p><img src=\"a.png\">$$";
+
+  g_assert_cmpint (eknr_html_scan_body (body, strlen ("<p>x</p>")),
+                   ==,
+                   EKNR_HTML_BODY_FEATURES_NONE);
+  g_assert_cmpint (eknr_html_scan_body (body, strlen (body) - 1),
+                   ==,
+                   EKNR_HTML_BODY_HAS_IMAGES);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/html/scan/cases", test_scan_cases);
+  g_test_add_func ("/html/scan/stops-at-length", test_scan_stops_at_length);
+
+  return g_test_run ();
+}
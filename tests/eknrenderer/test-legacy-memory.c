@@ -0,0 +1,268 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that rendering a legacy article does not copy its body. The
+ * test replaces malloc() and friends with versions that count what is
+ * allocated on the rendering thread, renders a large article, and
+ * checks that the only large allocation is the output itself, whether
+ * or not the body has images that are rewritten on the way. Also
+ * checks that once a renderer has warmed up, a render makes the same
+ * small number of allocations however many headings and images the
+ * article has, since everything but the output comes from the
+ * renderer's scratch arena. */
+
+#include <errno.h>
+#include <malloc.h>
+#include <string.h>
+
+#include "eknrenderer/eknr.h"
+
+/* Large enough that any copy of the body stands out from the
+ * allocations that every render makes */
+#define BODY_SIZE (8 * 1024 * 1024)
+#define LARGE_ALLOCATION (BODY_SIZE / 2)
+
+/* Room for the small allocations made while rendering, such as the
+ * disclaimer */
+#define ALLOWED_OVERHEAD (64 * 1024)
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+/* Only the thread doing the render is counted, so that nothing GLib
+ * does in the background gets in the way */
+static __thread gboolean counting;
+static gsize bytes_allocated;
+static guint n_allocations;
+static guint n_large_allocations;
+
+static void *
+count_allocation (void *ptr)
+{
+  if (counting && ptr != NULL)
+    {
+      gsize size = malloc_usable_size (ptr);
+
+      bytes_allocated += size;
+      n_allocations++;
+      if (size >= LARGE_ALLOCATION)
+        n_large_allocations++;
+    }
+
+  return ptr;
+}
+
+void *
+malloc (size_t size)
+{
+  return count_allocation (__libc_malloc (size));
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  return count_allocation (__libc_calloc (n_members, size));
+}
+
+/* Counted as a new allocation, since it may be one */
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  return count_allocation (__libc_realloc (ptr, size));
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  return count_allocation (__libc_memalign (alignment, size));
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  return memalign (alignment, size);
+}
+
+int
+posix_memalign (void   **ptr,
+                size_t   alignment,
+                size_t   size)
+{
+  void *result = memalign (alignment, size);
+
+  if (result == NULL)
+    return ENOMEM;
+
+  *ptr = result;
+  return 0;
+}
+
+void
+free (void *ptr)
+{
+  __libc_free (ptr);
+}
+
+/* A body of @paragraph over and over, BODY_SIZE bytes long */
+static char *
+make_large_body (const char *paragraph)
+{
+  GString *body = g_string_sized_new (BODY_SIZE + 64);
+
+  g_string_append (body, "<html><body>");
+  while (body->len < BODY_SIZE)
+    g_string_append (body, paragraph);
+  g_string_append (body, "</body></html>");
+
+  return g_string_free (body, FALSE);
+}
+
+/* A body with @n_sections headings and images, each of which gives the
+ * render something to do: the headings are collected for the scroll
+ * manager and the images are rewritten */
+static char *
+make_sectioned_body (guint n_sections)
+{
+  GString *body = g_string_new ("<html><body>");
+  guint i;
+
+  for (i = 0; i < n_sections; ++i)
+    g_string_append_printf (body,
+                            "<h2><span class=\"mw-headline\" id=\"Section_%u\">Section %u</span></h2>"
+                            "<p><img src=\"image-%u.png\"> Some text.</p>\n",
+                            i, i, i);
+  g_string_append (body, "</body></html>");
+
+  return g_string_free (body, FALSE);
+}
+
+static char *
+render_legacy (EknrRenderer *renderer,
+               const char   *body)
+{
+  g_autoptr(GError) error = NULL;
+  char *html = eknr_renderer_render_legacy_content (renderer,
+                                                    body,
+                                                    "wikipedia",
+                                                    "Wikipedia",
+                                                    "http://en.wikipedia.org/wiki/Jack",
+                                                    "CC-BY-SA 3.0",
+                                                    "Jack",
+                                                    TRUE,
+                                                    TRUE,
+                                                    &error);
+
+  g_assert_no_error (error);
+  return html;
+}
+
+static void
+check_large_body_not_copied (const char *paragraph)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autofree char *body = make_large_body (paragraph);
+  g_autofree char *priming_html = NULL;
+  g_autofree char *html = NULL;
+  gsize html_length;
+
+  /* Keep the render cache from adding its own copy of the output */
+  g_object_set (renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+
+  /* Load everything that is loaded once per renderer before counting */
+  priming_html = render_legacy (renderer, "<p>Priming</p>");
+
+  bytes_allocated = 0;
+  n_large_allocations = 0;
+  counting = TRUE;
+  html = render_legacy (renderer, body);
+  counting = FALSE;
+
+  html_length = strlen (html);
+  g_assert_cmpuint (html_length, >, BODY_SIZE);
+  g_assert_nonnull (strstr (html, "All work and no play"));
+  if (strstr (paragraph, "<img") != NULL)
+    g_assert_nonnull (strstr (html, "onerror="));
+
+  /* The output, allocated once, and nothing else of that size */
+  g_assert_cmpuint (n_large_allocations, ==, 1);
+  g_assert_cmpuint (bytes_allocated, <=, html_length + 1 + ALLOWED_OVERHEAD);
+}
+
+static void
+test_legacy_body_not_copied (void)
+{
+  check_large_body_not_copied ("<p>All work and no play makes Jack a dull boy.</p>\n");
+}
+
+/* The images are rewritten straight into the output, which is still
+ * allocated once at the right size */
+static void
+test_legacy_rewritten_body_not_copied (void)
+{
+  check_large_body_not_copied ("<p><img src=\"jack.png\">"
+                               "All work and no play makes Jack a dull boy.</p>\n");
+}
+
+/* Returns how many allocations rendering @body made */
+static guint
+count_render_allocations (EknrRenderer *renderer,
+                          const char   *body)
+{
+  g_autofree char *html = NULL;
+  guint count;
+
+  n_allocations = 0;
+  counting = TRUE;
+  html = render_legacy (renderer, body);
+  counting = FALSE;
+  count = n_allocations;
+
+  g_assert_nonnull (strstr (html, "Section_0"));
+  return count;
+}
+
+static void
+test_legacy_warm_render_allocations (void)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autofree char *small_body = make_sectioned_body (2);
+  g_autofree char *large_body = make_sectioned_body (2000);
+  guint i, n_small, n_large;
+
+  g_object_set (renderer, "render-cache-max-bytes", (guint64) 0, NULL);
+
+  /* Let the scratch arena grow to fit the largest article */
+  for (i = 0; i < 2; ++i)
+    {
+      g_autofree char *small_html = render_legacy (renderer, small_body);
+      g_autofree char *large_html = render_legacy (renderer, large_body);
+    }
+
+  n_small = count_render_allocations (renderer, small_body);
+  n_large = count_render_allocations (renderer, large_body);
+
+  /* Only the output */
+  g_assert_cmpuint (n_small, ==, 1);
+  g_assert_cmpuint (n_large, ==, n_small);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/legacy/memory/body-not-copied", test_legacy_body_not_copied);
+  g_test_add_func ("/legacy/memory/rewritten-body-not-copied",
+                   test_legacy_rewritten_body_not_copied);
+  g_test_add_func ("/legacy/memory/warm-render-allocations",
+                   test_legacy_warm_render_allocations);
+
+  return g_test_run ();
+}
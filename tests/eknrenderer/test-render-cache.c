@@ -0,0 +1,119 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that the render cache does not take articles that were
+ * rendered before it was last cleared, which a render on another thread
+ * may still be finishing when a source is registered, and that it does
+ * not mistake one body for another whose hash is the same. */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "eknrenderer/eknr-render-cache-private.h"
+
+static const char *html = "<html><body><p>Rendered</p></body></html>";
+
+static void
+init_key_with_body (EknrRenderCacheKey *key,
+                    const char         *body)
+{
+  eknr_render_cache_key_init (key,
+                              body,
+                              "wikipedia",
+                              "Wikipedia",
+                              "http://en.wikipedia.org/wiki/Rendered",
+                              "CC-BY-SA 3.0",
+                              "Rendered",
+                              "C",
+                              NULL,
+                              0);
+}
+
+static void
+init_key (EknrRenderCacheKey *key)
+{
+  init_key_with_body (key, "<p>Rendered</p>");
+}
+
+static void
+test_insert_current_generation (void)
+{
+  EknrRenderCache *cache = eknr_render_cache_new ();
+  EknrRenderCacheKey key;
+  g_autoptr(GBytes) cached = NULL;
+  guint generation;
+
+  eknr_render_cache_set_max_bytes (cache, 1024 * 1024);
+  init_key (&key);
+
+  generation = eknr_render_cache_get_generation (cache);
+  eknr_render_cache_insert (cache, &key, html, strlen (html), generation);
+
+  cached = eknr_render_cache_lookup (cache, &key);
+  g_assert_nonnull (cached);
+  g_assert_cmpstr (g_bytes_get_data (cached, NULL), ==, html);
+
+  eknr_render_cache_free (cache);
+}
+
+static void
+test_insert_stale_generation (void)
+{
+  EknrRenderCache *cache = eknr_render_cache_new ();
+  EknrRenderCacheKey key;
+  g_autoptr(GBytes) cached = NULL;
+  guint generation;
+
+  eknr_render_cache_set_max_bytes (cache, 1024 * 1024);
+  init_key (&key);
+
+  /* The render starts, then a source is registered before it finishes */
+  generation = eknr_render_cache_get_generation (cache);
+  eknr_render_cache_clear (cache);
+  g_assert_cmpuint (eknr_render_cache_get_generation (cache), !=, generation);
+
+  eknr_render_cache_insert (cache, &key, html, strlen (html), generation);
+
+  cached = eknr_render_cache_lookup (cache, &key);
+  g_assert_null (cached);
+
+  eknr_render_cache_free (cache);
+}
+
+static void
+test_lookup_hash_collision (void)
+{
+  EknrRenderCache *cache = eknr_render_cache_new ();
+  EknrRenderCacheKey key;
+  EknrRenderCacheKey collision;
+  g_autoptr(GBytes) cached = NULL;
+
+  eknr_render_cache_set_max_bytes (cache, 1024 * 1024);
+  init_key (&key);
+  eknr_render_cache_insert (cache, &key, html, strlen (html),
+                            eknr_render_cache_get_generation (cache));
+
+  /* A body of the same length, as if its hash were the same */
+  init_key_with_body (&collision, "<p>Collided</p>");
+  g_assert_cmpuint (collision.body_length, ==, key.body_length);
+  collision.body_hash = key.body_hash;
+  collision.hash = key.hash;
+
+  cached = eknr_render_cache_lookup (cache, &collision);
+  g_assert_null (cached);
+
+  eknr_render_cache_free (cache);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/render-cache/insert/current-generation", test_insert_current_generation);
+  g_test_add_func ("/render-cache/insert/stale-generation", test_insert_stale_generation);
+  g_test_add_func ("/render-cache/lookup/hash-collision", test_lookup_hash_collision);
+
+  return g_test_run ();
+}
@@ -0,0 +1,152 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that a legacy article rendered in pieces shares its body with
+ * the body it was rendered from, and that rendering it again with other
+ * flags shares the body too while giving the same output as a full
+ * render would have. */
+
+#include <string.h>
+
+#include "eknrenderer/eknr.h"
+
+static const char *legacy_body =
+  "<html><body><p>Pieces &amp; bodies</p></body></html>";
+
+static EknrRenderedArticle *
+render_article (EknrRenderer    *renderer,
+                GBytes          *body,
+                EknrRenderFlags  flags)
+{
+  g_autoptr(GError) error = NULL;
+  EknrRenderedArticle *article =
+    eknr_renderer_render_legacy_article (renderer,
+                                         body,
+                                         "wikipedia",
+                                         "Wikipedia",
+                                         "http://en.wikipedia.org/wiki/Piece",
+                                         "CC-BY-SA 3.0",
+                                         "Piece",
+                                         NULL,
+                                         flags,
+                                         &error);
+
+  g_assert_no_error (error);
+  g_assert_nonnull (article);
+  return article;
+}
+
+static char *
+render_content (EknrRenderer    *renderer,
+                EknrRenderFlags  flags)
+{
+  g_autoptr(GError) error = NULL;
+  char *html =
+    eknr_renderer_render_legacy_content (renderer,
+                                         legacy_body,
+                                         "wikipedia",
+                                         "Wikipedia",
+                                         "http://en.wikipedia.org/wiki/Piece",
+                                         "CC-BY-SA 3.0",
+                                         "Piece",
+                                         (flags & EKNR_RENDER_FLAGS_SHOW_TITLE) != 0,
+                                         (flags & EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER) != 0,
+                                         &error);
+
+  g_assert_no_error (error);
+  return html;
+}
+
+static void
+assert_body_within (GBytes *piece,
+                    GBytes *whole)
+{
+  gsize piece_size, whole_size;
+  const char *piece_data = g_bytes_get_data (piece, &piece_size);
+  const char *whole_data = g_bytes_get_data (whole, &whole_size);
+
+  g_assert_cmpuint (piece_size, >, 0);
+  g_assert_true (piece_data >= whole_data);
+  g_assert_true (piece_data + piece_size <= whole_data + whole_size);
+}
+
+static void
+test_body_is_shared (void)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autoptr(GBytes) body = g_bytes_new_static (legacy_body, strlen (legacy_body));
+  g_autoptr(EknrRenderedArticle) article = render_article (renderer, body,
+                                                           EKNR_RENDER_FLAGS_NONE);
+  GBytes *piece = eknr_rendered_article_get_body (article);
+  gsize size;
+  const char *data = g_bytes_get_data (piece, &size);
+
+  assert_body_within (piece, body);
+  g_assert_cmpmem (data, size, "<p>Pieces &amp; bodies</p>", strlen ("<p>Pieces &amp; bodies</p>"));
+}
+
+static void
+test_matches_full_render (void)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autoptr(GBytes) body = g_bytes_new_static (legacy_body, strlen (legacy_body));
+  EknrRenderFlags all_flags[] = {
+    EKNR_RENDER_FLAGS_NONE,
+    EKNR_RENDER_FLAGS_SHOW_TITLE,
+    EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER,
+    EKNR_RENDER_FLAGS_SHOW_TITLE | EKNR_RENDER_FLAGS_USE_SCROLL_MANAGER
+  };
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (all_flags); ++i)
+    {
+      g_autoptr(EknrRenderedArticle) article = render_article (renderer, body, all_flags[i]);
+      g_autofree char *expected = render_content (renderer, all_flags[i]);
+
+      g_assert_cmpstr (eknr_rendered_article_get_html (article), ==, expected);
+      g_assert_cmpuint (eknr_rendered_article_get_length (article), ==, strlen (expected));
+      g_assert_cmpint (eknr_rendered_article_get_flags (article), ==, all_flags[i]);
+    }
+}
+
+static void
+test_rerender_shares_body (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autoptr(GBytes) body = g_bytes_new_static (legacy_body, strlen (legacy_body));
+  g_autoptr(EknrRenderedArticle) article = render_article (renderer, body,
+                                                           EKNR_RENDER_FLAGS_NONE);
+  g_autoptr(EknrRenderedArticle) same = NULL;
+  g_autoptr(EknrRenderedArticle) titled = NULL;
+  g_autofree char *expected = render_content (renderer, EKNR_RENDER_FLAGS_SHOW_TITLE);
+
+  same = eknr_renderer_rerender_legacy_article (renderer, article,
+                                                EKNR_RENDER_FLAGS_NONE, &error);
+  g_assert_no_error (error);
+  g_assert_true (same == article);
+
+  titled = eknr_renderer_rerender_legacy_article (renderer, article,
+                                                  EKNR_RENDER_FLAGS_SHOW_TITLE, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (titled);
+  g_assert_true (titled != article);
+
+  g_assert_true (eknr_rendered_article_get_body (titled) ==
+                 eknr_rendered_article_get_body (article));
+  g_assert_false (g_bytes_equal (eknr_rendered_article_get_head (titled),
+                                 eknr_rendered_article_get_head (article)));
+  g_assert_cmpstr (eknr_rendered_article_get_html (titled), ==, expected);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/renderer/rendered-article/body-is-shared", test_body_is_shared);
+  g_test_add_func ("/renderer/rendered-article/matches-full-render", test_matches_full_render);
+  g_test_add_func ("/renderer/rendered-article/rerender-shares-body", test_rerender_shares_body);
+
+  return g_test_run ();
+}
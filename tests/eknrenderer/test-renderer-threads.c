@@ -0,0 +1,231 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Renders from many threads at once with a single shared renderer and
+ * checks that every thread gets the same output as a single-threaded
+ * render would have produced. */
+
+#include <glib/gstdio.h>
+
+#include "eknrenderer/eknr.h"
+
+#define N_TEMPLATES 8
+#define N_ITERATIONS 200
+
+typedef struct {
+  EknrRenderer *renderer;
+  char *tmpdir;
+  GFile *templates[N_TEMPLATES];
+  char *expected[N_TEMPLATES];
+  GVariant *variables;
+  char *expected_legacy;
+
+  /* Holds all threads back until they have all been started, so that
+   * they all miss the template cache at the same time */
+  GMutex lock;
+  GCond cond;
+  gboolean go;
+} Fixture;
+
+static const char *legacy_body =
+  "<html><body><p>Threads &amp; renderers</p></body></html>";
+
+static char *
+render_legacy (EknrRenderer *renderer)
+{
+  g_autoptr(GError) error = NULL;
+  char *html = eknr_renderer_render_legacy_content (renderer,
+                                                    legacy_body,
+                                                    "wikipedia",
+                                                    "Wikipedia",
+                                                    "http://en.wikipedia.org/wiki/Thread",
+                                                    "CC-BY-SA 3.0",
+                                                    "Thread",
+                                                    TRUE,
+                                                    TRUE,
+                                                    &error);
+
+  g_assert_no_error (error);
+  return html;
+}
+
+static void
+fixture_set_up (Fixture       *fixture,
+                gconstpointer  user_data)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrRenderer) reference_renderer = eknr_renderer_new ();
+  GVariantBuilder builder;
+  const char *items[] = { "one", "<two>", NULL };
+  gsize i;
+
+  fixture->tmpdir = g_dir_make_tmp ("eknr-threads-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "name", g_variant_new_string ("world"));
+  g_variant_builder_add (&builder, "{sv}", "items", g_variant_new_strv (items, -1));
+  fixture->variables = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  for (i = 0; i < N_TEMPLATES; ++i)
+    {
+      g_autofree char *basename = g_strdup_printf ("template-%" G_GSIZE_FORMAT ".mst", i);
+      g_autofree char *path = g_build_filename (fixture->tmpdir, basename, NULL);
+      g_autofree char *contents = g_strdup_printf ("<p>%" G_GSIZE_FORMAT " {{name}}</p>"
+                                                   "{{#items}}<i>{{.}}</i>{{/items}}",
+                                                   i);
+
+      g_file_set_contents (path, contents, -1, &error);
+      g_assert_no_error (error);
+
+      fixture->templates[i] = g_file_new_for_path (path);
+      fixture->expected[i] = eknr_renderer_render_mustache_document (reference_renderer,
+                                                                     contents,
+                                                                     fixture->variables,
+                                                                     &error);
+      g_assert_no_error (error);
+    }
+
+  fixture->expected_legacy = render_legacy (reference_renderer);
+  fixture->renderer = eknr_renderer_new ();
+
+  g_mutex_init (&fixture->lock);
+  g_cond_init (&fixture->cond);
+}
+
+static void
+fixture_tear_down (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  gsize i;
+
+  for (i = 0; i < N_TEMPLATES; ++i)
+    {
+      g_autofree char *path = g_file_get_path (fixture->templates[i]);
+
+      g_unlink (path);
+      g_object_unref (fixture->templates[i]);
+      g_free (fixture->expected[i]);
+    }
+
+  g_rmdir (fixture->tmpdir);
+  g_free (fixture->tmpdir);
+  g_free (fixture->expected_legacy);
+  g_variant_unref (fixture->variables);
+  g_object_unref (fixture->renderer);
+  g_mutex_clear (&fixture->lock);
+  g_cond_clear (&fixture->cond);
+}
+
+static gpointer
+render_thread (gpointer user_data)
+{
+  Fixture *fixture = user_data;
+  gsize i;
+
+  g_mutex_lock (&fixture->lock);
+  while (!fixture->go)
+    g_cond_wait (&fixture->cond, &fixture->lock);
+  g_mutex_unlock (&fixture->lock);
+
+  for (i = 0; i < N_ITERATIONS; ++i)
+    {
+      g_autoptr(GError) error = NULL;
+      gsize index = i % N_TEMPLATES;
+      g_autofree char *html = NULL;
+
+      html = eknr_renderer_render_mustache_document_from_file (fixture->renderer,
+                                                               fixture->templates[index],
+                                                               fixture->variables,
+                                                               &error);
+      g_assert_no_error (error);
+      g_assert_cmpstr (html, ==, fixture->expected[index]);
+
+      if (i % 10 == 0)
+        {
+          g_autofree char *legacy_html = render_legacy (fixture->renderer);
+
+          g_assert_cmpstr (legacy_html, ==, fixture->expected_legacy);
+        }
+    }
+
+  return NULL;
+}
+
+static void
+test_render_from_many_threads (Fixture       *fixture,
+                               gconstpointer  user_data)
+{
+  guint n_threads = MAX (g_get_num_processors (), 4) * 2;
+  g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < n_threads; ++i)
+    g_ptr_array_add (threads, g_thread_new ("render", render_thread, fixture));
+
+  g_mutex_lock (&fixture->lock);
+  fixture->go = TRUE;
+  g_cond_broadcast (&fixture->cond);
+  g_mutex_unlock (&fixture->lock);
+
+  for (i = 0; i < threads->len; ++i)
+    g_thread_join (g_ptr_array_index (threads, i));
+}
+
+/* A template that fails to load must fail in every thread that asks for
+ * it, not just the one that tried first. */
+static gpointer
+missing_template_thread (gpointer user_data)
+{
+  Fixture *fixture = user_data;
+  g_autofree char *path = g_build_filename (fixture->tmpdir, "missing.mst", NULL);
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = NULL;
+
+  g_mutex_lock (&fixture->lock);
+  while (!fixture->go)
+    g_cond_wait (&fixture->cond, &fixture->lock);
+  g_mutex_unlock (&fixture->lock);
+
+  html = eknr_renderer_render_mustache_document_from_file (fixture->renderer,
+                                                           file,
+                                                           fixture->variables,
+                                                           &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_null (html);
+
+  return NULL;
+}
+
+static void
+test_missing_template_from_many_threads (Fixture       *fixture,
+                                         gconstpointer  user_data)
+{
+  g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < 8; ++i)
+    g_ptr_array_add (threads, g_thread_new ("missing", missing_template_thread, fixture));
+
+  g_mutex_lock (&fixture->lock);
+  fixture->go = TRUE;
+  g_cond_broadcast (&fixture->cond);
+  g_mutex_unlock (&fixture->lock);
+
+  for (i = 0; i < threads->len; ++i)
+    g_thread_join (g_ptr_array_index (threads, i));
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/renderer/threads/render", Fixture, NULL,
+              fixture_set_up, test_render_from_many_threads, fixture_tear_down);
+  g_test_add ("/renderer/threads/missing-template", Fixture, NULL,
+              fixture_set_up, test_missing_template_from_many_threads, fixture_tear_down);
+
+  return g_test_run ();
+}
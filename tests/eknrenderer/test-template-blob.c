@@ -0,0 +1,363 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that compiled template blobs render like the templates they
+ * were compiled from, that damaged or stale blobs are rejected, that
+ * unused blobs are deleted from the directory they are saved in, and
+ * that the renderer reuses blobs saved by an earlier renderer. */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "eknrenderer/eknr.h"
+#include "eknrenderer/eknr-hash-private.h"
+#include "eknrenderer/eknr-template-blob-private.h"
+
+#define TEMPLATE_SOURCE "{{#items}}<li>{{.}}</li>{{/items}}"
+
+static const char *cache_home;
+
+static gboolean
+append_written (gpointer                user_data,
+                const char             *buffer,
+                gsize                   length,
+                G_GNUC_UNUSED GError  **error)
+{
+  g_string_append_len (user_data, buffer, length);
+  return TRUE;
+}
+
+static GVariant *
+make_variables (void)
+{
+  GVariantBuilder builder;
+  const char *items[] = { "one", "<two>", NULL };
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "title", g_variant_new_string ("A & B"));
+  g_variant_builder_add (&builder, "{sv}", "items", g_variant_new_strv (items, -1));
+  g_variant_builder_add (&builder, "{sv}", "show", g_variant_new_boolean (TRUE));
+  g_variant_builder_add (&builder, "{sv}", "hide", g_variant_new_boolean (FALSE));
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Equivalent to
+ * "<h1>{{title}}</h1>{{{title}}}{{#items}}<li>{{.}}</li>{{/items}}"
+ * "{{#show}}shown{{/show}}{{#hide}}hidden{{/hide}}" */
+static GBytes *
+build_blob (guint64 source_hash,
+            gsize   source_length)
+{
+  EknrTemplateBlobBuilder *builder = eknr_template_blob_builder_new ();
+
+  eknr_template_blob_builder_add_text (builder, "<h1>", 4);
+  eknr_template_blob_builder_add_variable (builder, "title", TRUE);
+  eknr_template_blob_builder_add_text (builder, "</h1>", 5);
+  eknr_template_blob_builder_add_variable (builder, "title", FALSE);
+  eknr_template_blob_builder_begin_section (builder, "items");
+  eknr_template_blob_builder_add_text (builder, "<li>", 4);
+  eknr_template_blob_builder_add_variable (builder, ".", TRUE);
+  eknr_template_blob_builder_add_text (builder, "</li>", 5);
+  eknr_template_blob_builder_end_section (builder);
+  eknr_template_blob_builder_begin_section (builder, "show");
+  eknr_template_blob_builder_add_text (builder, "shown", 5);
+  eknr_template_blob_builder_end_section (builder);
+  eknr_template_blob_builder_begin_section (builder, "hide");
+  eknr_template_blob_builder_add_text (builder, "hidden", 6);
+  eknr_template_blob_builder_end_section (builder);
+
+  return eknr_template_blob_builder_end (builder, source_hash, source_length);
+}
+
+static char *
+render_blob (EknrTemplateBlob *blob)
+{
+  g_autoptr(EknrTemplateContext) context = eknr_template_context_new (make_variables ());
+  g_autoptr(GString) output = g_string_new (NULL);
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true (eknr_template_blob_render (blob, context, append_written, output, &error));
+  g_assert_no_error (error);
+
+  return g_string_free (g_steal_pointer (&output), FALSE);
+}
+
+static const char *expected_output =
+  "<h1>A &amp; B</h1>A & B<li>one</li><li>&lt;two&gt;</li>shown";
+
+static void
+test_blob_render (void)
+{
+  g_autoptr(GBytes) bytes = build_blob (0, 0);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrTemplateBlob) blob = eknr_template_blob_new (bytes, &error);
+  g_autofree char *html = NULL;
+
+  g_assert_no_error (error);
+  html = render_blob (blob);
+  g_assert_cmpstr (html, ==, expected_output);
+}
+
+static void
+assert_blob_invalid (GBytes *bytes)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrTemplateBlob) blob = eknr_template_blob_new (bytes, &error);
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (blob);
+}
+
+static GBytes *
+modify_byte (GBytes *bytes,
+             gsize   offset,
+             guint8  value)
+{
+  gsize size;
+  guint8 *data = g_bytes_unref_to_data (g_bytes_ref (bytes), &size);
+
+  data[offset] = value;
+  return g_bytes_new_take (data, size);
+}
+
+static void
+test_blob_rejects_damage (void)
+{
+  g_autoptr(GBytes) bytes = build_blob (0, 0);
+  gsize size = g_bytes_get_size (bytes);
+  const guint8 *data = g_bytes_get_data (bytes, NULL);
+  g_autoptr(GBytes) truncated = g_bytes_new_from_bytes (bytes, 0, size - 1);
+  g_autoptr(GBytes) bad_magic = modify_byte (bytes, 0, 'X');
+  g_autoptr(GBytes) bad_version = modify_byte (bytes, 8, data[8] + 1);
+  g_autoptr(GBytes) bad_payload = modify_byte (bytes, size - 2, data[size - 2] ^ 0x20);
+  g_autoptr(GBytes) empty = g_bytes_new (NULL, 0);
+
+  assert_blob_invalid (truncated);
+  assert_blob_invalid (bad_magic);
+  assert_blob_invalid (bad_version);
+  assert_blob_invalid (bad_payload);
+  assert_blob_invalid (empty);
+}
+
+/* Equivalent to @depth nested "{{#show}}" sections around "x" */
+static GBytes *
+build_nested_blob (guint depth)
+{
+  EknrTemplateBlobBuilder *builder = eknr_template_blob_builder_new ();
+  guint i;
+
+  for (i = 0; i < depth; ++i)
+    eknr_template_blob_builder_begin_section (builder, "show");
+  eknr_template_blob_builder_add_text (builder, "x", 1);
+  for (i = 0; i < depth; ++i)
+    eknr_template_blob_builder_end_section (builder);
+
+  return eknr_template_blob_builder_end (builder, 0, 0);
+}
+
+static void
+test_blob_rejects_deep_nesting (void)
+{
+  g_autoptr(GBytes) nested = build_nested_blob (64);
+  g_autoptr(GBytes) too_deep = build_nested_blob (65);
+  g_autoptr(GBytes) far_too_deep = build_nested_blob (100000);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(EknrTemplateBlob) blob = eknr_template_blob_new (nested, &error);
+  g_autofree char *html = NULL;
+
+  g_assert_no_error (error);
+  html = render_blob (blob);
+  g_assert_cmpstr (html, ==, "x");
+
+  assert_blob_invalid (too_deep);
+  assert_blob_invalid (far_too_deep);
+}
+
+static void
+test_blob_save_and_load (void)
+{
+  g_autofree char *dir = g_dir_make_tmp ("eknr-blob-XXXXXX", NULL);
+  guint64 source_hash = eknr_hash_bytes (TEMPLATE_SOURCE, strlen (TEMPLATE_SOURCE));
+  g_autoptr(GBytes) bytes = build_blob (source_hash, strlen (TEMPLATE_SOURCE));
+  g_autoptr(EknrTemplateBlob) blob = eknr_template_blob_new (bytes, NULL);
+  g_autoptr(EknrTemplateBlob) loaded = NULL;
+  g_autoptr(EknrTemplateBlob) stale = NULL;
+  g_autoptr(EknrTemplateBlob) missing = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *html = NULL;
+
+  g_assert_nonnull (dir);
+  g_assert_true (eknr_template_blob_save (blob, dir, G_MAXUINT64, &error));
+  g_assert_no_error (error);
+
+  loaded = eknr_template_blob_load (dir, source_hash, strlen (TEMPLATE_SOURCE), &error);
+  g_assert_no_error (error);
+  html = render_blob (loaded);
+  g_assert_cmpstr (html, ==, expected_output);
+
+  /* Same hash, different source */
+  stale = eknr_template_blob_load (dir, source_hash, strlen (TEMPLATE_SOURCE) + 1, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (stale);
+  g_clear_error (&error);
+
+  missing = eknr_template_blob_load (dir, source_hash + 1, strlen (TEMPLATE_SOURCE), &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_assert_null (missing);
+}
+
+static char *
+save_blob_with_hash (const char *dir,
+                     guint64     source_hash,
+                     guint64     max_dir_bytes)
+{
+  g_autoptr(GBytes) bytes = build_blob (source_hash, strlen (TEMPLATE_SOURCE));
+  g_autoptr(EknrTemplateBlob) blob = eknr_template_blob_new (bytes, NULL);
+  g_autoptr(GError) error = NULL;
+  g_autofree char *basename = g_strdup_printf ("%016" G_GINT64_MODIFIER "x.tmpl",
+                                               source_hash);
+
+  g_assert_true (eknr_template_blob_save (blob, dir, max_dir_bytes, &error));
+  g_assert_no_error (error);
+
+  return g_build_filename (dir, basename, NULL);
+}
+
+static void
+set_modified_time (const char *path,
+                   guint64     seconds)
+{
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  g_autoptr(GError) error = NULL;
+
+  g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, seconds,
+                               G_FILE_QUERY_INFO_NONE, NULL, &error);
+  g_assert_no_error (error);
+}
+
+/* Saving deletes the least recently used blobs once there are too many,
+ * and loading a blob counts as using it. */
+static void
+test_blob_save_prunes (void)
+{
+  g_autofree char *dir = g_dir_make_tmp ("eknr-blob-XXXXXX", NULL);
+  g_autoptr(GBytes) bytes = build_blob (0, strlen (TEMPLATE_SOURCE));
+  gsize size = g_bytes_get_size (bytes);
+  g_autofree char *first = save_blob_with_hash (dir, 1, G_MAXUINT64);
+  g_autofree char *second = save_blob_with_hash (dir, 2, G_MAXUINT64);
+  g_autofree char *third = save_blob_with_hash (dir, 3, G_MAXUINT64);
+  g_autofree char *fourth = NULL;
+  g_autofree char *fifth = NULL;
+  g_autofree char *not_a_blob = g_build_filename (dir, "notes.txt", NULL);
+  g_autoptr(EknrTemplateBlob) loaded = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true (g_file_set_contents (not_a_blob, "keep me", -1, NULL));
+  set_modified_time (first, 1000);
+  set_modified_time (second, 2000);
+  set_modified_time (third, 3000);
+
+  loaded = eknr_template_blob_load (dir, 1, strlen (TEMPLATE_SOURCE), &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (loaded);
+
+  /* Room for three: the second is now the least recently used */
+  fourth = save_blob_with_hash (dir, 4, 3 * size);
+  g_assert_true (g_file_test (first, G_FILE_TEST_IS_REGULAR));
+  g_assert_false (g_file_test (second, G_FILE_TEST_EXISTS));
+  g_assert_true (g_file_test (third, G_FILE_TEST_IS_REGULAR));
+  g_assert_true (g_file_test (fourth, G_FILE_TEST_IS_REGULAR));
+
+  /* The blob just saved is kept even if it does not fit */
+  fifth = save_blob_with_hash (dir, 5, 0);
+  g_assert_false (g_file_test (first, G_FILE_TEST_EXISTS));
+  g_assert_false (g_file_test (third, G_FILE_TEST_EXISTS));
+  g_assert_false (g_file_test (fourth, G_FILE_TEST_EXISTS));
+  g_assert_true (g_file_test (fifth, G_FILE_TEST_IS_REGULAR));
+  g_assert_true (g_file_test (not_a_blob, G_FILE_TEST_IS_REGULAR));
+}
+
+static char *
+render_template_file (GFile *file)
+{
+  g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+  g_autoptr(GError) error = NULL;
+  char *html = eknr_renderer_render_mustache_document_from_file (renderer,
+                                                                 file,
+                                                                 make_variables (),
+                                                                 &error);
+
+  g_assert_no_error (error);
+  return html;
+}
+
+static char *
+saved_blob_path (const char *source)
+{
+  guint64 source_hash = eknr_hash_bytes (source, strlen (source));
+  g_autofree char *basename = g_strdup_printf ("%016" G_GINT64_MODIFIER "x.tmpl",
+                                               source_hash);
+
+  return g_build_filename (cache_home, "eknr", "templates", basename, NULL);
+}
+
+/* A renderer saves the templates it compiles, the next renderer uses
+ * them, and a damaged one is compiled and saved again. */
+static void
+test_renderer_reuses_saved_blob (void)
+{
+  g_autofree char *dir = g_dir_make_tmp ("eknr-template-XXXXXX", NULL);
+  g_autofree char *path = g_build_filename (dir, "list.mst", NULL);
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  g_autofree char *blob_path = saved_blob_path (TEMPLATE_SOURCE);
+  g_autofree char *first = NULL;
+  g_autofree char *second = NULL;
+  g_autofree char *third = NULL;
+  g_autoptr(GMappedFile) saved = NULL;
+  g_autoptr(GBytes) saved_bytes = NULL;
+  g_autoptr(EknrTemplateBlob) saved_blob = NULL;
+
+  g_assert_true (g_file_set_contents (path, TEMPLATE_SOURCE, -1, NULL));
+
+  first = render_template_file (file);
+  g_assert_cmpstr (first, ==, "<li>one</li><li>&lt;two&gt;</li>");
+  g_assert_true (g_file_test (blob_path, G_FILE_TEST_IS_REGULAR));
+
+  second = render_template_file (file);
+  g_assert_cmpstr (second, ==, first);
+
+  g_assert_true (g_file_set_contents (blob_path, "not a template", -1, NULL));
+  third = render_template_file (file);
+  g_assert_cmpstr (third, ==, first);
+
+  saved = g_mapped_file_new (blob_path, FALSE, NULL);
+  g_assert_nonnull (saved);
+  saved_bytes = g_mapped_file_get_bytes (saved);
+  saved_blob = eknr_template_blob_new (saved_bytes, NULL);
+  g_assert_nonnull (saved_blob);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_autofree char *tmp_cache_home = g_dir_make_tmp ("eknr-cache-XXXXXX", NULL);
+
+  /* Keep saved templates out of the real cache directory. This has to
+   * happen before anything asks GLib for the cache directory. */
+  g_setenv ("XDG_CACHE_HOME", tmp_cache_home, TRUE);
+  cache_home = tmp_cache_home;
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/template/blob/render", test_blob_render);
+  g_test_add_func ("/template/blob/rejects-damage", test_blob_rejects_damage);
+  g_test_add_func ("/template/blob/rejects-deep-nesting", test_blob_rejects_deep_nesting);
+  g_test_add_func ("/template/blob/save-and-load", test_blob_save_and_load);
+  g_test_add_func ("/template/blob/save-prunes", test_blob_save_prunes);
+  g_test_add_func ("/template/blob/renderer-reuses-saved", test_renderer_reuses_saved_blob);
+
+  return g_test_run ();
+}
@@ -1,4 +1,5 @@
-const {Eknr, Gio} = imports.gi;
+const ByteArray = imports.byteArray;
+const {Eknr, Gio, GLib} = imports.gi;
 
 function render_model_with_options(renderer,
     html, model, use_scroll_manager=false, show_title=false) {
@@ -7,12 +8,18 @@ function render_model_with_options(renderer,
         model.license, model.title, show_title, use_scroll_manager);
 }
 
+function stream_contents(stream) {
+    stream.close(null);
+    return ByteArray.toString(stream.steal_as_bytes().toArray());
+}
+
 describe('Legacy HTML Renderer', function () {
     let wikihow_model, wikibooks_model, wikipedia_model, wikisource_model;
     let all_models;
     let renderer;
 
     const html = '<html><body><p>dummy html</p></body></html>';
+    const math_html = '<html><body><p>\\(e^{i\\pi} + 1 = 0\\)</p></body></html>';
 
     beforeEach(function () {
         spyOn(Gio.Application, 'get_default').and.returnValue({
@@ -94,6 +101,18 @@ describe('Legacy HTML Renderer', function () {
         expect(rendered_html).toMatch('http://www.wikihow.com/Give-Passive-Aggressive-Gifts-for-Christmas');
     });
 
+    it('links each article from the same source to its own original', function () {
+        let other_model = Object.assign({}, wikihow_model, {
+            original_uri: 'http://www.wikihow.com/Other-Article',
+            title: 'Other <title>',
+        });
+        render_model_with_options(renderer, html, wikihow_model);
+        let rendered_html = render_model_with_options(renderer, html, other_model);
+        expect(rendered_html).toMatch(
+            '<a class="eos-show-link" href="http://www.wikihow.com/Other-Article">Other &lt;title&gt;</a>');
+        expect(rendered_html).not.toMatch('Give-Passive-Aggressive-Gifts-for-Christmas');
+    });
+
     it('includes correct css for article type', function () {
         expect(render_model_with_options(renderer, html,
             wikihow_model)).toMatch('wikihow.css');
@@ -111,28 +130,753 @@ describe('Legacy HTML Renderer', function () {
         expect(rendered_html).toMatch('<p>dummy html</p>');
     });
 
-    it('includes scroll_manager.js only when told to', function () {
+    it('strips the html and body tags surrounding the article', function () {
+        let rendered_html = render_model_with_options(renderer,
+            '\n  <html>\n<body>\n<p>dummy html</p>\n</body>  </html>\n',
+            wikihow_model);
+        expect(rendered_html).toMatch('<div>\n<p>dummy html</p>\n</div>');
+        expect(rendered_html).not.toMatch('<body>');
+        expect(rendered_html).not.toMatch('</html>');
+    });
+
+    it('leaves article html without surrounding tags untouched', function () {
+        let rendered_html = render_model_with_options(renderer,
+            '<p>dummy html</p></body>', wikihow_model);
+        expect(rendered_html).toMatch('<div><p>dummy html</p></body></div>');
+    });
+
+    it('includes the scroll manager only when told to', function () {
         let html_without_scroll_manager = render_model_with_options(renderer,
             html, wikibooks_model);
         renderer.enable_scroll_manager = true;
         let html_with_scroll_manager = render_model_with_options(renderer,
             html, wikibooks_model, true);
 
-        expect(html_with_scroll_manager).toMatch('scroll-manager.js');
-        expect(html_without_scroll_manager).not.toMatch('scroll-manager.js');
+        expect(html_with_scroll_manager).toMatch('legacy-article.js');
+        expect(html_without_scroll_manager).not.toMatch('legacy-article.js');
+    });
+
+    describe('passing headings to the scroll manager', function () {
+        const headings_html = '<html><body>' +
+            '<h2><span class="mw-headline" id="History">History</span></h2>' +
+            '<h2><span class="mw-headline" id="&lt;/script&gt;">x</span></h2>' +
+            '</body></html>';
+
+        it('lists the headings before the scroll manager runs', function () {
+            let rendered_html = render_model_with_options(renderer,
+                headings_html, wikipedia_model, true);
+            expect(rendered_html).toMatch(
+                'window.scrollManagerHeadings = \\["History","\\\\u003c/script\\\\u003e"\\];');
+            expect(rendered_html.indexOf('scrollManagerHeadings'))
+                .toBeLessThan(rendered_html.indexOf('legacy-article.js'));
+        });
+
+        it('does not list headings without the scroll manager', function () {
+            let rendered_html = render_model_with_options(renderer,
+                headings_html, wikipedia_model);
+            expect(rendered_html).not.toMatch('scrollManagerHeadings');
+        });
+
+        it('lists no headings when there are none', function () {
+            let rendered_html = render_model_with_options(renderer,
+                html, wikipedia_model, true);
+            expect(rendered_html).toMatch('window.scrollManagerHeadings = \\[\\];');
+        });
     });
 
     it('includes MathJax in rendered Wikipedia, Wikibooks, and Wikisource articles', function () {
-        let rendered_html = render_model_with_options(renderer, html, wikibooks_model);
+        let rendered_html = render_model_with_options(renderer, math_html, wikibooks_model);
         expect(rendered_html).toMatch('<script type="text/x-mathjax-config">');
-        rendered_html = render_model_with_options(renderer, html, wikipedia_model);
+        rendered_html = render_model_with_options(renderer, math_html, wikipedia_model);
         expect(rendered_html).toMatch('<script type="text/x-mathjax-config">');
-        rendered_html = render_model_with_options(renderer, html, wikisource_model);
+        rendered_html = render_model_with_options(renderer, math_html, wikisource_model);
         expect(rendered_html).toMatch('<script type="text/x-mathjax-config">');
     });
 
     it('does not include MathJax in articles from other sources', function () {
-        let rendered_html = render_model_with_options(renderer, html, wikihow_model);
+        let rendered_html = render_model_with_options(renderer, math_html, wikihow_model);
         expect(rendered_html).not.toMatch('<script type="text/x-mathjax-config">');
     });
+
+    describe('including scripts for what is in the body', function () {
+        it('does not include MathJax in articles without math', function () {
+            let rendered_html = render_model_with_options(renderer, html, wikipedia_model);
+            expect(rendered_html).not.toMatch('MathJax');
+        });
+
+        it('recognizes every kind of math MathJax looks for', function () {
+            ['<p>\\(x^2\\)</p>', '<p>\\[x^2\\]</p>', '<p>$$x^2$$</p>',
+                '<p>\\begin{align}x\\end{align}</p>',
+                '<p><math><mi>x</mi></math></p>'].forEach(body => {
+                expect(render_model_with_options(renderer, body, wikipedia_model))
+                    .toMatch('MathJax.js');
+            });
+        });
+
+        it('does not mistake a single dollar sign for math', function () {
+            let rendered_html = render_model_with_options(renderer,
+                '<p>It costs $5</p>', wikipedia_model);
+            expect(rendered_html).not.toMatch('MathJax');
+        });
+
+        it('defers the scripts it includes', function () {
+            let rendered_html = render_model_with_options(renderer, html,
+                wikipedia_model, true);
+            expect(rendered_html).toMatch('js/legacy-article.js" defer>');
+        });
+    });
+
+    describe('rewriting the body', function () {
+        it('hides images that fail to load without a script', function () {
+            let rendered_html = render_model_with_options(renderer,
+                '<p><IMG src="a.png"></p>', wikipedia_model);
+            expect(rendered_html).toMatch('<IMG onerror="');
+            expect(rendered_html).not.toMatch('hide-broken-images.js');
+        });
+
+        it('leaves images that handle their own errors alone', function () {
+            let rendered_html = render_model_with_options(renderer,
+                '<p><img onerror="retry()" src="a.png"></p>', wikipedia_model);
+            expect(rendered_html).toContain('<img onerror="retry()" src="a.png">');
+        });
+
+        it('drops citation needed markers without a script', function () {
+            let rendered_html = render_model_with_options(renderer,
+                '<p>Claim.<sup class="noprint">&#91;<i><a href="#cn">citation needed</a></i>&#93;</sup></p>',
+                wikipedia_model);
+            expect(rendered_html).toMatch('<p>Claim.</p>');
+            expect(rendered_html).not.toMatch('citation needed');
+            expect(rendered_html).not.toMatch('content-fixes.js');
+        });
+
+        it('keeps other superscripts', function () {
+            let body = '<p>x<sup>2</sup><sup class="reference"><a href="#1">[1]</a></sup></p>';
+            expect(render_model_with_options(renderer, body, wikipedia_model))
+                .toContain(body);
+        });
+
+        it('gives the same output when streaming', function () {
+            let body = '<p><img src="a.png"><sup>[<i><a href="#">x</a></i>]</sup></p>';
+            let stream = Gio.MemoryOutputStream.new_resizable();
+            expect(renderer.render_legacy_content_to_stream(stream, body,
+                wikipedia_model.source, wikipedia_model.source_name,
+                wikipedia_model.original_uri, wikipedia_model.license,
+                wikipedia_model.title, false, false, null)).toBeTruthy();
+            expect(stream_contents(stream)).toEqual(
+                render_model_with_options(renderer, body, wikipedia_model));
+        });
+    });
+
+    describe('rendering to a stream', function () {
+        it('writes the same content as rendering to a string', function () {
+            let stream = Gio.MemoryOutputStream.new_resizable();
+            expect(renderer.render_legacy_content_to_stream(stream, html,
+                wikipedia_model.source, wikipedia_model.source_name,
+                wikipedia_model.original_uri, wikipedia_model.license,
+                wikipedia_model.title, true, true, null)).toBeTruthy();
+            expect(stream_contents(stream)).toEqual(
+                render_model_with_options(renderer, html, wikipedia_model,
+                    true, true));
+        });
+
+        it('fails for unknown sources', function () {
+            let stream = Gio.MemoryOutputStream.new_resizable();
+            expect(() => renderer.render_legacy_content_to_stream(stream,
+                html, 'unknown', 'Unknown', 'http://example.com',
+                'CC-BY-SA 3.0', 'title', false, false, null)).toThrow();
+        });
+
+        it('writes the content asynchronously', function (done) {
+            let stream = Gio.MemoryOutputStream.new_resizable();
+            renderer.render_legacy_content_to_stream_async(stream, html,
+                wikihow_model.source, wikihow_model.source_name,
+                wikihow_model.original_uri, wikihow_model.license,
+                wikihow_model.title, false, false, null, (obj, res) => {
+                    expect(renderer.render_legacy_content_to_stream_finish(res)).toBeTruthy();
+                    expect(stream_contents(stream)).toEqual(
+                        render_model_with_options(renderer, html, wikihow_model));
+                    done();
+                });
+        });
+    });
+
+    describe('registering legacy sources', function () {
+        it('renders articles from a registered source', function () {
+            let source = Eknr.LegacySource.new('example');
+            source.set_css_files(['example.css']);
+            source.set_javascript_files(['example.js']);
+            source.set_include_mathjax(true);
+            source.set_disclaimer('From {original-link} under {license-link}.',
+                Eknr.LegacyDisclaimerLink.SOURCE_NAME);
+            renderer.register_legacy_source(source);
+
+            let rendered_html = renderer.render_legacy_content(math_html,
+                'example', 'Example & Co', 'http://example.com/article',
+                'CC-BY-SA 3.0', 'Example title', false, false);
+            expect(rendered_html).toMatch('css/example.css');
+            expect(rendered_html).toMatch('js/example.js');
+            expect(rendered_html).toMatch('<script type="text/x-mathjax-config">');
+            expect(rendered_html).toMatch(
+                'From <a class="eos-show-link" href="http://example.com/article">Example &amp; Co</a> under');
+            expect(rendered_html).toMatch('license://CC-BY-SA%203.0');
+        });
+
+        it('replaces a built-in source', function () {
+            render_model_with_options(renderer, html, wikihow_model);
+            renderer.register_legacy_source(Eknr.LegacySource.new('wikihow'));
+            let rendered_html = render_model_with_options(renderer, html, wikihow_model);
+            expect(rendered_html).not.toMatch('wikihow.css');
+            expect(rendered_html).not.toMatch('class="disclaimer"');
+        });
+    });
+
+    describe('inlining assets', function () {
+        const image_html = '<html><body><p><img src="a.png"></p></body></html>';
+
+        beforeEach(function () {
+            renderer.inline_assets = true;
+        });
+
+        it('does not inline assets by default', function () {
+            expect(new Eknr.Renderer().inline_assets).toBeFalsy();
+        });
+
+        it('includes stylesheets instead of linking to them', function () {
+            let rendered_html = render_model_with_options(renderer, html, wikipedia_model);
+            expect(rendered_html).toMatch('<style type="text/css">');
+            expect(rendered_html).not.toMatch('css/wikimedia.css');
+        });
+
+        it('includes scripts instead of linking to them', function () {
+            let rendered_html = render_model_with_options(renderer,
+                image_html, wikipedia_model, true);
+            expect(rendered_html).not.toMatch('js/legacy-article.js');
+            expect(rendered_html).toMatch('SCROLLED_PAST_PREFIX');
+        });
+
+        it('includes scripts that do not need jQuery', function () {
+            let rendered_html = render_model_with_options(renderer,
+                html, wikipedia_model, true);
+            expect(rendered_html).toMatch('share_actions_init');
+            expect(rendered_html).not.toMatch('\\$\\(');
+        });
+
+        it('keeps the bundled scripts as resources of their own', function () {
+            ['clipboard-manager.js', 'jquery-min.js', 'scroll-manager.js',
+                'share-actions.js'].forEach(name => {
+                let bytes = Gio.resources_lookup_data(
+                    `/com/endlessm/knowledge/data/templates/js/${name}`,
+                    Gio.ResourceLookupFlags.NONE);
+                expect(bytes.get_size()).toBeGreaterThan(0);
+            });
+
+            let share_actions = ByteArray.toString(Gio.resources_lookup_data(
+                '/com/endlessm/knowledge/data/templates/js/share-actions.js',
+                Gio.ResourceLookupFlags.NONE).toArray());
+            expect(share_actions).toMatch(/^\(function\(\)\{/);
+            expect(share_actions).toMatch('share_actions_init');
+        });
+
+        it('keeps the scripts that the rewrite replaced as resources', function () {
+            ['content-fixes.js', 'hide-broken-images.js'].forEach(name => {
+                let bytes = Gio.resources_lookup_data(
+                    `/com/endlessm/knowledge/data/templates/js/${name}`,
+                    Gio.ResourceLookupFlags.NONE);
+                expect(bytes.get_size()).toBeGreaterThan(0);
+            });
+        });
+
+        it('still links to assets that are not resources', function () {
+            let source = Eknr.LegacySource.new('example');
+            source.set_css_files(['example.css']);
+            source.set_javascript_files(['example.js']);
+            renderer.register_legacy_source(source);
+
+            let rendered_html = renderer.render_legacy_content(image_html,
+                'example', 'Example', 'http://example.com/article',
+                'CC-BY-SA 3.0', 'Example title', false, false);
+            expect(rendered_html).toMatch('css/example.css');
+            expect(rendered_html).toMatch('js/example.js');
+        });
+
+        it('does not mix up cached articles with linked assets', function () {
+            renderer.render_cache_max_bytes = 1024 * 1024;
+            let inlined = render_model_with_options(renderer, html, wikipedia_model);
+            renderer.inline_assets = false;
+            let linked = render_model_with_options(renderer, html, wikipedia_model);
+            expect(linked).not.toEqual(inlined);
+            expect(linked).toMatch('css/wikimedia.css');
+            expect(renderer.render_cache_hits).toEqual(0);
+        });
+    });
+
+    describe('caching rendered articles', function () {
+        it('does not cache by default', function () {
+            render_model_with_options(renderer, html, wikipedia_model);
+            render_model_with_options(renderer, html, wikipedia_model);
+            expect(renderer.render_cache_hits).toEqual(0);
+        });
+
+        it('returns the same html for repeat renders', function () {
+            renderer.render_cache_max_bytes = 1024 * 1024;
+            let first = render_model_with_options(renderer, html, wikipedia_model);
+            let second = render_model_with_options(renderer, html, wikipedia_model);
+            expect(second).toEqual(first);
+            expect(renderer.render_cache_misses).toEqual(1);
+            expect(renderer.render_cache_hits).toEqual(1);
+        });
+
+        it('renders again when the options differ', function () {
+            renderer.render_cache_max_bytes = 1024 * 1024;
+            let without_title = render_model_with_options(renderer, html,
+                wikipedia_model, false, false);
+            let with_title = render_model_with_options(renderer, html,
+                wikipedia_model, false, true);
+            expect(with_title).not.toEqual(without_title);
+            expect(renderer.render_cache_misses).toEqual(2);
+            expect(renderer.render_cache_hits).toEqual(0);
+        });
+
+        it('evicts the least recently used article when full', function () {
+            let length = render_model_with_options(renderer, html,
+                wikipedia_model).length;
+            renderer.render_cache_max_bytes = 2 * length + 1024;
+            let [first, second, third] = ['1', '2', '3'].map(suffix =>
+                Object.assign({}, wikipedia_model, {title: wikipedia_model.title + suffix}));
+            render_model_with_options(renderer, html, first);
+            render_model_with_options(renderer, html, second);
+            render_model_with_options(renderer, html, third);
+            expect(renderer.render_cache_evictions).toEqual(1);
+            render_model_with_options(renderer, html, third);
+            expect(renderer.render_cache_hits).toEqual(1);
+            render_model_with_options(renderer, html, first);
+            expect(renderer.render_cache_misses).toEqual(4);
+        });
+
+        describe('when the language changes', function () {
+            let language;
+
+            beforeEach(function () {
+                language = GLib.getenv('LANGUAGE');
+            });
+
+            afterEach(function () {
+                if (language === null)
+                    GLib.unsetenv('LANGUAGE');
+                else
+                    GLib.setenv('LANGUAGE', language, true);
+            });
+
+            it('does not return articles rendered for the old language', function () {
+                renderer.render_cache_max_bytes = 1024 * 1024;
+                GLib.setenv('LANGUAGE', 'en', true);
+                render_model_with_options(renderer, html, wikipedia_model);
+                GLib.setenv('LANGUAGE', 'pt_BR', true);
+                render_model_with_options(renderer, html, wikipedia_model);
+                expect(renderer.render_cache_misses).toEqual(2);
+                expect(renderer.render_cache_hits).toEqual(0);
+            });
+
+            it('returns articles rendered for the language again', function () {
+                renderer.render_cache_max_bytes = 1024 * 1024;
+                GLib.setenv('LANGUAGE', 'en', true);
+                let first = render_model_with_options(renderer, html, wikipedia_model);
+                GLib.setenv('LANGUAGE', 'pt_BR', true);
+                render_model_with_options(renderer, html, wikipedia_model);
+                GLib.setenv('LANGUAGE', 'en', true);
+                let again = render_model_with_options(renderer, html, wikipedia_model);
+                expect(again).toEqual(first);
+                expect(renderer.render_cache_hits).toEqual(1);
+            });
+        });
+    });
+
+    describe('instrumenting renders', function () {
+        let profiles;
+
+        beforeEach(function () {
+            profiles = [];
+            renderer.connect('render-profiled', (obj, profile) =>
+                profiles.push(profile.copy()));
+        });
+
+        it('does not profile by default', function () {
+            render_model_with_options(renderer, html, wikipedia_model);
+            expect(profiles.length).toEqual(0);
+        });
+
+        it('reports each stage of a legacy render', function () {
+            renderer.instrument = true;
+            let rendered = render_model_with_options(renderer, html, wikipedia_model);
+            expect(profiles.length).toEqual(1);
+
+            let [profile] = profiles;
+            expect(profile.get_kind()).toEqual(Eknr.RenderKind.LEGACY);
+            [Eknr.RenderStage.FRAGMENTS, Eknr.RenderStage.STRIP_BODY,
+                Eknr.RenderStage.DISCLAIMER, Eknr.RenderStage.SUBSTITUTE]
+                .forEach(stage => expect(profile.has_stage(stage)).toBeTruthy());
+            [Eknr.RenderStage.RENDER_CACHE, Eknr.RenderStage.TEMPLATE,
+                Eknr.RenderStage.VARIABLES]
+                .forEach(stage => expect(profile.has_stage(stage)).toBeFalsy());
+            expect(profile.get_stage_bytes(Eknr.RenderStage.STRIP_BODY))
+                .toEqual('<p>dummy html</p>'.length);
+            expect(profile.get_stage_bytes(Eknr.RenderStage.SUBSTITUTE))
+                .toEqual(ByteArray.fromString(rendered).length);
+            expect(profile.get_duration()).toBeGreaterThanOrEqual(
+                profile.get_stage_duration(Eknr.RenderStage.SUBSTITUTE));
+        });
+
+        it('stops after the render cache when the article is cached', function () {
+            renderer.instrument = true;
+            renderer.render_cache_max_bytes = 1024 * 1024;
+            render_model_with_options(renderer, html, wikipedia_model);
+            render_model_with_options(renderer, html, wikipedia_model);
+            expect(profiles.length).toEqual(2);
+            expect(profiles[1].has_stage(Eknr.RenderStage.RENDER_CACHE)).toBeTruthy();
+            expect(profiles[1].has_stage(Eknr.RenderStage.SUBSTITUTE)).toBeFalsy();
+        });
+
+        it('keeps a histogram of each stage', function () {
+            renderer.instrument = true;
+            all_models.forEach(model =>
+                render_model_with_options(renderer, html, model));
+
+            let histogram = renderer.get_stage_histogram(Eknr.RenderStage.SUBSTITUTE);
+            expect(histogram.length).toEqual(Eknr.RENDER_HISTOGRAM_N_BUCKETS);
+            expect(histogram.reduce((a, b) => a + b, 0)).toEqual(all_models.length);
+            let [count, duration, bytes] =
+                renderer.get_stage_totals(Eknr.RenderStage.SUBSTITUTE);
+            expect(count).toEqual(all_models.length);
+            expect(duration).toBeGreaterThan(0);
+            expect(bytes).toEqual(profiles.reduce((total, profile) =>
+                total + profile.get_stage_bytes(Eknr.RenderStage.SUBSTITUTE), 0));
+
+            renderer.reset_stage_stats();
+            [count] = renderer.get_stage_totals(Eknr.RenderStage.SUBSTITUTE);
+            expect(count).toEqual(0);
+        });
+    });
+
+    describe('rendering a batch', function () {
+        function article_for_model(model, flags=Eknr.RenderFlags.NONE) {
+            return Eknr.LegacyArticle.new(html, model.source,
+                model.source_name, model.original_uri, model.license,
+                model.title, flags);
+        }
+
+        it('renders each article the same as rendering it alone', function () {
+            let articles = all_models.map(model => article_for_model(model,
+                Eknr.RenderFlags.SHOW_TITLE | Eknr.RenderFlags.USE_SCROLL_MANAGER));
+            let results = [];
+            expect(renderer.render_legacy_batch(articles, 2,
+                (index, rendered_html, error) => {
+                    expect(error).toBeNull();
+                    results[index] = rendered_html;
+                }, null)).toBeTruthy();
+            expect(results).toEqual(all_models.map(model =>
+                render_model_with_options(renderer, html, model, true, true)));
+        });
+
+        it('reports errors for single articles asynchronously', function (done) {
+            let unknown_model = Object.assign({}, wikihow_model, {source: 'unknown'});
+            let articles = [article_for_model(wikihow_model),
+                article_for_model(unknown_model)];
+            let results = [];
+            renderer.render_legacy_batch_async(articles, 0,
+                (index, rendered_html, error) => {
+                    results[index] = {rendered_html, error};
+                }, null, (obj, res) => {
+                    expect(renderer.render_legacy_batch_finish(res)).toBeTruthy();
+                    expect(results[0].rendered_html).toEqual(
+                        render_model_with_options(renderer, html, wikihow_model));
+                    expect(results[1].rendered_html).toBeNull();
+                    expect(results[1].error.code).toEqual(
+                        Eknr.Error.UNKNOWN_LEGACY_SOURCE);
+                    done();
+                });
+        });
+    });
+
+    describe('rendering in pieces', function () {
+        function render_article(model, flags=Eknr.RenderFlags.NONE, body=html,
+            links=null) {
+            return renderer.render_legacy_article(
+                new GLib.Bytes(ByteArray.fromString(body)), model.source,
+                model.source_name, model.original_uri, model.license,
+                model.title, links, flags);
+        }
+
+        it('renders the same as rendering all at once', function () {
+            all_models.forEach(model => {
+                let article = render_article(model, Eknr.RenderFlags.SHOW_TITLE);
+                expect(article.get_html()).toEqual(
+                    render_model_with_options(renderer, html, model, false, true));
+            });
+        });
+
+        it('keeps only the stripped body in the body piece', function () {
+            let article = render_article(wikipedia_model);
+            expect(ByteArray.toString(article.get_body().toArray()))
+                .toEqual('<p>dummy html</p>');
+        });
+
+        it('keeps the rewritten body in the body piece', function () {
+            const image_html = '<html><body><p><img src="a.png"></p></body></html>';
+            let article = render_article(wikipedia_model, Eknr.RenderFlags.NONE, image_html);
+            expect(ByteArray.toString(article.get_body().toArray()))
+                .toMatch('^<p><img onerror="');
+            let rerendered = renderer.rerender_legacy_article(article,
+                Eknr.RenderFlags.SHOW_TITLE);
+            expect(rerendered.get_html()).toEqual(
+                render_model_with_options(renderer, image_html, wikipedia_model, false, true));
+        });
+
+        it('renders again with other flags', function () {
+            let article = render_article(wikihow_model);
+            let rerendered = renderer.rerender_legacy_article(article,
+                Eknr.RenderFlags.SHOW_TITLE | Eknr.RenderFlags.USE_SCROLL_MANAGER);
+            expect(rerendered.get_flags()).toEqual(
+                Eknr.RenderFlags.SHOW_TITLE | Eknr.RenderFlags.USE_SCROLL_MANAGER);
+            expect(rerendered.get_html()).toEqual(
+                render_model_with_options(renderer, html, wikihow_model, true, true));
+        });
+
+        it('lists the headings in the body', function () {
+            let article = render_article(wikipedia_model, Eknr.RenderFlags.NONE,
+                '<html><body><h2><span class="mw-headline" id="A">A</span></h2>' +
+                '<h2><span class="mw-headline" id="B&amp;C">B</span></h2></body></html>');
+            expect(article.get_headings()).toEqual(['A', 'B&C']);
+            let rerendered = renderer.rerender_legacy_article(article,
+                Eknr.RenderFlags.USE_SCROLL_MANAGER);
+            expect(rerendered.get_headings()).toEqual(['A', 'B&C']);
+            expect(rerendered.get_html()).toMatch('window.scrollManagerHeadings = \\["A","B\\\\u0026C"\\];');
+            expect(render_article(wikipedia_model).get_headings()).toEqual([]);
+        });
+
+        it('resolves links and fills in chunks', function () {
+            let links = Eknr.ArticleLinks.new(['ekn:///target', '']);
+            links.set_parent_featured_sets(['ekn:///set'], ['A & set']);
+            let article = render_article(wikipedia_model, Eknr.RenderFlags.NONE,
+                '<html><body><a href="x" data-ekn-link-table-idx="0">x</a>' +
+                '<a href="y" data-ekn-link-table-idx="1" data-ekn-link-type="Internal">y</a>' +
+                '<div data-ekn-chunk-type="ParentFeaturedSets"></div></body></html>',
+                links);
+            let body = ByteArray.toString(article.get_body().toArray());
+            expect(body).toMatch('<a href="ekn:///target" data-ekn-link-table-idx="0">');
+            expect(body).toMatch('<a class="eos-no-link" href="y"');
+            expect(body).toMatch(
+                '<p><a href="ekn:///set">A &amp; set</a></p></div>');
+        });
+
+        it('leaves links alone without a link table', function () {
+            const linked_html = '<html><body><a href="x" data-ekn-link-table-idx="0">x</a></body></html>';
+            let article = render_article(wikipedia_model, Eknr.RenderFlags.NONE,
+                linked_html);
+            expect(ByteArray.toString(article.get_body().toArray()))
+                .toEqual('<a href="x" data-ekn-link-table-idx="0">x</a>');
+        });
+
+        it('errors on chunks it cannot fill in', function () {
+            let links = Eknr.ArticleLinks.new([]);
+            expect(() => render_article(wikipedia_model, Eknr.RenderFlags.NONE,
+                '<div data-ekn-chunk-type="ParentFeaturedSets"></div>', links))
+                .toThrow();
+            expect(() => render_article(wikipedia_model, Eknr.RenderFlags.NONE,
+                '<div data-ekn-chunk-type="Unknown"></div>', links))
+                .toThrow();
+        });
+
+        it('errors on an unknown source', function () {
+            let unknown_model = Object.assign({}, wikihow_model, {source: 'unknown'});
+            expect(() => render_article(unknown_model)).toThrow();
+        });
+    });
+});
+
+describe('Mustache renderer', function () {
+    let renderer;
+
+    beforeEach(function () {
+        renderer = new Eknr.Renderer();
+    });
+
+    it('substitutes variables and sections of each type', function () {
+        let variables = new GLib.Variant('a{sv}', {
+            'title': new GLib.Variant('s', 'A & B'),
+            'items': new GLib.Variant('as', ['x', 'y']),
+            'show': new GLib.Variant('b', true),
+            'hide': new GLib.Variant('b', false),
+        });
+        expect(renderer.render_mustache_document(
+            '{{title}}|{{{title}}}|{{#items}}<{{{.}}}>{{/items}}|' +
+            '{{#title}}{{.}}{{/title}}|{{#show}}yes{{/show}}{{#hide}}no{{/hide}}',
+            variables)).toEqual('A &amp; B|A & B|<x><y>|A &amp; B|yes');
+    });
+
+    it('fails on missing variables', function () {
+        let variables = new GLib.Variant('a{sv}', {});
+        expect(() => renderer.render_mustache_document('{{missing}}',
+            variables)).toThrow();
+    });
+
+    describe('from a file asynchronously', function () {
+        let file, variables;
+
+        beforeEach(function () {
+            let dir = GLib.Dir.make_tmp('eknr-template-XXXXXX');
+            let path = GLib.build_filenamev([dir, 'list.mst']);
+            GLib.file_set_contents(path, '<h1>{{title}}</h1>{{#items}}<li>{{.}}</li>{{/items}}');
+            file = Gio.File.new_for_path(path);
+            variables = new GLib.Variant('a{sv}', {
+                'title': new GLib.Variant('s', 'A & B'),
+                'items': new GLib.Variant('as', ['x', 'y']),
+            });
+        });
+
+        it('renders the same as the synchronous version', function (done) {
+            renderer.render_mustache_document_from_file_async(file, variables,
+                null, (obj, res) => {
+                    let html = renderer.render_mustache_document_from_file_finish(res);
+                    expect(html).toEqual('<h1>A &amp; B</h1><li>x</li><li>y</li>');
+                    expect(html).toEqual(new Eknr.Renderer()
+                        .render_mustache_document_from_file(file, variables));
+                    done();
+                });
+        });
+
+        it('gives every request made while the file loads the same result', function (done) {
+            let results = [];
+            const n_requests = 5;
+            for (let i = 0; i < n_requests; i++) {
+                renderer.render_mustache_document_from_file_async(file,
+                    variables, null, (obj, res) => {
+                        results.push(renderer.render_mustache_document_from_file_finish(res));
+                        if (results.length < n_requests)
+                            return;
+                        results.forEach(html =>
+                            expect(html).toEqual('<h1>A &amp; B</h1><li>x</li><li>y</li>'));
+                        done();
+                    });
+            }
+        });
+
+        it('reports a missing file', function (done) {
+            let missing = file.get_parent().get_child('missing.mst');
+            renderer.render_mustache_document_from_file_async(missing,
+                variables, null, (obj, res) => {
+                    try {
+                        renderer.render_mustache_document_from_file_finish(res);
+                        fail('Expected an error');
+                    } catch (e) {
+                        expect(e.matches(Gio.IOErrorEnum,
+                            Gio.IOErrorEnum.NOT_FOUND)).toBeTruthy();
+                    }
+                    done();
+                });
+        });
+    });
+
+    describe('caching templates', function () {
+        let dir, variables;
+
+        function write_template(name, text) {
+            let path = GLib.build_filenamev([dir, name]);
+            GLib.file_set_contents(path, text);
+            return Gio.File.new_for_path(path);
+        }
+
+        beforeEach(function () {
+            dir = GLib.Dir.make_tmp('eknr-template-XXXXXX');
+            variables = new GLib.Variant('a{sv}', {
+                'title': new GLib.Variant('s', 'Title'),
+            });
+        });
+
+        it('preloads templates and counts hits and misses', function (done) {
+            let files = [write_template('a.mst', 'a {{title}}'),
+                write_template('b.mst', 'b {{title}}')];
+            renderer.preload_templates_async(files, null, (obj, res) => {
+                expect(renderer.preload_templates_finish(res)).toBeTruthy();
+                expect(renderer.template_cache_entries).toEqual(2);
+                expect(renderer.template_cache_misses).toEqual(2);
+                expect(renderer.template_cache_bytes).toBeGreaterThan(0);
+
+                expect(renderer.render_mustache_document_from_file(files[0],
+                    variables)).toEqual('a Title');
+                expect(renderer.template_cache_hits).toEqual(1);
+                expect(renderer.template_cache_misses).toEqual(2);
+                done();
+            });
+        });
+
+        it('reports templates that could not be preloaded', function (done) {
+            let files = [write_template('a.mst', 'a {{title}}'),
+                Gio.File.new_for_path(GLib.build_filenamev([dir, 'missing.mst']))];
+            renderer.preload_templates_async(files, null, (obj, res) => {
+                expect(() => renderer.preload_templates_finish(res)).toThrow();
+                expect(renderer.template_cache_entries).toEqual(1);
+                done();
+            });
+        });
+
+        it('drops the least recently used template when full', function () {
+            renderer = new Eknr.Renderer({template_cache_max_entries: 2});
+            let a = write_template('a.mst', 'a');
+            let b = write_template('b.mst', 'b');
+            let c = write_template('c.mst', 'c');
+            renderer.render_mustache_document_from_file(a, variables);
+            renderer.render_mustache_document_from_file(b, variables);
+            renderer.render_mustache_document_from_file(a, variables);
+            renderer.render_mustache_document_from_file(c, variables);
+            expect(renderer.template_cache_entries).toEqual(2);
+            expect(renderer.template_cache_evictions).toEqual(1);
+
+            // b was dropped, a was not
+            renderer.render_mustache_document_from_file(a, variables);
+            expect(renderer.template_cache_misses).toEqual(3);
+            renderer.render_mustache_document_from_file(b, variables);
+            expect(renderer.template_cache_misses).toEqual(4);
+        });
+
+        it('profiles each stage of rendering from a file', function () {
+            let file = write_template('a.mst', 'a {{title}}');
+            let profiles = [];
+            renderer.instrument = true;
+            renderer.connect('render-profiled', (obj, profile) =>
+                profiles.push(profile.copy()));
+            renderer.render_mustache_document_from_file(file, variables);
+            expect(profiles.length).toEqual(1);
+
+            let [profile] = profiles;
+            expect(profile.get_kind()).toEqual(Eknr.RenderKind.MUSTACHE);
+            expect(profile.get_stage_bytes(Eknr.RenderStage.TEMPLATE))
+                .toEqual('a {{title}}'.length);
+            expect(profile.has_stage(Eknr.RenderStage.VARIABLES)).toBeTruthy();
+            expect(profile.get_stage_bytes(Eknr.RenderStage.SUBSTITUTE))
+                .toEqual('a Title'.length);
+            expect(profile.has_stage(Eknr.RenderStage.FRAGMENTS)).toBeFalsy();
+        });
+
+        it('reloads changed templates only when revalidating', function () {
+            let file = write_template('a.mst', 'old {{title}}');
+            let revalidating = new Eknr.Renderer({template_cache_revalidate: true});
+            expect(renderer.render_mustache_document_from_file(file,
+                variables)).toEqual('old Title');
+            expect(revalidating.render_mustache_document_from_file(file,
+                variables)).toEqual('old Title');
+
+            write_template('a.mst', 'new {{title}}');
+            // Make sure the change shows, however coarse the file
+            // system's timestamps are
+            let info = file.query_info('time::modified', Gio.FileQueryInfoFlags.NONE, null);
+            file.set_attribute_uint64('time::modified',
+                info.get_attribute_uint64('time::modified') + 10,
+                Gio.FileQueryInfoFlags.NONE, null);
+
+            expect(renderer.render_mustache_document_from_file(file,
+                variables)).toEqual('old Title');
+            expect(revalidating.render_mustache_document_from_file(file,
+                variables)).toEqual('new Title');
+        });
+    });
 });